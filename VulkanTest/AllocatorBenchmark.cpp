@@ -0,0 +1,260 @@
+#include "AllocatorBenchmark.h"
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "SubAllocators.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+using std::unique_ptr;
+using std::runtime_error;
+
+namespace {
+
+constexpr const VkDeviceSize CAPACITY = 64ull * 1024 * 1024;
+// Larger than on most desktop GPUs so that granularity conflicts actually occur.
+constexpr const VkDeviceSize GRANULARITY = 4096;
+
+struct Strategy {
+    const char* name;
+    std::function<unique_ptr<SubAllocator>()> create;
+};
+
+vector<Strategy> getStrategies() {
+    return {
+        { "Linear", [] { return std::make_unique<LinearSubAllocator>(CAPACITY, GRANULARITY); } },
+        { "Buddy", [] { return std::make_unique<BuddySubAllocator>(CAPACITY, GRANULARITY); } },
+        { "Free list", [] { return std::make_unique<FreeListSubAllocator>(CAPACITY, GRANULARITY); } },
+    };
+}
+
+struct LiveAllocation {
+    VkDeviceSize size;
+    ResourceKind kind;
+};
+
+class RequestGenerator {
+
+public:
+
+    explicit RequestGenerator(uint32_t seed) : random(seed) {}
+
+    // Log-uniform sizes between 256 bytes and 1 MiB, like a mix of uniform buffers, meshes and textures.
+    VkDeviceSize nextSize() {
+        std::uniform_real_distribution<double> exponent(8.0, 20.0);
+        return static_cast<VkDeviceSize>(std::pow(2.0, exponent(this->random)));
+    }
+
+    VkDeviceSize nextAlignment() {
+        std::uniform_int_distribution<int> shift(0, 12);
+        return VkDeviceSize(1) << shift(this->random);
+    }
+
+    ResourceKind nextKind() {
+        return std::bernoulli_distribution(0.5)(this->random) ? ResourceKind::Linear : ResourceKind::Optimal;
+    }
+
+    bool nextBool(double probability) {
+        return std::bernoulli_distribution(probability)(this->random);
+    }
+
+    size_t nextIndex(size_t count) {
+        return std::uniform_int_distribution<size_t>(0, count - 1)(this->random);
+    }
+
+private:
+
+    std::mt19937 random;
+};
+
+bool onSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB) {
+    VkDeviceSize pageMask = ~(GRANULARITY - 1);
+    return ((offsetA + sizeA - 1) & pageMask) == (offsetB & pageMask);
+}
+
+void check(bool condition, const char* strategy, const string& what) {
+    if (!condition) {
+        throw runtime_error(string("allocator self-test failed (") + strategy + "): " + what);
+    }
+}
+
+void checkPlacement(const char* strategy, const std::map<VkDeviceSize, LiveAllocation>& live, VkDeviceSize offset,
+    VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) {
+    check(offset % alignment == 0, strategy, "misaligned offset " + std::to_string(offset));
+    check(offset + size <= CAPACITY, strategy, "allocation past end of block");
+
+    auto next = live.lower_bound(offset);
+    if (next != live.end()) {
+        check(offset + size <= next->first, strategy, "overlaps following allocation at " + std::to_string(next->first));
+        check(next->second.kind == kind || !onSamePage(offset, size, next->first), strategy, "granularity conflict with following allocation");
+    }
+    if (next != live.begin()) {
+        auto previous = std::prev(next);
+        check(previous->first + previous->second.size <= offset, strategy, "overlaps preceding allocation at " + std::to_string(previous->first));
+        check(previous->second.kind == kind || !onSamePage(previous->first, previous->second.size, offset), strategy, "granularity conflict with preceding allocation");
+    }
+}
+
+void runSelfTest(ostream& out, const Strategy& strategy) {
+    const uint32_t operations = 20000;
+
+    unique_ptr<SubAllocator> allocator = strategy.create();
+    RequestGenerator generator(1234);
+    std::map<VkDeviceSize, LiveAllocation> live;
+    vector<VkDeviceSize> liveOffsets;
+
+    for (uint32_t i = 0; i < operations; ++i) {
+        if (!liveOffsets.empty() && generator.nextBool(0.45)) {
+            size_t index = generator.nextIndex(liveOffsets.size());
+            VkDeviceSize offset = liveOffsets[index];
+            liveOffsets[index] = liveOffsets.back();
+            liveOffsets.pop_back();
+            live.erase(offset);
+            allocator->free(offset);
+            continue;
+        }
+
+        VkDeviceSize size = generator.nextSize();
+        VkDeviceSize alignment = generator.nextAlignment();
+        ResourceKind kind = generator.nextKind();
+        std::optional<VkDeviceSize> offset = allocator->allocate(size, alignment, kind);
+        if (!offset.has_value()) {
+            continue;
+        }
+
+        checkPlacement(strategy.name, live, *offset, size, alignment, kind);
+        live.emplace(*offset, LiveAllocation{ size, kind });
+        liveOffsets.push_back(*offset);
+    }
+
+    for (VkDeviceSize offset : liveOffsets) {
+        allocator->free(offset);
+    }
+
+    SubAllocatorStatistics statistics = allocator->getStatistics();
+    check(statistics.allocationCount == 0 && statistics.used == 0, strategy.name, "memory still in use after freeing everything");
+    check(statistics.freeRangeCount == 1 && statistics.largestFreeRange == CAPACITY, strategy.name, "free space did not coalesce back into one range");
+
+    out << '\t' << strategy.name << ": " << operations << " operations OK" << '\n';
+}
+
+struct ChurnOperation {
+    bool release;
+    size_t releaseIndex;
+    VkDeviceSize size;
+    VkDeviceSize alignment;
+    ResourceKind kind;
+};
+
+// Random numbers are drawn up front so the timed loop measures the allocator, not the generator.
+vector<ChurnOperation> generateChurnOperations(uint32_t count) {
+    RequestGenerator generator(5678);
+    vector<ChurnOperation> operations(count);
+    for (ChurnOperation& operation : operations) {
+        operation.release = generator.nextBool(0.5);
+        operation.releaseIndex = generator.nextIndex(1u << 20);
+        operation.size = generator.nextSize() / 8;
+        operation.alignment = generator.nextAlignment();
+        operation.kind = generator.nextKind();
+    }
+    return operations;
+}
+
+void runChurnBenchmark(ostream& out, const Strategy& strategy, const vector<ChurnOperation>& operations) {
+    // Linear blocks are released as a whole, so they are exercised frame by frame instead of randomly.
+    const bool frameBased = dynamic_cast<LinearSubAllocator*>(strategy.create().get()) != nullptr;
+    const size_t framePeriod = 512;
+
+    unique_ptr<SubAllocator> allocator = strategy.create();
+    vector<VkDeviceSize> liveOffsets;
+    liveOffsets.reserve(operations.size());
+    uint32_t failedAllocations = 0;
+    VkDeviceSize peakUsed = 0;
+    double worstFragmentation = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < operations.size(); ++i) {
+        const ChurnOperation& operation = operations[i];
+        bool release = frameBased ? liveOffsets.size() >= framePeriod : !liveOffsets.empty() && operation.release;
+        if (release) {
+            if (frameBased) {
+                for (VkDeviceSize offset : liveOffsets) {
+                    allocator->free(offset);
+                }
+                liveOffsets.clear();
+            } else {
+                size_t index = operation.releaseIndex % liveOffsets.size();
+                allocator->free(liveOffsets[index]);
+                liveOffsets[index] = liveOffsets.back();
+                liveOffsets.pop_back();
+            }
+            continue;
+        }
+
+        std::optional<VkDeviceSize> offset = allocator->allocate(operation.size, operation.alignment, operation.kind);
+        if (offset.has_value()) {
+            liveOffsets.push_back(*offset);
+        } else {
+            ++failedAllocations;
+        }
+
+        // Sampling statistics walks the whole block, so only do it occasionally.
+        if (i % 4096 == 0) {
+            SubAllocatorStatistics sample = allocator->getStatistics();
+            peakUsed = std::max(peakUsed, sample.used);
+            worstFragmentation = std::max(worstFragmentation, sample.getFragmentation());
+        }
+    }
+
+    double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    SubAllocatorStatistics statistics = allocator->getStatistics();
+
+    out << '\t' << strategy.name << ": " << elapsedNs / static_cast<double>(operations.size()) << " ns/op, "
+        << "peak " << static_cast<double>(peakUsed) / (1024.0 * 1024.0) << " MiB, "
+        << statistics.allocationCount << " live, " << statistics.freeRangeCount << " free ranges, "
+        << "fragmentation " << statistics.getFragmentation() * 100.0 << "% (worst " << worstFragmentation * 100.0 << "%)";
+    if (statistics.internalWaste > 0) {
+        out << ", rounding waste " << static_cast<double>(statistics.internalWaste) / (1024.0 * 1024.0) << " MiB";
+    }
+    if (failedAllocations > 0) {
+        out << ", " << failedAllocations << " failed";
+    }
+    out << '\n';
+}
+
+}
+
+void runAllocatorBenchmark(ostream& out) {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    vector<Strategy> strategies = getStrategies();
+
+    out << "[Allocator Self-Test]" << '\n';
+    for (const Strategy& strategy : strategies) {
+        runSelfTest(out, strategy);
+    }
+
+    out << "[Allocator Benchmark]" << '\n';
+    out << '\t' << "Block " << CAPACITY / (1024 * 1024) << " MiB, granularity " << GRANULARITY << '\n';
+    vector<ChurnOperation> operations = generateChurnOperations(1000000);
+    for (const Strategy& strategy : strategies) {
+        runChurnBenchmark(out, strategy, operations);
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
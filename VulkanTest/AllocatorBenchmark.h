@@ -0,0 +1,8 @@
+#pragma once
+
+#include <ostream>
+
+// CPU-only check and benchmark of the sub-allocation strategies (--bench allocator). Validates alignment,
+// overlap, bufferImageGranularity and coalescing under random churn, then times each strategy.
+// Throws runtime_error when a check fails.
+void runAllocatorBenchmark(std::ostream& out);
@@ -0,0 +1,337 @@
+#include "BindlessTable.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::vector;
+
+namespace {
+
+const char* const KIND_NAMES[] = { "Sampled images", "Samplers", "Storage buffers" };
+
+VkDescriptorType getDescriptorType(BindlessTable::Kind kind) {
+    switch (kind) {
+    case BindlessTable::Kind::SampledImage: return VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    case BindlessTable::Kind::Sampler: return VK_DESCRIPTOR_TYPE_SAMPLER;
+    case BindlessTable::Kind::StorageBuffer: return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    return VK_DESCRIPTOR_TYPE_SAMPLER;
+}
+
+}
+
+void BindlessTable::create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, DescriptorLayoutCache& layouts,
+    const DeviceCapabilities& capabilities, const VkPhysicalDeviceLimits& limits, uint32_t framesInFlight) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->bindless = capabilities.descriptorIndexing;
+
+    if (this->bindless) {
+        this->slots[static_cast<uint32_t>(Kind::SampledImage)].capacity = BINDLESS_SAMPLED_IMAGES;
+        this->slots[static_cast<uint32_t>(Kind::Sampler)].capacity = BINDLESS_SAMPLERS;
+        this->slots[static_cast<uint32_t>(Kind::StorageBuffer)].capacity = BINDLESS_STORAGE_BUFFERS;
+    } else {
+        this->slots[static_cast<uint32_t>(Kind::SampledImage)].capacity = std::min(CLASSIC_SAMPLED_IMAGES, limits.maxPerStageDescriptorSampledImages);
+        this->slots[static_cast<uint32_t>(Kind::Sampler)].capacity = std::min(CLASSIC_SAMPLERS, limits.maxPerStageDescriptorSamplers);
+        this->slots[static_cast<uint32_t>(Kind::StorageBuffer)].capacity = std::min(CLASSIC_STORAGE_BUFFERS, limits.maxPerStageDescriptorStorageBuffers);
+    }
+
+    // Slot 0 of every kind is the default resource, so index 0 is always safe to sample; the rest are handed
+    // out lowest first.
+    for (SlotAllocator& allocatorSlots : this->slots) {
+        for (uint32_t slot = allocatorSlots.capacity; slot > 1; --slot) {
+            allocatorSlots.freeSlots.push_back(slot - 1);
+        }
+    }
+
+    this->createDefaultResources(allocator, uploads);
+    this->createLayoutAndSets(layouts, framesInFlight);
+}
+
+void BindlessTable::createDefaultResources(DeviceMemoryAllocator& allocator, UploadService& uploads) {
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageInfo.extent = { 1, 1, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(this->device, &imageInfo, HostAllocator::get().getCallbacks(), &this->defaultImage) != VK_SUCCESS) {
+        throw runtime_error("failed to create default bindless image!");
+    }
+    this->defaultImageAllocation = allocator.allocateForImage(this->defaultImage, VK_IMAGE_TILING_OPTIMAL,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = this->defaultImage;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = 1;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &this->defaultImageView) != VK_SUCCESS) {
+        throw runtime_error("failed to create default bindless image view!");
+    }
+
+    const uint32_t white = 0xFFFFFFFFu;
+    uploads.uploadImage(this->defaultImage, VK_IMAGE_ASPECT_COLOR_BIT, 0, { 1, 1, 1 }, sizeof(white), &white, sizeof(white),
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(this->device, &samplerInfo, HostAllocator::get().getCallbacks(), &this->defaultSampler) != VK_SUCCESS) {
+        throw runtime_error("failed to create default bindless sampler!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = DEFAULT_BUFFER_SIZE;
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(this->device, &bufferInfo, HostAllocator::get().getCallbacks(), &this->defaultBuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create default bindless buffer!");
+    }
+    this->defaultBufferAllocation = allocator.allocateForBuffer(this->defaultBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+
+    const vector<uint8_t> zeros(DEFAULT_BUFFER_SIZE, 0);
+    uploads.uploadBuffer(this->defaultBuffer, 0, zeros.data(), DEFAULT_BUFFER_SIZE);
+}
+
+void BindlessTable::createLayoutAndSets(DescriptorLayoutCache& layouts, uint32_t framesInFlight) {
+    VkDescriptorSetLayoutBinding bindings[KIND_COUNT]{};
+    VkDescriptorBindingFlags bindingFlags[KIND_COUNT]{};
+    VkDescriptorPoolSize poolSizes[KIND_COUNT]{};
+    uint32_t setCount = this->bindless ? 1 : framesInFlight;
+
+    for (uint32_t kind = 0; kind < KIND_COUNT; ++kind) {
+        bindings[kind].binding = kind;
+        bindings[kind].descriptorType = getDescriptorType(static_cast<Kind>(kind));
+        bindings[kind].descriptorCount = this->slots[kind].capacity;
+        bindings[kind].stageFlags = VK_SHADER_STAGE_ALL;
+        bindingFlags[kind] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        poolSizes[kind].type = bindings[kind].descriptorType;
+        poolSizes[kind].descriptorCount = this->slots[kind].capacity * setCount;
+    }
+
+    if (this->bindless) {
+        this->layout = layouts.getLayout(bindings, KIND_COUNT, bindingFlags, VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+    } else {
+        this->layout = layouts.getLayout(bindings, KIND_COUNT);
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = this->bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0;
+    poolInfo.maxSets = setCount;
+    poolInfo.poolSizeCount = KIND_COUNT;
+    poolInfo.pPoolSizes = poolSizes;
+
+    if (vkCreateDescriptorPool(this->device, &poolInfo, HostAllocator::get().getCallbacks(), &this->pool) != VK_SUCCESS) {
+        throw runtime_error("failed to create bindless descriptor pool!");
+    }
+
+    vector<VkDescriptorSetLayout> setLayouts(setCount, this->layout);
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = this->pool;
+    allocInfo.descriptorSetCount = setCount;
+    allocInfo.pSetLayouts = setLayouts.data();
+
+    this->sets.resize(setCount);
+    if (vkAllocateDescriptorSets(this->device, &allocInfo, this->sets.data()) != VK_SUCCESS) {
+        throw runtime_error("failed to allocate bindless descriptor sets!");
+    }
+    this->appliedWrites.assign(setCount, 0);
+
+    // Partially bound sets only need the defaults in slot 0; classic ones need a valid descriptor everywhere.
+    vector<Write> defaults;
+    for (uint32_t kind = 0; kind < KIND_COUNT; ++kind) {
+        uint32_t count = this->bindless ? 1 : this->slots[kind].capacity;
+        for (uint32_t slot = 0; slot < count; ++slot) {
+            defaults.push_back(this->makeDefaultWrite(static_cast<Kind>(kind), slot));
+        }
+    }
+    for (VkDescriptorSet set : this->sets) {
+        this->applyWrites(set, defaults.data(), defaults.size());
+    }
+}
+
+void BindlessTable::destroy() {
+    vkDestroyDescriptorPool(this->device, this->pool, HostAllocator::get().getCallbacks());
+    this->sets.clear();
+
+    vkDestroySampler(this->device, this->defaultSampler, HostAllocator::get().getCallbacks());
+    vkDestroyImageView(this->device, this->defaultImageView, HostAllocator::get().getCallbacks());
+    vkDestroyImage(this->device, this->defaultImage, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->defaultImageAllocation);
+    vkDestroyBuffer(this->device, this->defaultBuffer, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->defaultBufferAllocation);
+}
+
+uint32_t BindlessTable::allocateSlot(Kind kind) {
+    SlotAllocator& allocatorSlots = this->slots[static_cast<uint32_t>(kind)];
+    if (allocatorSlots.freeSlots.empty()) {
+        throw runtime_error("bindless descriptor table is full!");
+    }
+    uint32_t slot = allocatorSlots.freeSlots.back();
+    allocatorSlots.freeSlots.pop_back();
+    allocatorSlots.peak = std::max(allocatorSlots.peak, ++allocatorSlots.used);
+    return slot;
+}
+
+uint32_t BindlessTable::addSampledImage(VkImageView view, VkImageLayout layout) {
+    Write entry{};
+    entry.kind = Kind::SampledImage;
+    entry.slot = this->allocateSlot(entry.kind);
+    entry.image.imageView = view;
+    entry.image.imageLayout = layout;
+    this->write(entry);
+    return entry.slot;
+}
+
+uint32_t BindlessTable::addSampler(VkSampler sampler) {
+    Write entry{};
+    entry.kind = Kind::Sampler;
+    entry.slot = this->allocateSlot(entry.kind);
+    entry.image.sampler = sampler;
+    this->write(entry);
+    return entry.slot;
+}
+
+uint32_t BindlessTable::addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+    Write entry{};
+    entry.kind = Kind::StorageBuffer;
+    entry.slot = this->allocateSlot(entry.kind);
+    entry.buffer.buffer = buffer;
+    entry.buffer.offset = offset;
+    entry.buffer.range = range;
+    this->write(entry);
+    return entry.slot;
+}
+
+void BindlessTable::release(Kind kind, uint32_t slot, uint64_t lastUseSerial) {
+    if (slot == 0 || slot == INVALID_SLOT) {
+        return;
+    }
+    SlotAllocator& allocatorSlots = this->slots[static_cast<uint32_t>(kind)];
+    allocatorSlots.retired.push_back({ slot, lastUseSerial });
+    --allocatorSlots.used;
+
+    // Classic sets must not keep a descriptor of a resource that is about to be destroyed. Each set picks up
+    // the default when its frame comes around again, which is before it is bound next.
+    if (!this->bindless) {
+        this->write(this->makeDefaultWrite(kind, slot));
+    }
+}
+
+void BindlessTable::write(const Write& entry) {
+    if (this->bindless) {
+        // Update-after-bind: fine while frames using other slots of the set are in flight.
+        this->applyWrites(this->sets[0], &entry, 1);
+    } else {
+        this->pendingWrites.push_back(entry);
+    }
+}
+
+void BindlessTable::beginFrame(uint32_t frameIndex, uint64_t completedSerial) {
+    for (SlotAllocator& allocatorSlots : this->slots) {
+        while (!allocatorSlots.retired.empty() && allocatorSlots.retired.front().serial <= completedSerial) {
+            allocatorSlots.freeSlots.push_back(allocatorSlots.retired.front().slot);
+            allocatorSlots.retired.pop_front();
+        }
+    }
+
+    if (this->bindless) {
+        return;
+    }
+
+    // The frame ring waited for this slot's previous frame, so its set is no longer in use.
+    this->currentFrame = frameIndex;
+    size_t& applied = this->appliedWrites[frameIndex];
+    this->applyWrites(this->sets[frameIndex], this->pendingWrites.data() + applied, this->pendingWrites.size() - applied);
+    applied = this->pendingWrites.size();
+
+    // Once every set caught up, the log starts over.
+    if (*std::min_element(this->appliedWrites.begin(), this->appliedWrites.end()) == this->pendingWrites.size()) {
+        this->pendingWrites.clear();
+        std::fill(this->appliedWrites.begin(), this->appliedWrites.end(), 0);
+    }
+}
+
+void BindlessTable::applyWrites(VkDescriptorSet set, const Write* writes, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    vector<VkWriteDescriptorSet> descriptorWrites(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Write& entry = writes[i];
+        VkWriteDescriptorSet& descriptorWrite = descriptorWrites[i];
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = set;
+        descriptorWrite.dstBinding = static_cast<uint32_t>(entry.kind);
+        descriptorWrite.dstArrayElement = entry.slot;
+        descriptorWrite.descriptorCount = 1;
+        descriptorWrite.descriptorType = getDescriptorType(entry.kind);
+        if (entry.kind == Kind::StorageBuffer) {
+            descriptorWrite.pBufferInfo = &entry.buffer;
+        } else {
+            descriptorWrite.pImageInfo = &entry.image;
+        }
+    }
+    vkUpdateDescriptorSets(this->device, static_cast<uint32_t>(count), descriptorWrites.data(), 0, nullptr);
+    this->descriptorWrites += count;
+}
+
+BindlessTable::Write BindlessTable::makeDefaultWrite(Kind kind, uint32_t slot) const {
+    Write entry{};
+    entry.kind = kind;
+    entry.slot = slot;
+    entry.image.imageView = kind == Kind::SampledImage ? this->defaultImageView : VK_NULL_HANDLE;
+    entry.image.imageLayout = kind == Kind::SampledImage ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    entry.image.sampler = kind == Kind::Sampler ? this->defaultSampler : VK_NULL_HANDLE;
+    entry.buffer.buffer = this->defaultBuffer;
+    entry.buffer.offset = 0;
+    entry.buffer.range = VK_WHOLE_SIZE;
+    return entry;
+}
+
+void BindlessTable::bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex) const {
+    VkDescriptorSet set = this->getCurrentSet();
+    vkCmdBindDescriptorSets(commandBuffer, bindPoint, pipelineLayout, setIndex, 1, &set, 0, nullptr);
+}
+
+void BindlessTable::printStatistics(ostream& out) const {
+    out << "[Bindless Table]" << '\n';
+    out << "\tMode: " << (this->bindless ? "update-after-bind (descriptor indexing)" : "classic sets, one per frame in flight") << '\n';
+    for (uint32_t kind = 0; kind < KIND_COUNT; ++kind) {
+        const SlotAllocator& allocatorSlots = this->slots[kind];
+        // Slot 0 holds the default and is not counted as used.
+        out << '\t' << KIND_NAMES[kind] << ": " << allocatorSlots.used << " used, peak " << allocatorSlots.peak << ", "
+            << allocatorSlots.retired.size() << " awaiting reuse, capacity " << allocatorSlots.capacity << '\n';
+    }
+    out << "\tDescriptor writes: " << this->descriptorWrites << '\n';
+}
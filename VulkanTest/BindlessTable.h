@@ -0,0 +1,135 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include "DescriptorLayoutCache.h"
+#include "DeviceFeatures.h"
+#include "DeviceMemoryAllocator.h"
+#include "UploadService.h"
+
+// One descriptor set holding every sampled image, sampler and storage buffer of the application, so draws
+// bind it once and pick their resources with indices passed in push constants.
+//
+// With descriptor indexing the set is update-after-bind and partially bound: slots are written as soon as a
+// resource is added, even while frames using the set are in flight, and empty slots need no descriptor.
+// Without it the table falls back to classic sets: one per frame in flight, much smaller (the device's
+// per-stage limits), with every slot holding a valid descriptor. Writes are then logged and replayed into
+// a frame's set in beginFrame(), once the frame that used it last has completed.
+//
+// Slots come from a free list per kind. A released slot may still be referenced by frames in flight, so it
+// only becomes free again once the frame ring reports the releasing frame complete. Shaders size their arrays
+// with the capacities as specialization constants (see getCapacity()).
+//
+// Not thread safe; resources are added and released from the thread that renders.
+class BindlessTable {
+
+public:
+
+    enum class Kind : uint32_t {
+        SampledImage,
+        Sampler,
+        StorageBuffer,
+    };
+
+    static constexpr const uint32_t KIND_COUNT = 3;
+    static constexpr const uint32_t INVALID_SLOT = ~0u;
+
+    void create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, DescriptorLayoutCache& layouts,
+        const DeviceCapabilities& capabilities, const VkPhysicalDeviceLimits& limits, uint32_t framesInFlight);
+    void destroy();
+
+    bool isBindless() const { return this->bindless; }
+    VkDescriptorSetLayout getLayout() const { return this->layout; }
+    // Slots of a kind; the binding of kind k is k.
+    uint32_t getCapacity(Kind kind) const { return this->slots[static_cast<uint32_t>(kind)].capacity; }
+
+    // Each returns the slot to index the resource with in shaders. Throws when the table is full.
+    uint32_t addSampledImage(VkImageView view, VkImageLayout layout);
+    uint32_t addSampler(VkSampler sampler);
+    uint32_t addStorageBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range);
+
+    // The slot is reused once every frame up to and including `lastUseSerial` has completed on the GPU.
+    void release(Kind kind, uint32_t slot, uint64_t lastUseSerial);
+
+    // After the frame ring handed out the slot `frameIndex`: recycles released slots and, in the fallback,
+    // brings that frame's set up to date.
+    void beginFrame(uint32_t frameIndex, uint64_t completedSerial);
+
+    // Binds the current frame's set as set `setIndex` of the layout.
+    void bind(VkCommandBuffer commandBuffer, VkPipelineBindPoint bindPoint, VkPipelineLayout pipelineLayout, uint32_t setIndex) const;
+    VkDescriptorSet getCurrentSet() const { return this->sets[this->currentFrame]; }
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    // Update-after-bind limits are at least 500000 on every device with descriptor indexing.
+    static constexpr const uint32_t BINDLESS_SAMPLED_IMAGES = 16384;
+    static constexpr const uint32_t BINDLESS_SAMPLERS = 256;
+    static constexpr const uint32_t BINDLESS_STORAGE_BUFFERS = 16384;
+    // Classic sets are written in full every time a frame catches up, so they stay small even where the
+    // limits would allow more.
+    static constexpr const uint32_t CLASSIC_SAMPLED_IMAGES = 64;
+    static constexpr const uint32_t CLASSIC_SAMPLERS = 16;
+    static constexpr const uint32_t CLASSIC_STORAGE_BUFFERS = 16;
+    static constexpr const VkDeviceSize DEFAULT_BUFFER_SIZE = 256;
+
+    struct Retired {
+        uint32_t slot;
+        uint64_t serial;
+    };
+
+    struct SlotAllocator {
+        uint32_t capacity = 0;
+        std::vector<uint32_t> freeSlots;
+        std::deque<Retired> retired;
+        uint32_t used = 0;
+        uint32_t peak = 0;
+    };
+
+    struct Write {
+        Kind kind;
+        uint32_t slot;
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+    };
+
+    void createDefaultResources(DeviceMemoryAllocator& allocator, UploadService& uploads);
+    void createLayoutAndSets(DescriptorLayoutCache& layouts, uint32_t framesInFlight);
+    uint32_t allocateSlot(Kind kind);
+    void write(const Write& entry);
+    void applyWrites(VkDescriptorSet set, const Write* writes, size_t count);
+    // The descriptor an empty slot holds in the fallback.
+    Write makeDefaultWrite(Kind kind, uint32_t slot) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    bool bindless = false;
+
+    // Owned by the layout cache.
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    // One set when bindless, one per frame in flight otherwise.
+    std::vector<VkDescriptorSet> sets;
+    uint32_t currentFrame = 0;
+
+    SlotAllocator slots[KIND_COUNT];
+
+    // Fallback only: every write since the oldest set last caught up, and how far each set has got.
+    std::vector<Write> pendingWrites;
+    std::vector<size_t> appliedWrites;
+
+    VkImage defaultImage = VK_NULL_HANDLE;
+    DeviceAllocation defaultImageAllocation;
+    VkImageView defaultImageView = VK_NULL_HANDLE;
+    VkSampler defaultSampler = VK_NULL_HANDLE;
+    VkBuffer defaultBuffer = VK_NULL_HANDLE;
+    DeviceAllocation defaultBufferAllocation;
+
+    uint64_t descriptorWrites = 0;
+};
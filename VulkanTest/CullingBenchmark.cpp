@@ -0,0 +1,150 @@
+#include "CullingBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "SphereCuller.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Hundreds of thousands of objects, more than fit in the caches: the kernels stream through memory.
+constexpr const uint32_t SPHERE_COUNT = 1u << 20;
+constexpr const float WORLD_HALF_SIZE = 1.0f;
+constexpr const float MIN_RADIUS = 0.001f;
+constexpr const float MAX_RADIUS = 0.02f;
+// The camera sees a quarter of the world's area, and part of the world lies before its near or beyond its far plane.
+constexpr const float CAMERA_HALF_SIZE = 0.5f;
+constexpr const float WORLD_DEPTH = 1.5f;
+constexpr const uint32_t REPETITIONS = 10;
+
+const CullKernel KERNELS[] = { CullKernel::Scalar, CullKernel::Sse, CullKernel::Avx2 };
+
+void check(bool condition, const string& what) {
+    if (!condition) {
+        throw runtime_error("culling self-test failed: " + what);
+    }
+}
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Best of a few runs, which is the least disturbed by whatever else the machine is doing.
+template <typename Function>
+double bestOfMs(Function&& function) {
+    double best = 0.0;
+    for (uint32_t i = 0; i < REPETITIONS; ++i) {
+        Clock::time_point start = Clock::now();
+        function();
+        double ms = elapsedMs(start);
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+void fillSpheres(SphereCuller& culler) {
+    // Fixed seed: every run and every kernel sees the same spheres.
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-WORLD_HALF_SIZE, WORLD_HALF_SIZE);
+    std::uniform_real_distribution<float> depth(-WORLD_DEPTH, WORLD_DEPTH);
+    std::uniform_real_distribution<float> radius(MIN_RADIUS, MAX_RADIUS);
+
+    culler.reserve(SPHERE_COUNT);
+    for (uint32_t i = 0; i < SPHERE_COUNT; ++i) {
+        float center[3] = { position(random), position(random), depth(random) };
+        culler.add(center, radius(random));
+    }
+}
+
+void runSelfTest(ostream& out, SphereCuller& culler, const Frustum& frustum, JobSystem& jobs) {
+    vector<uint8_t> expected(culler.getPaddedCount());
+    culler.setKernel(CullKernel::Scalar);
+    uint32_t expectedCount = culler.cull(frustum, expected.data());
+    check(expectedCount > 0 && expectedCount < SPHERE_COUNT, "the test frustum should see some spheres but not all");
+
+    vector<uint8_t> visible(culler.getPaddedCount());
+    for (CullKernel kernel : KERNELS) {
+        if (!isCullKernelSupported(kernel)) {
+            continue;
+        }
+        culler.setKernel(kernel);
+        // The scalar kernel over the job system is checked too.
+        for (bool parallel : { false, true }) {
+            std::fill(visible.begin(), visible.end(), uint8_t(2));
+            uint32_t count = parallel ? culler.cull(frustum, visible.data(), jobs) : culler.cull(frustum, visible.data());
+            string name = string(getCullKernelString(kernel)) + (parallel ? " over the job system" : "");
+            check(count == expectedCount, name + " found " + std::to_string(count) + " visible spheres instead of " + std::to_string(expectedCount));
+            check(visible == expected, name + " disagrees with the scalar kernel on some spheres");
+        }
+        if (kernel != CullKernel::Scalar) {
+            out << '\t' << getCullKernelString(kernel) << " matches scalar" << '\n';
+        }
+    }
+    out << '\t' << expectedCount << " of " << SPHERE_COUNT << " spheres visible" << '\n';
+}
+
+void runKernelBenchmark(ostream& out, SphereCuller& culler, const Frustum& frustum, JobSystem& jobs) {
+    vector<uint8_t> visible(culler.getPaddedCount());
+    double objects = static_cast<double>(SPHERE_COUNT);
+    double scalarMs = 0.0;
+    for (CullKernel kernel : KERNELS) {
+        if (!isCullKernelSupported(kernel)) {
+            out << '\t' << getCullKernelString(kernel) << ": not supported by this CPU" << '\n';
+            continue;
+        }
+        culler.setKernel(kernel);
+        double singleMs = bestOfMs([&] { culler.cull(frustum, visible.data()); });
+        double parallelMs = bestOfMs([&] { culler.cull(frustum, visible.data(), jobs); });
+        if (kernel == CullKernel::Scalar) {
+            scalarMs = singleMs;
+        }
+
+        out << '\t' << getCullKernelString(kernel) << ": 1 core " << objects / (singleMs * 1e6) << " objects/ns ("
+            << scalarMs / singleMs << "x scalar), all " << jobs.getWorkerCount() << " workers " << objects / (parallelMs * 1e6)
+            << " objects/ns (" << singleMs / parallelMs << "x 1 core)" << '\n';
+    }
+}
+
+}
+
+void runCullingBenchmark(ostream& out) {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+
+    JobSystem jobs;
+    jobs.start(0);
+
+    SphereCuller culler;
+    fillSpheres(culler);
+    float viewProjection[16];
+    makeOrthographicViewProjection(0.0f, 0.0f, CAMERA_HALF_SIZE, viewProjection);
+    Frustum frustum = extractFrustum(viewProjection);
+
+    out << "[Culling Self-Test]" << '\n';
+    runSelfTest(out, culler, frustum, jobs);
+
+    out << "[Culling Benchmark]" << '\n';
+    out << '\t' << "Spheres: " << SPHERE_COUNT << ", detected kernel " << getCullKernelString(detectCullKernel())
+        << ", best of " << REPETITIONS << " runs" << '\n';
+    runKernelBenchmark(out, culler, frustum, jobs);
+
+    jobs.stop();
+
+    out.flags(flags);
+    out.precision(precision);
+}
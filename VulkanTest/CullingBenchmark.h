@@ -0,0 +1,8 @@
+#pragma once
+
+#include <ostream>
+
+// CPU-only check and benchmark of SphereCuller (--bench culling). Checks that every kernel this CPU runs
+// agrees with the scalar one, on one thread and over the job system, then times each kernel on one core and
+// on all of them, in objects per nanosecond. Throws runtime_error when a check fails.
+void runCullingBenchmark(std::ostream& out);
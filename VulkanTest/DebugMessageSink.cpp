@@ -0,0 +1,300 @@
+#include "DebugMessageSink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using std::cerr;
+using std::ostream;
+using std::string;
+using std::vector;
+
+namespace {
+
+const char* getSeverityString(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        return "Error";
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        return "Warning";
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        return "Info";
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
+        return "Verbose";
+    } else {
+        return "Unknown Severity String";
+    }
+}
+
+size_t getSeverityIndex(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        return 3;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+        return 2;
+    } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
+        return 1;
+    }
+    return 0;
+}
+
+uint32_t getCurrentSecond() {
+    static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    // Offset by one so that 0 can mean "no window yet".
+    return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - epoch).count()) + 1;
+}
+
+}
+
+DebugMessageSink::DebugMessageSink()
+    : slots(new Slot[RING_CAPACITY]), counters(new IdCounter[ID_TABLE_CAPACITY]) {
+    static_assert((RING_CAPACITY & (RING_CAPACITY - 1)) == 0, "RING_CAPACITY must be a power of two");
+    static_assert((ID_TABLE_CAPACITY & (ID_TABLE_CAPACITY - 1)) == 0, "ID_TABLE_CAPACITY must be a power of two");
+
+    for (size_t i = 0; i < RING_CAPACITY; ++i) {
+        this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+DebugMessageSink::~DebugMessageSink() {
+    this->stop();
+}
+
+void DebugMessageSink::start() {
+    if (this->running.exchange(true)) {
+        return;
+    }
+    this->worker = std::thread(&DebugMessageSink::run, this);
+}
+
+void DebugMessageSink::stop() {
+    if (!this->running.exchange(false)) {
+        return;
+    }
+    this->worker.join();
+    this->drain();
+    this->flushRepeats();
+    cerr.flush();
+}
+
+uint32_t DebugMessageSink::getMessageKey(const VkDebugUtilsMessengerCallbackDataEXT* callbackData) {
+    // Loader and general messages often share messageIdNumber 0, so fall back to hashing the text (FNV-1a).
+    uint32_t key = static_cast<uint32_t>(callbackData->messageIdNumber);
+    if (key == 0 && callbackData->pMessage != nullptr) {
+        key = 2166136261u;
+        for (const char* c = callbackData->pMessage; *c != '\0'; ++c) {
+            key = (key ^ static_cast<uint8_t>(*c)) * 16777619u;
+        }
+    }
+    return key != 0 ? key : 1;
+}
+
+void DebugMessageSink::copyTruncated(char* destination, size_t capacity, const char* source) {
+    if (source == nullptr) {
+        destination[0] = '\0';
+        return;
+    }
+    size_t length = std::min(strlen(source), capacity - 1);
+    memcpy(destination, source, length);
+    destination[length] = '\0';
+}
+
+void DebugMessageSink::writeMessage(ostream& out, VkDebugUtilsMessageSeverityFlagBitsEXT severity, const char* idName, const char* text) {
+    out << "[Validation Layer] " << "[Severity] " << getSeverityString(severity);
+    if (idName[0] != '\0') {
+        out << " [ID] " << idName;
+    }
+    out << " [Message] " << text << '\n';
+}
+
+DebugMessageSink::IdCounter* DebugMessageSink::findCounter(uint32_t key) {
+    size_t mask = ID_TABLE_CAPACITY - 1;
+    for (size_t probe = 0; probe < ID_TABLE_CAPACITY; ++probe) {
+        IdCounter& counter = this->counters[(key + probe) & mask];
+        uint32_t existing = counter.key.load(std::memory_order_acquire);
+        if (existing == key) {
+            return &counter;
+        }
+        if (existing == 0) {
+            if (counter.key.compare_exchange_strong(existing, key, std::memory_order_acq_rel) || existing == key) {
+                return &counter;
+            }
+        }
+    }
+    return nullptr;
+}
+
+bool DebugMessageSink::isRateLimited(IdCounter& counter) {
+    uint32_t second = getCurrentSecond();
+    uint32_t windowSecond = counter.windowSecond.load(std::memory_order_relaxed);
+    if (windowSecond != second && counter.windowSecond.compare_exchange_strong(windowSecond, second, std::memory_order_relaxed)) {
+        // Losing this race only lets a handful of extra messages through at the window boundary.
+        counter.windowCount.store(0, std::memory_order_relaxed);
+    }
+    return counter.windowCount.fetch_add(1, std::memory_order_relaxed) >= this->rateLimit;
+}
+
+void DebugMessageSink::post(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT* callbackData) {
+    this->posted.fetch_add(1, std::memory_order_relaxed);
+    this->severityCounts[getSeverityIndex(severity)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t key = getMessageKey(callbackData);
+    IdCounter* counter = this->findCounter(key);
+    if (counter != nullptr) {
+        counter->total.fetch_add(1, std::memory_order_relaxed);
+        if (!(severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) && this->isRateLimited(*counter)) {
+            counter->suppressed.fetch_add(1, std::memory_order_relaxed);
+            this->suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+    } else {
+        this->untracked.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const char* idName = callbackData->pMessageIdName != nullptr ? callbackData->pMessageIdName : "";
+    const char* text = callbackData->pMessage != nullptr ? callbackData->pMessage : "";
+
+    if (!this->running.load(std::memory_order_acquire)) {
+        writeMessage(cerr, severity, idName, text);
+        return;
+    }
+
+    if (!this->tryPush(severity, key, idName, text)) {
+        // Never block the driver thread; a full ring means the logger is hopelessly behind anyway.
+        this->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool DebugMessageSink::tryPush(VkDebugUtilsMessageSeverityFlagBitsEXT severity, uint32_t key, const char* idName, const char* text) {
+    // Bounded MPMC queue by Dmitry Vyukov, used with a single consumer.
+    size_t mask = RING_CAPACITY - 1;
+    size_t position = this->tail.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &this->slots[position & mask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (this->tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = this->tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->severity = severity;
+    slot->key = key;
+    copyTruncated(slot->idName, ID_NAME_CAPACITY, idName);
+    copyTruncated(slot->text, MESSAGE_CAPACITY, text);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool DebugMessageSink::tryPop(PrintedMessage& message) {
+    Slot& slot = this->slots[this->head & (RING_CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != this->head + 1) {
+        return false;
+    }
+
+    message.severity = slot.severity;
+    message.key = slot.key;
+    message.idName.assign(slot.idName);
+    message.text.assign(slot.text);
+
+    slot.sequence.store(this->head + RING_CAPACITY, std::memory_order_release);
+    ++this->head;
+    return true;
+}
+
+void DebugMessageSink::flushRepeats() {
+    if (this->repeatCount > 0) {
+        cerr << "[Validation Layer] " << "(previous message repeated " << this->repeatCount << " more times)" << '\n';
+        this->collapsed += this->repeatCount;
+        this->repeatCount = 0;
+    }
+}
+
+size_t DebugMessageSink::drain() {
+    PrintedMessage message;
+    size_t count = 0;
+    while (this->tryPop(message)) {
+        ++count;
+        this->idNames.emplace(message.key, message.idName);
+
+        if (message.key == this->lastKey) {
+            ++this->repeatCount;
+            continue;
+        }
+
+        this->flushRepeats();
+        writeMessage(cerr, message.severity, message.idName.c_str(), message.text.c_str());
+        this->lastKey = message.key;
+        ++this->printed;
+    }
+    return count;
+}
+
+void DebugMessageSink::run() {
+    while (this->running.load(std::memory_order_acquire)) {
+        if (this->drain() > 0) {
+            cerr.flush();
+            continue;
+        }
+        // Idle: report pending repeats so they do not wait for the next distinct message.
+        this->flushRepeats();
+        this->lastKey = 0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+void DebugMessageSink::printSummary(ostream& out) const {
+    uint64_t postedCount = this->posted.load(std::memory_order_relaxed);
+    if (postedCount == 0) {
+        return;
+    }
+
+    out << "[Debug Messages]" << '\n';
+    out << '\t' << "Total: " << postedCount
+        << " (Error " << this->severityCounts[3].load(std::memory_order_relaxed)
+        << ", Warning " << this->severityCounts[2].load(std::memory_order_relaxed)
+        << ", Info " << this->severityCounts[1].load(std::memory_order_relaxed)
+        << ", Verbose " << this->severityCounts[0].load(std::memory_order_relaxed) << ")" << '\n';
+    out << '\t' << "Printed: " << this->printed << ", Collapsed: " << this->collapsed
+        << ", Rate limited: " << this->suppressed.load(std::memory_order_relaxed)
+        << ", Dropped (ring full): " << this->dropped.load(std::memory_order_relaxed) << '\n';
+
+    vector<const IdCounter*> used;
+    for (size_t i = 0; i < ID_TABLE_CAPACITY; ++i) {
+        if (this->counters[i].key.load(std::memory_order_relaxed) != 0) {
+            used.push_back(&this->counters[i]);
+        }
+    }
+    std::sort(used.begin(), used.end(), [](const IdCounter* a, const IdCounter* b) {
+        return a->total.load(std::memory_order_relaxed) > b->total.load(std::memory_order_relaxed);
+    });
+
+    const size_t maxListed = 10;
+    for (size_t i = 0; i < used.size() && i < maxListed; ++i) {
+        uint32_t key = used[i]->key.load(std::memory_order_relaxed);
+        auto name = this->idNames.find(key);
+        out << '\t' << used[i]->total.load(std::memory_order_relaxed) << "x ";
+        if (name != this->idNames.end() && !name->second.empty()) {
+            out << name->second;
+        } else {
+            out << "0x" << std::hex << key << std::dec;
+        }
+        uint64_t limited = used[i]->suppressed.load(std::memory_order_relaxed);
+        if (limited > 0) {
+            out << " (" << limited << " rate limited)";
+        }
+        out << '\n';
+    }
+
+    uint64_t untrackedCount = this->untracked.load(std::memory_order_relaxed);
+    if (untrackedCount > 0) {
+        out << '\t' << untrackedCount << " messages beyond " << ID_TABLE_CAPACITY << " distinct IDs were not rate limited" << '\n';
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Collects debug utils messages from any thread without blocking the caller.
+//
+// post() is lock-free: it bumps per-ID counters in a fixed open-addressed table, drops the message if its ID
+// exceeded the rate limit for the current second, and otherwise copies it into a bounded MPSC ring. A background
+// thread drains the ring, collapses consecutive repeats of the same ID and writes to cerr in batches.
+class DebugMessageSink {
+
+public:
+
+    DebugMessageSink();
+    ~DebugMessageSink();
+
+    DebugMessageSink(const DebugMessageSink&) = delete;
+    DebugMessageSink& operator=(const DebugMessageSink&) = delete;
+
+    // Messages beyond this many per ID per second are counted but not printed. Errors are never limited.
+    void setRateLimit(uint32_t messagesPerSecond) { this->rateLimit = messagesPerSecond; }
+
+    void start();
+    // Drains whatever is still queued. Messages posted afterwards are written synchronously.
+    void stop();
+
+    void post(VkDebugUtilsMessageSeverityFlagBitsEXT severity, const VkDebugUtilsMessengerCallbackDataEXT* callbackData);
+
+    void printSummary(std::ostream& out) const;
+
+private:
+
+    static constexpr const size_t RING_CAPACITY = 512;
+    static constexpr const size_t MESSAGE_CAPACITY = 2048;
+    static constexpr const size_t ID_NAME_CAPACITY = 64;
+    static constexpr const size_t ID_TABLE_CAPACITY = 256;
+
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        uint32_t key;
+        char idName[ID_NAME_CAPACITY];
+        char text[MESSAGE_CAPACITY];
+    };
+
+    struct IdCounter {
+        // 0 marks a free entry; keys are never 0 (see getMessageKey).
+        std::atomic<uint32_t> key{ 0 };
+        std::atomic<uint64_t> total{ 0 };
+        std::atomic<uint64_t> suppressed{ 0 };
+        std::atomic<uint32_t> windowSecond{ 0 };
+        std::atomic<uint32_t> windowCount{ 0 };
+    };
+
+    struct PrintedMessage {
+        VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+        uint32_t key;
+        std::string idName;
+        std::string text;
+    };
+
+    static uint32_t getMessageKey(const VkDebugUtilsMessengerCallbackDataEXT* callbackData);
+    static void copyTruncated(char* destination, size_t capacity, const char* source);
+    static void writeMessage(std::ostream& out, VkDebugUtilsMessageSeverityFlagBitsEXT severity, const char* idName, const char* text);
+
+    IdCounter* findCounter(uint32_t key);
+    bool isRateLimited(IdCounter& counter);
+
+    bool tryPush(VkDebugUtilsMessageSeverityFlagBitsEXT severity, uint32_t key, const char* idName, const char* text);
+    bool tryPop(PrintedMessage& message);
+    size_t drain();
+    void flushRepeats();
+    void run();
+
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<size_t> tail{ 0 };
+    alignas(64) size_t head = 0;
+
+    std::unique_ptr<IdCounter[]> counters;
+
+    std::atomic<bool> running{ false };
+    std::thread worker;
+    uint32_t rateLimit = 10;
+
+    std::atomic<uint64_t> posted{ 0 };
+    std::atomic<uint64_t> suppressed{ 0 };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<uint64_t> untracked{ 0 };
+    std::atomic<uint64_t> severityCounts[4] = {};
+
+    // Consumer-side state, touched only by the logger thread (or after it was joined).
+    std::unordered_map<uint32_t, std::string> idNames;
+    uint32_t lastKey = 0;
+    uint64_t repeatCount = 0;
+    uint64_t collapsed = 0;
+    uint64_t printed = 0;
+};
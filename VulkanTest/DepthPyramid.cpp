@@ -0,0 +1,253 @@
+#include "DepthPyramid.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+#include "ShaderModule.h"
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+bool DepthPyramid::isSupported(const DeviceCapabilities& capabilities) {
+    return capabilities.storageImageArrayDynamicIndexing;
+}
+
+void DepthPyramid::create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, DescriptorLayoutCache& layouts,
+    DescriptorAllocator& descriptors, VkPipelineCache pipelineCache, const string& shaderDirectory) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->descriptors = &descriptors;
+
+    // Culling reads single texels with texelFetch, so the filter never matters.
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+
+    if (vkCreateSampler(this->device, &samplerInfo, HostAllocator::get().getCallbacks(), &this->sampler) != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid sampler!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = this->getCounterSize();
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(this->device, &bufferInfo, HostAllocator::get().getCallbacks(), &this->counter) != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid counter!");
+    }
+    this->counterAllocation = allocator.allocateForBuffer(this->counter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+    const uint32_t zero = 0;
+    uploads.uploadBuffer(this->counter, 0, &zero, sizeof(zero));
+
+    this->createPipeline(layouts, pipelineCache, shaderDirectory);
+}
+
+void DepthPyramid::destroy() {
+    // Only called once the device is idle.
+    this->collectRetired(UINT64_MAX);
+    this->destroyImages(this->current);
+
+    vkDestroyPipeline(this->device, this->pipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, HostAllocator::get().getCallbacks());
+    vkDestroyBuffer(this->device, this->counter, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->counterAllocation);
+    vkDestroySampler(this->device, this->sampler, HostAllocator::get().getCallbacks());
+}
+
+void DepthPyramid::createPipeline(DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const string& shaderDirectory) {
+    // Depth buffer, one storage image per level, counter.
+    VkDescriptorSetLayoutBinding bindings[3]{};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = MAX_LEVELS;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[2].binding = 2;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    this->setLayout = layouts.getLayout(bindings, 3);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(BuildConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &this->setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, HostAllocator::get().getCallbacks(), &this->pipelineLayout) != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid pipeline layout!");
+    }
+
+    VkShaderModule computeShaderModule = createShaderModule(this->device, shaderDirectory + "depth_pyramid.comp.spv");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = this->pipelineLayout;
+
+    VkResult result = vkCreateComputePipelines(this->device, pipelineCache, 1, &pipelineInfo, HostAllocator::get().getCallbacks(), &this->pipeline);
+
+    vkDestroyShaderModule(this->device, computeShaderModule, HostAllocator::get().getCallbacks());
+
+    if (result != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid pipeline!");
+    }
+}
+
+DepthPyramid::Images DepthPyramid::createImages(uint32_t size, uint32_t levelCount) {
+    Images images;
+
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = FORMAT;
+    imageInfo.extent = { size, size, 1 };
+    imageInfo.mipLevels = levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    if (vkCreateImage(this->device, &imageInfo, HostAllocator::get().getCallbacks(), &images.image) != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid!");
+    }
+    images.allocation = this->allocator->allocateForImage(images.image, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        AllocationLifetime::LongLived);
+
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = images.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = FORMAT;
+    viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    viewInfo.subresourceRange.levelCount = levelCount;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &images.view) != VK_SUCCESS) {
+        throw runtime_error("failed to create depth pyramid view!");
+    }
+
+    images.levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &images.levelViews[level]) != VK_SUCCESS) {
+            throw runtime_error("failed to create depth pyramid level view!");
+        }
+    }
+    return images;
+}
+
+void DepthPyramid::destroyImages(Images& images) {
+    for (VkImageView levelView : images.levelViews) {
+        vkDestroyImageView(this->device, levelView, HostAllocator::get().getCallbacks());
+    }
+    images.levelViews.clear();
+    vkDestroyImageView(this->device, images.view, HostAllocator::get().getCallbacks());
+    vkDestroyImage(this->device, images.image, HostAllocator::get().getCallbacks());
+    if (images.image != VK_NULL_HANDLE) {
+        this->allocator->free(images.allocation);
+    }
+    images.view = VK_NULL_HANDLE;
+    images.image = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::resize(VkExtent2D depthExtent, uint64_t lastUseSerial) {
+    if (this->current.image != VK_NULL_HANDLE && depthExtent.width == this->depthExtent.width && depthExtent.height == this->depthExtent.height) {
+        return;
+    }
+
+    uint32_t size = 1;
+    uint32_t levelCount = 1;
+    while (size < std::max(depthExtent.width, depthExtent.height)) {
+        size *= 2;
+        ++levelCount;
+    }
+    if (levelCount > MAX_LEVELS) {
+        throw runtime_error("depth buffer too large for the depth pyramid!");
+    }
+
+    if (this->current.image != VK_NULL_HANDLE) {
+        this->retired.push_back({ std::move(this->current), lastUseSerial });
+    }
+    this->current = this->createImages(size, levelCount);
+    this->depthExtent = depthExtent;
+    this->size = size;
+    this->levelCount = levelCount;
+}
+
+void DepthPyramid::collectRetired(uint64_t completedSerial) {
+    auto first = std::remove_if(this->retired.begin(), this->retired.end(), [this, completedSerial](Retired& entry) {
+        if (entry.serial > completedSerial) {
+            return false;
+        }
+        this->destroyImages(entry.images);
+        return true;
+    });
+    this->retired.erase(first, this->retired.end());
+}
+
+void DepthPyramid::recordBuild(VkCommandBuffer commandBuffer, VkImageView depthView) {
+    // Returned wholesale when this frame's slot comes around again.
+    VkDescriptorSet set = this->descriptors->allocate(this->setLayout);
+
+    VkDescriptorImageInfo depthInfo{ this->sampler, depthView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    // Every array element needs a valid descriptor; levels past the last repeat it and are never written.
+    VkDescriptorImageInfo levelInfos[MAX_LEVELS];
+    for (uint32_t level = 0; level < MAX_LEVELS; ++level) {
+        levelInfos[level] = { VK_NULL_HANDLE, this->current.levelViews[std::min(level, this->levelCount - 1)], VK_IMAGE_LAYOUT_GENERAL };
+    }
+    VkDescriptorBufferInfo counterInfo{ this->counter, 0, VK_WHOLE_SIZE };
+
+    VkWriteDescriptorSet writes[3]{};
+    for (uint32_t i = 0; i < 3; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+    }
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &depthInfo;
+    writes[1].descriptorCount = MAX_LEVELS;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo = levelInfos;
+    writes[2].descriptorCount = 1;
+    writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[2].pBufferInfo = &counterInfo;
+    vkUpdateDescriptorSets(this->device, 3, writes, 0, nullptr);
+
+    uint32_t tiles = (this->size + TILE_SIZE - 1) / TILE_SIZE;
+    BuildConstants constants;
+    constants.depthSize[0] = static_cast<int32_t>(this->depthExtent.width);
+    constants.depthSize[1] = static_cast<int32_t>(this->depthExtent.height);
+    constants.levelCount = this->levelCount;
+    constants.workGroupCount = tiles * tiles;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipelineLayout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, tiles, tiles, 1);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "DeviceFeatures.h"
+#include "DeviceMemoryAllocator.h"
+#include "UploadService.h"
+
+// A mip chain of the farthest depth under each texel of a depth buffer, for occlusion culling: anything whose
+// nearest depth lies behind a texel's value is hidden everywhere under that texel.
+//
+// Level 0 is a square power of two covering the depth buffer one texel per pixel; texels past the depth
+// buffer's edge hold 0, which never raises a maximum, since culling clamps its footprints to the screen.
+// The whole chain is built by one compute dispatch: each workgroup reduces a 64x64 tile down six levels in
+// shared memory, and the last workgroup to finish, found with an atomic counter, reduces the remaining levels
+// from the tiles' results.
+class DepthPyramid {
+
+public:
+
+    // Level 0 up to 4096x4096, so the last workgroup's 64x64 tile covers all of level 6.
+    static constexpr const uint32_t MAX_LEVELS = 13;
+    static constexpr const VkFormat FORMAT = VK_FORMAT_R32_SFLOAT;
+
+    // The build shader indexes its array of level images with the loop's level.
+    static bool isSupported(const DeviceCapabilities& capabilities);
+
+    void create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, DescriptorLayoutCache& layouts,
+        DescriptorAllocator& descriptors, VkPipelineCache pipelineCache, const std::string& shaderDirectory);
+    void destroy();
+
+    // Sizes the pyramid for a depth buffer of `depthExtent`, if it is not already. Frames up to and including
+    // `lastUseSerial` may still use the previous images; they are destroyed by collectRetired() afterwards.
+    void resize(VkExtent2D depthExtent, uint64_t lastUseSerial);
+    void collectRetired(uint64_t completedSerial);
+
+    VkImage getImage() const { return this->current.image; }
+    // Every level, for sampling with texelFetch.
+    VkImageView getView() const { return this->current.view; }
+    VkSampler getSampler() const { return this->sampler; }
+    uint32_t getSize() const { return this->size; }
+    uint32_t getLevelCount() const { return this->levelCount; }
+    VkExtent2D getDepthExtent() const { return this->depthExtent; }
+    // Lets the last workgroup find itself; left at 0 after every build.
+    VkBuffer getCounter() const { return this->counter; }
+    VkDeviceSize getCounterSize() const { return sizeof(uint32_t); }
+
+    // Reads `depthView` in SHADER_READ_ONLY_OPTIMAL and writes every level in GENERAL.
+    void recordBuild(VkCommandBuffer commandBuffer, VkImageView depthView);
+
+private:
+
+    // Level-0 texels one workgroup reduces.
+    static constexpr const uint32_t TILE_SIZE = 64;
+
+    struct BuildConstants {
+        int32_t depthSize[2];
+        uint32_t levelCount;
+        uint32_t workGroupCount;
+    };
+
+    struct Images {
+        VkImage image = VK_NULL_HANDLE;
+        DeviceAllocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        std::vector<VkImageView> levelViews;
+    };
+
+    struct Retired {
+        Images images;
+        uint64_t serial;
+    };
+
+    void createPipeline(DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const std::string& shaderDirectory);
+    Images createImages(uint32_t size, uint32_t levelCount);
+    void destroyImages(Images& images);
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    DescriptorAllocator* descriptors = nullptr;
+
+    VkExtent2D depthExtent{};
+    uint32_t size = 0;
+    uint32_t levelCount = 0;
+    Images current;
+    std::vector<Retired> retired;
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    VkBuffer counter = VK_NULL_HANDLE;
+    DeviceAllocation counterAllocation;
+
+    // Owned by the layout cache.
+    VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+};
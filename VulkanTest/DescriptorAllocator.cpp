@@ -0,0 +1,110 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::vector;
+
+void DescriptorAllocator::create(VkDevice device, uint32_t framesInFlight) {
+    this->device = device;
+    this->frames.resize(framesInFlight);
+}
+
+void DescriptorAllocator::destroy() {
+    for (FramePools& frame : this->frames) {
+        for (VkDescriptorPool pool : frame.pools) {
+            vkDestroyDescriptorPool(this->device, pool, HostAllocator::get().getCallbacks());
+        }
+    }
+    this->frames.clear();
+}
+
+VkDescriptorPool DescriptorAllocator::createPool(uint32_t maxSets) {
+    vector<VkDescriptorPoolSize> poolSizes;
+    for (const PoolRatio& ratio : POOL_RATIOS) {
+        poolSizes.push_back({ ratio.type, static_cast<uint32_t>(ratio.perSet * static_cast<float>(maxSets)) });
+    }
+
+    // No FREE_DESCRIPTOR_SET_BIT: sets are only ever returned by resetting the whole pool, which lets the
+    // driver allocate them linearly.
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = maxSets;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(this->device, &poolInfo, HostAllocator::get().getCallbacks(), &pool) != VK_SUCCESS) {
+        throw runtime_error("failed to create transient descriptor pool!");
+    }
+    ++this->poolsCreated;
+    return pool;
+}
+
+void DescriptorAllocator::beginFrame(uint32_t frameIndex) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->currentFrame = frameIndex;
+
+    FramePools& frame = this->frames[frameIndex];
+    if (frame.allocatedSets == 0) {
+        return;
+    }
+    // Pools past `current` were not touched since their last reset.
+    size_t used = std::min(frame.current + 1, frame.pools.size());
+    for (size_t i = 0; i < used; ++i) {
+        vkResetDescriptorPool(this->device, frame.pools[i], 0);
+        ++this->poolResets;
+    }
+    frame.current = 0;
+    frame.allocatedSets = 0;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    FramePools& frame = this->frames[this->currentFrame];
+
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    while (true) {
+        bool fresh = frame.current == frame.pools.size();
+        if (fresh) {
+            uint32_t maxSets = std::min(FIRST_POOL_SETS << std::min<size_t>(frame.pools.size(), 4), MAX_POOL_SETS);
+            frame.pools.push_back(this->createPool(maxSets));
+        }
+
+        allocInfo.descriptorPool = frame.pools[frame.current];
+        VkDescriptorSet set;
+        VkResult result = vkAllocateDescriptorSets(this->device, &allocInfo, &set);
+        if (result == VK_SUCCESS) {
+            ++frame.allocatedSets;
+            ++this->totalSets;
+            this->peakSetsPerFrame = std::max(this->peakSetsPerFrame, frame.allocatedSets);
+            return set;
+        }
+        if ((result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) || fresh) {
+            throw runtime_error("failed to allocate transient descriptor set!");
+        }
+        // The pool is full; move on along the chain.
+        ++frame.current;
+    }
+}
+
+void DescriptorAllocator::printStatistics(ostream& out) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    size_t pools = 0;
+    for (const FramePools& frame : this->frames) {
+        pools += frame.pools.size();
+    }
+
+    out << "[Descriptor Allocator]" << '\n';
+    out << "\tTransient sets: " << this->totalSets << ", peak " << this->peakSetsPerFrame << " per frame" << '\n';
+    out << "\tPools: " << pools << " across " << this->frames.size() << " frames in flight (" << this->poolsCreated << " created)" << '\n';
+    out << "\tPool resets: " << this->poolResets << '\n';
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Transient descriptor sets that live for one frame, allocated linearly and never freed one by one.
+//
+// Every frame in flight owns a chain of VkDescriptorPools. Sets come from the chain's current pool; when it
+// runs out, the next pool of the chain is used, creating it if the chain is too short. Once the frame ring
+// has waited for a slot's fence, beginFrame() resets the pools that slot used with one vkResetDescriptorPool
+// each, which returns all of their sets at once. Pools are kept, so a steady workload stops creating them
+// after the first few frames.
+//
+// Pools hold a mix of descriptor types in fixed ratios per set; a set that does not fit a fresh pool of
+// its chain is an error. Pools later in a chain are larger, so a frame needs few of them.
+//
+// allocate() may be called from several threads, e.g. by recording jobs.
+class DescriptorAllocator {
+
+public:
+
+    DescriptorAllocator() = default;
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+    void create(VkDevice device, uint32_t framesInFlight);
+    void destroy();
+
+    // After the frame ring waited for the slot `frameIndex`: the GPU is done with everything that slot
+    // allocated, so its pools are reset and its sets are handed out again from the start of the chain.
+    void beginFrame(uint32_t frameIndex);
+
+    // A set that stays valid until the current slot comes around again.
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct PoolRatio {
+        VkDescriptorType type;
+        float perSet;
+    };
+
+    // Descriptors per set a pool is sized for, by type.
+    static constexpr const PoolRatio POOL_RATIOS[] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.0f },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+    };
+    static constexpr const uint32_t FIRST_POOL_SETS = 256;
+    static constexpr const uint32_t MAX_POOL_SETS = 4096;
+
+    struct FramePools {
+        std::vector<VkDescriptorPool> pools;
+        // Index of the pool sets come from; pools before it are full.
+        size_t current = 0;
+        uint32_t allocatedSets = 0;
+    };
+
+    VkDescriptorPool createPool(uint32_t maxSets);
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::vector<FramePools> frames;
+    uint32_t currentFrame = 0;
+
+    mutable std::mutex mutex;
+    uint64_t totalSets = 0;
+    uint64_t poolsCreated = 0;
+    uint64_t poolResets = 0;
+    uint32_t peakSetsPerFrame = 0;
+};
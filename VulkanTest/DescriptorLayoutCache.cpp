@@ -0,0 +1,101 @@
+#include "DescriptorLayoutCache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::vector;
+
+void DescriptorLayoutCache::create(VkDevice device) {
+    this->device = device;
+}
+
+void DescriptorLayoutCache::destroy() {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (const auto& entry : this->layouts) {
+        vkDestroyDescriptorSetLayout(this->device, entry.second, HostAllocator::get().getCallbacks());
+    }
+    this->layouts.clear();
+}
+
+size_t DescriptorLayoutCache::KeyHash::operator()(const Key& key) const {
+    // FNV-1a over the words.
+    uint64_t hash = 14695981039346656037ull;
+    for (uint64_t word : key) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+DescriptorLayoutCache::Key DescriptorLayoutCache::makeKey(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount,
+    const VkDescriptorBindingFlags* bindingFlags, VkDescriptorSetLayoutCreateFlags flags) {
+    // Binding order in the create info does not matter to Vulkan, so it must not matter to the key either.
+    vector<uint32_t> order(bindingCount);
+    for (uint32_t i = 0; i < bindingCount; ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [bindings](uint32_t a, uint32_t b) { return bindings[a].binding < bindings[b].binding; });
+
+    Key key;
+    key.reserve(1 + bindingCount * 4);
+    key.push_back(flags);
+    for (uint32_t i : order) {
+        const VkDescriptorSetLayoutBinding& binding = bindings[i];
+        key.push_back((static_cast<uint64_t>(binding.binding) << 32) | static_cast<uint64_t>(binding.descriptorType));
+        key.push_back((static_cast<uint64_t>(binding.descriptorCount) << 32) | binding.stageFlags);
+        key.push_back(bindingFlags != nullptr ? bindingFlags[i] : 0);
+        // Immutable samplers are part of the layout; an unused count is not.
+        bool samplers = binding.pImmutableSamplers != nullptr &&
+            (binding.descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER || binding.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        key.push_back(samplers ? binding.descriptorCount : 0);
+        for (uint32_t s = 0; samplers && s < binding.descriptorCount; ++s) {
+            key.push_back(reinterpret_cast<uint64_t>(binding.pImmutableSamplers[s]));
+        }
+    }
+    return key;
+}
+
+VkDescriptorSetLayout DescriptorLayoutCache::getLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount,
+    const VkDescriptorBindingFlags* bindingFlags, VkDescriptorSetLayoutCreateFlags flags) {
+    Key key = makeKey(bindings, bindingCount, bindingFlags, flags);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto found = this->layouts.find(key);
+    if (found != this->layouts.end()) {
+        ++this->hits;
+        return found->second;
+    }
+
+    bool hasBindingFlags = bindingFlags != nullptr &&
+        std::any_of(bindingFlags, bindingFlags + bindingCount, [](VkDescriptorBindingFlags value) { return value != 0; });
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+    bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    bindingFlagsInfo.bindingCount = bindingCount;
+    bindingFlagsInfo.pBindingFlags = bindingFlags;
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = hasBindingFlags ? &bindingFlagsInfo : nullptr;
+    layoutInfo.flags = flags;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings;
+
+    VkDescriptorSetLayout layout;
+    if (vkCreateDescriptorSetLayout(this->device, &layoutInfo, HostAllocator::get().getCallbacks(), &layout) != VK_SUCCESS) {
+        throw runtime_error("failed to create descriptor set layout!");
+    }
+    ++this->misses;
+    this->layouts.emplace(std::move(key), layout);
+    return layout;
+}
+
+void DescriptorLayoutCache::printStatistics(ostream& out) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    out << "[Descriptor Layout Cache]" << '\n';
+    out << "\tLayouts: " << this->layouts.size() << '\n';
+    out << "\tLookups: " << (this->hits + this->misses) << " (" << this->hits << " hits, " << this->misses << " created)" << '\n';
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+// Hands out one VkDescriptorSetLayout per distinct set of bindings, so identical layouts are created once per
+// device no matter how many subsystems ask for them. Layouts are compatible for binding and pipeline layout
+// purposes only when their definitions match, so sharing the handle costs nothing and saves driver memory.
+//
+// A layout is keyed by its create flags and its bindings, sorted by binding number, including the binding
+// flags and any immutable sampler handles. The cache owns the layouts; callers never destroy them.
+//
+// Safe to call from several threads.
+class DescriptorLayoutCache {
+
+public:
+
+    DescriptorLayoutCache() = default;
+    DescriptorLayoutCache(const DescriptorLayoutCache&) = delete;
+    DescriptorLayoutCache& operator=(const DescriptorLayoutCache&) = delete;
+
+    void create(VkDevice device);
+    void destroy();
+
+    // `bindingFlags` is either nullptr or has an entry per binding; non-zero flags are chained in through
+    // VkDescriptorSetLayoutBindingFlagsCreateInfo.
+    VkDescriptorSetLayout getLayout(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount,
+        const VkDescriptorBindingFlags* bindingFlags = nullptr, VkDescriptorSetLayoutCreateFlags flags = 0);
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    // The whole definition flattened into words; equal keys mean identical layouts.
+    using Key = std::vector<uint64_t>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    static Key makeKey(const VkDescriptorSetLayoutBinding* bindings, uint32_t bindingCount,
+        const VkDescriptorBindingFlags* bindingFlags, VkDescriptorSetLayoutCreateFlags flags);
+
+    VkDevice device = VK_NULL_HANDLE;
+
+    mutable std::mutex mutex;
+    std::unordered_map<Key, VkDescriptorSetLayout, KeyHash> layouts;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
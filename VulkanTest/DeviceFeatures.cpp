@@ -0,0 +1,181 @@
+#include "DeviceFeatures.h"
+
+#include <algorithm>
+#include <cstring>
+
+using std::vector;
+using std::ostream;
+
+void DeviceFeatureChain::reset(uint32_t apiVersion) {
+    this->apiVersion = getApiVersionWithoutPatch(apiVersion);
+
+    this->features2 = {};
+    this->features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    this->features11 = {};
+    this->features11.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+    this->features12 = {};
+    this->features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    this->features13 = {};
+    this->features13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+
+    // The VkPhysicalDeviceVulkan1xFeatures structures were introduced in 1.2 and 1.3 respectively;
+    // chaining them on an older device is invalid usage.
+    if (this->apiVersion >= VK_API_VERSION_1_2) {
+        this->features2.pNext = &this->features11;
+        this->features11.pNext = &this->features12;
+    }
+    if (this->apiVersion >= VK_API_VERSION_1_3) {
+        this->features12.pNext = &this->features13;
+    }
+}
+
+void DeviceFeatureChain::query(VkPhysicalDevice device, uint32_t apiVersion) {
+    this->reset(apiVersion);
+
+    if (this->apiVersion >= VK_API_VERSION_1_1) {
+        vkGetPhysicalDeviceFeatures2(device, &this->features2);
+    } else {
+        vkGetPhysicalDeviceFeatures(device, &this->features2.features);
+    }
+}
+
+void DeviceFeatureChain::attach(VkDeviceCreateInfo& createInfo) const {
+    if (this->apiVersion >= VK_API_VERSION_1_1) {
+        createInfo.pNext = &this->features2;
+        createInfo.pEnabledFeatures = nullptr;
+    } else {
+        createInfo.pNext = nullptr;
+        createInfo.pEnabledFeatures = &this->features2.features;
+    }
+}
+
+uint32_t getInstanceApiVersion() {
+    auto func = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+    if (func == nullptr) {
+        return VK_API_VERSION_1_0;
+    }
+
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+    if (func(&apiVersion) != VK_SUCCESS) {
+        return VK_API_VERSION_1_0;
+    }
+    return apiVersion;
+}
+
+uint32_t getApiVersionWithoutPatch(uint32_t apiVersion) {
+    return VK_MAKE_API_VERSION(0, VK_API_VERSION_MAJOR(apiVersion), VK_API_VERSION_MINOR(apiVersion), 0);
+}
+
+static bool hasDeviceExtension(const vector<VkExtensionProperties>& extensions, const char* name) {
+    for (const auto& extension : extensions) {
+        if (strcmp(extension.extensionName, name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Turns a feature on exactly when the device supports it, and reports whether it did.
+static bool enableIfSupported(VkBool32 supported, VkBool32& enabled) {
+    enabled = supported;
+    return supported == VK_TRUE;
+}
+
+DeviceCapabilities negotiateDeviceFeatures(VkPhysicalDevice device, uint32_t instanceApiVersion, DeviceFeatureChain& enabled, vector<const char*>& extensions) {
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(device, &deviceProperties);
+
+    DeviceCapabilities capabilities;
+    capabilities.apiVersion = std::min(getApiVersionWithoutPatch(instanceApiVersion), getApiVersionWithoutPatch(deviceProperties.apiVersion));
+
+    DeviceFeatureChain supported;
+    supported.query(device, capabilities.apiVersion);
+    enabled.reset(capabilities.apiVersion);
+
+    const VkPhysicalDeviceFeatures& core = supported.features2.features;
+    VkPhysicalDeviceFeatures& coreEnabled = enabled.features2.features;
+    capabilities.multiDrawIndirect = enableIfSupported(core.multiDrawIndirect, coreEnabled.multiDrawIndirect);
+    capabilities.drawIndirectFirstInstance = enableIfSupported(core.drawIndirectFirstInstance, coreEnabled.drawIndirectFirstInstance);
+    capabilities.samplerAnisotropy = enableIfSupported(core.samplerAnisotropy, coreEnabled.samplerAnisotropy);
+    capabilities.descriptorArrayDynamicIndexing =
+        enableIfSupported(core.shaderSampledImageArrayDynamicIndexing, coreEnabled.shaderSampledImageArrayDynamicIndexing) &
+        enableIfSupported(core.shaderStorageBufferArrayDynamicIndexing, coreEnabled.shaderStorageBufferArrayDynamicIndexing);
+    capabilities.storageImageArrayDynamicIndexing =
+        enableIfSupported(core.shaderStorageImageArrayDynamicIndexing, coreEnabled.shaderStorageImageArrayDynamicIndexing);
+
+    if (capabilities.apiVersion >= VK_API_VERSION_1_2) {
+        const VkPhysicalDeviceVulkan12Features& f12 = supported.features12;
+        VkPhysicalDeviceVulkan12Features& e12 = enabled.features12;
+
+        capabilities.timelineSemaphores = enableIfSupported(f12.timelineSemaphore, e12.timelineSemaphore);
+        capabilities.bufferDeviceAddress = enableIfSupported(f12.bufferDeviceAddress, e12.bufferDeviceAddress);
+        capabilities.drawIndirectCount = enableIfSupported(f12.drawIndirectCount, e12.drawIndirectCount);
+        capabilities.samplerFilterMinmax = enableIfSupported(f12.samplerFilterMinmax, e12.samplerFilterMinmax);
+        capabilities.hostQueryReset = enableIfSupported(f12.hostQueryReset, e12.hostQueryReset);
+
+        capabilities.descriptorIndexing = f12.descriptorIndexing &&
+            f12.runtimeDescriptorArray &&
+            f12.descriptorBindingPartiallyBound &&
+            f12.descriptorBindingVariableDescriptorCount &&
+            f12.descriptorBindingSampledImageUpdateAfterBind &&
+            f12.descriptorBindingStorageBufferUpdateAfterBind &&
+            f12.descriptorBindingUpdateUnusedWhilePending &&
+            f12.shaderSampledImageArrayNonUniformIndexing &&
+            f12.shaderStorageBufferArrayNonUniformIndexing;
+        if (capabilities.descriptorIndexing) {
+            e12.descriptorIndexing = VK_TRUE;
+            e12.runtimeDescriptorArray = VK_TRUE;
+            e12.descriptorBindingPartiallyBound = VK_TRUE;
+            e12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+            e12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+            e12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+            e12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+            e12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            e12.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+        }
+    }
+
+    if (capabilities.apiVersion >= VK_API_VERSION_1_3) {
+        capabilities.dynamicRendering = enableIfSupported(supported.features13.dynamicRendering, enabled.features13.dynamicRendering);
+        capabilities.synchronization2 = enableIfSupported(supported.features13.synchronization2, enabled.features13.synchronization2);
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    vector<VkExtensionProperties> available(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, available.data());
+
+    // Both depend on VK_KHR_get_physical_device_properties2, which the instance only has as 1.1 core.
+    if (capabilities.apiVersion >= VK_API_VERSION_1_1) {
+        if (hasDeviceExtension(available, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME)) {
+            extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+            capabilities.calibratedTimestamps = true;
+        }
+        if (hasDeviceExtension(available, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+            extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            capabilities.memoryBudget = true;
+        }
+    }
+
+    return capabilities;
+}
+
+void printDeviceCapabilities(ostream& out, const DeviceCapabilities& capabilities) {
+    auto yesNo = [](bool value) { return value ? "yes" : "no"; };
+
+    out << "[Device Capabilities]" << '\n';
+    out << "\tAPI version: " << VK_API_VERSION_MAJOR(capabilities.apiVersion) << '.' << VK_API_VERSION_MINOR(capabilities.apiVersion) << '\n';
+    out << "\tDynamic rendering: " << yesNo(capabilities.dynamicRendering) << '\n';
+    out << "\tSynchronization2: " << yesNo(capabilities.synchronization2) << '\n';
+    out << "\tTimeline semaphores: " << yesNo(capabilities.timelineSemaphores) << '\n';
+    out << "\tDescriptor indexing: " << yesNo(capabilities.descriptorIndexing) << '\n';
+    out << "\tBuffer device address: " << yesNo(capabilities.bufferDeviceAddress) << '\n';
+    out << "\tDraw indirect count: " << yesNo(capabilities.drawIndirectCount) << '\n';
+    out << "\tSampler filter minmax: " << yesNo(capabilities.samplerFilterMinmax) << '\n';
+    out << "\tHost query reset: " << yesNo(capabilities.hostQueryReset) << '\n';
+    out << "\tMulti draw indirect: " << yesNo(capabilities.multiDrawIndirect) << '\n';
+    out << "\tDescriptor array dynamic indexing: " << yesNo(capabilities.descriptorArrayDynamicIndexing) << '\n';
+    out << "\tStorage image array dynamic indexing: " << yesNo(capabilities.storageImageArrayDynamicIndexing) << '\n';
+    out << "\tCalibrated timestamps: " << yesNo(capabilities.calibratedTimestamps) << '\n';
+    out << "\tMemory budget: " << yesNo(capabilities.memoryBudget) << '\n';
+}
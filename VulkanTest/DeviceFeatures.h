@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <ostream>
+#include <vector>
+
+// What the selected device can do beyond the Vulkan 1.0 baseline, resolved once in createLogicalDevice.
+// Subsystems check these flags to choose their fast paths instead of querying the device again.
+struct DeviceCapabilities {
+    // The lower of the instance and device versions, i.e. what may actually be used.
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+
+    // Vulkan 1.3
+    bool dynamicRendering = false;
+    bool synchronization2 = false;
+
+    // Vulkan 1.2
+    bool timelineSemaphores = false;
+    bool bufferDeviceAddress = false;
+    bool drawIndirectCount = false;
+    bool samplerFilterMinmax = false;
+    bool hostQueryReset = false;
+    // Everything a bindless descriptor table needs: runtime-sized, partially bound, update-after-bind
+    // arrays of sampled images and storage buffers, indexed non-uniformly from shaders.
+    bool descriptorIndexing = false;
+
+    // Vulkan 1.0
+    bool multiDrawIndirect = false;
+    bool drawIndirectFirstInstance = false;
+    bool samplerAnisotropy = false;
+    // Arrays of sampled images and storage buffers indexed with dynamically uniform values, e.g. push constants.
+    bool descriptorArrayDynamicIndexing = false;
+    // Arrays of storage images indexed with dynamically uniform values, e.g. a mip level in a loop.
+    bool storageImageArrayDynamicIndexing = false;
+
+    // Optional device extensions
+    bool calibratedTimestamps = false;
+    bool memoryBudget = false;
+};
+
+// Owns the feature structures that vkGetPhysicalDeviceFeatures2 fills and vkCreateDevice consumes.
+// The structures are linked through pNext pointers into this object, so it can be neither copied nor moved.
+class DeviceFeatureChain {
+
+public:
+
+    DeviceFeatureChain() = default;
+    DeviceFeatureChain(const DeviceFeatureChain&) = delete;
+    DeviceFeatureChain& operator=(const DeviceFeatureChain&) = delete;
+
+    // Clears every feature and links only the structures that exist at this API version.
+    void reset(uint32_t apiVersion);
+
+    // Fills the chain with everything the device supports at this API version.
+    void query(VkPhysicalDevice device, uint32_t apiVersion);
+
+    // Hands the chain to vkCreateDevice: through pNext from 1.1 on, through pEnabledFeatures on 1.0.
+    void attach(VkDeviceCreateInfo& createInfo) const;
+
+    VkPhysicalDeviceFeatures2 features2{};
+    VkPhysicalDeviceVulkan11Features features11{};
+    VkPhysicalDeviceVulkan12Features features12{};
+    VkPhysicalDeviceVulkan13Features features13{};
+
+private:
+
+    uint32_t apiVersion = VK_API_VERSION_1_0;
+};
+
+// vkEnumerateInstanceVersion does not exist on 1.0 loaders, in which case this is VK_API_VERSION_1_0.
+uint32_t getInstanceApiVersion();
+
+// Keeps only major and minor, so versions reported with different patch levels compare as expected.
+uint32_t getApiVersionWithoutPatch(uint32_t apiVersion);
+
+// Enables the performance-relevant subset of what the device supports into `enabled`, appends the optional
+// device extensions worth enabling to `extensions`, and returns the result.
+DeviceCapabilities negotiateDeviceFeatures(VkPhysicalDevice device, uint32_t instanceApiVersion, DeviceFeatureChain& enabled, std::vector<const char*>& extensions);
+
+void printDeviceCapabilities(std::ostream& out, const DeviceCapabilities& capabilities);
@@ -0,0 +1,361 @@
+#include "DeviceMemoryAllocator.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::unique_ptr;
+using std::vector;
+
+class DeviceMemoryBlock {
+
+public:
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    void* mappedData = nullptr;
+    uint32_t memoryTypeIndex = 0;
+    AllocationLifetime lifetime = AllocationLifetime::LongLived;
+    unique_ptr<SubAllocator> allocator;
+};
+
+namespace {
+
+constexpr const VkDeviceSize MAX_BLOCK_SIZE = 64ull * 1024 * 1024;
+constexpr const VkDeviceSize MIN_BLOCK_SIZE = 1ull * 1024 * 1024;
+
+VkDeviceSize getBlockSizeForHeap(VkDeviceSize heapSize) {
+    // Small heaps (BAR memory, integrated carve-outs) get blocks of an eighth of the heap,
+    // rounded down to a power of two so the buddy strategy can use them too.
+    VkDeviceSize blockSize = MIN_BLOCK_SIZE;
+    while (blockSize * 2 <= heapSize / 8 && blockSize * 2 <= MAX_BLOCK_SIZE) {
+        blockSize *= 2;
+    }
+    return blockSize;
+}
+
+unique_ptr<SubAllocator> createSubAllocator(AllocationLifetime lifetime, VkDeviceSize capacity, VkDeviceSize bufferImageGranularity) {
+    switch (lifetime) {
+    case AllocationLifetime::Transient: return std::make_unique<LinearSubAllocator>(capacity, bufferImageGranularity);
+    case AllocationLifetime::ShortLived: return std::make_unique<BuddySubAllocator>(capacity, bufferImageGranularity);
+    default: return std::make_unique<FreeListSubAllocator>(capacity, bufferImageGranularity);
+    }
+}
+
+double toMiB(VkDeviceSize bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+}
+
+const char* getAllocationLifetimeString(AllocationLifetime lifetime) {
+    switch (lifetime) {
+    case AllocationLifetime::Transient: return "Transient (linear)";
+    case AllocationLifetime::ShortLived: return "Short-lived (buddy)";
+    case AllocationLifetime::LongLived: return "Long-lived (free list)";
+    default: return "Unknown Allocation Lifetime";
+    }
+}
+
+DeviceMemoryAllocator::DeviceMemoryAllocator() = default;
+
+DeviceMemoryAllocator::~DeviceMemoryAllocator() = default;
+
+void DeviceMemoryAllocator::create(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t apiVersion) {
+    this->device = device;
+    this->dedicatedAllocation = apiVersion >= VK_API_VERSION_1_1;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &this->memoryProperties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    this->bufferImageGranularity = properties.limits.bufferImageGranularity;
+    this->maxMemoryAllocationCount = properties.limits.maxMemoryAllocationCount;
+
+    this->pools.resize(this->memoryProperties.memoryTypeCount);
+    for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i) {
+        uint32_t heapIndex = this->memoryProperties.memoryTypes[i].heapIndex;
+        this->pools[i].blockSize = getBlockSizeForHeap(this->memoryProperties.memoryHeaps[heapIndex].size);
+    }
+}
+
+void DeviceMemoryAllocator::destroy() {
+    for (MemoryTypePool& pool : this->pools) {
+        for (auto& blocks : pool.blocks) {
+            for (const unique_ptr<DeviceMemoryBlock>& block : blocks) {
+                this->freeDeviceMemory(block->memory);
+            }
+            blocks.clear();
+        }
+    }
+    this->pools.clear();
+}
+
+uint32_t DeviceMemoryAllocator::findMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags requiredProperties) const {
+    for (uint32_t i = 0; i < this->memoryProperties.memoryTypeCount; ++i) {
+        if ((typeBits & (1u << i)) && (this->memoryProperties.memoryTypes[i].propertyFlags & requiredProperties) == requiredProperties) {
+            return i;
+        }
+    }
+
+    throw runtime_error("failed to find suitable memory type!");
+}
+
+VkDeviceMemory DeviceMemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const void* pNext) {
+    if (this->deviceMemoryCount >= this->maxMemoryAllocationCount) {
+        throw runtime_error("exceeded maxMemoryAllocationCount!");
+    }
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.pNext = pNext;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(this->device, &allocInfo, HostAllocator::get().getCallbacks(), &memory) != VK_SUCCESS) {
+        throw runtime_error("failed to allocate device memory!");
+    }
+
+    ++this->deviceMemoryCount;
+    this->peakDeviceMemoryCount = std::max(this->peakDeviceMemoryCount, this->deviceMemoryCount);
+    return memory;
+}
+
+void DeviceMemoryAllocator::freeDeviceMemory(VkDeviceMemory memory) {
+    // Freeing implicitly unmaps.
+    vkFreeMemory(this->device, memory, HostAllocator::get().getCallbacks());
+    --this->deviceMemoryCount;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, VkBuffer buffer, VkImage image) {
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicatedInfo.buffer = buffer;
+    dedicatedInfo.image = image;
+
+    // Raw memory that several resources will share has no single owner to dedicate it to.
+    bool hasOwner = this->dedicatedAllocation && (buffer != VK_NULL_HANDLE || image != VK_NULL_HANDLE);
+
+    DeviceAllocation allocation;
+    allocation.memory = this->allocateDeviceMemory(requirements.size, memoryTypeIndex, hasOwner ? &dedicatedInfo : nullptr);
+    allocation.offset = 0;
+    allocation.size = requirements.size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+
+    if (this->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(this->device, allocation.memory, 0, VK_WHOLE_SIZE, 0, &allocation.mappedData) != VK_SUCCESS) {
+            throw runtime_error("failed to map device memory!");
+        }
+    }
+
+    ++this->dedicatedCount;
+    this->dedicatedBytes += requirements.size;
+    return allocation;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags requiredProperties,
+    AllocationLifetime lifetime, ResourceKind kind, bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage) {
+    uint32_t memoryTypeIndex = this->findMemoryTypeIndex(requirements.memoryTypeBits, requiredProperties);
+    MemoryTypePool& pool = this->pools[memoryTypeIndex];
+
+    // Large resources would mostly waste a shared block, and drivers can place dedicated ones better.
+    if (dedicated || requirements.size > pool.blockSize / 2) {
+        return this->allocateDedicated(requirements, memoryTypeIndex, dedicatedBuffer, dedicatedImage);
+    }
+
+    auto makeAllocation = [&](DeviceMemoryBlock* block, VkDeviceSize offset) {
+        DeviceAllocation allocation;
+        allocation.memory = block->memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.memoryTypeIndex = memoryTypeIndex;
+        allocation.mappedData = block->mappedData != nullptr ? static_cast<char*>(block->mappedData) + offset : nullptr;
+        allocation.block = block;
+        return allocation;
+    };
+
+    vector<unique_ptr<DeviceMemoryBlock>>& blocks = pool.blocks[static_cast<size_t>(lifetime)];
+    for (const unique_ptr<DeviceMemoryBlock>& block : blocks) {
+        std::optional<VkDeviceSize> offset = block->allocator->allocate(requirements.size, requirements.alignment, kind);
+        if (offset.has_value()) {
+            return makeAllocation(block.get(), *offset);
+        }
+    }
+
+    auto block = std::make_unique<DeviceMemoryBlock>();
+    block->memory = this->allocateDeviceMemory(pool.blockSize, memoryTypeIndex, nullptr);
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->lifetime = lifetime;
+    block->allocator = createSubAllocator(lifetime, pool.blockSize, this->bufferImageGranularity);
+
+    // Host-visible blocks stay mapped for their whole life; mapping per allocation would serialize in the driver.
+    if (this->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(this->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mappedData) != VK_SUCCESS) {
+            throw runtime_error("failed to map device memory!");
+        }
+    }
+
+    std::optional<VkDeviceSize> offset = block->allocator->allocate(requirements.size, requirements.alignment, kind);
+    if (!offset.has_value()) {
+        throw runtime_error("failed to sub-allocate device memory!");
+    }
+
+    blocks.push_back(std::move(block));
+    return makeAllocation(blocks.back().get(), *offset);
+}
+
+VkMemoryRequirements DeviceMemoryAllocator::getBufferRequirements(VkBuffer buffer, bool& dedicated) const {
+    dedicated = false;
+    if (!this->dedicatedAllocation) {
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(this->device, buffer, &requirements);
+        return requirements;
+    }
+
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    VkBufferMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.buffer = buffer;
+    vkGetBufferMemoryRequirements2(this->device, &requirementsInfo, &requirements);
+
+    dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+    return requirements.memoryRequirements;
+}
+
+VkMemoryRequirements DeviceMemoryAllocator::getImageRequirements(VkImage image, bool& dedicated) const {
+    dedicated = false;
+    if (!this->dedicatedAllocation) {
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(this->device, image, &requirements);
+        return requirements;
+    }
+
+    VkMemoryDedicatedRequirements dedicatedRequirements{};
+    dedicatedRequirements.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 requirements{};
+    requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    requirements.pNext = &dedicatedRequirements;
+
+    VkImageMemoryRequirementsInfo2 requirementsInfo{};
+    requirementsInfo.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2;
+    requirementsInfo.image = image;
+    vkGetImageMemoryRequirements2(this->device, &requirementsInfo, &requirements);
+
+    dedicated = dedicatedRequirements.requiresDedicatedAllocation || dedicatedRequirements.prefersDedicatedAllocation;
+    return requirements.memoryRequirements;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags requiredProperties, AllocationLifetime lifetime) {
+    bool dedicated = false;
+    VkMemoryRequirements requirements = this->getBufferRequirements(buffer, dedicated);
+    DeviceAllocation allocation = this->allocate(requirements, requiredProperties, lifetime, ResourceKind::Linear,
+        dedicated, buffer, VK_NULL_HANDLE);
+
+    if (vkBindBufferMemory(this->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        throw runtime_error("failed to bind buffer memory!");
+    }
+    return allocation;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags requiredProperties, AllocationLifetime lifetime) {
+    bool dedicated = false;
+    VkMemoryRequirements requirements = this->getImageRequirements(image, dedicated);
+    ResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+    DeviceAllocation allocation = this->allocate(requirements, requiredProperties, lifetime, kind,
+        dedicated, VK_NULL_HANDLE, image);
+
+    if (vkBindImageMemory(this->device, image, allocation.memory, allocation.offset) != VK_SUCCESS) {
+        throw runtime_error("failed to bind image memory!");
+    }
+    return allocation;
+}
+
+DeviceAllocation DeviceMemoryAllocator::allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags requiredProperties,
+    AllocationLifetime lifetime, ResourceKind kind) {
+    return this->allocate(requirements, requiredProperties, lifetime, kind, false, VK_NULL_HANDLE, VK_NULL_HANDLE);
+}
+
+void DeviceMemoryAllocator::free(DeviceAllocation& allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (allocation.block == nullptr) {
+        this->freeDeviceMemory(allocation.memory);
+        --this->dedicatedCount;
+        this->dedicatedBytes -= allocation.size;
+        allocation = DeviceAllocation{};
+        return;
+    }
+
+    DeviceMemoryBlock* block = allocation.block;
+    block->allocator->free(allocation.offset);
+    allocation = DeviceAllocation{};
+
+    // Keep one empty block per pool around so a resource that is recreated every frame does not
+    // turn into a vkAllocateMemory/vkFreeMemory pair every frame.
+    vector<unique_ptr<DeviceMemoryBlock>>& blocks = this->pools[block->memoryTypeIndex].blocks[static_cast<size_t>(block->lifetime)];
+    if (block->allocator->isEmpty() && blocks.size() > 1) {
+        auto it = std::find_if(blocks.begin(), blocks.end(), [block](const unique_ptr<DeviceMemoryBlock>& candidate) {
+            return candidate.get() == block;
+        });
+        this->freeDeviceMemory(block->memory);
+        blocks.erase(it);
+    }
+}
+
+void DeviceMemoryAllocator::printStatistics(ostream& out) const {
+    out << "[Device Memory]" << '\n';
+    out << '\t' << "Device memory objects: " << this->deviceMemoryCount << " (peak " << this->peakDeviceMemoryCount
+        << ", limit " << this->maxMemoryAllocationCount << ")" << '\n';
+    out << '\t' << "Dedicated: " << this->dedicatedCount << " allocations, " << toMiB(this->dedicatedBytes) << " MiB" << '\n';
+    out << '\t' << "bufferImageGranularity: " << this->bufferImageGranularity << '\n';
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    for (size_t typeIndex = 0; typeIndex < this->pools.size(); ++typeIndex) {
+        const MemoryTypePool& pool = this->pools[typeIndex];
+        for (size_t lifetime = 0; lifetime < ALLOCATION_LIFETIME_COUNT; ++lifetime) {
+            const vector<unique_ptr<DeviceMemoryBlock>>& blocks = pool.blocks[lifetime];
+            if (blocks.empty()) {
+                continue;
+            }
+
+            SubAllocatorStatistics total;
+            double fragmentation = 0.0;
+            for (const unique_ptr<DeviceMemoryBlock>& block : blocks) {
+                SubAllocatorStatistics statistics = block->allocator->getStatistics();
+                total.capacity += statistics.capacity;
+                total.used += statistics.used;
+                total.internalWaste += statistics.internalWaste;
+                total.allocationCount += statistics.allocationCount;
+                total.freeRangeCount += statistics.freeRangeCount;
+                fragmentation = std::max(fragmentation, statistics.getFragmentation());
+            }
+
+            out << '\t' << "Type " << typeIndex << " " << getAllocationLifetimeString(static_cast<AllocationLifetime>(lifetime)) << ": "
+                << blocks.size() << " x " << toMiB(pool.blockSize) << " MiB blocks, "
+                << toMiB(total.used) << " MiB used, " << total.allocationCount << " allocations, "
+                << total.freeRangeCount << " free ranges, worst fragmentation " << fragmentation * 100.0 << "%";
+            if (total.internalWaste > 0) {
+                out << ", " << toMiB(total.internalWaste) << " MiB rounding waste";
+            }
+            out << '\n';
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
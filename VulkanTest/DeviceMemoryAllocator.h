@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "SubAllocators.h"
+
+// Picks the placement strategy for an allocation's memory block.
+enum class AllocationLifetime {
+    // Released together (per frame or per load): linear bump allocation.
+    Transient,
+    // Created and destroyed often, similar sizes: buddy allocation.
+    ShortLived,
+    // Lives for a long time, arbitrary sizes: best-fit free list.
+    LongLived,
+};
+
+constexpr const size_t ALLOCATION_LIFETIME_COUNT = 3;
+
+const char* getAllocationLifetimeString(AllocationLifetime lifetime);
+
+class DeviceMemoryBlock;
+
+struct DeviceAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    // Points at offset inside a persistently mapped block; null unless the memory is host visible.
+    void* mappedData = nullptr;
+    uint32_t memoryTypeIndex = 0;
+
+    // Null for dedicated allocations, which own their VkDeviceMemory.
+    DeviceMemoryBlock* block = nullptr;
+};
+
+// Sub-allocates resources out of large VkDeviceMemory blocks, one set of blocks per memory type and lifetime,
+// so the number of vkAllocateMemory calls stays far below maxMemoryAllocationCount.
+class DeviceMemoryAllocator {
+
+public:
+
+    DeviceMemoryAllocator();
+    ~DeviceMemoryAllocator();
+
+    DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+    DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
+
+    // apiVersion is the one the device was created with; below 1.1 there are no dedicated allocations.
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, uint32_t apiVersion);
+    void destroy();
+
+    // Queries requirements (including the driver's dedicated-allocation preference) and binds the memory.
+    DeviceAllocation allocateForBuffer(VkBuffer buffer, VkMemoryPropertyFlags requiredProperties, AllocationLifetime lifetime);
+    DeviceAllocation allocateForImage(VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags requiredProperties, AllocationLifetime lifetime);
+
+    // Memory with nothing bound to it, for callers that place several resources into it themselves
+    // (e.g. aliased transient attachments). `requirements` must already cover all of them.
+    DeviceAllocation allocateMemory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags requiredProperties,
+        AllocationLifetime lifetime, ResourceKind kind);
+
+    void free(DeviceAllocation& allocation);
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct MemoryTypePool {
+        VkDeviceSize blockSize = 0;
+        std::array<std::vector<std::unique_ptr<DeviceMemoryBlock>>, ALLOCATION_LIFETIME_COUNT> blocks;
+    };
+
+    // The requirements and, from Vulkan 1.1, whether the driver asks for a dedicated allocation.
+    VkMemoryRequirements getBufferRequirements(VkBuffer buffer, bool& dedicated) const;
+    VkMemoryRequirements getImageRequirements(VkImage image, bool& dedicated) const;
+    uint32_t findMemoryTypeIndex(uint32_t typeBits, VkMemoryPropertyFlags requiredProperties) const;
+    VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, const void* pNext);
+    void freeDeviceMemory(VkDeviceMemory memory);
+
+    DeviceAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags requiredProperties,
+        AllocationLifetime lifetime, ResourceKind kind, bool dedicated, VkBuffer dedicatedBuffer, VkImage dedicatedImage);
+    DeviceAllocation allocateDedicated(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, VkBuffer buffer, VkImage image);
+
+    VkDevice device = VK_NULL_HANDLE;
+    // VkMemoryDedicatedAllocateInfo and the *MemoryRequirements2 queries are Vulkan 1.1.
+    bool dedicatedAllocation = false;
+    VkPhysicalDeviceMemoryProperties memoryProperties{};
+    VkDeviceSize bufferImageGranularity = 1;
+    uint32_t maxMemoryAllocationCount = 0;
+
+    std::vector<MemoryTypePool> pools;
+
+    uint32_t deviceMemoryCount = 0;
+    uint32_t peakDeviceMemoryCount = 0;
+    uint32_t dedicatedCount = 0;
+    VkDeviceSize dedicatedBytes = 0;
+};
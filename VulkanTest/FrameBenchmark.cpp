@@ -0,0 +1,192 @@
+#include "FrameBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "JsonWriter.h"
+
+using std::ifstream;
+using std::ofstream;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+constexpr const FrameBenchmark::Metric METRICS[] = {
+    FrameBenchmark::Metric::CpuFrame,
+    FrameBenchmark::Metric::GpuFrame,
+    FrameBenchmark::Metric::SubmitLatency,
+};
+
+// Nearest rank, as RollingTimings does it.
+double percentileOfSorted(const vector<double>& sorted, double p) {
+    size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+    return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+// Finds `"key":` after `from` and before `end`, returning the position just past the colon.
+optional<size_t> findKey(const string& text, const string& key, size_t from, size_t end) {
+    size_t found = text.find("\"" + key + "\"", from);
+    if (found == string::npos || found >= end) {
+        return nullopt;
+    }
+    size_t colon = text.find(':', found);
+    if (colon == string::npos || colon >= end) {
+        return nullopt;
+    }
+    return colon + 1;
+}
+
+// Reads a statistic of a metric from JSON written by writeJson(). Not a general JSON parser: it relies on
+// metric objects being flat, which holds for the files this class writes.
+optional<double> readBaselineValue(const string& text, const string& metric, const string& statistic) {
+    optional<size_t> metricStart = findKey(text, metric, 0, text.size());
+    if (!metricStart.has_value()) {
+        return nullopt;
+    }
+    size_t metricEnd = text.find('}', *metricStart);
+    optional<size_t> valueStart = findKey(text, statistic, *metricStart, metricEnd == string::npos ? text.size() : metricEnd);
+    if (!valueStart.has_value()) {
+        return nullopt;
+    }
+    try {
+        return std::stod(text.substr(*valueStart));
+    }
+    catch (const std::logic_error&) {
+        return nullopt;
+    }
+}
+
+}
+
+const char* FrameBenchmark::getMetricName(Metric metric) {
+    switch (metric) {
+    case Metric::CpuFrame: return "cpuFrameMs";
+    case Metric::GpuFrame: return "gpuFrameMs";
+    case Metric::SubmitLatency: return "submitLatencyMs";
+    }
+    return "unknown";
+}
+
+void FrameBenchmark::setDescription(const string& deviceName, uint32_t drawCount, uint32_t warmupFrames, uint32_t measuredFrames) {
+    this->deviceName = deviceName;
+    this->drawCount = drawCount;
+    this->warmupFrames = warmupFrames;
+    this->measuredFrames = measuredFrames;
+}
+
+void FrameBenchmark::reserve(size_t frames) {
+    for (vector<double>& series : this->samples) {
+        series.reserve(frames);
+    }
+}
+
+void FrameBenchmark::add(Metric metric, double ms) {
+    this->samples[static_cast<size_t>(metric)].push_back(ms);
+}
+
+FrameBenchmark::Summary FrameBenchmark::summarize(Metric metric) const {
+    vector<double> sorted = this->samples[static_cast<size_t>(metric)];
+    Summary summary;
+    summary.samples = sorted.size();
+    if (sorted.empty()) {
+        return summary;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    summary.p50 = percentileOfSorted(sorted, 0.50);
+    summary.p90 = percentileOfSorted(sorted, 0.90);
+    summary.p99 = percentileOfSorted(sorted, 0.99);
+    summary.max = sorted.back();
+    return summary;
+}
+
+void FrameBenchmark::print(ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    out << "[Frame Benchmark]" << '\n';
+    out << "\tDevice: " << this->deviceName << '\n';
+    out << "\tDraws: " << this->drawCount << ", " << this->warmupFrames << " warm-up + " << this->measuredFrames << " measured frames" << '\n';
+    for (Metric metric : METRICS) {
+        Summary summary = this->summarize(metric);
+        out << '\t' << getMetricName(metric) << ": ";
+        if (summary.samples == 0) {
+            out << "n/a" << '\n';
+            continue;
+        }
+        out << "p50 " << summary.p50 << ", p90 " << summary.p90 << ", p99 " << summary.p99 << ", max " << summary.max
+            << " (" << summary.samples << " samples)" << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void FrameBenchmark::writeJson(const string& path) const {
+    ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        throw runtime_error("failed to open benchmark results file: " + path);
+    }
+
+    file << std::fixed << std::setprecision(4);
+    file << "{\n";
+    file << "  \"benchmark\": \"frames\",\n";
+    file << "  \"device\": \"" << escapeJson(this->deviceName) << "\",\n";
+    file << "  \"draws\": " << this->drawCount << ",\n";
+    file << "  \"warmupFrames\": " << this->warmupFrames << ",\n";
+    file << "  \"measuredFrames\": " << this->measuredFrames << ",\n";
+    file << "  \"metrics\": {";
+    bool first = true;
+    for (Metric metric : METRICS) {
+        Summary summary = this->summarize(metric);
+        if (summary.samples == 0) {
+            continue;
+        }
+        file << (first ? "\n" : ",\n");
+        file << "    \"" << getMetricName(metric) << "\": { \"samples\": " << summary.samples << ", \"p50\": " << summary.p50
+            << ", \"p90\": " << summary.p90 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+        first = false;
+    }
+    file << "\n  }\n}\n";
+
+    if (!file) {
+        throw runtime_error("failed to write benchmark results file: " + path);
+    }
+}
+
+vector<FrameBenchmark::Regression> FrameBenchmark::compareWithBaseline(const string& path, double threshold) const {
+    ifstream file(path);
+    if (!file) {
+        throw runtime_error("failed to open benchmark baseline file: " + path);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    string text = contents.str();
+
+    vector<Regression> regressions;
+    for (Metric metric : METRICS) {
+        Summary summary = this->summarize(metric);
+        if (summary.samples == 0) {
+            continue;
+        }
+        const std::pair<const char*, double> statistics[] = { { "p50", summary.p50 }, { "p90", summary.p90 }, { "p99", summary.p99 } };
+        for (const auto& statistic : statistics) {
+            optional<double> baseline = readBaselineValue(text, getMetricName(metric), statistic.first);
+            if (!baseline.has_value()) {
+                regressions.push_back({ getMetricName(metric), statistic.first, 0.0, statistic.second, true });
+            } else if (statistic.second > *baseline * (1.0 + threshold)) {
+                regressions.push_back({ getMetricName(metric), statistic.first, *baseline, statistic.second, false });
+            }
+        }
+    }
+    return regressions;
+}
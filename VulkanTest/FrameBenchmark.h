@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Samples of the fixed-frame benchmark (--bench frames) and what is done with them: percentiles printed and
+// written as JSON, and an optional comparison against a JSON file of an earlier run.
+//
+// Every metric keeps all of its samples, so the percentiles are exact; a run is a few thousand frames at most.
+class FrameBenchmark {
+
+public:
+
+    enum class Metric {
+        // From the start of one frame to the start of the next, fence wait included.
+        CpuFrame,
+        // The frame's outermost GPU profiler scope.
+        GpuFrame,
+        // From vkQueueSubmit to the frame's last GPU timestamp, on the calibrated clock.
+        SubmitLatency,
+    };
+
+    static constexpr const size_t METRIC_COUNT = 3;
+
+    struct Summary {
+        size_t samples = 0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    struct Regression {
+        std::string metric;
+        std::string statistic;
+        double baselineMs;
+        double currentMs;
+        // The baseline has no value for this statistic, e.g. because it is stale or malformed; counts as a failure.
+        bool missingFromBaseline = false;
+    };
+
+    // Describes the run in the JSON, so a baseline from a different configuration is easy to spot.
+    void setDescription(const std::string& deviceName, uint32_t drawCount, uint32_t warmupFrames, uint32_t measuredFrames);
+
+    void reserve(size_t frames);
+    void add(Metric metric, double ms);
+
+    Summary summarize(Metric metric) const;
+
+    void print(std::ostream& out) const;
+    void writeJson(const std::string& path) const;
+
+    // Statistics (p50, p90, p99) that got slower than the baseline by more than the threshold, a fraction.
+    // Statistics the baseline lacks are reported as failures too; metrics this run did not measure are skipped.
+    // max is too noisy to gate on.
+    std::vector<Regression> compareWithBaseline(const std::string& path, double threshold) const;
+
+private:
+
+    static const char* getMetricName(Metric metric);
+
+    std::array<std::vector<double>, METRIC_COUNT> samples;
+    std::string deviceName;
+    uint32_t drawCount = 0;
+    uint32_t warmupFrames = 0;
+    uint32_t measuredFrames = 0;
+};
@@ -0,0 +1,183 @@
+#include "FrameRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+
+void TimingAccumulator::add(double ms) {
+    if (this->count == 0) {
+        this->minMs = ms;
+        this->maxMs = ms;
+    } else {
+        this->minMs = std::min(this->minMs, ms);
+        this->maxMs = std::max(this->maxMs, ms);
+    }
+    this->totalMs += ms;
+    ++this->count;
+}
+
+double TimingAccumulator::average() const {
+    return this->count == 0 ? 0.0 : this->totalMs / static_cast<double>(this->count);
+}
+
+void FrameRing::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight) {
+    if (framesInFlight == 0) {
+        throw runtime_error("at least one frame must be in flight!");
+    }
+
+    this->device = device;
+    this->frames.resize(framesInFlight);
+
+    for (Frame& frame : this->frames) {
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        // The pool only ever holds this frame's short-lived command buffers.
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        if (vkCreateCommandPool(this->device, &poolInfo, HostAllocator::get().getCallbacks(), &frame.commandPool) != VK_SUCCESS) {
+            throw runtime_error("failed to create command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(this->device, &allocInfo, &frame.commandBuffer) != VK_SUCCESS) {
+            throw runtime_error("failed to allocate command buffer!");
+        }
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        // Created signaled so that the first wait on every slot returns immediately.
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        if (vkCreateSemaphore(this->device, &semaphoreInfo, HostAllocator::get().getCallbacks(), &frame.imageAvailable) != VK_SUCCESS ||
+            vkCreateSemaphore(this->device, &semaphoreInfo, HostAllocator::get().getCallbacks(), &frame.renderFinished) != VK_SUCCESS ||
+            vkCreateFence(this->device, &fenceInfo, HostAllocator::get().getCallbacks(), &frame.inFlight) != VK_SUCCESS) {
+            throw runtime_error("failed to create synchronization objects for a frame!");
+        }
+    }
+}
+
+void FrameRing::destroy() {
+    for (Frame& frame : this->frames) {
+        vkDestroyFence(this->device, frame.inFlight, HostAllocator::get().getCallbacks());
+        vkDestroySemaphore(this->device, frame.renderFinished, HostAllocator::get().getCallbacks());
+        vkDestroySemaphore(this->device, frame.imageAvailable, HostAllocator::get().getCallbacks());
+        vkDestroyCommandPool(this->device, frame.commandPool, HostAllocator::get().getCallbacks());
+    }
+    this->frames.clear();
+}
+
+FrameRing::Frame& FrameRing::beginFrame() {
+    Frame& frame = this->frames[this->frameIndex];
+    this->currentFrameIndex = this->frameIndex;
+    this->frameIndex = (this->frameIndex + 1) % static_cast<uint32_t>(this->frames.size());
+
+    vkWaitForFences(this->device, 1, &frame.inFlight, VK_TRUE, UINT64_MAX);
+    this->completedSerial = std::max(this->completedSerial, frame.serial);
+
+    vkResetCommandPool(this->device, frame.commandPool, 0);
+
+    Clock::time_point now = Clock::now();
+    if (this->currentSerial > 0) {
+        this->cpuFrameTime.add(std::chrono::duration<double, std::milli>(now - this->lastBeginTime).count());
+    }
+    this->lastBeginTime = now;
+
+    frame.serial = ++this->currentSerial;
+    frame.beginTime = now;
+    return frame;
+}
+
+void FrameRing::beginCommandBuffer(Frame& frame) {
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(frame.commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw runtime_error("failed to begin recording command buffer!");
+    }
+}
+
+void FrameRing::endCommandBuffer(Frame& frame) {
+    if (vkEndCommandBuffer(frame.commandBuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to record command buffer!");
+    }
+}
+
+void FrameRing::submit(Frame& frame, VkQueue queue, VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore,
+    const TimelineWait& timelineWait) {
+    VkSemaphore waitSemaphores[2];
+    VkPipelineStageFlags waitStages[2];
+    // Values for binary semaphores are ignored, but the array has to line up with pWaitSemaphores.
+    uint64_t waitValues[2] = { 0, 0 };
+    uint32_t waitCount = 0;
+
+    if (waitSemaphore != VK_NULL_HANDLE) {
+        waitSemaphores[waitCount] = waitSemaphore;
+        waitStages[waitCount] = waitStage;
+        ++waitCount;
+    }
+    if (timelineWait.semaphore != VK_NULL_HANDLE) {
+        waitSemaphores[waitCount] = timelineWait.semaphore;
+        waitStages[waitCount] = timelineWait.stage;
+        waitValues[waitCount] = timelineWait.value;
+        ++waitCount;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if (timelineWait.semaphore != VK_NULL_HANDLE) {
+        submitInfo.pNext = &timelineInfo;
+    }
+    submitInfo.waitSemaphoreCount = waitCount;
+    submitInfo.pWaitSemaphores = waitSemaphores;
+    submitInfo.pWaitDstStageMask = waitStages;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &frame.commandBuffer;
+    if (signalSemaphore != VK_NULL_HANDLE) {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &signalSemaphore;
+    }
+
+    vkResetFences(this->device, 1, &frame.inFlight);
+
+    frame.submitTime = Clock::now();
+    if (vkQueueSubmit(queue, 1, &submitInfo, frame.inFlight) != VK_SUCCESS) {
+        throw runtime_error("failed to submit draw command buffer!");
+    }
+
+    this->cpuRecordTime.add(std::chrono::duration<double, std::milli>(frame.submitTime - frame.beginTime).count());
+}
+
+void FrameRing::printTimings(ostream& out) const {
+    auto printSeries = [&](const char* name, const TimingAccumulator& series) {
+        out << '\t' << name << ": ";
+        if (series.count == 0) {
+            out << "n/a" << '\n';
+            return;
+        }
+        out << "avg " << series.average() << " ms, min " << series.minMs << " ms, max " << series.maxMs << " ms" << '\n';
+    };
+
+    out << "[Frame Timing]" << '\n';
+    out << "\tFrames: " << this->currentSerial << " (" << this->frames.size() << " in flight)" << '\n';
+    printSeries("CPU frame", this->cpuFrameTime);
+    printSeries("CPU record + submit", this->cpuRecordTime);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Running min/avg/max of one timing series, in milliseconds.
+struct TimingAccumulator {
+    uint64_t count = 0;
+    double totalMs = 0.0;
+    double minMs = 0.0;
+    double maxMs = 0.0;
+
+    void add(double ms);
+    double average() const;
+};
+
+// A wait on a timeline semaphore value, added to a frame's submission next to its binary semaphore wait.
+struct TimelineWait {
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    uint64_t value = 0;
+    VkPipelineStageFlags stage = 0;
+};
+
+// N frames in flight, each slot owning everything needed to record and submit one frame.
+// While the GPU executes frame N the CPU records frame N+1 into the next slot; a slot is only reused once
+// its fence shows the GPU is done with it. Frames are numbered with increasing serials so other
+// subsystems (e.g. swapchain retirement) can tell when work that referenced a resource has completed.
+class FrameRing {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        // Reset wholesale with vkResetCommandPool when the slot comes around again, never per buffer.
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkSemaphore imageAvailable = VK_NULL_HANDLE;
+        VkSemaphore renderFinished = VK_NULL_HANDLE;
+        VkFence inFlight = VK_NULL_HANDLE;
+        uint64_t serial = 0;
+        Clock::time_point beginTime;
+        // When the slot's last command buffer went to the queue; kept until the slot is submitted again.
+        Clock::time_point submitTime;
+    };
+
+    void create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight);
+    void destroy();
+
+    // Waits until the next slot is free and resets its command pool.
+    // The fence is left signaled until submit(), so bailing out of a frame (e.g. on an out-of-date
+    // swapchain) never leaves the slot waiting on work that was not submitted.
+    Frame& beginFrame();
+
+    void beginCommandBuffer(Frame& frame);
+    void endCommandBuffer(Frame& frame);
+
+    void submit(Frame& frame, VkQueue queue, VkSemaphore waitSemaphore, VkPipelineStageFlags waitStage, VkSemaphore signalSemaphore,
+        const TimelineWait& timelineWait = {});
+
+    Frame& getFrame(uint32_t frameIndex) { return this->frames[frameIndex]; }
+    uint32_t getFramesInFlight() const { return static_cast<uint32_t>(this->frames.size()); }
+    // The serial of the frame most recently returned by beginFrame().
+    uint64_t getCurrentSerial() const { return this->currentSerial; }
+    // The slot of that frame, for state kept per frame in flight elsewhere.
+    uint32_t getCurrentFrameIndex() const { return this->currentFrameIndex; }
+    // Every frame with this serial or an older one has finished on the GPU.
+    uint64_t getCompletedSerial() const { return this->completedSerial; }
+
+    void printTimings(std::ostream& out) const;
+
+private:
+
+    VkDevice device = VK_NULL_HANDLE;
+    std::vector<Frame> frames;
+    uint32_t frameIndex = 0;
+    uint32_t currentFrameIndex = 0;
+    uint64_t currentSerial = 0;
+    uint64_t completedSerial = 0;
+
+    Clock::time_point lastBeginTime;
+    TimingAccumulator cpuFrameTime;
+    TimingAccumulator cpuRecordTime;
+};
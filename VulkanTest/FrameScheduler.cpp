@@ -0,0 +1,155 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using std::string;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+
+using Clock = std::chrono::steady_clock;
+
+optional<LoopMode> parseLoopMode(const string& text) {
+    if (text == "continuous") {
+        return LoopMode::Continuous;
+    } else if (text == "limit") {
+        return LoopMode::FpsLimit;
+    } else if (text == "on-demand") {
+        return LoopMode::OnDemand;
+    }
+    return nullopt;
+}
+
+const char* getLoopModeString(LoopMode mode) {
+    switch (mode) {
+    case LoopMode::Continuous: return "Continuous";
+    case LoopMode::FpsLimit: return "FPS Limit";
+    case LoopMode::OnDemand: return "On Demand";
+    default: return "Unknown Loop Mode";
+    }
+}
+
+double CpuUsageMeter::getProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return 0.0;
+    }
+    auto toSeconds = [](const FILETIME& time) {
+        ULARGE_INTEGER value;
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        // FILETIME counts 100 ns intervals.
+        return static_cast<double>(value.QuadPart) * 1.0e-7;
+    };
+    return toSeconds(kernelTime) + toSeconds(userTime);
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+        return 0.0;
+    }
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) * 1.0e-9;
+#endif
+}
+
+void CpuUsageMeter::start() {
+    this->wallStart = Clock::now();
+    this->cpuStart = getProcessCpuSeconds();
+}
+
+double CpuUsageMeter::getElapsedSeconds() const {
+    return std::chrono::duration<double>(Clock::now() - this->wallStart).count();
+}
+
+double CpuUsageMeter::getUtilizationPercent() const {
+    double wallSeconds = this->getElapsedSeconds();
+    if (wallSeconds <= 0.0) {
+        return 0.0;
+    }
+    return (getProcessCpuSeconds() - this->cpuStart) / wallSeconds * 100.0;
+}
+
+void FrameScheduler::configure(LoopMode mode, double targetFps) {
+    this->mode = mode;
+    this->targetFrameSeconds = targetFps > 0.0 ? 1.0 / targetFps : 0.0;
+}
+
+bool FrameScheduler::consumeRedraw() {
+    bool requested = this->redrawRequested;
+    this->redrawRequested = false;
+    return requested;
+}
+
+void FrameScheduler::start() {
+    this->nextFrameTime = Clock::now();
+    this->framesRendered = 0;
+    this->idleWakeups = 0;
+    this->cpuUsage.start();
+}
+
+void FrameScheduler::sleepPrecise(double seconds) {
+    while (seconds > this->sleepEstimate) {
+        Clock::time_point start = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double observed = std::chrono::duration<double>(Clock::now() - start).count();
+        seconds -= observed;
+
+        ++this->sleepCount;
+        double delta = observed - this->sleepMean;
+        this->sleepMean += delta / static_cast<double>(this->sleepCount);
+        this->sleepM2 += delta * (observed - this->sleepMean);
+        double stddev = std::sqrt(this->sleepM2 / static_cast<double>(this->sleepCount - 1));
+        this->sleepEstimate = this->sleepMean + stddev;
+    }
+
+    Clock::time_point spinStart = Clock::now();
+    while (std::chrono::duration<double>(Clock::now() - spinStart).count() < seconds) {
+        std::this_thread::yield();
+    }
+}
+
+void FrameScheduler::paceFrame() {
+    if (this->mode != LoopMode::FpsLimit || this->targetFrameSeconds <= 0.0) {
+        return;
+    }
+
+    this->nextFrameTime += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(this->targetFrameSeconds));
+
+    Clock::time_point now = Clock::now();
+    if (this->nextFrameTime <= now) {
+        // Running behind; restart the schedule instead of rendering a burst of frames to catch up.
+        this->nextFrameTime = now;
+        return;
+    }
+
+    this->sleepPrecise(std::chrono::duration<double>(this->nextFrameTime - now).count());
+}
+
+void FrameScheduler::printReport(ostream& out) const {
+    double seconds = this->cpuUsage.getElapsedSeconds();
+
+    out << "[Main Loop]" << '\n';
+    out << "\tMode: " << getLoopModeString(this->mode) << '\n';
+    out << "\tFrames: " << this->framesRendered << " in " << seconds << " s";
+    if (seconds > 0.0) {
+        out << " (" << static_cast<double>(this->framesRendered) / seconds << " fps)";
+    }
+    out << '\n';
+    if (this->mode == LoopMode::OnDemand) {
+        out << "\tIdle wake-ups: " << this->idleWakeups << '\n';
+    }
+    out << "\tCPU utilization: " << this->cpuUsage.getUtilizationPercent() << "% of one core" << '\n';
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+
+enum class LoopMode {
+    // Render as fast as the swapchain allows.
+    Continuous,
+    // Render at most targetFps frames per second, sleeping in between.
+    FpsLimit,
+    // Block in the event queue and render only when something changed.
+    OnDemand,
+};
+
+std::optional<LoopMode> parseLoopMode(const std::string& text);
+const char* getLoopModeString(LoopMode mode);
+
+// Process CPU time (user + kernel, all threads) against wall time since start().
+class CpuUsageMeter {
+
+public:
+
+    void start();
+    double getElapsedSeconds() const;
+    // 100% is one fully busy core.
+    double getUtilizationPercent() const;
+
+private:
+
+    static double getProcessCpuSeconds();
+
+    std::chrono::steady_clock::time_point wallStart;
+    double cpuStart = 0.0;
+};
+
+// Decides when the main loop renders, and measures what that costs in CPU time.
+class FrameScheduler {
+
+public:
+
+    void configure(LoopMode mode, double targetFps);
+
+    LoopMode getMode() const { return this->mode; }
+
+    // On-demand mode renders only after something asked for a redraw (input, resize, expose).
+    void requestRedraw() { this->redrawRequested = true; }
+    bool consumeRedraw();
+
+    // FPS-limit mode: sleeps until the next frame is due. Sleeping is coarse on most OSes, so it sleeps
+    // in short slices while the remaining time exceeds the observed oversleep, then spins for the rest.
+    void paceFrame();
+
+    void onFrameRendered() { ++this->framesRendered; }
+    void onIdleWake() { ++this->idleWakeups; }
+
+    void start();
+    void printReport(std::ostream& out) const;
+
+private:
+
+    void sleepPrecise(double seconds);
+
+    LoopMode mode = LoopMode::Continuous;
+    double targetFrameSeconds = 1.0 / 60.0;
+    bool redrawRequested = true;
+
+    std::chrono::steady_clock::time_point nextFrameTime;
+
+    // Running estimate of how long a 1 ms sleep really takes (Welford mean/variance).
+    double sleepEstimate = 0.005;
+    double sleepMean = 0.005;
+    double sleepM2 = 0.0;
+    uint64_t sleepCount = 1;
+
+    CpuUsageMeter cpuUsage;
+    uint64_t framesRendered = 0;
+    uint64_t idleWakeups = 0;
+};
@@ -0,0 +1,60 @@
+#include "Frustum.h"
+
+#include <cmath>
+
+namespace {
+
+// Element (row, column) of a column-major 4x4 matrix.
+float element(const float matrix[16], uint32_t row, uint32_t column) {
+    return matrix[column * 4 + row];
+}
+
+}
+
+Frustum extractFrustum(const float viewProjection[16]) {
+    // Gribb and Hartmann: with clip = M * p, the clip-space conditions -w <= x <= w, -w <= y <= w and
+    // 0 <= z <= w are each a linear combination of rows of M.
+    const float signs[Frustum::PLANE_COUNT][2] = {
+        { 1.0f, 1.0f }, { 1.0f, -1.0f },   // w + x, w - x
+        { 1.0f, 1.0f }, { 1.0f, -1.0f },   // w + y, w - y
+        { 0.0f, 1.0f }, { 1.0f, -1.0f },   // z, w - z
+    };
+    const uint32_t rows[Frustum::PLANE_COUNT] = { 0, 0, 1, 1, 2, 2 };
+
+    Frustum frustum;
+    for (uint32_t i = 0; i < Frustum::PLANE_COUNT; ++i) {
+        float* plane = frustum.planes[i];
+        for (uint32_t column = 0; column < 4; ++column) {
+            plane[column] = signs[i][0] * element(viewProjection, 3, column) + signs[i][1] * element(viewProjection, rows[i], column);
+        }
+        float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (uint32_t column = 0; column < 4; ++column) {
+                plane[column] /= length;
+            }
+        }
+    }
+    return frustum;
+}
+
+bool isSphereVisible(const Frustum& frustum, const float center[3], float radius) {
+    for (const float* plane : frustum.planes) {
+        if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void makeOrthographicViewProjection(float centerX, float centerY, float halfSize, float viewProjection[16]) {
+    for (uint32_t i = 0; i < 16; ++i) {
+        viewProjection[i] = 0.0f;
+    }
+    viewProjection[0] = 1.0f / halfSize;
+    viewProjection[5] = 1.0f / halfSize;
+    viewProjection[10] = 0.5f;
+    viewProjection[12] = -centerX / halfSize;
+    viewProjection[13] = -centerY / halfSize;
+    viewProjection[14] = 0.5f;
+    viewProjection[15] = 1.0f;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// Six planes (a, b, c, d) with normals pointing inside: a point p is inside a plane when a*px + b*py + c*pz + d >= 0.
+// Planes are normalized, so the same expression is the signed distance and bounding spheres test against it
+// directly. Order: left, right, bottom, top, near, far.
+struct Frustum {
+    static constexpr const uint32_t PLANE_COUNT = 6;
+
+    float planes[PLANE_COUNT][4];
+};
+
+// `viewProjection` is column-major, as GLSL reads a mat4, and maps to Vulkan clip space (depth in [0, 1]).
+Frustum extractFrustum(const float viewProjection[16]);
+
+bool isSphereVisible(const Frustum& frustum, const float center[3], float radius);
+
+// Looks down the z axis at (centerX, centerY), seeing halfSize world units to each side; z in [-1, 1] maps to
+// depth [0, 1]. Column-major.
+void makeOrthographicViewProjection(float centerX, float centerY, float halfSize, float viewProjection[16]);
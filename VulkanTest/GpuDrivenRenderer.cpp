@@ -0,0 +1,635 @@
+#include "GpuDrivenRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+#include "ShaderModule.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+}
+
+const char* getIndirectDrawModeString(IndirectDrawMode mode) {
+    switch (mode) {
+    case IndirectDrawMode::Count: return "draw indirect count";
+    case IndirectDrawMode::MultiDraw: return "multi draw indirect";
+    case IndirectDrawMode::SingleDraws: return "single indirect draws";
+    }
+    return "unknown";
+}
+
+bool GpuDrivenRenderer::isSupported(const DeviceCapabilities& capabilities) {
+    return capabilities.drawIndirectFirstInstance;
+}
+
+void GpuDrivenRenderer::create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, BindlessTable& bindless,
+    DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors, const DeviceCapabilities& capabilities,
+    const VkPhysicalDeviceLimits& limits, const SceneRenderer& scene, VkFormat colorFormat, VkPipelineCache pipelineCache,
+    const string& shaderDirectory, uint32_t gridCount, uint32_t framesInFlight) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->bindless = &bindless;
+    this->descriptors = &descriptors;
+    this->materialSlot = scene.getMaterialSlot();
+    this->gridCount = gridCount;
+    this->instanceCount = gridCount + OCCLUDER_COLUMNS * OCCLUDER_COLUMNS;
+    this->maxDrawIndirectCount = std::max(1u, limits.maxDrawIndirectCount);
+    this->occlusionSupported = DepthPyramid::isSupported(capabilities);
+
+    // A count draw cannot be split, so it has to fit the limit in one call.
+    if (capabilities.drawIndirectCount && this->instanceCount <= this->maxDrawIndirectCount) {
+        this->mode = IndirectDrawMode::Count;
+    } else if (capabilities.multiDrawIndirect) {
+        this->mode = IndirectDrawMode::MultiDraw;
+    } else {
+        this->mode = IndirectDrawMode::SingleDraws;
+    }
+
+    this->createInstances(uploads, gridCount);
+
+    this->frames.resize(framesInFlight);
+    for (FrameBuffers& frame : this->frames) {
+        frame.drawCommands = this->createBuffer(this->getDrawCommandsSize(),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.drawCommandsAllocation);
+        frame.counters = this->createBuffer(this->getCountersSize(),
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.countersAllocation);
+        frame.camera = this->createBuffer(sizeof(CullCamera), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.cameraAllocation);
+        frame.readback = this->createBuffer(this->getCountersSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.readbackAllocation);
+    }
+
+    this->clearRenderPass = this->createRenderPass(colorFormat, VK_ATTACHMENT_LOAD_OP_CLEAR);
+    this->loadRenderPass = this->createRenderPass(colorFormat, VK_ATTACHMENT_LOAD_OP_LOAD);
+    this->createCullPipelines(layouts, pipelineCache, shaderDirectory);
+    this->createDrawPipeline(scene, pipelineCache, shaderDirectory);
+
+    if (this->occlusionSupported) {
+        this->depthPyramid.create(device, allocator, uploads, layouts, descriptors, pipelineCache, shaderDirectory);
+    }
+}
+
+void GpuDrivenRenderer::destroy() {
+    if (this->occlusionSupported) {
+        this->depthPyramid.destroy();
+    }
+
+    vkDestroyPipeline(this->device, this->drawPipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipelineLayout(this->device, this->drawPipelineLayout, HostAllocator::get().getCallbacks());
+    vkDestroyPipeline(this->device, this->lateCullPipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipelineLayout(this->device, this->lateCullPipelineLayout, HostAllocator::get().getCallbacks());
+    vkDestroyPipeline(this->device, this->earlyCullPipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipeline(this->device, this->frustumCullPipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipelineLayout(this->device, this->cullPipelineLayout, HostAllocator::get().getCallbacks());
+    vkDestroyRenderPass(this->device, this->loadRenderPass, HostAllocator::get().getCallbacks());
+    vkDestroyRenderPass(this->device, this->clearRenderPass, HostAllocator::get().getCallbacks());
+
+    for (FrameBuffers& frame : this->frames) {
+        vkDestroyBuffer(this->device, frame.drawCommands, HostAllocator::get().getCallbacks());
+        this->allocator->free(frame.drawCommandsAllocation);
+        vkDestroyBuffer(this->device, frame.counters, HostAllocator::get().getCallbacks());
+        this->allocator->free(frame.countersAllocation);
+        vkDestroyBuffer(this->device, frame.camera, HostAllocator::get().getCallbacks());
+        this->allocator->free(frame.cameraAllocation);
+        vkDestroyBuffer(this->device, frame.readback, HostAllocator::get().getCallbacks());
+        this->allocator->free(frame.readbackAllocation);
+    }
+    this->frames.clear();
+
+    // Only called once the device is idle.
+    this->bindless->release(BindlessTable::Kind::StorageBuffer, this->instanceSlot, 0);
+    vkDestroyBuffer(this->device, this->instanceBuffer, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->instanceAllocation);
+    vkDestroyBuffer(this->device, this->indexBuffer, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->indexAllocation);
+    vkDestroyBuffer(this->device, this->visibility, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->visibilityAllocation);
+}
+
+VkDeviceSize GpuDrivenRenderer::getDrawCommandsSize() const {
+    return 2 * sizeof(VkDrawIndexedIndirectCommand) * static_cast<VkDeviceSize>(this->instanceCount);
+}
+
+void GpuDrivenRenderer::resizeDepthPyramid(VkExtent2D depthExtent, uint64_t lastUseSerial) {
+    this->depthPyramid.resize(depthExtent, lastUseSerial);
+}
+
+VkFramebuffer GpuDrivenRenderer::createFramebuffer(VkImageView colorView, VkImageView depthView, VkExtent2D extent) const {
+    VkImageView attachments[2] = { colorView, depthView };
+
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = this->clearRenderPass;
+    framebufferInfo.attachmentCount = 2;
+    framebufferInfo.pAttachments = attachments;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(this->device, &framebufferInfo, HostAllocator::get().getCallbacks(), &framebuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create GPU-driven framebuffer!");
+    }
+    return framebuffer;
+}
+
+VkBuffer GpuDrivenRenderer::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    DeviceAllocation& allocation) {
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(this->device, &bufferInfo, HostAllocator::get().getCallbacks(), &buffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create GPU-driven buffer!");
+    }
+    allocation = this->allocator->allocateForBuffer(buffer, properties, AllocationLifetime::LongLived);
+    return buffer;
+}
+
+void GpuDrivenRenderer::createInstances(UploadService& uploads, uint32_t gridCount) {
+    vector<Instance> instances(this->instanceCount);
+
+    // The same grid as SceneRenderer::recordDraws, in world units.
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(std::max(1u, gridCount)))));
+    float cellSize = 2.0f / static_cast<float>(columns);
+    for (uint32_t i = 0; i < gridCount; ++i) {
+        Instance& instance = instances[i];
+        instance.center[0] = -1.0f + (static_cast<float>(i % columns) + 0.5f) * cellSize;
+        instance.center[1] = -1.0f + (static_cast<float>(i / columns) + 0.5f) * cellSize;
+        instance.center[2] = 0.0f;
+        instance.scale = cellSize * 0.9f;
+        instance.material = i % SceneRenderer::MATERIAL_COUNT;
+    }
+
+    // Nearer to the camera than the grid, each hiding a good part of the grid cells behind it.
+    float occluderCellSize = 2.0f / static_cast<float>(OCCLUDER_COLUMNS);
+    for (uint32_t i = 0; i < OCCLUDER_COLUMNS * OCCLUDER_COLUMNS; ++i) {
+        Instance& instance = instances[gridCount + i];
+        instance.center[0] = -1.0f + (static_cast<float>(i % OCCLUDER_COLUMNS) + 0.5f) * occluderCellSize;
+        instance.center[1] = -1.0f + (static_cast<float>(i / OCCLUDER_COLUMNS) + 0.5f) * occluderCellSize;
+        instance.center[2] = OCCLUDER_Z;
+        instance.scale = occluderCellSize * 0.9f;
+        instance.material = SceneRenderer::MATERIAL_COUNT - 1;
+    }
+
+    for (Instance& instance : instances) {
+        instance.radius = instance.scale * TRIANGLE_RADIUS;
+        instance.padding[0] = 0.0f;
+        instance.padding[1] = 0.0f;
+    }
+
+    VkDeviceSize instanceBytes = sizeof(Instance) * instances.size();
+    this->instanceBuffer = this->createBuffer(instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->instanceAllocation);
+    uploads.uploadBuffer(this->instanceBuffer, 0, instances.data(), instanceBytes);
+    this->instanceSlot = this->bindless->addStorageBuffer(this->instanceBuffer, 0, instanceBytes);
+
+    // Vertices still come from the shader; the indices only exist because indirect draws are indexed. The
+    // fourth is padding, since copies of buffer data are sized in whole words.
+    const uint16_t indices[4] = { 0, 1, 2, 0 };
+    this->indexBuffer = this->createBuffer(sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->indexAllocation);
+    uploads.uploadBuffer(this->indexBuffer, 0, indices, sizeof(indices));
+
+    // Nothing was visible before the first frame: its early pass draws nothing and its late pass everything.
+    vector<uint32_t> visible(this->instanceCount, 0);
+    this->visibility = this->createBuffer(this->getVisibilitySize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, this->visibilityAllocation);
+    uploads.uploadBuffer(this->visibility, 0, visible.data(), this->getVisibilitySize());
+}
+
+VkRenderPass GpuDrivenRenderer::createRenderPass(VkFormat colorFormat, VkAttachmentLoadOp loadOp) {
+    VkAttachmentDescription attachments[2]{};
+    attachments[0].format = colorFormat;
+    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+    attachments[0].loadOp = loadOp;
+    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // Stored even by the late pass, which keeps both render passes compatible with one framebuffer.
+    attachments[1] = attachments[0];
+    attachments[1].format = DEPTH_FORMAT;
+    attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthAttachmentRef{};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 2;
+    renderPassInfo.pAttachments = attachments;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    VkRenderPass renderPass;
+    if (vkCreateRenderPass(this->device, &renderPassInfo, HostAllocator::get().getCallbacks(), &renderPass) != VK_SUCCESS) {
+        throw runtime_error("failed to create GPU-driven render pass!");
+    }
+    return renderPass;
+}
+
+VkPipeline GpuDrivenRenderer::createCullPipeline(VkPipelineLayout layout, const string& path, VkBool32 early, VkPipelineCache pipelineCache) {
+    // Compacting only pays off when the draw reads the count; otherwise every instance keeps its own command.
+    VkBool32 constants[2] = { this->mode == IndirectDrawMode::Count ? VK_TRUE : VK_FALSE, early };
+    VkSpecializationMapEntry specializationEntries[2]{};
+    for (uint32_t i = 0; i < 2; ++i) {
+        specializationEntries[i].constantID = i;
+        specializationEntries[i].offset = i * sizeof(VkBool32);
+        specializationEntries[i].size = sizeof(VkBool32);
+    }
+
+    // cull_late.comp has no EARLY constant; entries for constants a shader lacks are ignored.
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 2;
+    specializationInfo.pMapEntries = specializationEntries;
+    specializationInfo.dataSize = sizeof(constants);
+    specializationInfo.pData = constants;
+
+    VkShaderModule computeShaderModule = createShaderModule(this->device, path);
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeShaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipelineInfo.layout = layout;
+
+    VkPipeline pipeline;
+    VkResult result = vkCreateComputePipelines(this->device, pipelineCache, 1, &pipelineInfo, HostAllocator::get().getCallbacks(), &pipeline);
+
+    vkDestroyShaderModule(this->device, computeShaderModule, HostAllocator::get().getCallbacks());
+
+    if (result != VK_SUCCESS) {
+        throw runtime_error("failed to create cull pipeline!");
+    }
+    return pipeline;
+}
+
+void GpuDrivenRenderer::createCullPipelines(DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const string& shaderDirectory) {
+    // Instances, draw commands, counters, visibility, camera.
+    VkDescriptorSetLayoutBinding bindings[5]{};
+    for (uint32_t i = 0; i < 5; ++i) {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    this->cullSetLayout = layouts.getLayout(bindings, 5);
+
+    VkDescriptorSetLayoutBinding pyramidBinding{};
+    pyramidBinding.binding = 0;
+    pyramidBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidBinding.descriptorCount = 1;
+    pyramidBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    this->pyramidSetLayout = layouts.getLayout(&pyramidBinding, 1);
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullConstants);
+
+    VkDescriptorSetLayout setLayouts[2] = { this->cullSetLayout, this->pyramidSetLayout };
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = setLayouts;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, HostAllocator::get().getCallbacks(), &this->cullPipelineLayout) != VK_SUCCESS) {
+        throw runtime_error("failed to create cull pipeline layout!");
+    }
+    this->frustumCullPipeline = this->createCullPipeline(this->cullPipelineLayout, shaderDirectory + "cull.comp.spv", VK_FALSE, pipelineCache);
+
+    if (!this->occlusionSupported) {
+        return;
+    }
+
+    pipelineLayoutInfo.setLayoutCount = 2;
+    if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, HostAllocator::get().getCallbacks(), &this->lateCullPipelineLayout) != VK_SUCCESS) {
+        throw runtime_error("failed to create late cull pipeline layout!");
+    }
+    this->earlyCullPipeline = this->createCullPipeline(this->cullPipelineLayout, shaderDirectory + "cull.comp.spv", VK_TRUE, pipelineCache);
+    this->lateCullPipeline = this->createCullPipeline(this->lateCullPipelineLayout, shaderDirectory + "cull_late.comp.spv", VK_FALSE, pipelineCache);
+}
+
+void GpuDrivenRenderer::createDrawPipeline(const SceneRenderer& scene, VkPipelineCache pipelineCache, const string& shaderDirectory) {
+    VkShaderModule vertShaderModule = createShaderModule(this->device, shaderDirectory + "gpu_driven.vert.spv");
+    VkShaderModule fragShaderModule = createShaderModule(this->device, shaderDirectory + "triangle.frag.spv");
+
+    uint32_t storageBufferCount = this->bindless->getCapacity(BindlessTable::Kind::StorageBuffer);
+    VkSpecializationMapEntry specializationEntry{};
+    specializationEntry.constantID = 0;
+    specializationEntry.offset = 0;
+    specializationEntry.size = sizeof(storageBufferCount);
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &specializationEntry;
+    specializationInfo.dataSize = sizeof(storageBufferCount);
+    specializationInfo.pData = &storageBufferCount;
+
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[0].pSpecializationInfo = &specializationInfo;
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawConstants);
+
+    VkDescriptorSetLayout setLayout = this->bindless->getLayout();
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, HostAllocator::get().getCallbacks(), &this->drawPipelineLayout) != VK_SUCCESS) {
+        throw runtime_error("failed to create GPU-driven pipeline layout!");
+    }
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil{};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = VK_TRUE;
+    depthStencil.depthWriteEnable = VK_TRUE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    VkResult result = scene.createGraphicsPipeline(pipelineCache, shaderStages, this->drawPipelineLayout, this->clearRenderPass,
+        &depthStencil, &this->drawPipeline);
+
+    vkDestroyShaderModule(this->device, fragShaderModule, HostAllocator::get().getCallbacks());
+    vkDestroyShaderModule(this->device, vertShaderModule, HostAllocator::get().getCallbacks());
+
+    if (result != VK_SUCCESS) {
+        throw runtime_error("failed to create GPU-driven graphics pipeline!");
+    }
+}
+
+void GpuDrivenRenderer::beginFrame(uint32_t frameIndex, uint64_t serial, uint64_t completedSerial) {
+    this->currentFrame = frameIndex;
+
+    FrameBuffers& frame = this->frames[frameIndex];
+    if (frame.readbackPending) {
+        const CullCounters& counters = *static_cast<const CullCounters*>(frame.readbackAllocation.mappedData);
+        CullTotals& totals = frame.occlusion ? this->occlusionTotals : this->frustumTotals;
+        ++totals.frames;
+        totals.early += counters.drawCounts[0];
+        if (frame.occlusion) {
+            totals.inFrustum += counters.inFrustum;
+            totals.occluded += counters.occluded;
+            totals.late += counters.drawCounts[1];
+        } else {
+            totals.inFrustum += counters.drawCounts[0];
+        }
+        frame.readbackPending = false;
+    }
+
+    if (this->occlusionSupported) {
+        this->depthPyramid.collectRetired(completedSerial);
+    }
+
+    double angle = 2.0 * PI * static_cast<double>(serial % CAMERA_ORBIT_FRAMES) / CAMERA_ORBIT_FRAMES;
+    makeOrthographicViewProjection(CAMERA_ORBIT_RADIUS * static_cast<float>(std::cos(angle)),
+        CAMERA_ORBIT_RADIUS * static_cast<float>(std::sin(angle)), CAMERA_HALF_SIZE, this->viewProjection);
+    Frustum frustum = extractFrustum(this->viewProjection);
+
+    // The frame that last used this slot's camera has completed.
+    CullCamera& camera = *static_cast<CullCamera*>(frame.cameraAllocation.mappedData);
+    std::copy(this->viewProjection, this->viewProjection + 16, camera.viewProjection);
+    std::copy(&frustum.planes[0][0], &frustum.planes[0][0] + Frustum::PLANE_COUNT * 4, &camera.planes[0][0]);
+}
+
+void GpuDrivenRenderer::recordResetCounters(VkCommandBuffer commandBuffer) {
+    FrameBuffers& frame = this->frames[this->currentFrame];
+    frame.occlusion = false;
+    vkCmdFillBuffer(commandBuffer, frame.counters, 0, this->getCountersSize(), 0);
+}
+
+void GpuDrivenRenderer::recordCull(VkCommandBuffer commandBuffer, CullPass pass) {
+    FrameBuffers& frame = this->frames[this->currentFrame];
+
+    // Returned wholesale when this slot comes around again.
+    VkDescriptorSet set = this->descriptors->allocate(this->cullSetLayout);
+    VkDescriptorBufferInfo bufferInfos[5] = {
+        { this->instanceBuffer, 0, VK_WHOLE_SIZE },
+        { frame.drawCommands, 0, VK_WHOLE_SIZE },
+        { frame.counters, 0, VK_WHOLE_SIZE },
+        { this->visibility, 0, VK_WHOLE_SIZE },
+        { frame.camera, 0, VK_WHOLE_SIZE },
+    };
+    VkWriteDescriptorSet writes[5]{};
+    for (uint32_t i = 0; i < 5; ++i) {
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(this->device, 5, writes, 0, nullptr);
+
+    CullConstants constants{};
+    constants.instanceCount = this->instanceCount;
+    constants.phase = pass == CullPass::Late ? 1 : 0;
+
+    VkPipelineLayout layout = this->cullPipelineLayout;
+    switch (pass) {
+    case CullPass::Frustum:
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->frustumCullPipeline);
+        break;
+    case CullPass::Early:
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->earlyCullPipeline);
+        break;
+    case CullPass::Late: {
+        layout = this->lateCullPipelineLayout;
+        frame.occlusion = true;
+        constants.depthSize[0] = static_cast<int32_t>(this->depthPyramid.getDepthExtent().width);
+        constants.depthSize[1] = static_cast<int32_t>(this->depthPyramid.getDepthExtent().height);
+        constants.pyramidLevels = static_cast<int32_t>(this->depthPyramid.getLevelCount());
+
+        VkDescriptorSet pyramidSet = this->descriptors->allocate(this->pyramidSetLayout);
+        VkDescriptorImageInfo pyramidInfo{ this->depthPyramid.getSampler(), this->depthPyramid.getView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+        VkWriteDescriptorSet pyramidWrite{};
+        pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        pyramidWrite.dstSet = pyramidSet;
+        pyramidWrite.dstBinding = 0;
+        pyramidWrite.descriptorCount = 1;
+        pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pyramidWrite.pImageInfo = &pyramidInfo;
+        vkUpdateDescriptorSets(this->device, 1, &pyramidWrite, 0, nullptr);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, this->lateCullPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 1, 1, &pyramidSet, 0, nullptr);
+        break;
+    }
+    }
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(commandBuffer, (this->instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void GpuDrivenRenderer::recordDepthPyramid(VkCommandBuffer commandBuffer, VkImageView depthView) {
+    this->depthPyramid.recordBuild(commandBuffer, depthView);
+}
+
+void GpuDrivenRenderer::recordDraws(VkCommandBuffer commandBuffer, VkExtent2D extent, CullPass pass) const {
+    const FrameBuffers& frame = this->frames[this->currentFrame];
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->drawPipeline);
+    this->bindless->bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->drawPipelineLayout, 0);
+    vkCmdBindIndexBuffer(commandBuffer, this->indexBuffer, 0, VK_INDEX_TYPE_UINT16);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    DrawConstants constants;
+    std::copy(this->viewProjection, this->viewProjection + 16, constants.viewProjection);
+    constants.instanceBuffer = this->instanceSlot;
+    constants.materialBuffer = this->materialSlot;
+    vkCmdPushConstants(commandBuffer, this->drawPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    uint32_t phase = pass == CullPass::Late ? 1 : 0;
+    VkDeviceSize commandsOffset = static_cast<VkDeviceSize>(phase) * this->instanceCount * stride;
+    switch (this->mode) {
+    case IndirectDrawMode::Count:
+        vkCmdDrawIndexedIndirectCount(commandBuffer, frame.drawCommands, commandsOffset, frame.counters,
+            offsetof(CullCounters, drawCounts) + phase * sizeof(uint32_t), this->instanceCount, stride);
+        break;
+    case IndirectDrawMode::MultiDraw:
+        for (uint32_t first = 0; first < this->instanceCount; first += this->maxDrawIndirectCount) {
+            uint32_t count = std::min(this->maxDrawIndirectCount, this->instanceCount - first);
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.drawCommands, commandsOffset + static_cast<VkDeviceSize>(first) * stride, count, stride);
+        }
+        break;
+    case IndirectDrawMode::SingleDraws:
+        for (uint32_t i = 0; i < this->instanceCount; ++i) {
+            vkCmdDrawIndexedIndirect(commandBuffer, frame.drawCommands, commandsOffset + static_cast<VkDeviceSize>(i) * stride, 1, stride);
+        }
+        break;
+    }
+}
+
+void GpuDrivenRenderer::recordReadback(VkCommandBuffer commandBuffer) {
+    FrameBuffers& frame = this->frames[this->currentFrame];
+
+    VkBufferCopy region{};
+    region.size = this->getCountersSize();
+    vkCmdCopyBuffer(commandBuffer, frame.counters, frame.readback, 1, &region);
+
+    // Read by the host once the frame's fence has signaled.
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    frame.readbackPending = true;
+}
+
+void GpuDrivenRenderer::resetStatistics() {
+    this->frustumTotals = CullTotals();
+    this->occlusionTotals = CullTotals();
+}
+
+double GpuDrivenRenderer::getAverageDrawn() const {
+    uint64_t frames = this->frustumTotals.frames + this->occlusionTotals.frames;
+    uint64_t drawn = this->frustumTotals.early + this->occlusionTotals.early + this->occlusionTotals.late;
+    return frames == 0 ? 0.0 : static_cast<double>(drawn) / static_cast<double>(frames);
+}
+
+void GpuDrivenRenderer::printTotals(ostream& out, const char* name, const CullTotals& totals) const {
+    if (totals.frames == 0) {
+        out << '\t' << name << ": not used" << '\n';
+        return;
+    }
+    double frames = static_cast<double>(totals.frames);
+    double percent = 100.0 / (frames * this->instanceCount);
+    out << '\t' << name << ": " << totals.frames << " frames, " << percent * (totals.frames * this->instanceCount - totals.inFrustum)
+        << "% outside the frustum, " << percent * totals.occluded << "% occluded, "
+        << (totals.early + totals.late) / frames << " drawn on average";
+    if (totals.late > 0 || totals.occluded > 0) {
+        out << " (" << totals.early / frames << " early, " << totals.late / frames << " late)";
+    }
+    out << '\n';
+}
+
+void GpuDrivenRenderer::printStatistics(ostream& out, const GpuProfiler& profiler) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    out << "[GPU-Driven Rendering]" << '\n';
+    out << "\tInstances: " << this->instanceCount << " (" << this->gridCount << " grid, " << OCCLUDER_COLUMNS * OCCLUDER_COLUMNS
+        << " occluders), drawn with " << getIndirectDrawModeString(this->mode) << '\n';
+    this->printTotals(out, "Frustum culling", this->frustumTotals);
+    if (this->occlusionSupported) {
+        this->printTotals(out, "Occlusion culling", this->occlusionTotals);
+    } else {
+        out << "\tOcclusion culling: unsupported" << '\n';
+    }
+
+    const char* const passes[] = { RESET_PASS, CULL_PASS, DRAW_PASS, EARLY_CULL_PASS, EARLY_DRAW_PASS, DEPTH_PYRAMID_PASS,
+        LATE_CULL_PASS, LATE_DRAW_PASS, READBACK_PASS };
+    out << std::setprecision(3);
+    for (const char* pass : passes) {
+        const RollingTimings* timings = profiler.getTimings(pass);
+        if (timings != nullptr && timings->size() > 0) {
+            out << "\tGPU " << pass << ": avg " << timings->average() << " ms, p99 " << timings->percentile(0.99) << " ms" << '\n';
+        }
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "BindlessTable.h"
+#include "DepthPyramid.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "DeviceFeatures.h"
+#include "DeviceMemoryAllocator.h"
+#include "Frustum.h"
+#include "GpuProfiler.h"
+#include "SceneRenderer.h"
+#include "UploadService.h"
+
+// How the culled draws reach the GPU, best first.
+enum class IndirectDrawMode {
+    // vkCmdDrawIndexedIndirectCount: the cull pass compacts survivors and the GPU reads how many there are.
+    Count,
+    // One vkCmdDrawIndexedIndirect over a command per instance; culled instances have instanceCount 0.
+    MultiDraw,
+    // Without multiDrawIndirect: the same commands, one vkCmdDrawIndexedIndirect each.
+    SingleDraws,
+};
+
+const char* getIndirectDrawModeString(IndirectDrawMode mode);
+
+// Which cull and draw pass is being recorded.
+enum class CullPass {
+    // Frustum culling on its own: one cull, one draw.
+    Frustum,
+    // Occlusion culling: the early cull and draw take what was visible last frame; the late ones, after the
+    // depth pyramid was built from the early draw's depth, whatever else passes the pyramid.
+    Early,
+    Late,
+};
+
+// Draws the scene's grid of triangles as instances without any per-draw CPU work, with a few large occluders
+// in front of the grid.
+//
+// The instances live in a storage buffer. Every frame a compute pass tests each instance's bounding sphere
+// against the camera frustum and writes a VkDrawIndexedIndirectCommand for the survivors, then the scene pass
+// draws them all with one indirect call. The camera pans slowly across the grid, so part of it is always culled.
+//
+// With occlusion culling the cull and draw are split in two phases around a depth pyramid (see CullPass), and a
+// visibility buffer carries each instance's late result to the next frame. Everything the late pass finds
+// visible is drawn that same frame, so occlusion culling never makes anything pop in.
+//
+// The draw commands and counters are per frame in flight and are imported into the render graph along with the
+// visibility buffer and the pyramid, which orders the passes. Everything runs on the graphics queue, in the
+// frame's command buffer.
+class GpuDrivenRenderer {
+
+public:
+
+    static constexpr const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+    // Render graph pass names, under which the GPU profiler times them for printStatistics().
+    static constexpr const char* const RESET_PASS = "cull reset";
+    static constexpr const char* const CULL_PASS = "cull";
+    static constexpr const char* const DRAW_PASS = "draw";
+    static constexpr const char* const EARLY_CULL_PASS = "early cull";
+    static constexpr const char* const EARLY_DRAW_PASS = "early draw";
+    static constexpr const char* const DEPTH_PYRAMID_PASS = "depth pyramid";
+    static constexpr const char* const LATE_CULL_PASS = "late cull";
+    static constexpr const char* const LATE_DRAW_PASS = "late draw";
+    static constexpr const char* const READBACK_PASS = "cull readback";
+
+    // Needs drawIndirectFirstInstance: the vertex shader finds its instance through gl_InstanceIndex.
+    static bool isSupported(const DeviceCapabilities& capabilities);
+
+    void create(VkDevice device, DeviceMemoryAllocator& allocator, UploadService& uploads, BindlessTable& bindless,
+        DescriptorLayoutCache& layouts, DescriptorAllocator& descriptors, const DeviceCapabilities& capabilities,
+        const VkPhysicalDeviceLimits& limits, const SceneRenderer& scene, VkFormat colorFormat, VkPipelineCache pipelineCache,
+        const std::string& shaderDirectory, uint32_t gridCount, uint32_t framesInFlight);
+    void destroy();
+
+    IndirectDrawMode getMode() const { return this->mode; }
+    bool isOcclusionSupported() const { return this->occlusionSupported; }
+    // Grid triangles and occluders.
+    uint32_t getInstanceCount() const { return this->instanceCount; }
+
+    // The render pass clearing both attachments, for CullPass::Frustum and Early, or loading them, for Late;
+    // both in COLOR_ATTACHMENT_OPTIMAL and DEPTH_STENCIL_ATTACHMENT_OPTIMAL on both ends.
+    VkRenderPass getRenderPass(CullPass pass) const { return pass == CullPass::Late ? this->loadRenderPass : this->clearRenderPass; }
+    VkFramebuffer createFramebuffer(VkImageView colorView, VkImageView depthView, VkExtent2D extent) const;
+
+    // The early and the late pass each have their half of the commands.
+    VkDeviceSize getDrawCommandsSize() const;
+    VkDeviceSize getCountersSize() const { return sizeof(CullCounters); }
+    VkBuffer getDrawCommands(uint32_t frameIndex) const { return this->frames[frameIndex].drawCommands; }
+    VkBuffer getCounters(uint32_t frameIndex) const { return this->frames[frameIndex].counters; }
+    VkDeviceSize getVisibilitySize() const { return sizeof(uint32_t) * static_cast<VkDeviceSize>(this->instanceCount); }
+    VkBuffer getVisibility() const { return this->visibility; }
+    // Only with occlusion support.
+    const DepthPyramid& getDepthPyramid() const { return this->depthPyramid; }
+    void resizeDepthPyramid(VkExtent2D depthExtent, uint64_t lastUseSerial);
+
+    // After the frame ring waited for the slot `frameIndex`: collects the counters of that slot's previous
+    // frame, releases what completed frames left behind and places the camera for frame `serial`.
+    void beginFrame(uint32_t frameIndex, uint64_t serial, uint64_t completedSerial);
+
+    // The passes, in the order the render graph runs them.
+    void recordResetCounters(VkCommandBuffer commandBuffer);
+    void recordCull(VkCommandBuffer commandBuffer, CullPass pass);
+    // Inside getRenderPass(pass).
+    void recordDraws(VkCommandBuffer commandBuffer, VkExtent2D extent, CullPass pass) const;
+    void recordDepthPyramid(VkCommandBuffer commandBuffer, VkImageView depthView);
+    void recordReadback(VkCommandBuffer commandBuffer);
+
+    void resetStatistics();
+    double getAverageDrawn() const;
+    // Culling results and, from the profiler, the GPU time of each of the passes above.
+    void printStatistics(std::ostream& out, const GpuProfiler& profiler) const;
+
+private:
+
+    static constexpr const uint32_t CULL_GROUP_SIZE = 64;
+    // Bounding radius of the triangle the shaders draw, at scale 1.
+    static constexpr const float TRIANGLE_RADIUS = 0.70711f;
+    // A few large triangles in front of the grid, on a grid of their own.
+    static constexpr const uint32_t OCCLUDER_COLUMNS = 4;
+    static constexpr const float OCCLUDER_Z = -0.5f;
+    // Half the grid is seen at a time, while the camera circles the grid's centre once every so many frames.
+    static constexpr const float CAMERA_HALF_SIZE = 0.5f;
+    static constexpr const float CAMERA_ORBIT_RADIUS = 0.5f;
+    static constexpr const uint32_t CAMERA_ORBIT_FRAMES = 600;
+
+    // Matches Instance in the shaders (std430).
+    struct Instance {
+        float center[3];
+        float radius;
+        float scale;
+        uint32_t material;
+        float padding[2];
+    };
+
+    // Matches CullCounters in cull.glsl.
+    struct CullCounters {
+        uint32_t drawCounts[2];
+        uint32_t inFrustum;
+        uint32_t occluded;
+    };
+
+    // Matches CullCamera in cull.glsl (std140).
+    struct CullCamera {
+        float viewProjection[16];
+        float planes[Frustum::PLANE_COUNT][4];
+    };
+
+    struct CullConstants {
+        uint32_t instanceCount;
+        uint32_t phase;
+        int32_t depthSize[2];
+        int32_t pyramidLevels;
+    };
+
+    struct DrawConstants {
+        float viewProjection[16];
+        uint32_t instanceBuffer;
+        uint32_t materialBuffer;
+    };
+
+    struct FrameBuffers {
+        VkBuffer drawCommands = VK_NULL_HANDLE;
+        DeviceAllocation drawCommandsAllocation;
+        VkBuffer counters = VK_NULL_HANDLE;
+        DeviceAllocation countersAllocation;
+        // Host visible and written in beginFrame().
+        VkBuffer camera = VK_NULL_HANDLE;
+        DeviceAllocation cameraAllocation;
+        // Host visible; holds the counters once the frame that wrote them has completed.
+        VkBuffer readback = VK_NULL_HANDLE;
+        DeviceAllocation readbackAllocation;
+        bool readbackPending = false;
+        // Whether the frame culled occlusion, i.e. recorded the late pass.
+        bool occlusion = false;
+    };
+
+    struct CullTotals {
+        uint64_t frames = 0;
+        uint64_t inFrustum = 0;
+        uint64_t occluded = 0;
+        uint64_t early = 0;
+        uint64_t late = 0;
+    };
+
+    VkBuffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, DeviceAllocation& allocation);
+    void createInstances(UploadService& uploads, uint32_t gridCount);
+    VkRenderPass createRenderPass(VkFormat colorFormat, VkAttachmentLoadOp loadOp);
+    VkPipeline createCullPipeline(VkPipelineLayout layout, const std::string& path, VkBool32 early, VkPipelineCache pipelineCache);
+    void createCullPipelines(DescriptorLayoutCache& layouts, VkPipelineCache pipelineCache, const std::string& shaderDirectory);
+    void createDrawPipeline(const SceneRenderer& scene, VkPipelineCache pipelineCache, const std::string& shaderDirectory);
+    void printTotals(std::ostream& out, const char* name, const CullTotals& totals) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    BindlessTable* bindless = nullptr;
+    DescriptorAllocator* descriptors = nullptr;
+    IndirectDrawMode mode = IndirectDrawMode::SingleDraws;
+    uint32_t maxDrawIndirectCount = 1;
+    uint32_t materialSlot = BindlessTable::INVALID_SLOT;
+    bool occlusionSupported = false;
+
+    uint32_t gridCount = 0;
+    uint32_t instanceCount = 0;
+    VkBuffer instanceBuffer = VK_NULL_HANDLE;
+    DeviceAllocation instanceAllocation;
+    uint32_t instanceSlot = BindlessTable::INVALID_SLOT;
+    VkBuffer indexBuffer = VK_NULL_HANDLE;
+    DeviceAllocation indexAllocation;
+    VkBuffer visibility = VK_NULL_HANDLE;
+    DeviceAllocation visibilityAllocation;
+    DepthPyramid depthPyramid;
+
+    std::vector<FrameBuffers> frames;
+    uint32_t currentFrame = 0;
+    float viewProjection[16]{};
+
+    VkRenderPass clearRenderPass = VK_NULL_HANDLE;
+    VkRenderPass loadRenderPass = VK_NULL_HANDLE;
+
+    // Owned by the layout cache.
+    VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline frustumCullPipeline = VK_NULL_HANDLE;
+    VkPipeline earlyCullPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout lateCullPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline lateCullPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout drawPipelineLayout = VK_NULL_HANDLE;
+    VkPipeline drawPipeline = VK_NULL_HANDLE;
+
+    CullTotals frustumTotals;
+    CullTotals occlusionTotals;
+};
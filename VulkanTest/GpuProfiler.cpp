@@ -0,0 +1,420 @@
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include "HostAllocator.h"
+#include "TraceRecorder.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The host time domain steady_clock runs on, where Vulkan has one for it.
+#if defined(_WIN32)
+constexpr const VkTimeDomainEXT STEADY_CLOCK_TIME_DOMAIN = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#elif defined(__linux__) || defined(__ANDROID__)
+constexpr const VkTimeDomainEXT STEADY_CLOCK_TIME_DOMAIN = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#else
+constexpr const VkTimeDomainEXT STEADY_CLOCK_TIME_DOMAIN = VK_TIME_DOMAIN_DEVICE_EXT;
+#endif
+
+// A host time domain value as a steady_clock time point.
+TraceRecorder::Clock::time_point hostTimeToSteadyClock(uint64_t value) {
+#ifdef _WIN32
+    // QueryPerformanceCounter ticks, which MSVC's steady_clock scales the same way.
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    uint64_t ticksPerSecond = static_cast<uint64_t>(frequency.QuadPart);
+    uint64_t ns = value / ticksPerSecond * 1000000000ull + value % ticksPerSecond * 1000000000ull / ticksPerSecond;
+#else
+    // CLOCK_MONOTONIC nanoseconds, steady_clock's own clock.
+    uint64_t ns = value;
+#endif
+    return TraceRecorder::Clock::time_point(std::chrono::duration_cast<TraceRecorder::Clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+}
+
+void RollingTimings::add(double ms) {
+    if (this->samples.size() < this->capacity) {
+        this->samples.push_back(ms);
+    } else {
+        this->samples[this->next] = ms;
+    }
+    this->next = (this->next + 1) % this->capacity;
+}
+
+void RollingTimings::clear() {
+    this->samples.clear();
+    this->next = 0;
+}
+
+double RollingTimings::minimum() const {
+    return this->samples.empty() ? 0.0 : *std::min_element(this->samples.begin(), this->samples.end());
+}
+
+double RollingTimings::maximum() const {
+    return this->samples.empty() ? 0.0 : *std::max_element(this->samples.begin(), this->samples.end());
+}
+
+double RollingTimings::average() const {
+    if (this->samples.empty()) {
+        return 0.0;
+    }
+    double total = 0.0;
+    for (double sample : this->samples) {
+        total += sample;
+    }
+    return total / static_cast<double>(this->samples.size());
+}
+
+double RollingTimings::percentile(double p) const {
+    if (this->samples.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted = this->samples;
+    size_t rank = static_cast<size_t>(std::ceil(std::clamp(p, 0.0, 1.0) * static_cast<double>(sorted.size())));
+    size_t index = rank == 0 ? 0 : rank - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(index), sorted.end());
+    return sorted[index];
+}
+
+GpuProfiler::Scope::Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name)
+    : profiler(profiler), commandBuffer(commandBuffer), scopeIndex(profiler.beginScope(commandBuffer, name)) {
+}
+
+GpuProfiler::Scope::~Scope() {
+    this->profiler.endScope(this->commandBuffer, this->scopeIndex);
+}
+
+void GpuProfiler::create(VkDevice device, uint32_t framesInFlight, uint32_t timestampValidBits, float timestampPeriod) {
+    this->device = device;
+    this->enabled = timestampValidBits > 0;
+    this->timestampValidBits = timestampValidBits;
+    this->timestampMask = timestampValidBits >= 64 ? ~0ull : ((1ull << timestampValidBits) - 1);
+    this->timestampPeriod = timestampPeriod;
+
+    if (!this->enabled) {
+        return;
+    }
+
+    this->frames.resize(framesInFlight);
+    for (FrameQueries& frame : this->frames) {
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = MAX_QUERIES_PER_FRAME;
+
+        if (vkCreateQueryPool(this->device, &queryPoolInfo, HostAllocator::get().getCallbacks(), &frame.queryPool) != VK_SUCCESS) {
+            throw runtime_error("failed to create timestamp query pool!");
+        }
+        frame.scopes.reserve(MAX_QUERIES_PER_FRAME / 2);
+    }
+    this->results.resize(MAX_QUERIES_PER_FRAME);
+}
+
+void GpuProfiler::destroy() {
+    for (FrameQueries& frame : this->frames) {
+        vkDestroyQueryPool(this->device, frame.queryPool, HostAllocator::get().getCallbacks());
+    }
+    this->frames.clear();
+    this->currentFrame = nullptr;
+}
+
+void GpuProfiler::beginFrame(uint32_t frameIndex, VkCommandBuffer commandBuffer) {
+    if (!this->enabled) {
+        return;
+    }
+
+    FrameQueries& frame = this->frames[frameIndex];
+    this->readResults(frame);
+
+    vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, MAX_QUERIES_PER_FRAME);
+    frame.scopes.clear();
+    frame.usedQueries = 0;
+    this->currentFrame = &frame;
+    this->depth = 0;
+
+    if (this->clockCalibrated && this->getCalibratedTimestamps != nullptr && ++this->framesSinceCalibration >= RECALIBRATION_INTERVAL) {
+        this->sampleCalibratedClocks();
+    }
+}
+
+void GpuProfiler::calibrateClock(VkInstance instance, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex,
+    bool calibratedTimestamps) {
+    if (!this->enabled) {
+        return;
+    }
+
+    if (calibratedTimestamps && STEADY_CLOCK_TIME_DOMAIN != VK_TIME_DOMAIN_DEVICE_EXT) {
+        auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+        uint32_t domainCount = 0;
+        vector<VkTimeDomainEXT> domains;
+        if (getTimeDomains != nullptr && getTimeDomains(physicalDevice, &domainCount, nullptr) == VK_SUCCESS) {
+            domains.resize(domainCount);
+            getTimeDomains(physicalDevice, &domainCount, domains.data());
+        }
+
+        bool hasDevice = std::find(domains.begin(), domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != domains.end();
+        bool hasHost = std::find(domains.begin(), domains.end(), STEADY_CLOCK_TIME_DOMAIN) != domains.end();
+        if (hasDevice && hasHost) {
+            this->getCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                vkGetDeviceProcAddr(this->device, "vkGetCalibratedTimestampsEXT"));
+            this->hostTimeDomain = STEADY_CLOCK_TIME_DOMAIN;
+        }
+    }
+
+    if (this->getCalibratedTimestamps != nullptr && this->sampleCalibratedClocks()) {
+        this->clockCalibrated = true;
+        return;
+    }
+    this->getCalibratedTimestamps = nullptr;
+    // Without a single sample the offset is unknown; GPU scopes then stay out of the trace.
+    this->clockCalibrated = this->estimateClockOffset(queue, queueFamilyIndex);
+    this->calibrationFailed = !this->clockCalibrated;
+}
+
+bool GpuProfiler::sampleCalibratedClocks() {
+    VkCalibratedTimestampInfoEXT infos[2]{};
+    infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+    infos[1].timeDomain = this->hostTimeDomain;
+
+    uint64_t timestamps[2] = {};
+    uint64_t maxDeviation = 0;
+    if (this->getCalibratedTimestamps(this->device, 2, infos, timestamps, &maxDeviation) != VK_SUCCESS) {
+        return false;
+    }
+
+    this->calibration.gpuTicks = timestamps[0] & this->timestampMask;
+    this->calibration.cpuNs = TraceRecorder::get().toNs(hostTimeToSteadyClock(timestamps[1]));
+    this->calibration.deviationNs = static_cast<double>(maxDeviation);
+    this->framesSinceCalibration = 0;
+    return true;
+}
+
+bool GpuProfiler::estimateClockOffset(VkQueue queue, uint32_t queueFamilyIndex) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    VkCommandPool commandPool;
+    if (vkCreateCommandPool(this->device, &poolInfo, HostAllocator::get().getCallbacks(), &commandPool) != VK_SUCCESS) {
+        throw runtime_error("failed to create clock calibration command pool!");
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = commandPool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    VkFence fence;
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkQueryPool queryPool = this->frames[0].queryPool;
+    if (vkAllocateCommandBuffers(this->device, &allocInfo, &commandBuffer) != VK_SUCCESS
+        || vkCreateFence(this->device, &fenceInfo, HostAllocator::get().getCallbacks(), &fence) != VK_SUCCESS) {
+        vkDestroyCommandPool(this->device, commandPool, HostAllocator::get().getCallbacks());
+        throw runtime_error("failed to create clock calibration objects!");
+    }
+
+    // The timestamp is written somewhere between the submission and the fence signaling; the tightest of a
+    // few brackets gives the best estimate, taken at its middle.
+    TraceRecorder& recorder = TraceRecorder::get();
+    bool haveSample = false;
+    for (uint32_t sample = 0; sample < ESTIMATION_SAMPLES; ++sample) {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        vkBeginCommandBuffer(commandBuffer, &beginInfo);
+        vkCmdResetQueryPool(commandBuffer, queryPool, 0, 1);
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+        vkEndCommandBuffer(commandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+
+        int64_t beforeNs = recorder.nowNs();
+        if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+            vkDestroyFence(this->device, fence, HostAllocator::get().getCallbacks());
+            vkDestroyCommandPool(this->device, commandPool, HostAllocator::get().getCallbacks());
+            throw runtime_error("failed to submit clock calibration command buffer!");
+        }
+        vkWaitForFences(this->device, 1, &fence, VK_TRUE, UINT64_MAX);
+        int64_t afterNs = recorder.nowNs();
+        vkResetFences(this->device, 1, &fence);
+
+        uint64_t ticks = 0;
+        if (vkGetQueryPoolResults(this->device, queryPool, 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS) {
+            continue;
+        }
+
+        double deviationNs = static_cast<double>(afterNs - beforeNs) / 2.0;
+        if (!haveSample || deviationNs < this->calibration.deviationNs) {
+            this->calibration.gpuTicks = ticks & this->timestampMask;
+            this->calibration.cpuNs = beforeNs + (afterNs - beforeNs) / 2;
+            this->calibration.deviationNs = deviationNs;
+            haveSample = true;
+        }
+    }
+
+    vkDestroyFence(this->device, fence, HostAllocator::get().getCallbacks());
+    vkDestroyCommandPool(this->device, commandPool, HostAllocator::get().getCallbacks());
+    return haveSample;
+}
+
+int64_t GpuProfiler::toCpuNs(uint64_t gpuTicks) const {
+    // Ticks wrap at the valid bits, so the distance to the calibration point is taken as the shorter way round.
+    uint64_t delta = (gpuTicks - this->calibration.gpuTicks) & this->timestampMask;
+    double ticks = delta > (this->timestampMask >> 1)
+        ? -static_cast<double>((this->calibration.gpuTicks - gpuTicks) & this->timestampMask)
+        : static_cast<double>(delta);
+    return this->calibration.cpuNs + static_cast<int64_t>(ticks * this->timestampPeriod);
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer commandBuffer, const char* name) {
+    FrameQueries* frame = this->currentFrame;
+    if (frame == nullptr || frame->usedQueries + 2 > MAX_QUERIES_PER_FRAME) {
+        // Disabled, or the frame ran out of queries; the scope still nests so depths stay right.
+        this->droppedScopes += this->enabled ? 1 : 0;
+        ++this->depth;
+        return NO_SCOPE;
+    }
+
+    auto found = this->statisticsIndex.find(name);
+    if (found == this->statisticsIndex.end()) {
+        found = this->statisticsIndex.emplace(name, this->statistics.size()).first;
+        const char* traceName = TraceRecorder::get().isEnabled() ? TraceRecorder::get().intern(name) : nullptr;
+        this->statistics.push_back({ name, this->depth, RollingTimings(), traceName });
+    }
+    ++this->depth;
+
+    ScopeRecord record;
+    record.statisticsIndex = found->second;
+    record.beginQuery = frame->usedQueries;
+    record.endQuery = frame->usedQueries + 1;
+    frame->usedQueries += 2;
+
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->queryPool, record.beginQuery);
+    frame->scopes.push_back(record);
+    return static_cast<uint32_t>(frame->scopes.size() - 1);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scopeIndex) {
+    --this->depth;
+    if (scopeIndex == NO_SCOPE) {
+        return;
+    }
+
+    const ScopeRecord& record = this->currentFrame->scopes[scopeIndex];
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, this->currentFrame->queryPool, record.endQuery);
+}
+
+void GpuProfiler::readResults(FrameQueries& frame) {
+    this->completedFrame.reset();
+    if (frame.usedQueries == 0) {
+        return;
+    }
+
+    // No WAIT flag: the frame's fence has normally signaled by now, and if the driver disagrees the frame is
+    // skipped rather than stalling the CPU on it.
+    VkResult result = vkGetQueryPoolResults(this->device, frame.queryPool, 0, frame.usedQueries, frame.usedQueries * sizeof(uint64_t),
+        this->results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    // Read once only, even if the slot is not recorded again (a frame abandoned on an out-of-date swapchain).
+    frame.usedQueries = 0;
+    if (result != VK_SUCCESS) {
+        ++this->unavailableFrames;
+        return;
+    }
+
+    for (const ScopeRecord& record : frame.scopes) {
+        uint64_t begin = this->results[record.beginQuery] & this->timestampMask;
+        uint64_t end = this->results[record.endQuery] & this->timestampMask;
+        uint64_t ticks = (end - begin) & this->timestampMask;
+        double ms = static_cast<double>(ticks) * this->timestampPeriod / 1.0e6;
+        ScopeStatistics& statistics = this->statistics[record.statisticsIndex];
+        statistics.timings.add(ms);
+        if (this->clockCalibrated && statistics.traceName != nullptr) {
+            TraceRecorder::get().addGpuRange(statistics.traceName, this->toCpuNs(begin), static_cast<int64_t>(ticks * this->timestampPeriod));
+        }
+        if (statistics.depth == 0 && !this->completedFrame.has_value()) {
+            this->completedFrame = CompletedFrame{ ms, this->clockCalibrated ? std::optional<int64_t>(this->toCpuNs(end)) : std::nullopt };
+        }
+    }
+}
+
+void GpuProfiler::collectFrame(uint32_t frameIndex) {
+    if (!this->enabled) {
+        return;
+    }
+    this->readResults(this->frames[frameIndex]);
+}
+
+std::optional<GpuProfiler::CompletedFrame> GpuProfiler::takeCompletedFrame() {
+    std::optional<CompletedFrame> frame = this->completedFrame;
+    this->completedFrame.reset();
+    return frame;
+}
+
+const RollingTimings* GpuProfiler::getTimings(const string& name) const {
+    auto found = this->statisticsIndex.find(name);
+    return found == this->statisticsIndex.end() ? nullptr : &this->statistics[found->second].timings;
+}
+
+void GpuProfiler::printStatistics(ostream& out) const {
+    out << "[GPU Profiler]" << '\n';
+    if (!this->enabled) {
+        out << "\tDisabled: the graphics queue family has no valid timestamp bits" << '\n';
+        return;
+    }
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(3);
+
+    out << "\tTimestamps: " << this->timestampValidBits << " valid bits, " << this->timestampPeriod << " ns per tick" << '\n';
+    for (const ScopeStatistics& scope : this->statistics) {
+        const RollingTimings& timings = scope.timings;
+        if (timings.size() == 0) {
+            continue;
+        }
+        out << '\t' << string(scope.depth, '\t') << scope.name << ": avg " << timings.average() << " ms, min " << timings.minimum()
+            << " ms, p99 " << timings.percentile(0.99) << " ms (last " << timings.size() << " frames)" << '\n';
+    }
+    if (this->clockCalibrated) {
+        out << "\tGPU clock: " << (this->getCalibratedTimestamps != nullptr ? "calibrated (VK_EXT_calibrated_timestamps)" : "estimated offset")
+            << ", within " << this->calibration.deviationNs / 1.0e3 << " us" << '\n';
+    } else if (this->calibrationFailed) {
+        out << "\tGPU clock: not calibrated, every timestamp readback failed; GPU scopes are left out of the trace" << '\n';
+    }
+    if (this->droppedScopes > 0) {
+        out << "\tScopes dropped for lack of queries: " << this->droppedScopes << '\n';
+    }
+    if (this->unavailableFrames > 0) {
+        out << "\tFrames whose results were not ready: " << this->unavailableFrames << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The most recent samples of one timing series, in milliseconds, so the statistics follow what the
+// application does now rather than averaging in its start-up.
+class RollingTimings {
+
+public:
+
+    explicit RollingTimings(size_t capacity = 256) : capacity(capacity) {}
+
+    void add(double ms);
+    void clear();
+
+    size_t size() const { return this->samples.size(); }
+    double minimum() const;
+    double maximum() const;
+    double average() const;
+    // p in [0, 1], nearest rank.
+    double percentile(double p) const;
+
+private:
+
+    size_t capacity;
+    std::vector<double> samples;
+    size_t next = 0;
+};
+
+// Times command buffer regions on the GPU with timestamp queries.
+//
+// Every frame in flight has its own query pool. beginFrame() reads back what the slot recorded the last time
+// it was used, which the frame ring has already waited for, so reading never blocks; the results arrive
+// framesInFlight frames late. Scopes nest and are keyed by name, and each name keeps rolling statistics.
+// Queue families without valid timestamp bits turn the profiler into a no-op.
+//
+// calibrateClock() maps GPU ticks to the CPU clock: afterwards every scope is also added to the trace recorder
+// as a GPU range when it is on, and completed frames report when they ended on the CPU clock.
+// With VK_EXT_calibrated_timestamps both clocks are sampled at once, and again every few hundred frames against
+// drift. Without it the offset is estimated once from a timestamp written by a tiny submission, bracketed by CPU
+// times taken around it.
+//
+// Scopes can only be recorded into primary command buffers, from the thread that records the frame.
+class GpuProfiler {
+
+public:
+
+    // Writes a timestamp pair around everything recorded during its lifetime.
+    class Scope {
+
+    public:
+
+        Scope(GpuProfiler& profiler, VkCommandBuffer commandBuffer, const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+
+        GpuProfiler& profiler;
+        VkCommandBuffer commandBuffer;
+        uint32_t scopeIndex;
+    };
+
+    void create(VkDevice device, uint32_t framesInFlight, uint32_t timestampValidBits, float timestampPeriod);
+    void destroy();
+
+    bool isEnabled() const { return this->enabled; }
+
+    // Pairs GPU ticks with CPU times (trace recorder nanoseconds); a no-op when the profiler is disabled.
+    // Submits to the queue, so it must not be in use by another thread.
+    void calibrateClock(VkInstance instance, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex,
+        bool calibratedTimestamps);
+
+    // The outermost scope of a frame whose results were read back.
+    struct CompletedFrame {
+        double gpuMs = 0.0;
+        // When the scope ended on the GPU, in trace recorder nanoseconds; only with a calibrated clock.
+        std::optional<int64_t> endNs;
+    };
+
+    // Collects the results of the slot's previous frame and resets its queries; must come first in the
+    // frame's command buffer, outside any render pass.
+    void beginFrame(uint32_t frameIndex, VkCommandBuffer commandBuffer);
+
+    // Reads back a slot's results outside beginFrame(), e.g. for the last frames once the device is idle.
+    void collectFrame(uint32_t frameIndex);
+
+    // The frame read back by the last beginFrame() or collectFrame(), once; nothing if it had no outermost
+    // scope or its results were not available.
+    std::optional<CompletedFrame> takeCompletedFrame();
+
+    // Rolling statistics of a scope, or nullptr if it was never recorded.
+    const RollingTimings* getTimings(const std::string& name) const;
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct ScopeRecord {
+        // Resolved when the scope is recorded; names (e.g. of a retired render graph's passes) may be gone
+        // by the time the results are read.
+        size_t statisticsIndex;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct FrameQueries {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<ScopeRecord> scopes;
+        uint32_t usedQueries = 0;
+    };
+
+    struct ScopeStatistics {
+        std::string name;
+        uint32_t depth = 0;
+        RollingTimings timings;
+        // The name as the trace recorder keeps it, or nullptr when not tracing.
+        const char* traceName = nullptr;
+    };
+
+    // A GPU tick count and the CPU time (trace recorder nanoseconds) it was taken at.
+    struct ClockCalibration {
+        uint64_t gpuTicks = 0;
+        int64_t cpuNs = 0;
+        // Half the window the two samples were taken in, i.e. how far off the pairing may be.
+        double deviationNs = 0.0;
+    };
+
+    static constexpr const uint32_t MAX_QUERIES_PER_FRAME = 128;
+    static constexpr const uint32_t NO_SCOPE = ~0u;
+    // Frames between two calibrations with VK_EXT_calibrated_timestamps, which keeps drift well below a microsecond.
+    static constexpr const uint32_t RECALIBRATION_INTERVAL = 256;
+    static constexpr const uint32_t ESTIMATION_SAMPLES = 8;
+
+    uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name);
+    void endScope(VkCommandBuffer commandBuffer, uint32_t scopeIndex);
+    void readResults(FrameQueries& frame);
+    bool sampleCalibratedClocks();
+    // False when no sample could be read back.
+    bool estimateClockOffset(VkQueue queue, uint32_t queueFamilyIndex);
+    int64_t toCpuNs(uint64_t gpuTicks) const;
+
+    VkDevice device = VK_NULL_HANDLE;
+    bool enabled = false;
+    uint64_t timestampMask = 0;
+    float timestampPeriod = 1.0f;
+    uint32_t timestampValidBits = 0;
+
+    // Set once the clocks were paired; GPU ranges only go to the trace after that.
+    bool clockCalibrated = false;
+    // calibrateClock() ran but got no usable sample.
+    bool calibrationFailed = false;
+    ClockCalibration calibration;
+    PFN_vkGetCalibratedTimestampsEXT getCalibratedTimestamps = nullptr;
+    VkTimeDomainEXT hostTimeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+    uint32_t framesSinceCalibration = 0;
+
+    std::vector<FrameQueries> frames;
+    FrameQueries* currentFrame = nullptr;
+    uint32_t depth = 0;
+
+    // In the order the scopes were first seen, which is the order they are printed in.
+    std::vector<ScopeStatistics> statistics;
+    std::unordered_map<std::string, size_t> statisticsIndex;
+    std::vector<uint64_t> results;
+    std::optional<CompletedFrame> completedFrame;
+    uint64_t droppedScopes = 0;
+    uint64_t unavailableFrames = 0;
+};
@@ -0,0 +1,298 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+using std::nullopt;
+using std::optional;
+using std::ostream;
+using std::string;
+
+namespace {
+
+const char* const SCOPE_NAMES[] = { "command", "object", "cache", "device", "instance" };
+
+uintptr_t alignUp(uintptr_t value, size_t alignment) {
+    return (value + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+}
+
+}
+
+optional<HostAllocatorMode> parseHostAllocatorMode(const string& text) {
+    if (text == "system") {
+        return HostAllocatorMode::System;
+    } else if (text == "tracking") {
+        return HostAllocatorMode::Tracking;
+    } else if (text == "arena") {
+        return HostAllocatorMode::Arena;
+    }
+    return nullopt;
+}
+
+const char* getHostAllocatorModeString(HostAllocatorMode mode) {
+    switch (mode) {
+    case HostAllocatorMode::System: return "system";
+    case HostAllocatorMode::Tracking: return "tracking";
+    case HostAllocatorMode::Arena: return "arena";
+    }
+    return "unknown";
+}
+
+HostAllocator& HostAllocator::get() {
+    static HostAllocator allocator;
+    return allocator;
+}
+
+HostAllocator::HostAllocator() : startTime(Clock::now()) {
+    this->callbacks.pUserData = this;
+    this->callbacks.pfnAllocation = &HostAllocator::allocationCallback;
+    this->callbacks.pfnReallocation = &HostAllocator::reallocationCallback;
+    this->callbacks.pfnFree = &HostAllocator::freeCallback;
+    this->callbacks.pfnInternalAllocation = &HostAllocator::internalAllocationCallback;
+    this->callbacks.pfnInternalFree = &HostAllocator::internalFreeCallback;
+}
+
+void HostAllocator::configure(HostAllocatorMode mode) {
+    this->mode = mode;
+}
+
+const VkAllocationCallbacks* HostAllocator::getCallbacks() const {
+    return this->mode == HostAllocatorMode::System ? nullptr : &this->callbacks;
+}
+
+void* VKAPI_PTR HostAllocator::allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+    if (size == 0) {
+        return nullptr;
+    }
+    void* memory = allocator.allocateBlock(size, alignment, scope);
+    if (memory != nullptr) {
+        allocator.scopes[scope].allocations.fetch_add(1, std::memory_order_relaxed);
+        allocator.countAllocation(scope, size);
+    }
+    return memory;
+}
+
+void* VKAPI_PTR HostAllocator::reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+    if (original == nullptr) {
+        return allocationCallback(userData, size, alignment, scope);
+    }
+    if (size == 0) {
+        freeCallback(userData, original);
+        return nullptr;
+    }
+
+    // The original has to survive a failure, so the copy is made before it is freed.
+    void* memory = allocator.allocateBlock(size, alignment, scope);
+    if (memory == nullptr) {
+        return nullptr;
+    }
+    Header* originalHeader = reinterpret_cast<Header*>(static_cast<uint8_t*>(original) - sizeof(Header));
+    std::memcpy(memory, original, std::min(size, originalHeader->size));
+
+    allocator.scopes[scope].reallocations.fetch_add(1, std::memory_order_relaxed);
+    allocator.countFree(originalHeader->scope, originalHeader->size);
+    allocator.countAllocation(scope, size);
+    allocator.freeBlock(originalHeader);
+    return memory;
+}
+
+void VKAPI_PTR HostAllocator::freeCallback(void* userData, void* memory) {
+    if (memory == nullptr) {
+        return;
+    }
+    HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+    Header* header = reinterpret_cast<Header*>(static_cast<uint8_t*>(memory) - sizeof(Header));
+    allocator.scopes[header->scope].frees.fetch_add(1, std::memory_order_relaxed);
+    allocator.countFree(header->scope, header->size);
+    allocator.freeBlock(header);
+}
+
+void VKAPI_PTR HostAllocator::internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+    HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+    allocator.scopes[scope].internalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void VKAPI_PTR HostAllocator::internalFreeCallback(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+    HostAllocator& allocator = *static_cast<HostAllocator*>(userData);
+    allocator.scopes[scope].internalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+}
+
+void HostAllocator::updatePeak(std::atomic<int64_t>& peak, int64_t value) {
+    int64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void HostAllocator::countAllocation(VkSystemAllocationScope scope, size_t size) {
+    ScopeCounters& counters = this->scopes[scope];
+    int64_t bytes = static_cast<int64_t>(size);
+    updatePeak(counters.peakBytes, counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    updatePeak(this->peakBytes, this->liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    this->operations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void HostAllocator::countFree(uint8_t scope, size_t size) {
+    int64_t bytes = static_cast<int64_t>(size);
+    this->scopes[scope].liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+    this->liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void* HostAllocator::allocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+    // Enough for the header and for aligning the pointer after it, wherever the block starts.
+    size_t blockSize = sizeof(Header) + size + std::max(alignment, alignof(Header));
+
+    Header header{};
+    header.size = size;
+    header.scope = static_cast<uint8_t>(scope);
+
+    void* block = nullptr;
+    if (this->mode == HostAllocatorMode::Arena) {
+        if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+            block = this->allocateFromCommandArena(blockSize, header);
+        } else if (scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT) {
+            block = this->allocateFromObjectPool(blockSize, header);
+        }
+        if (block != nullptr) {
+            this->scopes[scope].arenaAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    if (block == nullptr) {
+        block = std::malloc(blockSize);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        header.source = Source::Heap;
+    }
+    header.block = block;
+
+    uintptr_t memory = alignUp(reinterpret_cast<uintptr_t>(block) + sizeof(Header), std::max(alignment, alignof(Header)));
+    std::memcpy(reinterpret_cast<void*>(memory - sizeof(Header)), &header, sizeof(Header));
+    return reinterpret_cast<void*>(memory);
+}
+
+void HostAllocator::freeBlock(Header* header) {
+    switch (header->source) {
+    case Source::Heap:
+        std::free(header->block);
+        break;
+    case Source::CommandArena:
+        header->arena->liveAllocations.fetch_sub(1, std::memory_order_release);
+        break;
+    case Source::ObjectPool: {
+        SizeClass& sizeClass = this->sizeClasses[header->sizeClass];
+        void* block = header->block;
+        std::lock_guard<std::mutex> lock(sizeClass.mutex);
+        *static_cast<void**>(block) = sizeClass.freeList;
+        sizeClass.freeList = block;
+        break;
+    }
+    }
+}
+
+void* HostAllocator::allocateFromCommandArena(size_t blockSize, Header& header) {
+    thread_local CommandArena arena;
+
+    // Everything the last commands allocated was freed, so the buffer starts over.
+    if (arena.liveAllocations.load(std::memory_order_acquire) == 0) {
+        arena.offset = 0;
+    }
+    size_t offset = alignUp(arena.offset, alignof(Header));
+    if (offset + blockSize > COMMAND_ARENA_SIZE) {
+        return nullptr;
+    }
+    arena.offset = offset + blockSize;
+    arena.liveAllocations.fetch_add(1, std::memory_order_relaxed);
+
+    header.source = Source::CommandArena;
+    header.arena = &arena;
+    return arena.buffer.get() + offset;
+}
+
+void* HostAllocator::allocateFromObjectPool(size_t blockSize, Header& header) {
+    size_t classIndex = 0;
+    size_t classSize = MIN_SIZE_CLASS;
+    while (classSize < blockSize) {
+        if (++classIndex == SIZE_CLASS_COUNT) {
+            return nullptr;
+        }
+        classSize *= 2;
+    }
+
+    SizeClass& sizeClass = this->sizeClasses[classIndex];
+    std::lock_guard<std::mutex> lock(sizeClass.mutex);
+    if (sizeClass.freeList == nullptr) {
+        // Carve a new slab into blocks; slabs are only released at process exit.
+        sizeClass.slabs.push_back(std::make_unique<uint8_t[]>(SLAB_SIZE));
+        uint8_t* slab = sizeClass.slabs.back().get();
+        for (size_t offset = 0; offset + classSize <= SLAB_SIZE; offset += classSize) {
+            *reinterpret_cast<void**>(slab + offset) = sizeClass.freeList;
+            sizeClass.freeList = slab + offset;
+        }
+    }
+    void* block = sizeClass.freeList;
+    sizeClass.freeList = *static_cast<void**>(block);
+
+    header.source = Source::ObjectPool;
+    header.sizeClass = static_cast<uint8_t>(classIndex);
+    return block;
+}
+
+void HostAllocator::onFrame() {
+    uint64_t operations = this->operations.load(std::memory_order_relaxed);
+    // The first frame only sets the starting point; everything before it is start-up.
+    if (this->frames > 0) {
+        uint64_t delta = operations - this->lastFrameOperations;
+        this->frameOperations += delta;
+        this->framesWithAllocations += delta > 0 ? 1 : 0;
+        this->maxOperationsPerFrame = std::max(this->maxOperationsPerFrame, delta);
+    }
+    this->lastFrameOperations = operations;
+    ++this->frames;
+}
+
+void HostAllocator::printStatistics(ostream& out) const {
+    out << "[Host Allocations]" << '\n';
+    out << "\tMode: " << getHostAllocatorModeString(this->mode) << '\n';
+    if (this->mode == HostAllocatorMode::System) {
+        return;
+    }
+
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(1);
+
+    for (size_t scope = 0; scope < SCOPE_COUNT; ++scope) {
+        const ScopeCounters& counters = this->scopes[scope];
+        uint64_t allocations = counters.allocations.load();
+        if (allocations == 0 && counters.internalBytes.load() == 0) {
+            continue;
+        }
+        out << '\t' << SCOPE_NAMES[scope] << ": " << allocations << " allocations, " << counters.reallocations.load() << " reallocations, "
+            << counters.frees.load() << " frees, peak " << static_cast<double>(counters.peakBytes.load()) / 1024.0 << " KiB, live "
+            << static_cast<double>(counters.liveBytes.load()) / 1024.0 << " KiB";
+        if (this->mode == HostAllocatorMode::Arena) {
+            out << ", " << counters.arenaAllocations.load() << " from arenas";
+        }
+        if (counters.internalBytes.load() != 0) {
+            out << ", internal " << static_cast<double>(counters.internalBytes.load()) / 1024.0 << " KiB";
+        }
+        out << '\n';
+    }
+    out << "\tPeak: " << static_cast<double>(this->peakBytes.load()) / 1024.0 << " KiB, live at exit "
+        << static_cast<double>(this->liveBytes.load()) / 1024.0 << " KiB" << '\n';
+
+    double seconds = std::chrono::duration<double>(Clock::now() - this->startTime).count();
+    out << "\tRate: " << static_cast<double>(this->operations.load()) / std::max(seconds, 1e-9) << " allocations per second over the run" << '\n';
+    if (this->frames > 1) {
+        uint64_t measuredFrames = this->frames - 1;
+        out << "\tPer frame: avg " << static_cast<double>(this->frameOperations) / static_cast<double>(measuredFrames) << ", max "
+            << this->maxOperationsPerFrame << ", " << this->framesWithAllocations << " of " << measuredFrames << " frames allocated" << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class HostAllocatorMode {
+    // pAllocator is nullptr; the driver uses its own allocator and nothing is counted.
+    System,
+    // Every host allocation of the loader, the layers and the driver goes through the counting callbacks.
+    Tracking,
+    // Tracking, plus arenas for the short-lived COMMAND and small OBJECT scope allocations.
+    Arena,
+};
+
+std::optional<HostAllocatorMode> parseHostAllocatorMode(const std::string& text);
+const char* getHostAllocatorModeString(HostAllocatorMode mode);
+
+// The VkAllocationCallbacks passed to every vkCreate*/vkDestroy* call of the application.
+//
+// Counts allocations, reallocations, frees, live and peak bytes per VkSystemAllocationScope, plus the
+// driver's internal (executable) allocations it reports through the notification callbacks. onFrame()
+// turns the counts into a per-frame rate, which should settle at zero once start-up is over.
+//
+// The arena mode serves COMMAND scope allocations, which the spec frees before the command returns, from a
+// per-thread bump buffer that rewinds once all of them are freed, and small OBJECT scope allocations from
+// size-class free lists. Anything else, or anything that does not fit, goes to malloc.
+//
+// The mode is fixed by configure() before the first Vulkan call: memory must be freed by the callbacks that
+// allocated it. The allocator is never destroyed before process exit, since the debug messenger is never
+// destroyed either.
+class HostAllocator {
+
+public:
+
+    static HostAllocator& get();
+
+    void configure(HostAllocatorMode mode);
+    HostAllocatorMode getMode() const { return this->mode; }
+
+    // nullptr in System mode.
+    const VkAllocationCallbacks* getCallbacks() const;
+
+    // Call once per rendered frame, from the thread that renders.
+    void onFrame();
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr const size_t SCOPE_COUNT = 5;
+    // Object pool size classes, from 64 bytes doubling up; larger blocks come from malloc.
+    static constexpr const size_t SIZE_CLASS_COUNT = 6;
+    static constexpr const size_t MIN_SIZE_CLASS = 64;
+    static constexpr const size_t SLAB_SIZE = 64 * 1024;
+    static constexpr const size_t COMMAND_ARENA_SIZE = 64 * 1024;
+
+    enum class Source : uint8_t {
+        Heap,
+        CommandArena,
+        ObjectPool,
+    };
+
+    struct CommandArena;
+
+    // Sits right in front of every pointer handed to the driver.
+    struct alignas(16) Header {
+        void* block;
+        size_t size;
+        CommandArena* arena;
+        uint8_t scope;
+        Source source;
+        uint8_t sizeClass;
+    };
+
+    // Per thread; only the owner allocates from it, frees just count down.
+    struct CommandArena {
+        std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(COMMAND_ARENA_SIZE);
+        size_t offset = 0;
+        std::atomic<uint32_t> liveAllocations{ 0 };
+    };
+
+    struct SizeClass {
+        std::mutex mutex;
+        // Linked through the first bytes of each free block.
+        void* freeList = nullptr;
+        std::vector<std::unique_ptr<uint8_t[]>> slabs;
+    };
+
+    struct ScopeCounters {
+        std::atomic<uint64_t> allocations{ 0 };
+        std::atomic<uint64_t> reallocations{ 0 };
+        std::atomic<uint64_t> frees{ 0 };
+        std::atomic<uint64_t> arenaAllocations{ 0 };
+        std::atomic<int64_t> liveBytes{ 0 };
+        std::atomic<int64_t> peakBytes{ 0 };
+        std::atomic<int64_t> internalBytes{ 0 };
+    };
+
+    HostAllocator();
+
+    static void* VKAPI_PTR allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void* VKAPI_PTR reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+    static void VKAPI_PTR freeCallback(void* userData, void* memory);
+    static void VKAPI_PTR internalAllocationCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+    static void VKAPI_PTR internalFreeCallback(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    static void updatePeak(std::atomic<int64_t>& peak, int64_t value);
+
+    void* allocateBlock(size_t size, size_t alignment, VkSystemAllocationScope scope);
+    void freeBlock(Header* header);
+    void* allocateFromCommandArena(size_t blockSize, Header& header);
+    void* allocateFromObjectPool(size_t blockSize, Header& header);
+    void countAllocation(VkSystemAllocationScope scope, size_t size);
+    void countFree(uint8_t scope, size_t size);
+
+    HostAllocatorMode mode = HostAllocatorMode::System;
+    VkAllocationCallbacks callbacks{};
+
+    std::array<ScopeCounters, SCOPE_COUNT> scopes;
+    std::atomic<int64_t> liveBytes{ 0 };
+    std::atomic<int64_t> peakBytes{ 0 };
+    // Allocations and reallocations of every scope, for the rates.
+    std::atomic<uint64_t> operations{ 0 };
+    std::array<SizeClass, SIZE_CLASS_COUNT> sizeClasses;
+
+    const Clock::time_point startTime;
+    uint64_t frames = 0;
+    uint64_t lastFrameOperations = 0;
+    uint64_t framesWithAllocations = 0;
+    uint64_t maxOperationsPerFrame = 0;
+    uint64_t frameOperations = 0;
+};
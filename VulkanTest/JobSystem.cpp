@@ -0,0 +1,306 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "TraceRecorder.h"
+
+using std::runtime_error;
+
+namespace {
+
+// Rounds of finding nothing before a worker goes to sleep; each one yields the thread.
+constexpr const uint32_t IDLE_ROUNDS_BEFORE_SLEEP = 64;
+// parallelFor() ranges per worker, enough for stealing to balance ranges that take different times.
+constexpr const uint32_t RANGES_PER_WORKER = 4;
+
+thread_local const JobSystem* currentJobSystem = nullptr;
+thread_local uint32_t currentWorkerIndex = 0;
+
+uint32_t nextRandom(uint32_t& state) {
+    // xorshift32, plenty for picking a victim.
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+}
+
+void JobSystem::WorkQueue::push(Job* job) {
+    int64_t b = this->bottom.load(std::memory_order_relaxed);
+    int64_t t = this->top.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(QUEUE_CAPACITY)) {
+        throw runtime_error("job queue overflow!");
+    }
+
+    this->buffer[static_cast<size_t>(b) & (QUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    // Publishes the job (and everything written to it) to thieves that read bottom.
+    this->bottom.store(b + 1, std::memory_order_release);
+}
+
+JobSystem::Job* JobSystem::WorkQueue::pop() {
+    // Claims the bottom slot before looking at top; sequentially consistent, so a concurrent steal() either
+    // sees the smaller bottom or its move of top is seen here.
+    int64_t b = this->bottom.load(std::memory_order_relaxed) - 1;
+    this->bottom.store(b, std::memory_order_seq_cst);
+    int64_t t = this->top.load(std::memory_order_seq_cst);
+
+    if (t > b) {
+        // Empty.
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = this->buffer[static_cast<size_t>(b) & (QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (t == b) {
+        // The last job; a thief may be taking it at the same time, and whoever moves top wins.
+        if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            job = nullptr;
+        }
+        this->bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkQueue::steal() {
+    int64_t t = this->top.load(std::memory_order_seq_cst);
+    int64_t b = this->bottom.load(std::memory_order_seq_cst);
+
+    if (t >= b) {
+        return nullptr;
+    }
+
+    Job* job = this->buffer[static_cast<size_t>(t) & (QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!this->top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return job;
+}
+
+JobSystem::~JobSystem() {
+    this->stop();
+}
+
+void JobSystem::start(uint32_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    this->stopping = false;
+    for (uint32_t workerIndex = 0; workerIndex < workerCount; ++workerIndex) {
+        this->workers.push_back(std::make_unique<Worker>());
+        this->workers.back()->randomState = 0x9E3779B9u * (workerIndex + 1);
+    }
+
+    currentJobSystem = this;
+    currentWorkerIndex = 0;
+    for (uint32_t workerIndex = 1; workerIndex < workerCount; ++workerIndex) {
+        this->workers[workerIndex]->thread = std::thread(&JobSystem::workerMain, this, workerIndex);
+    }
+}
+
+void JobSystem::stop() {
+    {
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+
+    for (std::unique_ptr<Worker>& worker : this->workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    this->workers.clear();
+
+    if (currentJobSystem == this) {
+        currentJobSystem = nullptr;
+    }
+}
+
+uint32_t JobSystem::getCurrentWorkerIndex() const {
+    if (currentJobSystem != this) {
+        throw runtime_error("jobs can only be started and waited on from a worker thread!");
+    }
+    return currentWorkerIndex;
+}
+
+JobSystem::Job* JobSystem::allocateJob(Worker& worker) {
+    Job& job = worker.jobs[worker.nextJob++ & (QUEUE_CAPACITY - 1)];
+    if (!job.free.load(std::memory_order_acquire)) {
+        throw runtime_error("too many jobs in flight on one worker!");
+    }
+    job.free.store(false, std::memory_order_relaxed);
+    return &job;
+}
+
+void JobSystem::push(uint32_t workerIndex, Job* job) {
+    // Counted before it is visible, so the count never drops below zero when a thief is quick.
+    this->queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    this->workers[workerIndex]->queue.push(job);
+
+    if (this->sleepingWorkers.load(std::memory_order_seq_cst) > 0) {
+        // Taking the lock orders this against a worker that checked queuedJobs but has not started waiting.
+        std::lock_guard<std::mutex> lock(this->sleepMutex);
+        this->wake.notify_one();
+    }
+}
+
+void JobSystem::run(JobCounter& counter, JobFunction function, JobCounter* dependency) {
+    uint32_t workerIndex = this->getCurrentWorkerIndex();
+
+    Job* job = this->allocateJob(*this->workers[workerIndex]);
+    job->function = std::move(function);
+    job->counter = &counter;
+    counter.pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (dependency != nullptr) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->pending.load(std::memory_order_acquire) != 0) {
+            dependency->continuations.push_back(job);
+            return;
+        }
+    }
+    this->push(workerIndex, job);
+}
+
+JobSystem::Job* JobSystem::findJob(uint32_t workerIndex) {
+    Worker& worker = *this->workers[workerIndex];
+    Job* job = worker.queue.pop();
+
+    uint32_t workerCount = this->getWorkerCount();
+    if (job == nullptr && workerCount > 1) {
+        uint32_t first = nextRandom(worker.randomState) % workerCount;
+        for (uint32_t i = 0; i < workerCount && job == nullptr; ++i) {
+            uint32_t victim = (first + i) % workerCount;
+            if (victim != workerIndex) {
+                job = this->workers[victim]->queue.steal();
+            }
+        }
+    }
+
+    if (job != nullptr) {
+        this->queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void JobSystem::execute(Job* job, uint32_t workerIndex) {
+    JobFunction function = std::move(job->function);
+    job->function = nullptr;
+    JobCounter& counter = *job->counter;
+    job->free.store(true, std::memory_order_release);
+
+    try {
+        function(workerIndex);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (!counter.error) {
+            counter.error = std::current_exception();
+        }
+    }
+
+    this->finish(counter, workerIndex);
+}
+
+void JobSystem::finish(JobCounter& counter, uint32_t workerIndex) {
+    std::vector<Job*> ready;
+    {
+        // The count drops under the lock so that run() either sees it pending and parks its job here, or sees
+        // it done and queues the job itself. wait() takes the lock once more before returning, so the counter
+        // outlives this block even if the waiter destroys it right away.
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            ready.swap(counter.continuations);
+        }
+    }
+
+    for (Job* job : ready) {
+        this->push(workerIndex, job);
+    }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+    uint32_t workerIndex = this->getCurrentWorkerIndex();
+
+    while (!counter.isDone()) {
+        Job* job = this->findJob(workerIndex);
+        if (job != nullptr) {
+            this->execute(job, workerIndex);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(counter.mutex);
+        error = counter.error;
+        counter.error = nullptr;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void JobSystem::parallelFor(uint32_t count, uint32_t minRange, const RangeFunction& function) {
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t rangeCount = std::min(this->getWorkerCount() * RANGES_PER_WORKER, std::max(1u, count / std::max(1u, minRange)));
+    if (rangeCount == 1) {
+        function(0, count, this->getCurrentWorkerIndex());
+        return;
+    }
+
+    JobCounter counter;
+    try {
+        for (uint32_t range = 0; range < rangeCount; ++range) {
+            uint32_t begin = static_cast<uint32_t>(uint64_t(count) * range / rangeCount);
+            uint32_t end = static_cast<uint32_t>(uint64_t(count) * (range + 1) / rangeCount);
+            // Small enough for std::function to store without allocating.
+            const RangeFunction* rangeFunction = &function;
+            this->run(counter, [rangeFunction, begin, end](uint32_t workerIndex) { (*rangeFunction)(begin, end, workerIndex); });
+        }
+    }
+    catch (...) {
+        // The ranges already queued refer to the counter and the function, so they have to finish first.
+        this->wait(counter);
+        throw;
+    }
+    this->wait(counter);
+}
+
+void JobSystem::workerMain(uint32_t workerIndex) {
+    currentJobSystem = this;
+    currentWorkerIndex = workerIndex;
+    TraceRecorder::get().setThreadName("worker " + std::to_string(workerIndex));
+
+    uint32_t idleRounds = 0;
+    for (;;) {
+        Job* job = this->findJob(workerIndex);
+        if (job != nullptr) {
+            this->execute(job, workerIndex);
+            idleRounds = 0;
+            continue;
+        }
+
+        if (++idleRounds < IDLE_ROUNDS_BEFORE_SLEEP) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->sleepMutex);
+        this->sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        this->wake.wait(lock, [this] { return this->stopping || this->queuedJobs.load(std::memory_order_seq_cst) > 0; });
+        this->sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        if (this->stopping) {
+            return;
+        }
+        idleRounds = 0;
+    }
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// The application's task runtime: one worker per hardware thread, each with its own Chase-Lev deque.
+//
+// A worker pushes and pops jobs at the bottom of its own deque (LIFO, so the data it just touched is still
+// in cache) and, when that runs dry, steals from the top of a random other worker's deque. The thread that
+// calls start() becomes worker 0 and only runs jobs while it waits on a counter; the others sleep on a
+// condition variable once they found nothing to do for a while.
+//
+// Dependencies are expressed with counters: every job counts down the counter it was started with, wait()
+// keeps running jobs until a counter reaches zero, and a job started with a dependency is parked on that
+// counter and only queued once it reached zero. There are no fibers, so a job that waits keeps its thread
+// busy with other jobs instead of being suspended.
+class JobSystem {
+
+public:
+
+    using JobFunction = std::function<void(uint32_t workerIndex)>;
+    // Processes items [begin, end).
+    using RangeFunction = std::function<void(uint32_t begin, uint32_t end, uint32_t workerIndex)>;
+
+    JobSystem() = default;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+    ~JobSystem();
+
+    // workerCount includes the calling thread; 0 means one worker per hardware thread.
+    void start(uint32_t workerCount);
+    void stop();
+
+    uint32_t getWorkerCount() const { return static_cast<uint32_t>(this->workers.size()); }
+
+    // Queues a job on the calling worker's deque. It runs once `dependency`, if given, is done.
+    // Jobs can only be started from worker threads, which includes other jobs.
+    void run(JobCounter& counter, JobFunction function, JobCounter* dependency = nullptr);
+
+    // Runs queued jobs on the calling worker until every job counted by `counter` has finished, then rethrows
+    // the first exception one of them threw. The counter may be reused or destroyed afterwards.
+    void wait(JobCounter& counter);
+
+    // Splits [0, count) into ranges of at least minRange items, a few per worker so stealing can even out
+    // uneven ranges, runs them as jobs and waits for all of them.
+    void parallelFor(uint32_t count, uint32_t minRange, const RangeFunction& function);
+
+private:
+
+    friend class JobCounter;
+
+    // Per worker, both the deque and the ring of jobs it starts.
+    static constexpr const uint32_t QUEUE_CAPACITY = 4096;
+
+    struct Job {
+        JobFunction function;
+        JobCounter* counter = nullptr;
+        // Cleared when handed out, set again once the function has been moved out to run.
+        std::atomic<bool> free{ true };
+    };
+
+    // Chase-Lev work-stealing deque with a fixed capacity. push() and pop() are for the owning worker only,
+    // steal() may be called from any thread.
+    class WorkQueue {
+
+    public:
+
+        void push(Job* job);
+        Job* pop();
+        Job* steal();
+
+    private:
+
+        std::atomic<int64_t> top{ 0 };
+        std::atomic<int64_t> bottom{ 0 };
+        std::unique_ptr<std::atomic<Job*>[]> buffer = std::make_unique<std::atomic<Job*>[]>(QUEUE_CAPACITY);
+    };
+
+    struct Worker {
+        WorkQueue queue;
+        // Jobs started by this worker, recycled round-robin.
+        std::unique_ptr<Job[]> jobs = std::make_unique<Job[]>(QUEUE_CAPACITY);
+        uint32_t nextJob = 0;
+        uint32_t randomState = 0;
+        std::thread thread;
+    };
+
+    uint32_t getCurrentWorkerIndex() const;
+    Job* allocateJob(Worker& worker);
+    void push(uint32_t workerIndex, Job* job);
+    Job* findJob(uint32_t workerIndex);
+    void execute(Job* job, uint32_t workerIndex);
+    void finish(JobCounter& counter, uint32_t workerIndex);
+    void workerMain(uint32_t workerIndex);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Jobs sitting in some deque; sleeping workers wake up when it becomes non-zero.
+    std::atomic<int32_t> queuedJobs{ 0 };
+    std::atomic<uint32_t> sleepingWorkers{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+};
+
+// Counts the unfinished jobs of a group, see JobSystem.
+class JobCounter {
+
+public:
+
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const { return this->pending.load(std::memory_order_acquire) == 0; }
+
+private:
+
+    friend class JobSystem;
+
+    std::atomic<uint32_t> pending{ 0 };
+    // Guards the hand-over of continuations when the count reaches zero, and the error.
+    std::mutex mutex;
+    std::vector<JobSystem::Job*> continuations;
+    std::exception_ptr error;
+};
@@ -0,0 +1,268 @@
+#include "JobSystemBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+
+using std::ostream;
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Small jobs: about a microsecond of arithmetic each, where scheduling overhead dominates.
+constexpr const uint32_t SMALL_JOB_COUNT = 4096;
+constexpr const uint32_t SMALL_JOB_ITERATIONS = 1000;
+constexpr const uint32_t SMALL_JOB_BATCH = 1024;
+// The parallel loop: a few milliseconds of work spread over many items.
+constexpr const uint32_t LOOP_ITEM_COUNT = 1u << 24;
+constexpr const uint32_t LOOP_MIN_RANGE = 4096;
+constexpr const uint32_t REPETITIONS = 5;
+
+void check(bool condition, const string& what) {
+    if (!condition) {
+        throw runtime_error("job system self-test failed: " + what);
+    }
+}
+
+// Work the optimizer cannot drop, since the result is accumulated and printed.
+uint32_t spin(uint32_t seed, uint32_t iterations) {
+    uint32_t state = seed | 1;
+    for (uint32_t i = 0; i < iterations; ++i) {
+        state = state * 1664525u + 1013904223u;
+    }
+    return state;
+}
+
+double loopItem(uint32_t index) {
+    return std::sqrt(static_cast<double>(index));
+}
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Best of a few runs, which is the least disturbed by whatever else the machine is doing.
+template <typename Function>
+double bestOfMs(Function&& function) {
+    double best = 0.0;
+    for (uint32_t i = 0; i < REPETITIONS; ++i) {
+        Clock::time_point start = Clock::now();
+        function();
+        double ms = elapsedMs(start);
+        best = i == 0 ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+void runSelfTest(ostream& out, JobSystem& jobs) {
+    // Every item exactly once, including counts that do not divide evenly.
+    for (uint32_t count : { 1u, 7u, 4097u, 1000003u }) {
+        vector<uint32_t> visits(count, 0);
+        jobs.parallelFor(count, 64, [&visits](uint32_t begin, uint32_t end, uint32_t) {
+            for (uint32_t i = begin; i < end; ++i) {
+                ++visits[i];
+            }
+        });
+        for (uint32_t i = 0; i < count; ++i) {
+            check(visits[i] == 1, "parallelFor visited item " + std::to_string(i) + " " + std::to_string(visits[i]) + " times");
+        }
+    }
+    out << '\t' << "parallelFor coverage OK" << '\n';
+
+    // A job started with a dependency must see all of the dependency's work.
+    for (uint32_t round = 0; round < 100; ++round) {
+        JobCounter first;
+        JobCounter second;
+        std::atomic<uint32_t> firstDone{ 0 };
+        std::atomic<uint32_t> orderViolations{ 0 };
+        for (uint32_t i = 0; i < 64; ++i) {
+            jobs.run(first, [&firstDone](uint32_t) {
+                spin(1, 200);
+                firstDone.fetch_add(1);
+            });
+        }
+        for (uint32_t i = 0; i < 64; ++i) {
+            jobs.run(second, [&firstDone, &orderViolations](uint32_t) {
+                if (firstDone.load() != 64) {
+                    orderViolations.fetch_add(1);
+                }
+            }, &first);
+        }
+        jobs.wait(second);
+        jobs.wait(first);
+        check(orderViolations.load() == 0, "a dependent job ran before its dependency finished");
+    }
+    out << '\t' << "Dependencies OK" << '\n';
+
+    // Jobs that start and wait on jobs of their own.
+    std::atomic<uint32_t> leaves{ 0 };
+    JobCounter outer;
+    for (uint32_t i = 0; i < 32; ++i) {
+        jobs.run(outer, [&jobs, &leaves](uint32_t) {
+            JobCounter inner;
+            for (uint32_t j = 0; j < 32; ++j) {
+                jobs.run(inner, [&leaves](uint32_t) { leaves.fetch_add(1); });
+            }
+            jobs.wait(inner);
+        });
+    }
+    jobs.wait(outer);
+    check(leaves.load() == 32 * 32, "nested jobs ran " + std::to_string(leaves.load()) + " leaves instead of 1024");
+    out << '\t' << "Nested jobs OK" << '\n';
+
+    bool caught = false;
+    try {
+        jobs.parallelFor(1000, 1, [](uint32_t begin, uint32_t, uint32_t) {
+            if (begin == 0) {
+                throw runtime_error("expected");
+            }
+        });
+    }
+    catch (const runtime_error&) {
+        caught = true;
+    }
+    check(caught, "an exception thrown by a job did not reach the waiter");
+    out << '\t' << "Exception propagation OK" << '\n';
+}
+
+void runSmallJobBenchmark(ostream& out, JobSystem& jobs) {
+    std::atomic<uint32_t> sink{ 0 };
+
+    double serialMs = bestOfMs([&] {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < SMALL_JOB_COUNT; ++i) {
+            sum += spin(i, SMALL_JOB_ITERATIONS);
+        }
+        sink += sum;
+    });
+
+    double jobMs = bestOfMs([&] {
+        // Started in batches from jobs, so no single worker's ring has to hold all of them at once.
+        JobCounter counter;
+        for (uint32_t first = 0; first < SMALL_JOB_COUNT; first += SMALL_JOB_BATCH) {
+            jobs.run(counter, [&jobs, &sink, first](uint32_t) {
+                JobCounter batch;
+                uint32_t last = std::min(first + SMALL_JOB_BATCH, SMALL_JOB_COUNT);
+                for (uint32_t i = first; i < last; ++i) {
+                    jobs.run(batch, [&sink, i](uint32_t) { sink += spin(i, SMALL_JOB_ITERATIONS); });
+                }
+                jobs.wait(batch);
+            });
+        }
+        jobs.wait(counter);
+    });
+
+    double asyncMs = bestOfMs([&] {
+        vector<std::future<uint32_t>> futures;
+        futures.reserve(SMALL_JOB_COUNT);
+        for (uint32_t i = 0; i < SMALL_JOB_COUNT; ++i) {
+            futures.push_back(std::async(std::launch::async, spin, i, SMALL_JOB_ITERATIONS));
+        }
+        uint32_t sum = 0;
+        for (std::future<uint32_t>& future : futures) {
+            sum += future.get();
+        }
+        sink += sum;
+    });
+
+    double jobCount = static_cast<double>(SMALL_JOB_COUNT);
+    out << '\t' << SMALL_JOB_COUNT << " small jobs:" << '\n';
+    out << "\t\tSerial: " << serialMs << " ms (" << serialMs * 1e6 / jobCount << " ns per job)" << '\n';
+    out << "\t\tJob system: " << jobMs << " ms (" << jobMs * 1e6 / jobCount << " ns per job), speedup " << serialMs / jobMs << "x" << '\n';
+    out << "\t\tstd::async: " << asyncMs << " ms (" << asyncMs * 1e6 / jobCount << " ns per job), speedup " << serialMs / asyncMs << "x" << '\n';
+    out << "\t\t(checksum " << sink.load() << ")" << '\n';
+}
+
+void runParallelLoopBenchmark(ostream& out, JobSystem& jobs) {
+    double serialSum = 0.0;
+    double serialMs = bestOfMs([&] {
+        double sum = 0.0;
+        for (uint32_t i = 0; i < LOOP_ITEM_COUNT; ++i) {
+            sum += loopItem(i);
+        }
+        serialSum = sum;
+    });
+
+    vector<double> partialSums(jobs.getWorkerCount());
+    double jobSum = 0.0;
+    double jobMs = bestOfMs([&] {
+        std::fill(partialSums.begin(), partialSums.end(), 0.0);
+        jobs.parallelFor(LOOP_ITEM_COUNT, LOOP_MIN_RANGE, [&partialSums](uint32_t begin, uint32_t end, uint32_t workerIndex) {
+            double sum = 0.0;
+            for (uint32_t i = begin; i < end; ++i) {
+                sum += loopItem(i);
+            }
+            partialSums[workerIndex] += sum;
+        });
+        jobSum = 0.0;
+        for (double sum : partialSums) {
+            jobSum += sum;
+        }
+    });
+
+    // The usual std::async version: one future per hardware thread, each with an equal share.
+    uint32_t taskCount = jobs.getWorkerCount();
+    double asyncSum = 0.0;
+    double asyncMs = bestOfMs([&] {
+        vector<std::future<double>> futures;
+        for (uint32_t task = 0; task < taskCount; ++task) {
+            uint32_t begin = static_cast<uint32_t>(uint64_t(LOOP_ITEM_COUNT) * task / taskCount);
+            uint32_t end = static_cast<uint32_t>(uint64_t(LOOP_ITEM_COUNT) * (task + 1) / taskCount);
+            futures.push_back(std::async(std::launch::async, [begin, end] {
+                double sum = 0.0;
+                for (uint32_t i = begin; i < end; ++i) {
+                    sum += loopItem(i);
+                }
+                return sum;
+            }));
+        }
+        asyncSum = 0.0;
+        for (std::future<double>& future : futures) {
+            asyncSum += future.get();
+        }
+    });
+
+    check(std::abs(jobSum - serialSum) <= 1e-9 * serialSum && std::abs(asyncSum - serialSum) <= 1e-9 * serialSum,
+        "parallel loop sums differ from the serial one");
+
+    out << '\t' << "Parallel loop over " << LOOP_ITEM_COUNT << " items:" << '\n';
+    out << "\t\tSerial: " << serialMs << " ms" << '\n';
+    out << "\t\tparallelFor: " << jobMs << " ms, speedup " << serialMs / jobMs << "x" << '\n';
+    out << "\t\tstd::async: " << asyncMs << " ms, speedup " << serialMs / asyncMs << "x" << '\n';
+}
+
+}
+
+void runJobSystemBenchmark(ostream& out) {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+
+    JobSystem jobs;
+    jobs.start(0);
+
+    out << "[Job System Self-Test]" << '\n';
+    runSelfTest(out, jobs);
+
+    out << "[Job System Benchmark]" << '\n';
+    out << '\t' << "Workers: " << jobs.getWorkerCount() << ", best of " << REPETITIONS << " runs" << '\n';
+    runSmallJobBenchmark(out, jobs);
+    runParallelLoopBenchmark(out, jobs);
+
+    jobs.stop();
+
+    out.flags(flags);
+    out.precision(precision);
+}
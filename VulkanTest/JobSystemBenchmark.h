@@ -0,0 +1,8 @@
+#pragma once
+
+#include <ostream>
+
+// CPU-only check and benchmark of the job system (--bench jobs). Checks that parallelFor() covers every item
+// once, that dependencies hold and that exceptions reach the waiter, then times fan-outs of small jobs and a
+// parallel loop against std::async. Throws runtime_error when a check fails.
+void runJobSystemBenchmark(std::ostream& out);
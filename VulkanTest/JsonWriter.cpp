@@ -0,0 +1,31 @@
+#include "JsonWriter.h"
+
+using std::string;
+
+string escapeJson(const string& text) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+
+    string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default: {
+            unsigned char code = static_cast<unsigned char>(c);
+            if (code < 0x20) {
+                escaped += "\\u00";
+                escaped += HEX_DIGITS[code >> 4];
+                escaped += HEX_DIGITS[code & 0xf];
+            } else {
+                escaped += c;
+            }
+            break;
+        }
+        }
+    }
+    return escaped;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <string>
+
+// Escapes text for a JSON string literal: quotes, backslashes and every control character.
+std::string escapeJson(const std::string& text);
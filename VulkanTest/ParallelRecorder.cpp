@@ -0,0 +1,149 @@
+#include "ParallelRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+#include "TraceRecorder.h"
+
+using std::ostream;
+using std::runtime_error;
+
+namespace {
+
+// Below this a chunk records faster than a worker wakes up, and every secondary adds its own state setup.
+constexpr const uint32_t MIN_ITEMS_PER_CHUNK = 256;
+
+}
+
+void ParallelRecorder::create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, JobSystem& jobs) {
+    this->device = device;
+    this->jobs = &jobs;
+    this->threadCount = jobs.getWorkerCount();
+
+    this->frames.resize(framesInFlight);
+    for (std::vector<WorkerCommands>& frame : this->frames) {
+        frame.resize(jobs.getWorkerCount());
+        for (WorkerCommands& commands : frame) {
+            VkCommandPoolCreateInfo poolInfo{};
+            poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+            poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+            poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+            if (vkCreateCommandPool(device, &poolInfo, HostAllocator::get().getCallbacks(), &commands.commandPool) != VK_SUCCESS) {
+                throw runtime_error("failed to create worker command pool!");
+            }
+        }
+    }
+}
+
+void ParallelRecorder::destroy() {
+    for (std::vector<WorkerCommands>& frame : this->frames) {
+        for (WorkerCommands& commands : frame) {
+            vkDestroyCommandPool(this->device, commands.commandPool, HostAllocator::get().getCallbacks());
+        }
+    }
+    this->frames.clear();
+}
+
+void ParallelRecorder::setThreadCount(uint32_t threadCount) {
+    this->threadCount = std::clamp(threadCount, 1u, this->jobs->getWorkerCount());
+}
+
+VkCommandBuffer ParallelRecorder::acquireSecondary(WorkerCommands& commands) {
+    if (commands.usedCount == commands.secondaries.size()) {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = commands.commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer commandBuffer;
+        if (vkAllocateCommandBuffers(this->device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw runtime_error("failed to allocate secondary command buffer!");
+        }
+        commands.secondaries.push_back(commandBuffer);
+    }
+    return commands.secondaries[commands.usedCount++];
+}
+
+void ParallelRecorder::recordRenderPass(VkCommandBuffer primary, const VkRenderPassBeginInfo& beginInfo, uint32_t frameIndex,
+    uint32_t itemCount, const RecordFunction& recordItems) {
+    auto start = std::chrono::steady_clock::now();
+
+    uint32_t chunkCount = std::min(this->threadCount, std::max(1u, itemCount / MIN_ITEMS_PER_CHUNK));
+
+    if (chunkCount == 1) {
+        vkCmdBeginRenderPass(primary, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        recordItems(primary, 0, itemCount);
+        vkCmdEndRenderPass(primary);
+    } else {
+        // The frame ring has waited for this frame's fence, so nothing recorded from these pools is still pending.
+        std::vector<WorkerCommands>& frame = this->frames[frameIndex];
+        for (WorkerCommands& commands : frame) {
+            if (commands.usedCount > 0) {
+                vkResetCommandPool(this->device, commands.commandPool, 0);
+                commands.usedCount = 0;
+            }
+        }
+
+        VkCommandBufferInheritanceInfo inheritance{};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.renderPass = beginInfo.renderPass;
+        inheritance.subpass = 0;
+        inheritance.framebuffer = beginInfo.framebuffer;
+
+        this->chunkBuffers.resize(chunkCount);
+        // One job per chunk; whichever worker runs it records from its own pool.
+        this->jobs->parallelFor(chunkCount, 1, [&](uint32_t firstChunk, uint32_t endChunk, uint32_t workerIndex) {
+            for (uint32_t chunk = firstChunk; chunk < endChunk; ++chunk) {
+                TraceRecorder::Scope traceScope("recordChunk");
+                uint32_t firstItem = static_cast<uint32_t>(uint64_t(itemCount) * chunk / chunkCount);
+                uint32_t endItem = static_cast<uint32_t>(uint64_t(itemCount) * (chunk + 1) / chunkCount);
+
+                VkCommandBuffer secondary = this->acquireSecondary(frame[workerIndex]);
+
+                VkCommandBufferBeginInfo secondaryBeginInfo{};
+                secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                secondaryBeginInfo.pInheritanceInfo = &inheritance;
+
+                if (vkBeginCommandBuffer(secondary, &secondaryBeginInfo) != VK_SUCCESS) {
+                    throw runtime_error("failed to begin recording secondary command buffer!");
+                }
+                recordItems(secondary, firstItem, endItem - firstItem);
+                if (vkEndCommandBuffer(secondary) != VK_SUCCESS) {
+                    throw runtime_error("failed to record secondary command buffer!");
+                }
+
+                this->chunkBuffers[chunk] = secondary;
+            }
+        });
+
+        vkCmdBeginRenderPass(primary, &beginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        vkCmdExecuteCommands(primary, chunkCount, this->chunkBuffers.data());
+        vkCmdEndRenderPass(primary);
+        this->secondaryCount += chunkCount;
+    }
+
+    ++this->passCount;
+    this->recordTime.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void ParallelRecorder::resetStatistics() {
+    this->recordTime = TimingAccumulator{};
+    this->secondaryCount = 0;
+    this->passCount = 0;
+}
+
+void ParallelRecorder::printStatistics(ostream& out) const {
+    out << "[Command Recording]" << '\n';
+    out << "\tThreads: " << this->threadCount << " of " << this->jobs->getWorkerCount() << " workers" << '\n';
+    if (this->passCount == 0) {
+        return;
+    }
+    out << "\tRecord time: avg " << this->recordTime.average() << " ms, min " << this->recordTime.minMs
+        << " ms, max " << this->recordTime.maxMs << " ms" << '\n';
+    out << "\tSecondary command buffers per pass: " << static_cast<double>(this->secondaryCount) / static_cast<double>(this->passCount) << '\n';
+}
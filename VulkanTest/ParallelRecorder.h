@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "FrameRing.h"
+#include "JobSystem.h"
+
+// Records the contents of a render pass on several threads.
+//
+// The items (draws) are split into contiguous chunks, each recorded by a job into a secondary command buffer
+// allocated from the running worker's own command pool for the frame in flight, so no pool is ever shared
+// between threads. The secondaries are then executed in item order, which keeps the result identical to recording
+// everything on one thread. Pools are reset wholesale when their frame comes around again.
+class ParallelRecorder {
+
+public:
+
+    // Records items [firstItem, firstItem + itemCount); secondaries inherit nothing but the render pass,
+    // so the pipeline and dynamic state have to be bound every time.
+    using RecordFunction = std::function<void(VkCommandBuffer commandBuffer, uint32_t firstItem, uint32_t itemCount)>;
+
+    void create(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, JobSystem& jobs);
+    void destroy();
+
+    // How many chunks a pass is split into, at most the job system's worker count.
+    void setThreadCount(uint32_t threadCount);
+    uint32_t getThreadCount() const { return this->threadCount; }
+
+    // Begins the render pass in `primary`, records all items and ends it. With one thread, or too few items to
+    // be worth splitting, the items go straight into the primary command buffer.
+    void recordRenderPass(VkCommandBuffer primary, const VkRenderPassBeginInfo& beginInfo, uint32_t frameIndex,
+        uint32_t itemCount, const RecordFunction& recordItems);
+
+    const TimingAccumulator& getRecordTime() const { return this->recordTime; }
+    void resetStatistics();
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct WorkerCommands {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> secondaries;
+        uint32_t usedCount = 0;
+    };
+
+    VkCommandBuffer acquireSecondary(WorkerCommands& commands);
+
+    VkDevice device = VK_NULL_HANDLE;
+    JobSystem* jobs = nullptr;
+    uint32_t threadCount = 1;
+
+    // [frame in flight][worker]
+    std::vector<std::vector<WorkerCommands>> frames;
+    // Indexed by chunk, so executing them in order reproduces the item order.
+    std::vector<VkCommandBuffer> chunkBuffers;
+
+    TimingAccumulator recordTime;
+    uint64_t secondaryCount = 0;
+    uint64_t passCount = 0;
+};
@@ -0,0 +1,231 @@
+#include "PipelineCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+
+#include "HostAllocator.h"
+
+using std::string;
+using std::vector;
+using std::ostream;
+using std::ifstream;
+using std::ofstream;
+using std::runtime_error;
+
+uint64_t PipelineCache::hashData(const vector<char>& data) {
+    // FNV-1a; this guards against truncated or torn files, not against tampering.
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : data) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+PipelineCache::FileHeader PipelineCache::makeHeader() const {
+    FileHeader header{};
+    header.magic = FILE_MAGIC;
+    header.fileVersion = FILE_VERSION;
+    header.vendorID = this->properties.vendorID;
+    header.deviceID = this->properties.deviceID;
+    header.driverVersion = this->properties.driverVersion;
+    memcpy(header.pipelineCacheUUID, this->properties.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+vector<char> PipelineCache::loadValidatedData(const string& path) {
+    ifstream file(path, std::ios::binary);
+    if (!file) {
+        this->loadStatus = "no cache file, starting empty";
+        return {};
+    }
+
+    FileHeader header{};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        this->loadStatus = "rejected: file too small";
+        return {};
+    }
+
+    FileHeader expected = this->makeHeader();
+    if (header.magic != expected.magic || header.fileVersion != expected.fileVersion) {
+        this->loadStatus = "rejected: unknown file format";
+        return {};
+    }
+    if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID) {
+        this->loadStatus = "rejected: written by a different device";
+        return {};
+    }
+    if (header.driverVersion != expected.driverVersion) {
+        this->loadStatus = "rejected: written by a different driver version";
+        return {};
+    }
+    if (memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        this->loadStatus = "rejected: pipeline cache UUID changed";
+        return {};
+    }
+
+    // Checked before allocating: a corrupt header could otherwise ask for gigabytes.
+    std::streamoff dataStart = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff fileEnd = file.tellg();
+    file.seekg(dataStart);
+    if (dataStart < 0 || fileEnd < dataStart || static_cast<uint64_t>(fileEnd - dataStart) != header.dataSize) {
+        this->loadStatus = "rejected: size does not match header";
+        return {};
+    }
+
+    vector<char> data(static_cast<size_t>(header.dataSize));
+    if (!file.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+        this->loadStatus = "rejected: size does not match header";
+        return {};
+    }
+    if (hashData(data) != header.dataHash) {
+        this->loadStatus = "rejected: checksum mismatch";
+        return {};
+    }
+
+    // The driver validates its own header too, but a mismatch there would silently give us an empty cache.
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    if (data.size() < sizeof(driverHeader)) {
+        this->loadStatus = "rejected: driver header missing";
+        return {};
+    }
+    memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerSize < sizeof(driverHeader) || driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        || driverHeader.vendorID != expected.vendorID || driverHeader.deviceID != expected.deviceID
+        || memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        this->loadStatus = "rejected: driver header does not match device";
+        return {};
+    }
+
+    this->loadedSize = data.size();
+    this->loadedHash = header.dataHash;
+    this->loadStatus = "loaded " + std::to_string(data.size()) + " bytes";
+    return data;
+}
+
+void PipelineCache::create(const VkPhysicalDeviceProperties& properties, VkDevice device, const string& path) {
+    this->device = device;
+    this->path = path;
+    this->properties = properties;
+
+    vector<char> initialData = this->loadValidatedData(path);
+
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = initialData.size();
+    createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+    if (vkCreatePipelineCache(device, &createInfo, HostAllocator::get().getCallbacks(), &this->cache) != VK_SUCCESS) {
+        throw runtime_error("failed to create pipeline cache!");
+    }
+}
+
+VkPipelineCache PipelineCache::createThreadCache() {
+    VkPipelineCacheCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+    VkPipelineCache threadCache;
+    if (vkCreatePipelineCache(this->device, &createInfo, HostAllocator::get().getCallbacks(), &threadCache) != VK_SUCCESS) {
+        throw runtime_error("failed to create thread pipeline cache!");
+    }
+
+    std::lock_guard<std::mutex> lock(this->threadCachesMutex);
+    this->threadCaches.push_back(threadCache);
+    return threadCache;
+}
+
+void PipelineCache::mergeThreadCaches() {
+    std::lock_guard<std::mutex> lock(this->threadCachesMutex);
+    if (this->threadCaches.empty()) {
+        return;
+    }
+
+    if (vkMergePipelineCaches(this->device, this->cache, static_cast<uint32_t>(this->threadCaches.size()), this->threadCaches.data()) != VK_SUCCESS) {
+        throw runtime_error("failed to merge pipeline caches!");
+    }
+    for (VkPipelineCache threadCache : this->threadCaches) {
+        vkDestroyPipelineCache(this->device, threadCache, HostAllocator::get().getCallbacks());
+    }
+    this->threadCaches.clear();
+}
+
+void PipelineCache::save() {
+    if (this->cache == VK_NULL_HANDLE || this->path.empty()) {
+        return;
+    }
+
+    this->mergeThreadCaches();
+
+    size_t dataSize = 0;
+    vkGetPipelineCacheData(this->device, this->cache, &dataSize, nullptr);
+    vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(this->device, this->cache, &dataSize, data.data()) != VK_SUCCESS) {
+        this->saveStatus = "not saved: failed to read cache data";
+        return;
+    }
+    data.resize(dataSize);
+
+    FileHeader header = this->makeHeader();
+    header.dataSize = data.size();
+    header.dataHash = hashData(data);
+
+    if (header.dataSize == this->loadedSize && header.dataHash == this->loadedHash) {
+        this->saveStatus = "unchanged, not rewritten";
+        return;
+    }
+
+    // Write next to the target and rename over it, so a crash mid-write never leaves a torn cache behind.
+    string temporaryPath = this->path + ".tmp";
+    {
+        ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        file.close();
+        if (!file) {
+            std::error_code ignored;
+            std::filesystem::remove(temporaryPath, ignored);
+            this->saveStatus = "not saved: failed to write " + temporaryPath;
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, this->path, error);
+    if (error) {
+        std::error_code ignored;
+        std::filesystem::remove(temporaryPath, ignored);
+        this->saveStatus = "not saved: " + error.message();
+        return;
+    }
+
+    this->loadedSize = data.size();
+    this->loadedHash = header.dataHash;
+    this->saveStatus = "saved " + std::to_string(data.size()) + " bytes";
+}
+
+void PipelineCache::destroy() {
+    {
+        std::lock_guard<std::mutex> lock(this->threadCachesMutex);
+        for (VkPipelineCache threadCache : this->threadCaches) {
+            vkDestroyPipelineCache(this->device, threadCache, HostAllocator::get().getCallbacks());
+        }
+        this->threadCaches.clear();
+    }
+
+    if (this->cache != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(this->device, this->cache, HostAllocator::get().getCallbacks());
+        this->cache = VK_NULL_HANDLE;
+    }
+}
+
+void PipelineCache::print(ostream& out) const {
+    out << "[Pipeline Cache]" << '\n';
+    out << '\t' << "Path: " << this->path << '\n';
+    out << '\t' << "Load: " << this->loadStatus << '\n';
+    if (!this->saveStatus.empty()) {
+        out << '\t' << "Save: " << this->saveStatus << '\n';
+    }
+}
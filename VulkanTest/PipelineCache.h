@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// A VkPipelineCache that survives restarts.
+//
+// The blob is stored behind a small header of our own recording the device identity and driver version, because
+// the driver's header alone does not cover driverVersion and a stale cache from an older driver is at best
+// useless. Anything that does not match exactly is discarded and the cache starts empty.
+class PipelineCache {
+
+public:
+
+    PipelineCache() = default;
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    void create(const VkPhysicalDeviceProperties& properties, VkDevice device, const std::string& path);
+    // Merges the thread caches, then writes the data to a temporary file and renames it over the old one.
+    void save();
+    void destroy();
+
+    VkPipelineCache getHandle() const { return this->cache; }
+
+    // Worker threads compiling pipelines use their own cache to avoid contending on the main one;
+    // the results are merged back into it by mergeThreadCaches() or save().
+    VkPipelineCache createThreadCache();
+    void mergeThreadCaches();
+
+    void print(std::ostream& out) const;
+
+private:
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t fileVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+        uint64_t dataHash;
+    };
+
+    static constexpr const uint32_t FILE_MAGIC = 0x43505456; // "VTPC"
+    static constexpr const uint32_t FILE_VERSION = 1;
+
+    static uint64_t hashData(const std::vector<char>& data);
+
+    FileHeader makeHeader() const;
+    std::vector<char> loadValidatedData(const std::string& path);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties{};
+    std::string path;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+
+    std::mutex threadCachesMutex;
+    std::vector<VkPipelineCache> threadCaches;
+
+    size_t loadedSize = 0;
+    uint64_t loadedHash = 0;
+    std::string loadStatus;
+    std::string saveStatus;
+};
@@ -0,0 +1,166 @@
+#include "QueuePool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+using std::vector;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+using std::runtime_error;
+
+const char* getQueueRoleString(QueueRole role) {
+    switch (role) {
+    case QueueRole::Graphics: return "Graphics";
+    case QueueRole::Compute: return "Compute";
+    case QueueRole::Transfer: return "Transfer";
+    case QueueRole::Present: return "Present";
+    default: return "Unknown Queue Role";
+    }
+}
+
+size_t QueuePool::getUniqueIndex(uint32_t familyIndex, uint32_t queueIndex) {
+    for (size_t i = 0; i < this->uniqueQueues.size(); ++i) {
+        if (this->uniqueQueues[i].first == familyIndex && this->uniqueQueues[i].second == queueIndex) {
+            return i;
+        }
+    }
+    this->uniqueQueues.emplace_back(familyIndex, queueIndex);
+    this->leasable.push_back(true);
+    return this->uniqueQueues.size() - 1;
+}
+
+void QueuePool::plan(const vector<VkQueueFamilyProperties>& queueFamilies, const vector<QueueRequest>& requests) {
+    this->familyPriorities.clear();
+    for (auto& slots : this->roleSlots) {
+        slots.clear();
+    }
+    this->uniqueQueues.clear();
+    this->leasable.clear();
+
+    for (const QueueRequest& request : requests) {
+        if (request.familyIndex >= queueFamilies.size()) {
+            throw runtime_error("queue request for a family the device does not have!");
+        }
+        if (request.priorities.empty()) {
+            throw runtime_error("queue request without any queue!");
+        }
+
+        uint32_t familyQueueCount = queueFamilies[request.familyIndex].queueCount;
+        vector<float>& priorities = this->familyPriorities[request.familyIndex];
+        vector<Slot>& slots = this->roleSlots[static_cast<size_t>(request.role)];
+
+        for (float priority : request.priorities) {
+            if (priority < 0.0f || priority > 1.0f) {
+                throw runtime_error("queue priorities must be between 0.0 and 1.0!");
+            }
+
+            uint32_t queueIndex;
+            if (priorities.size() < familyQueueCount) {
+                queueIndex = static_cast<uint32_t>(priorities.size());
+                priorities.push_back(priority);
+            } else {
+                queueIndex = static_cast<uint32_t>(slots.size() % familyQueueCount);
+                priorities[queueIndex] = std::max(priorities[queueIndex], priority);
+            }
+
+            slots.push_back({ request.familyIndex, queueIndex, this->getUniqueIndex(request.familyIndex, queueIndex), VK_NULL_HANDLE });
+        }
+    }
+
+    // A role's primary queue is used by the render thread without a lease, so it can never be handed out.
+    for (const auto& slots : this->roleSlots) {
+        if (!slots.empty()) {
+            this->leasable[slots.front().uniqueIndex] = false;
+        }
+    }
+
+    this->leased.reset(new std::atomic<bool>[this->uniqueQueues.size()]);
+    for (size_t i = 0; i < this->uniqueQueues.size(); ++i) {
+        this->leased[i].store(false, std::memory_order_relaxed);
+    }
+}
+
+void QueuePool::shareQueue(QueueRole role, QueueRole source) {
+    const vector<Slot>& sourceSlots = this->roleSlots[static_cast<size_t>(source)];
+    if (sourceSlots.empty()) {
+        throw runtime_error("cannot share a queue with a role that has none!");
+    }
+    this->roleSlots[static_cast<size_t>(role)] = { sourceSlots.front() };
+}
+
+vector<VkDeviceQueueCreateInfo> QueuePool::getCreateInfos() const {
+    vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (const auto& [familyIndex, priorities] : this->familyPriorities) {
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = familyIndex;
+        queueCreateInfo.queueCount = static_cast<uint32_t>(priorities.size());
+        queueCreateInfo.pQueuePriorities = priorities.data();
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+    return queueCreateInfos;
+}
+
+void QueuePool::retrieveQueues(VkDevice device) {
+    for (auto& slots : this->roleSlots) {
+        for (Slot& slot : slots) {
+            vkGetDeviceQueue(device, slot.familyIndex, slot.queueIndex, &slot.queue);
+        }
+    }
+}
+
+bool QueuePool::hasRole(QueueRole role) const {
+    return !this->roleSlots[static_cast<size_t>(role)].empty();
+}
+
+uint32_t QueuePool::getFamilyIndex(QueueRole role) const {
+    return this->roleSlots[static_cast<size_t>(role)].at(0).familyIndex;
+}
+
+uint32_t QueuePool::getQueueCount(QueueRole role) const {
+    return static_cast<uint32_t>(this->roleSlots[static_cast<size_t>(role)].size());
+}
+
+VkQueue QueuePool::getQueue(QueueRole role, uint32_t index) const {
+    return this->roleSlots[static_cast<size_t>(role)].at(index).queue;
+}
+
+optional<QueuePool::QueueHandle> QueuePool::tryAcquire(QueueRole role) {
+    for (const Slot& slot : this->roleSlots[static_cast<size_t>(role)]) {
+        if (!this->leasable[slot.uniqueIndex]) {
+            continue;
+        }
+
+        bool expected = false;
+        if (this->leased[slot.uniqueIndex].compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return QueueHandle{ slot.queue, slot.familyIndex, slot.queueIndex };
+        }
+    }
+    return nullopt;
+}
+
+void QueuePool::release(const QueueHandle& handle) {
+    for (size_t i = 0; i < this->uniqueQueues.size(); ++i) {
+        if (this->uniqueQueues[i].first == handle.familyIndex && this->uniqueQueues[i].second == handle.queueIndex) {
+            this->leased[i].store(false, std::memory_order_release);
+            return;
+        }
+    }
+}
+
+void QueuePool::print(ostream& out) const {
+    out << "[Queues]" << '\n';
+    for (size_t role = 0; role < QUEUE_ROLE_COUNT; ++role) {
+        const vector<Slot>& slots = this->roleSlots[role];
+        if (slots.empty()) {
+            continue;
+        }
+
+        out << '\t' << getQueueRoleString(static_cast<QueueRole>(role)) << ": family " << slots.front().familyIndex << ", queues";
+        for (const Slot& slot : slots) {
+            out << ' ' << slot.queueIndex << " (" << this->familyPriorities.at(slot.familyIndex)[slot.queueIndex] << ")";
+        }
+        out << '\n';
+    }
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+enum class QueueRole {
+    Graphics,
+    Compute,
+    Transfer,
+    Present,
+};
+
+static constexpr const size_t QUEUE_ROLE_COUNT = 4;
+
+// How many queues a role wants from its family, one priority per queue.
+struct QueueRequest {
+    QueueRole role;
+    uint32_t familyIndex;
+    std::vector<float> priorities;
+};
+
+// Owns every VkQueue of the logical device.
+// Requests for the same family are packed into a single VkDeviceQueueCreateInfo and clamped to the family's
+// queueCount; once a family is full, further requests share its queues round-robin at the highest priority
+// any of them asked for.
+// Slot 0 of every role is that role's primary queue and belongs to the render thread. The other slots can be
+// leased exclusively by submission threads, so each thread owns its queue and never contends on a lock.
+class QueuePool {
+
+public:
+
+    struct QueueHandle {
+        VkQueue queue = VK_NULL_HANDLE;
+        uint32_t familyIndex = 0;
+        uint32_t queueIndex = 0;
+    };
+
+    void plan(const std::vector<VkQueueFamilyProperties>& queueFamilies, const std::vector<QueueRequest>& requests);
+
+    // Makes a role use another role's primary queue instead of one of its own, e.g. presenting on the
+    // graphics queue when both live in the same family.
+    void shareQueue(QueueRole role, QueueRole source);
+
+    // Valid until the next call to plan(); the priorities they point at are owned by the pool.
+    std::vector<VkDeviceQueueCreateInfo> getCreateInfos() const;
+
+    void retrieveQueues(VkDevice device);
+
+    bool hasRole(QueueRole role) const;
+    uint32_t getFamilyIndex(QueueRole role) const;
+    uint32_t getQueueCount(QueueRole role) const;
+    VkQueue getQueue(QueueRole role, uint32_t index = 0) const;
+
+    // Leases a non-primary queue of the role that no other thread holds, if there is one left.
+    std::optional<QueueHandle> tryAcquire(QueueRole role);
+    void release(const QueueHandle& handle);
+
+    void print(std::ostream& out) const;
+
+private:
+
+    struct Slot {
+        uint32_t familyIndex;
+        uint32_t queueIndex;
+        size_t uniqueIndex;
+        VkQueue queue;
+    };
+
+    size_t getUniqueIndex(uint32_t familyIndex, uint32_t queueIndex);
+
+    std::map<uint32_t, std::vector<float>> familyPriorities;
+    std::array<std::vector<Slot>, QUEUE_ROLE_COUNT> roleSlots;
+    std::vector<std::pair<uint32_t, uint32_t>> uniqueQueues;
+    std::vector<bool> leasable;
+    std::unique_ptr<std::atomic<bool>[]> leased;
+};
+
+const char* getQueueRoleString(QueueRole role);
@@ -0,0 +1,794 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Every stage and access bit a ResourceUsage maps to has the same value in the legacy 32-bit enums,
+// so converting for vkCmdPipelineBarrier is a truncation. NONE has no legacy equivalent.
+VkPipelineStageFlags toLegacyStages(VkPipelineStageFlags2 stages, VkPipelineStageFlags none) {
+    return stages == VK_PIPELINE_STAGE_2_NONE ? none : static_cast<VkPipelineStageFlags>(stages);
+}
+
+VkAccessFlags toLegacyAccess(VkAccessFlags2 access) {
+    return static_cast<VkAccessFlags>(access);
+}
+
+// Only writes have to be made available; read bits in a source access mask do nothing.
+VkAccessFlags2 getWriteAccess(VkAccessFlags2 access) {
+    return access & (VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT);
+}
+
+bool isImageUsage(ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::IndirectArgument:
+    case ResourceUsage::VertexBuffer:
+    case ResourceUsage::IndexBuffer:
+        return false;
+    default:
+        return true;
+    }
+}
+
+bool isBufferUsage(ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::TransferSrc:
+    case ResourceUsage::TransferDst:
+    case ResourceUsage::ComputeStorageRead:
+    case ResourceUsage::ComputeStorageWrite:
+    case ResourceUsage::IndirectArgument:
+    case ResourceUsage::VertexBuffer:
+    case ResourceUsage::IndexBuffer:
+        return true;
+    default:
+        return false;
+    }
+}
+
+VkImageUsageFlags getImageUsageFlags(ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    case ResourceUsage::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    case ResourceUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    case ResourceUsage::DepthAttachment:
+    case ResourceUsage::DepthRead: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    case ResourceUsage::FragmentSampled:
+    case ResourceUsage::ComputeSampled: return VK_IMAGE_USAGE_SAMPLED_BIT;
+    case ResourceUsage::ComputeStorageRead:
+    case ResourceUsage::ComputeStorageWrite: return VK_IMAGE_USAGE_STORAGE_BIT;
+    default: return 0;
+    }
+}
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+double toMiB(VkDeviceSize bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+}
+
+const char* getResourceUsageString(ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::TransferSrc: return "transfer src";
+    case ResourceUsage::TransferDst: return "transfer dst";
+    case ResourceUsage::ColorAttachment: return "color attachment";
+    case ResourceUsage::DepthAttachment: return "depth attachment";
+    case ResourceUsage::DepthRead: return "depth read";
+    case ResourceUsage::FragmentSampled: return "fragment sampled";
+    case ResourceUsage::ComputeSampled: return "compute sampled";
+    case ResourceUsage::ComputeStorageRead: return "compute storage read";
+    case ResourceUsage::ComputeStorageWrite: return "compute storage write";
+    case ResourceUsage::IndirectArgument: return "indirect argument";
+    case ResourceUsage::VertexBuffer: return "vertex buffer";
+    case ResourceUsage::IndexBuffer: return "index buffer";
+    case ResourceUsage::Present: return "present";
+    default: return "unknown";
+    }
+}
+
+void RenderGraph::PassBuilder::read(RenderGraphResource resource, ResourceUsage usage) {
+    this->graph.addAccess(this->passIndex, resource, usage, false);
+}
+
+void RenderGraph::PassBuilder::write(RenderGraphResource resource, ResourceUsage usage) {
+    this->graph.addAccess(this->passIndex, resource, usage, true);
+}
+
+void RenderGraph::PassBuilder::setSideEffects() {
+    this->graph.passes[this->passIndex].sideEffects = true;
+}
+
+RenderGraph::ResourceState RenderGraph::getUsageState(ResourceUsage usage) {
+    ResourceState state;
+    switch (usage) {
+    case ResourceUsage::TransferSrc:
+        state = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+        break;
+    case ResourceUsage::TransferDst:
+        state = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+        break;
+    case ResourceUsage::ColorAttachment:
+        state = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+        break;
+    case ResourceUsage::DepthAttachment:
+        state = { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+        break;
+    case ResourceUsage::DepthRead:
+        state = { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, false };
+        break;
+    case ResourceUsage::FragmentSampled:
+        state = { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        break;
+    case ResourceUsage::ComputeSampled:
+        state = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        break;
+    case ResourceUsage::ComputeStorageRead:
+        state = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+        break;
+    case ResourceUsage::ComputeStorageWrite:
+        state = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+        break;
+    case ResourceUsage::IndirectArgument:
+        state = { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+        break;
+    case ResourceUsage::VertexBuffer:
+        state = { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+        break;
+    case ResourceUsage::IndexBuffer:
+        state = { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+        break;
+    case ResourceUsage::Present:
+        // The presentation engine is ordered by the semaphore, the barrier only has to change the layout.
+        state = { VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+        break;
+    }
+    return state;
+}
+
+void RenderGraph::create(VkDevice device, DeviceMemoryAllocator& allocator, bool synchronization2) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->synchronization2 = synchronization2;
+}
+
+void RenderGraph::destroy() {
+    this->destroyTransientImages();
+    this->resources.clear();
+    this->passes.clear();
+    this->finalBarriers.clear();
+    this->compiled = false;
+    this->transientBytesUnaliased = 0;
+    this->transientBytesAliased = 0;
+    this->naiveBarrierCount = 0;
+    this->barrierCount = 0;
+    this->barrierBatchCount = 0;
+}
+
+void RenderGraph::destroyTransientImages() {
+    for (Resource& resource : this->resources) {
+        if (resource.imported) {
+            continue;
+        }
+        if (resource.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(this->device, resource.view, HostAllocator::get().getCallbacks());
+            resource.view = VK_NULL_HANDLE;
+        }
+        if (resource.image != VK_NULL_HANDLE) {
+            vkDestroyImage(this->device, resource.image, HostAllocator::get().getCallbacks());
+            resource.image = VK_NULL_HANDLE;
+        }
+        this->allocator->free(resource.ownAllocation);
+    }
+    this->allocator->free(this->transientMemory);
+}
+
+RenderGraphResource RenderGraph::addResource(Resource resource) {
+    if (this->compiled) {
+        throw runtime_error("render graph is already compiled!");
+    }
+    this->resources.push_back(std::move(resource));
+    return RenderGraphResource{ static_cast<uint32_t>(this->resources.size() - 1) };
+}
+
+RenderGraphResource RenderGraph::importImage(const string& name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect,
+    ResourceUsage finalUsage) {
+    Resource resource;
+    resource.name = name;
+    resource.imported = true;
+    resource.format = format;
+    resource.extent = extent;
+    resource.aspect = aspect;
+    resource.finalUsage = finalUsage;
+    return this->addResource(std::move(resource));
+}
+
+RenderGraphResource RenderGraph::importBuffer(const string& name, VkDeviceSize size) {
+    Resource resource;
+    resource.name = name;
+    resource.isImage = false;
+    resource.imported = true;
+    resource.bufferSize = size;
+    return this->addResource(std::move(resource));
+}
+
+RenderGraphResource RenderGraph::createImage(const string& name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect) {
+    Resource resource;
+    resource.name = name;
+    resource.format = format;
+    resource.extent = extent;
+    resource.aspect = aspect;
+    return this->addResource(std::move(resource));
+}
+
+void RenderGraph::addPass(const string& name, const std::function<void(PassBuilder&)>& setup, ExecuteFunction execute) {
+    if (this->compiled) {
+        throw runtime_error("render graph is already compiled!");
+    }
+
+    Pass pass;
+    pass.name = name;
+    pass.execute = std::move(execute);
+    this->passes.push_back(std::move(pass));
+
+    PassBuilder builder(*this, static_cast<uint32_t>(this->passes.size() - 1));
+    setup(builder);
+}
+
+void RenderGraph::addAccess(uint32_t passIndex, RenderGraphResource handle, ResourceUsage usage, bool write) {
+    Pass& pass = this->passes[passIndex];
+    const Resource& resource = this->resources.at(handle.index);
+
+    if (usage == ResourceUsage::Present) {
+        throw runtime_error("render graph pass " + pass.name + " cannot use " + resource.name + " for presenting!");
+    }
+    if (resource.isImage ? !isImageUsage(usage) : !isBufferUsage(usage)) {
+        throw runtime_error(string("render graph pass ") + pass.name + " uses " + resource.name + " as " + getResourceUsageString(usage) + "!");
+    }
+    // One state per resource and pass: a barrier cannot be placed between two accesses inside a pass.
+    for (const Access& access : pass.accesses) {
+        if (access.resource == handle.index) {
+            throw runtime_error("render graph pass " + pass.name + " accesses " + resource.name + " twice!");
+        }
+    }
+
+    pass.accesses.push_back({ handle.index, usage, write });
+}
+
+void RenderGraph::compile() {
+    if (this->compiled) {
+        throw runtime_error("render graph is already compiled!");
+    }
+
+    this->cullPasses();
+    this->computeLifetimes();
+    this->createTransientImages();
+    this->placeTransientImages();
+    this->computeBarriers();
+    this->compiled = true;
+}
+
+void RenderGraph::cullPasses() {
+    // Walking backwards, a pass survives when it has side effects or writes something a later surviving
+    // pass reads or the outside world sees (any imported resource). Its reads are then needed in turn.
+    vector<bool> needed(this->resources.size());
+    for (size_t i = 0; i < this->resources.size(); ++i) {
+        needed[i] = this->resources[i].imported;
+    }
+
+    for (auto pass = this->passes.rbegin(); pass != this->passes.rend(); ++pass) {
+        bool keep = pass->sideEffects;
+        for (const Access& access : pass->accesses) {
+            keep = keep || (access.write && needed[access.resource]);
+        }
+
+        pass->culled = !keep;
+        if (keep) {
+            for (const Access& access : pass->accesses) {
+                if (!access.write) {
+                    needed[access.resource] = true;
+                }
+            }
+        }
+    }
+}
+
+void RenderGraph::computeLifetimes() {
+    for (uint32_t passIndex = 0; passIndex < this->passes.size(); ++passIndex) {
+        const Pass& pass = this->passes[passIndex];
+        if (pass.culled) {
+            continue;
+        }
+        for (const Access& access : pass.accesses) {
+            Resource& resource = this->resources[access.resource];
+            resource.firstPass = std::min(resource.firstPass, passIndex);
+            resource.lastPass = std::max(resource.lastPass, passIndex);
+            resource.imageUsage |= getImageUsageFlags(access.usage);
+        }
+    }
+}
+
+void RenderGraph::createTransientImages() {
+    for (Resource& resource : this->resources) {
+        // Transients that only culled passes touched are never created.
+        if (resource.imported || resource.firstPass == UINT32_MAX) {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = resource.format;
+        imageInfo.extent = { resource.extent.width, resource.extent.height, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = resource.imageUsage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(this->device, &imageInfo, HostAllocator::get().getCallbacks(), &resource.image) != VK_SUCCESS) {
+            throw runtime_error("failed to create render graph image " + resource.name + "!");
+        }
+        vkGetImageMemoryRequirements(this->device, resource.image, &resource.memoryRequirements);
+    }
+}
+
+void RenderGraph::placeTransientImages() {
+    struct Placement {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+        uint32_t firstPass;
+        uint32_t lastPass;
+    };
+
+    vector<uint32_t> order;
+    for (uint32_t i = 0; i < this->resources.size(); ++i) {
+        if (this->resources[i].image != VK_NULL_HANDLE && !this->resources[i].imported) {
+            order.push_back(i);
+        }
+    }
+    // Largest first, so small images fill the gaps that the large ones leave.
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return this->resources[a].memoryRequirements.size > this->resources[b].memoryRequirements.size;
+    });
+
+    vector<Placement> placements;
+    VkMemoryRequirements sharedRequirements{ 0, 1, ~0u };
+
+    for (uint32_t index : order) {
+        Resource& resource = this->resources[index];
+        const VkMemoryRequirements& requirements = resource.memoryRequirements;
+        this->transientBytesUnaliased += requirements.size;
+
+        // An image that cannot live in the same memory type as the others gets memory of its own.
+        if ((sharedRequirements.memoryTypeBits & requirements.memoryTypeBits) == 0) {
+            continue;
+        }
+        sharedRequirements.memoryTypeBits &= requirements.memoryTypeBits;
+        sharedRequirements.alignment = std::max(sharedRequirements.alignment, requirements.alignment);
+
+        // Only images alive during the same passes compete for space; find the lowest gap between them.
+        vector<Placement> overlapping;
+        for (const Placement& placement : placements) {
+            if (placement.firstPass <= resource.lastPass && resource.firstPass <= placement.lastPass) {
+                overlapping.push_back(placement);
+            }
+        }
+        std::sort(overlapping.begin(), overlapping.end(), [](const Placement& a, const Placement& b) { return a.offset < b.offset; });
+
+        VkDeviceSize offset = 0;
+        for (const Placement& placement : overlapping) {
+            if (alignUp(offset, requirements.alignment) + requirements.size <= placement.offset) {
+                break;
+            }
+            offset = std::max(offset, placement.offset + placement.size);
+        }
+        offset = alignUp(offset, requirements.alignment);
+
+        resource.aliasOffset = offset;
+        placements.push_back({ offset, requirements.size, resource.firstPass, resource.lastPass });
+        sharedRequirements.size = std::max(sharedRequirements.size, offset + requirements.size);
+    }
+
+    if (sharedRequirements.size > 0) {
+        this->transientMemory = this->allocator->allocateMemory(sharedRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            AllocationLifetime::LongLived, ResourceKind::Optimal);
+        this->transientBytesAliased += sharedRequirements.size;
+    }
+
+    for (uint32_t index : order) {
+        Resource& resource = this->resources[index];
+        if (resource.aliasOffset.has_value()) {
+            if (vkBindImageMemory(this->device, resource.image, this->transientMemory.memory, this->transientMemory.offset + *resource.aliasOffset) != VK_SUCCESS) {
+                throw runtime_error("failed to bind render graph image " + resource.name + "!");
+            }
+        } else {
+            resource.ownAllocation = this->allocator->allocateForImage(resource.image, VK_IMAGE_TILING_OPTIMAL,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+            this->transientBytesAliased += resource.ownAllocation.size;
+        }
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = resource.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = resource.format;
+        viewInfo.subresourceRange.aspectMask = resource.aspect;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &resource.view) != VK_SUCCESS) {
+            throw runtime_error("failed to create render graph image view " + resource.name + "!");
+        }
+    }
+}
+
+void RenderGraph::computeBarriers() {
+    // What each resource looks like at the end of the graph, which is also what the next frame starts from.
+    vector<ResourceState> endStates(this->resources.size());
+    for (const Pass& pass : this->passes) {
+        if (pass.culled) {
+            continue;
+        }
+        for (const Access& access : pass.accesses) {
+            endStates[access.resource] = getUsageState(access.usage);
+        }
+    }
+    for (size_t i = 0; i < this->resources.size(); ++i) {
+        if (this->resources[i].finalUsage.has_value()) {
+            endStates[i] = getUsageState(*this->resources[i].finalUsage);
+        }
+    }
+
+    // Per resource: the last write still to be waited for, and which stages already see the current contents.
+    struct Tracker {
+        bool started = false;
+        VkPipelineStageFlags2 writeStage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 writeAccess = VK_ACCESS_2_NONE;
+        VkPipelineStageFlags2 readStages = VK_PIPELINE_STAGE_2_NONE;
+        VkPipelineStageFlags2 visibleStages = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 visibleAccess = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    };
+    vector<Tracker> trackers(this->resources.size());
+
+    // The state the first barrier of a frame has to wait for. Contents never carry over, so images start
+    // from UNDEFINED; the wait covers the previous frame's use of the same memory.
+    auto getStartState = [&](uint32_t index, const ResourceState& firstUse) {
+        const Resource& resource = this->resources[index];
+        ResourceState start = endStates[index];
+
+        if (resource.imported && resource.isImage) {
+            // Also chains to the semaphore that hands the image over, which is waited on at the first use.
+            VkPipelineStageFlags2 firstUseStage = firstUse.stage != VK_PIPELINE_STAGE_2_NONE ? firstUse.stage : VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+            this->resources[index].firstUseStage = firstUseStage;
+            start.stage |= firstUseStage;
+        } else if (resource.aliasOffset.has_value()) {
+            // Every image sharing this memory may have touched it last.
+            VkDeviceSize begin = *resource.aliasOffset;
+            VkDeviceSize end = begin + resource.memoryRequirements.size;
+            for (uint32_t other = 0; other < this->resources.size(); ++other) {
+                const Resource& candidate = this->resources[other];
+                if (other == index || !candidate.aliasOffset.has_value()) {
+                    continue;
+                }
+                VkDeviceSize otherBegin = *candidate.aliasOffset;
+                if (otherBegin < end && begin < otherBegin + candidate.memoryRequirements.size) {
+                    start.stage |= endStates[other].stage;
+                    start.access |= getWriteAccess(endStates[other].access);
+                    start.write = start.write || endStates[other].write;
+                }
+            }
+        }
+        start.access = getWriteAccess(start.access);
+        if (resource.isImage) {
+            start.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        }
+        return start;
+    };
+
+    // Appends the barrier needed before `usage` (if any) and advances the tracker past it.
+    auto transition = [&](uint32_t index, const ResourceState& usage, vector<Barrier>& barriers) {
+        const Resource& resource = this->resources[index];
+        Tracker& tracker = trackers[index];
+        ++this->naiveBarrierCount;
+
+        if (!tracker.started) {
+            ResourceState start = getStartState(index, usage);
+            tracker.started = true;
+            tracker.layout = start.layout;
+            if (start.write) {
+                tracker.writeStage = start.stage;
+                tracker.writeAccess = start.access;
+            } else {
+                tracker.readStages = start.stage;
+            }
+        }
+
+        bool layoutChange = resource.isImage && tracker.layout != usage.layout;
+
+        if (!usage.write && !layoutChange) {
+            bool alreadyVisible = (usage.stage & ~tracker.visibleStages) == 0 && (usage.access & ~tracker.visibleAccess) == 0;
+            // Reads after reads never conflict; reads of a visible write need nothing more.
+            if (alreadyVisible || tracker.writeStage == VK_PIPELINE_STAGE_2_NONE) {
+                tracker.readStages |= usage.stage;
+                return;
+            }
+
+            ResourceState source = { tracker.writeStage, tracker.writeAccess, tracker.layout, true };
+            barriers.push_back({ index, source, usage });
+            tracker.readStages |= usage.stage;
+            tracker.visibleStages |= usage.stage;
+            tracker.visibleAccess |= usage.access;
+            return;
+        }
+
+        // Writes and layout transitions wait for the last write (write-after-write) and every read since
+        // (write-after-read, which only needs the execution dependency).
+        ResourceState source = { tracker.writeStage | tracker.readStages, tracker.writeAccess, tracker.layout, tracker.writeAccess != VK_ACCESS_2_NONE };
+        if (source.stage != VK_PIPELINE_STAGE_2_NONE || layoutChange) {
+            barriers.push_back({ index, source, usage });
+        }
+
+        // A layout transition is a write the barrier itself performs and makes visible to its destination.
+        tracker.writeStage = usage.stage;
+        tracker.writeAccess = getWriteAccess(usage.access);
+        tracker.readStages = usage.write ? VK_PIPELINE_STAGE_2_NONE : usage.stage;
+        tracker.visibleStages = usage.stage;
+        tracker.visibleAccess = usage.access;
+        tracker.layout = usage.layout;
+    };
+
+    for (Pass& pass : this->passes) {
+        if (pass.culled) {
+            continue;
+        }
+        for (const Access& access : pass.accesses) {
+            transition(access.resource, getUsageState(access.usage), pass.barriers);
+        }
+        this->barrierCount += static_cast<uint32_t>(pass.barriers.size());
+        this->barrierBatchCount += pass.barriers.empty() ? 0 : 1;
+    }
+
+    for (uint32_t index = 0; index < this->resources.size(); ++index) {
+        const Resource& resource = this->resources[index];
+        if (resource.finalUsage.has_value()) {
+            transition(index, getUsageState(*resource.finalUsage), this->finalBarriers);
+        }
+    }
+    this->barrierCount += static_cast<uint32_t>(this->finalBarriers.size());
+    this->barrierBatchCount += this->finalBarriers.empty() ? 0 : 1;
+
+    this->imageBarriers.reserve(this->resources.size());
+    this->bufferBarriers.reserve(this->resources.size());
+    this->imageBarriers2.reserve(this->resources.size());
+    this->bufferBarriers2.reserve(this->resources.size());
+}
+
+void RenderGraph::setImportedImage(RenderGraphResource handle, VkImage image, VkImageView view) {
+    Resource& resource = this->resources.at(handle.index);
+    resource.image = image;
+    resource.view = view;
+}
+
+void RenderGraph::setImportedBuffer(RenderGraphResource handle, VkBuffer buffer) {
+    this->resources.at(handle.index).buffer = buffer;
+}
+
+VkImage RenderGraph::getImage(RenderGraphResource handle) const {
+    return this->resources.at(handle.index).image;
+}
+
+VkImageView RenderGraph::getImageView(RenderGraphResource handle) const {
+    return this->resources.at(handle.index).view;
+}
+
+VkBuffer RenderGraph::getBuffer(RenderGraphResource handle) const {
+    return this->resources.at(handle.index).buffer;
+}
+
+VkPipelineStageFlags RenderGraph::getFirstUseStage(RenderGraphResource handle) const {
+    return toLegacyStages(this->resources.at(handle.index).firstUseStage, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const vector<Barrier>& barriers) {
+    if (barriers.empty()) {
+        return;
+    }
+
+    auto getRange = [](const Resource& resource) {
+        VkImageSubresourceRange range{};
+        range.aspectMask = resource.aspect;
+        range.levelCount = VK_REMAINING_MIP_LEVELS;
+        range.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        return range;
+    };
+
+    auto checkBound = [](const Resource& resource) {
+        if (resource.isImage ? resource.image == VK_NULL_HANDLE : resource.buffer == VK_NULL_HANDLE) {
+            throw runtime_error("render graph resource " + resource.name + " is not bound!");
+        }
+    };
+
+    if (this->synchronization2) {
+        this->imageBarriers2.clear();
+        this->bufferBarriers2.clear();
+
+        for (const Barrier& barrier : barriers) {
+            const Resource& resource = this->resources[barrier.resource];
+            checkBound(resource);
+
+            if (resource.isImage) {
+                VkImageMemoryBarrier2 imageBarrier{};
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                imageBarrier.srcStageMask = barrier.source.stage;
+                imageBarrier.srcAccessMask = barrier.source.access;
+                imageBarrier.dstStageMask = barrier.destination.stage;
+                imageBarrier.dstAccessMask = barrier.destination.access;
+                imageBarrier.oldLayout = barrier.source.layout;
+                imageBarrier.newLayout = barrier.destination.layout;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.image = resource.image;
+                imageBarrier.subresourceRange = getRange(resource);
+                this->imageBarriers2.push_back(imageBarrier);
+            } else {
+                VkBufferMemoryBarrier2 bufferBarrier{};
+                bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+                bufferBarrier.srcStageMask = barrier.source.stage;
+                bufferBarrier.srcAccessMask = barrier.source.access;
+                bufferBarrier.dstStageMask = barrier.destination.stage;
+                bufferBarrier.dstAccessMask = barrier.destination.access;
+                bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.buffer = resource.buffer;
+                bufferBarrier.size = VK_WHOLE_SIZE;
+                this->bufferBarriers2.push_back(bufferBarrier);
+            }
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.bufferMemoryBarrierCount = static_cast<uint32_t>(this->bufferBarriers2.size());
+        dependencyInfo.pBufferMemoryBarriers = this->bufferBarriers2.data();
+        dependencyInfo.imageMemoryBarrierCount = static_cast<uint32_t>(this->imageBarriers2.size());
+        dependencyInfo.pImageMemoryBarriers = this->imageBarriers2.data();
+        vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+        return;
+    }
+
+    // Without synchronization2 the stage masks apply to the whole call, so they are the union over the batch.
+    this->imageBarriers.clear();
+    this->bufferBarriers.clear();
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+
+    for (const Barrier& barrier : barriers) {
+        const Resource& resource = this->resources[barrier.resource];
+        checkBound(resource);
+        srcStages |= toLegacyStages(barrier.source.stage, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        dstStages |= toLegacyStages(barrier.destination.stage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+        if (resource.isImage) {
+            VkImageMemoryBarrier imageBarrier{};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcAccessMask = toLegacyAccess(barrier.source.access);
+            imageBarrier.dstAccessMask = toLegacyAccess(barrier.destination.access);
+            imageBarrier.oldLayout = barrier.source.layout;
+            imageBarrier.newLayout = barrier.destination.layout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = resource.image;
+            imageBarrier.subresourceRange = getRange(resource);
+            this->imageBarriers.push_back(imageBarrier);
+        } else {
+            VkBufferMemoryBarrier bufferBarrier{};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.srcAccessMask = toLegacyAccess(barrier.source.access);
+            bufferBarrier.dstAccessMask = toLegacyAccess(barrier.destination.access);
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.buffer = resource.buffer;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+            this->bufferBarriers.push_back(bufferBarrier);
+        }
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, nullptr,
+        static_cast<uint32_t>(this->bufferBarriers.size()), this->bufferBarriers.data(),
+        static_cast<uint32_t>(this->imageBarriers.size()), this->imageBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer, GpuProfiler* profiler) {
+    if (!this->compiled) {
+        throw runtime_error("render graph is not compiled!");
+    }
+
+    for (const Pass& pass : this->passes) {
+        if (pass.culled) {
+            continue;
+        }
+        // The barriers are part of the pass's cost, so they are timed with it.
+        std::optional<GpuProfiler::Scope> scope;
+        if (profiler != nullptr) {
+            scope.emplace(*profiler, commandBuffer, pass.name.c_str());
+        }
+        this->recordBarriers(commandBuffer, pass.barriers);
+        pass.execute(commandBuffer);
+    }
+    this->recordBarriers(commandBuffer, this->finalBarriers);
+}
+
+void RenderGraph::printStatistics(ostream& out) const {
+    std::ios_base::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    out << std::fixed << std::setprecision(2);
+
+    uint32_t culledCount = 0;
+    for (const Pass& pass : this->passes) {
+        culledCount += pass.culled ? 1 : 0;
+    }
+
+    out << "[Render Graph]" << '\n';
+    out << "\tPasses: " << this->passes.size() - culledCount << " of " << this->passes.size()
+        << " (" << culledCount << " culled), barriers via " << (this->synchronization2 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier") << '\n';
+
+    for (const Pass& pass : this->passes) {
+        out << "\t\t" << pass.name << ": ";
+        if (pass.culled) {
+            out << "culled" << '\n';
+            continue;
+        }
+        out << pass.accesses.size() << " accesses, " << pass.barriers.size() << " barriers";
+        if (pass.accesses.size() > pass.barriers.size()) {
+            out << " (" << pass.accesses.size() - pass.barriers.size() << " removed)";
+        }
+        out << '\n';
+    }
+    if (!this->finalBarriers.empty()) {
+        out << "\t\t(final): " << this->finalBarriers.size() << " barriers" << '\n';
+    }
+
+    out << "\tBarriers: " << this->barrierCount << " for " << this->naiveBarrierCount << " accesses ("
+        << this->naiveBarrierCount - this->barrierCount << " removed), recorded in " << this->barrierBatchCount << " calls" << '\n';
+
+    out << "\tTransient memory: " << toMiB(this->transientBytesAliased) << " MiB for " << toMiB(this->transientBytesUnaliased) << " MiB of images";
+    if (this->transientBytesUnaliased > this->transientBytesAliased) {
+        out << " (" << toMiB(this->transientBytesUnaliased - this->transientBytesAliased) << " MiB saved by aliasing)";
+    }
+    out << '\n';
+
+    for (const Resource& resource : this->resources) {
+        if (resource.imported || resource.image == VK_NULL_HANDLE) {
+            continue;
+        }
+        out << "\t\t" << resource.name << ": " << toMiB(resource.memoryRequirements.size) << " MiB, passes "
+            << resource.firstPass << "-" << resource.lastPass;
+        if (resource.aliasOffset.has_value()) {
+            out << ", offset " << *resource.aliasOffset;
+        } else {
+            out << ", own memory";
+        }
+        out << '\n';
+    }
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "DeviceMemoryAllocator.h"
+#include "GpuProfiler.h"
+
+// How a pass touches a resource. Each usage implies the pipeline stage, access and image layout it needs,
+// so passes never spell out barriers themselves.
+enum class ResourceUsage {
+    TransferSrc,
+    TransferDst,
+    ColorAttachment,
+    DepthAttachment,
+    DepthRead,
+    FragmentSampled,
+    ComputeSampled,
+    ComputeStorageRead,
+    ComputeStorageWrite,
+    IndirectArgument,
+    VertexBuffer,
+    IndexBuffer,
+    // Only valid as the final usage of an imported image.
+    Present,
+};
+
+const char* getResourceUsageString(ResourceUsage usage);
+
+struct RenderGraphResource {
+    uint32_t index = UINT32_MAX;
+
+    bool isValid() const { return this->index != UINT32_MAX; }
+};
+
+// One frame's passes and the resources they read and write, declared up front and compiled once.
+//
+// compile() culls passes whose results nobody consumes, works out the barriers between the remaining passes
+// (merging every transition a pass needs into one vkCmdPipelineBarrier2, or vkCmdPipelineBarrier without
+// synchronization2) and places transient images whose lifetimes do not overlap at the same memory offset.
+// Passes run in declaration order on a single queue. Imported resources (swapchain images, the offscreen
+// target, long-lived buffers) can be rebound each frame without recompiling.
+class RenderGraph {
+
+public:
+
+    using ExecuteFunction = std::function<void(VkCommandBuffer commandBuffer)>;
+
+    class PassBuilder {
+
+    public:
+
+        void read(RenderGraphResource resource, ResourceUsage usage);
+        void write(RenderGraphResource resource, ResourceUsage usage);
+        // Keeps the pass even when nothing reads what it writes (e.g. it only produces queries or readbacks).
+        void setSideEffects();
+
+    private:
+
+        friend class RenderGraph;
+
+        PassBuilder(RenderGraph& graph, uint32_t passIndex) : graph(graph), passIndex(passIndex) {}
+
+        RenderGraph& graph;
+        uint32_t passIndex;
+    };
+
+    RenderGraph() = default;
+    RenderGraph(const RenderGraph&) = delete;
+    RenderGraph& operator=(const RenderGraph&) = delete;
+
+    void create(VkDevice device, DeviceMemoryAllocator& allocator, bool synchronization2);
+    void destroy();
+
+    // The previous contents are discarded at the first use each frame; finalUsage is the state the image is
+    // handed over in after the last pass (and in which the previous frame left it).
+    RenderGraphResource importImage(const std::string& name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect,
+        ResourceUsage finalUsage);
+    // Buffers keep their contents; their previous writes are assumed complete before the graph runs.
+    RenderGraphResource importBuffer(const std::string& name, VkDeviceSize size);
+    // Lives only inside the graph. Created, and aliased with other transients, by compile().
+    RenderGraphResource createImage(const std::string& name, VkFormat format, VkExtent2D extent, VkImageAspectFlags aspect);
+
+    void addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, ExecuteFunction execute);
+
+    void compile();
+
+    void setImportedImage(RenderGraphResource resource, VkImage image, VkImageView view);
+    void setImportedBuffer(RenderGraphResource resource, VkBuffer buffer);
+
+    VkImage getImage(RenderGraphResource resource) const;
+    VkImageView getImageView(RenderGraphResource resource) const;
+    VkBuffer getBuffer(RenderGraphResource resource) const;
+
+    // The stage a semaphore guarding an imported resource (e.g. the swapchain acquire) has to be waited on.
+    VkPipelineStageFlags getFirstUseStage(RenderGraphResource resource) const;
+
+    // Records every pass that survived culling, each in its own profiler scope when a profiler is given.
+    void execute(VkCommandBuffer commandBuffer, GpuProfiler* profiler = nullptr);
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct ResourceState {
+        VkPipelineStageFlags2 stage = VK_PIPELINE_STAGE_2_NONE;
+        VkAccessFlags2 access = VK_ACCESS_2_NONE;
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        bool write = false;
+    };
+
+    struct Access {
+        uint32_t resource;
+        ResourceUsage usage;
+        bool write;
+    };
+
+    struct Resource {
+        std::string name;
+        bool isImage = true;
+        bool imported = false;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        VkExtent2D extent{};
+        VkImageAspectFlags aspect = 0;
+        VkDeviceSize bufferSize = 0;
+        std::optional<ResourceUsage> finalUsage;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        // Filled by compile(); firstPass and lastPass index the declared passes.
+        VkImageUsageFlags imageUsage = 0;
+        uint32_t firstPass = UINT32_MAX;
+        uint32_t lastPass = 0;
+        VkMemoryRequirements memoryRequirements{};
+        // Offset into the shared transient memory, or none when the image got memory of its own.
+        std::optional<VkDeviceSize> aliasOffset;
+        DeviceAllocation ownAllocation;
+        VkPipelineStageFlags2 firstUseStage = VK_PIPELINE_STAGE_2_NONE;
+    };
+
+    struct Barrier {
+        uint32_t resource;
+        ResourceState source;
+        ResourceState destination;
+    };
+
+    struct Pass {
+        std::string name;
+        std::vector<Access> accesses;
+        ExecuteFunction execute;
+        bool sideEffects = false;
+        bool culled = false;
+        std::vector<Barrier> barriers;
+    };
+
+    static ResourceState getUsageState(ResourceUsage usage);
+
+    RenderGraphResource addResource(Resource resource);
+    void addAccess(uint32_t passIndex, RenderGraphResource resource, ResourceUsage usage, bool write);
+
+    void cullPasses();
+    void computeLifetimes();
+    void createTransientImages();
+    void placeTransientImages();
+    void computeBarriers();
+
+    void recordBarriers(VkCommandBuffer commandBuffer, const std::vector<Barrier>& barriers);
+    void destroyTransientImages();
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+    bool synchronization2 = false;
+
+    std::vector<Resource> resources;
+    std::vector<Pass> passes;
+    // Handed over to finalUsage after the last pass.
+    std::vector<Barrier> finalBarriers;
+    bool compiled = false;
+
+    DeviceAllocation transientMemory;
+    VkDeviceSize transientBytesUnaliased = 0;
+    VkDeviceSize transientBytesAliased = 0;
+
+    // A barrier per declared access is what recording each pass by hand would have taken.
+    uint32_t naiveBarrierCount = 0;
+    uint32_t barrierCount = 0;
+    uint32_t barrierBatchCount = 0;
+
+    // Reused by every recordBarriers() call so that executing the graph does not allocate.
+    std::vector<VkImageMemoryBarrier2> imageBarriers2;
+    std::vector<VkBufferMemoryBarrier2> bufferBarriers2;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+};
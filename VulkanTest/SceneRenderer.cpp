@@ -0,0 +1,253 @@
+#include "SceneRenderer.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "HostAllocator.h"
+#include "ShaderModule.h"
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+void SceneRenderer::create(VkDevice device, VkFormat colorFormat, VkPipelineCache pipelineCache, const string& shaderDirectory,
+    DeviceMemoryAllocator& allocator, UploadService& uploads, BindlessTable& bindless) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->bindless = &bindless;
+    this->createMaterials(allocator, uploads);
+    this->createRenderPass(colorFormat);
+    this->createPipeline(pipelineCache, shaderDirectory);
+}
+
+void SceneRenderer::destroy() {
+    // Only called once the device is idle.
+    this->bindless->release(BindlessTable::Kind::StorageBuffer, this->materialSlot, 0);
+    vkDestroyBuffer(this->device, this->materialBuffer, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->materialAllocation);
+
+    vkDestroyPipeline(this->device, this->pipeline, HostAllocator::get().getCallbacks());
+    vkDestroyPipelineLayout(this->device, this->pipelineLayout, HostAllocator::get().getCallbacks());
+    vkDestroyRenderPass(this->device, this->renderPass, HostAllocator::get().getCallbacks());
+}
+
+void SceneRenderer::createMaterials(DeviceMemoryAllocator& allocator, UploadService& uploads) {
+    float tints[MATERIAL_COUNT];
+    for (uint32_t i = 0; i < MATERIAL_COUNT; ++i) {
+        tints[i] = static_cast<float>(i) / 16.0f;
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = sizeof(tints);
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(this->device, &bufferInfo, HostAllocator::get().getCallbacks(), &this->materialBuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create material buffer!");
+    }
+    this->materialAllocation = allocator.allocateForBuffer(this->materialBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+    uploads.uploadBuffer(this->materialBuffer, 0, tints, sizeof(tints));
+
+    this->materialSlot = this->bindless->addStorageBuffer(this->materialBuffer, 0, sizeof(tints));
+}
+
+void SceneRenderer::createRenderPass(VkFormat colorFormat) {
+    VkAttachmentDescription colorAttachment{};
+    colorAttachment.format = colorFormat;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef{};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    if (vkCreateRenderPass(this->device, &renderPassInfo, HostAllocator::get().getCallbacks(), &this->renderPass) != VK_SUCCESS) {
+        throw runtime_error("failed to create render pass!");
+    }
+}
+
+void SceneRenderer::createPipeline(VkPipelineCache pipelineCache, const string& shaderDirectory) {
+    VkShaderModule vertShaderModule = createShaderModule(this->device, shaderDirectory + "triangle.vert.spv");
+    VkShaderModule fragShaderModule = createShaderModule(this->device, shaderDirectory + "triangle.frag.spv");
+
+    // The vertex shader's storage buffer array matches the table's binding.
+    uint32_t storageBufferCount = this->bindless->getCapacity(BindlessTable::Kind::StorageBuffer);
+    VkSpecializationMapEntry specializationEntry{};
+    specializationEntry.constantID = 0;
+    specializationEntry.offset = 0;
+    specializationEntry.size = sizeof(storageBufferCount);
+
+    VkSpecializationInfo specializationInfo{};
+    specializationInfo.mapEntryCount = 1;
+    specializationInfo.pMapEntries = &specializationEntry;
+    specializationInfo.dataSize = sizeof(storageBufferCount);
+    specializationInfo.pData = &storageBufferCount;
+
+    VkPipelineShaderStageCreateInfo shaderStages[2]{};
+    shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+    shaderStages[0].module = vertShaderModule;
+    shaderStages[0].pName = "main";
+    shaderStages[0].pSpecializationInfo = &specializationInfo;
+    shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    shaderStages[1].module = fragShaderModule;
+    shaderStages[1].pName = "main";
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawConstants);
+
+    VkDescriptorSetLayout setLayout = this->bindless->getLayout();
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &setLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+    if (vkCreatePipelineLayout(this->device, &pipelineLayoutInfo, HostAllocator::get().getCallbacks(), &this->pipelineLayout) != VK_SUCCESS) {
+        throw runtime_error("failed to create pipeline layout!");
+    }
+
+    VkResult result = this->createGraphicsPipeline(pipelineCache, shaderStages, this->pipelineLayout, VK_NULL_HANDLE, nullptr, &this->pipeline);
+
+    vkDestroyShaderModule(this->device, fragShaderModule, HostAllocator::get().getCallbacks());
+    vkDestroyShaderModule(this->device, vertShaderModule, HostAllocator::get().getCallbacks());
+
+    if (result != VK_SUCCESS) {
+        throw runtime_error("failed to create graphics pipeline!");
+    }
+}
+
+VkResult SceneRenderer::createGraphicsPipeline(VkPipelineCache pipelineCache, const VkPipelineShaderStageCreateInfo shaderStages[2],
+    VkPipelineLayout layout, VkRenderPass renderPass, const VkPipelineDepthStencilStateCreateInfo* depthStencil,
+    VkPipeline* pipeline) const {
+    // Vertices come from the shader itself.
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    // Viewport and scissor are dynamic so the pipeline survives swapchain resizes.
+    VkPipelineViewportStateCreateInfo viewportState{};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo rasterizer{};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling{};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorBlendAttachment.blendEnable = VK_FALSE;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending{};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkDynamicState dynamicStates[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo dynamicState{};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = layout;
+    pipelineInfo.renderPass = renderPass != VK_NULL_HANDLE ? renderPass : this->renderPass;
+    pipelineInfo.subpass = 0;
+
+    return vkCreateGraphicsPipelines(this->device, pipelineCache, 1, &pipelineInfo, HostAllocator::get().getCallbacks(), pipeline);
+}
+
+VkFramebuffer SceneRenderer::createFramebuffer(VkImageView view, VkExtent2D extent) const {
+    VkFramebufferCreateInfo framebufferInfo{};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = this->renderPass;
+    framebufferInfo.attachmentCount = 1;
+    framebufferInfo.pAttachments = &view;
+    framebufferInfo.width = extent.width;
+    framebufferInfo.height = extent.height;
+    framebufferInfo.layers = 1;
+
+    VkFramebuffer framebuffer;
+    if (vkCreateFramebuffer(this->device, &framebufferInfo, HostAllocator::get().getCallbacks(), &framebuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create framebuffer!");
+    }
+    return framebuffer;
+}
+
+void SceneRenderer::recordDraws(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t firstDraw, uint32_t drawCount, uint32_t totalDraws) const {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipeline);
+    this->bindless->bind(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, this->pipelineLayout, 0);
+
+    VkViewport viewport{};
+    viewport.width = static_cast<float>(extent.width);
+    viewport.height = static_cast<float>(extent.height);
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.extent = extent;
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+    // Square grid in normalized device coordinates, one cell per draw, with a small gap between cells.
+    uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(totalDraws))));
+    float cellSize = 2.0f / static_cast<float>(columns);
+
+    for (uint32_t draw = firstDraw; draw < firstDraw + drawCount; ++draw) {
+        DrawConstants constants;
+        constants.offset[0] = -1.0f + (static_cast<float>(draw % columns) + 0.5f) * cellSize;
+        constants.offset[1] = -1.0f + (static_cast<float>(draw / columns) + 0.5f) * cellSize;
+        constants.scale = cellSize * 0.9f;
+        constants.materialBuffer = this->materialSlot;
+        constants.material = draw % MATERIAL_COUNT;
+
+        vkCmdPushConstants(commandBuffer, this->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+    }
+}
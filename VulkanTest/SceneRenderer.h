@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <string>
+
+#include "BindlessTable.h"
+#include "DeviceMemoryAllocator.h"
+#include "UploadService.h"
+
+// Draws the scene: a grid of triangles, one draw call each, into a single color attachment. Each triangle's
+// tint comes from a material buffer it finds through the bindless table, by the indices in its push constants.
+//
+// The render pass keeps the attachment in COLOR_ATTACHMENT_OPTIMAL on both ends; getting it there and out
+// again is left to the render graph's barriers.
+class SceneRenderer {
+
+public:
+
+    static constexpr const uint32_t MATERIAL_COUNT = 8;
+
+    void create(VkDevice device, VkFormat colorFormat, VkPipelineCache pipelineCache, const std::string& shaderDirectory,
+        DeviceMemoryAllocator& allocator, UploadService& uploads, BindlessTable& bindless);
+    void destroy();
+
+    VkRenderPass getRenderPass() const { return this->renderPass; }
+    // The material buffer's slot in the bindless table, for other renderers drawing with the same materials.
+    uint32_t getMaterialSlot() const { return this->materialSlot; }
+    VkFramebuffer createFramebuffer(VkImageView view, VkExtent2D extent) const;
+    // A pipeline with the scene's fixed-function state, for other ways of drawing the scene. Takes a vertex and a
+    // fragment stage; a null render pass means the scene's own, a null depth state no depth attachment.
+    VkResult createGraphicsPipeline(VkPipelineCache pipelineCache, const VkPipelineShaderStageCreateInfo shaderStages[2],
+        VkPipelineLayout layout, VkRenderPass renderPass, const VkPipelineDepthStencilStateCreateInfo* depthStencil,
+        VkPipeline* pipeline) const;
+
+    // Binds the pipeline and dynamic state, then draws triangles [firstDraw, firstDraw + drawCount) of a grid
+    // sized for totalDraws. Safe to call from several threads on different command buffers.
+    void recordDraws(VkCommandBuffer commandBuffer, VkExtent2D extent, uint32_t firstDraw, uint32_t drawCount, uint32_t totalDraws) const;
+
+private:
+
+    struct DrawConstants {
+        float offset[2];
+        float scale;
+        // Slot of the material buffer in the bindless table, and the material within it.
+        uint32_t materialBuffer;
+        uint32_t material;
+    };
+
+    void createMaterials(DeviceMemoryAllocator& allocator, UploadService& uploads);
+    void createRenderPass(VkFormat colorFormat);
+    void createPipeline(VkPipelineCache pipelineCache, const std::string& shaderDirectory);
+
+    VkDevice device = VK_NULL_HANDLE;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+
+    DeviceMemoryAllocator* allocator = nullptr;
+    BindlessTable* bindless = nullptr;
+    VkBuffer materialBuffer = VK_NULL_HANDLE;
+    DeviceAllocation materialAllocation;
+    uint32_t materialSlot = BindlessTable::INVALID_SLOT;
+};
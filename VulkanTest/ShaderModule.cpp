@@ -0,0 +1,43 @@
+#include "ShaderModule.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "HostAllocator.h"
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace {
+
+vector<char> readFile(const string& path) {
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        throw runtime_error("failed to open " + path + " (run shaders/compile.bat)!");
+    }
+
+    size_t fileSize = static_cast<size_t>(file.tellg());
+    vector<char> buffer(fileSize);
+    file.seekg(0);
+    file.read(buffer.data(), static_cast<std::streamsize>(fileSize));
+    return buffer;
+}
+
+}
+
+VkShaderModule createShaderModule(VkDevice device, const string& path) {
+    vector<char> code = readFile(path);
+
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = code.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, HostAllocator::get().getCallbacks(), &shaderModule) != VK_SUCCESS) {
+        throw runtime_error("failed to create shader module!");
+    }
+    return shaderModule;
+}
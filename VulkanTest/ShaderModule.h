@@ -0,0 +1,8 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+
+// Loads SPIR-V compiled by shaders/compile.bat. The caller destroys the module once its pipelines exist.
+VkShaderModule createShaderModule(VkDevice device, const std::string& path);
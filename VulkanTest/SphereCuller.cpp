@@ -0,0 +1,241 @@
+#include "SphereCuller.h"
+
+#include <atomic>
+#include <cfloat>
+#include <stdexcept>
+#include <string>
+
+#include "JobSystem.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SPHERE_CULLER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles intrinsics for any instruction set as is; GCC and Clang need the functions using them marked,
+// since the rest of the program is built for the baseline CPU.
+#if defined(__GNUC__) || defined(__clang__)
+#define SPHERE_CULLER_TARGET_SSE __attribute__((target("sse2")))
+#define SPHERE_CULLER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SPHERE_CULLER_TARGET_SSE
+#define SPHERE_CULLER_TARGET_AVX2
+#endif
+
+using std::string;
+using std::runtime_error;
+
+namespace {
+
+// Padding spheres: no distance is below -radius, so no frustum contains them.
+constexpr const float PADDING_RADIUS = -FLT_MAX;
+
+struct SphereArrays {
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* radius;
+};
+
+uint32_t cullScalar(const Frustum& frustum, const SphereArrays& spheres, uint32_t first, uint32_t last, uint8_t* visible) {
+    uint32_t visibleCount = 0;
+    for (uint32_t i = first; i < last; ++i) {
+        const float center[3] = { spheres.x[i], spheres.y[i], spheres.z[i] };
+        uint8_t inside = isSphereVisible(frustum, center, spheres.radius[i]) ? 1 : 0;
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+#ifdef SPHERE_CULLER_X86
+
+// Same expression and order as isSphereVisible(), so every kernel agrees with the scalar one.
+SPHERE_CULLER_TARGET_SSE
+uint32_t cullSse(const Frustum& frustum, const SphereArrays& spheres, uint32_t first, uint32_t last, uint8_t* visible) {
+    __m128 planes[Frustum::PLANE_COUNT][4];
+    for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = first; i < last; i += 4) {
+        __m128 x = _mm_loadu_ps(spheres.x + i);
+        __m128 y = _mm_loadu_ps(spheres.y + i);
+        __m128 z = _mm_loadu_ps(spheres.z + i);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+
+        __m128 inside = _mm_cmpeq_ps(x, x);
+        for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+                _mm_mul_ps(planes[p][2], z)), planes[p][3]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+        for (uint32_t j = 0; j < 4; ++j) {
+            uint8_t bit = static_cast<uint8_t>((mask >> j) & 1);
+            visible[i + j] = bit;
+            visibleCount += bit;
+        }
+    }
+    return visibleCount;
+}
+
+SPHERE_CULLER_TARGET_AVX2
+uint32_t cullAvx2(const Frustum& frustum, const SphereArrays& spheres, uint32_t first, uint32_t last, uint8_t* visible) {
+    __m256 planes[Frustum::PLANE_COUNT][4];
+    for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p) {
+        for (uint32_t c = 0; c < 4; ++c) {
+            planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+        }
+    }
+
+    uint32_t visibleCount = 0;
+    for (uint32_t i = first; i < last; i += 8) {
+        __m256 x = _mm256_loadu_ps(spheres.x + i);
+        __m256 y = _mm256_loadu_ps(spheres.y + i);
+        __m256 z = _mm256_loadu_ps(spheres.z + i);
+        __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius + i));
+
+        // No FMA: it would round differently from the scalar kernel.
+        __m256 inside = _mm256_cmp_ps(x, x, _CMP_EQ_OQ);
+        for (uint32_t p = 0; p < Frustum::PLANE_COUNT; ++p) {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], x), _mm256_mul_ps(planes[p][1], y)),
+                _mm256_mul_ps(planes[p][2], z)), planes[p][3]);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        for (uint32_t j = 0; j < 8; ++j) {
+            uint8_t bit = static_cast<uint8_t>((mask >> j) & 1);
+            visible[i + j] = bit;
+            visibleCount += bit;
+        }
+    }
+    return visibleCount;
+}
+
+bool detectAvx2() {
+#if defined(_MSC_VER)
+    int registers[4];
+    __cpuid(registers, 0);
+    if (registers[0] < 7) {
+        return false;
+    }
+    // AVX2 also needs the OS to save the YMM registers on context switches: OSXSAVE, then XCR0 bits 1 and 2.
+    __cpuid(registers, 1);
+    bool osxsave = (registers[2] & (1 << 27)) != 0;
+    bool avx = (registers[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(registers, 7, 0);
+    return (registers[1] & (1 << 5)) != 0;
+#else
+    // CPUID through the compiler's runtime, which checks the OS saves the YMM registers too.
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+}
+
+const char* getCullKernelString(CullKernel kernel) {
+    switch (kernel) {
+    case CullKernel::Scalar:
+        return "scalar";
+    case CullKernel::Sse:
+        return "SSE";
+    case CullKernel::Avx2:
+        return "AVX2";
+    }
+    return "unknown";
+}
+
+CullKernel detectCullKernel() {
+#ifdef SPHERE_CULLER_X86
+    static const CullKernel detected = detectAvx2() ? CullKernel::Avx2 : CullKernel::Sse;
+    return detected;
+#else
+    return CullKernel::Scalar;
+#endif
+}
+
+bool isCullKernelSupported(CullKernel kernel) {
+    return static_cast<int>(kernel) <= static_cast<int>(detectCullKernel());
+}
+
+void SphereCuller::reserve(uint32_t count) {
+    size_t padded = (static_cast<size_t>(count) + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+    this->x.reserve(padded);
+    this->y.reserve(padded);
+    this->z.reserve(padded);
+    this->radius.reserve(padded);
+}
+
+void SphereCuller::clear() {
+    this->count = 0;
+    this->x.clear();
+    this->y.clear();
+    this->z.clear();
+    this->radius.clear();
+}
+
+void SphereCuller::add(const float center[3], float radius) {
+    // Overwrite the first padding sphere, or start a new block of padding.
+    if (this->count == this->radius.size()) {
+        this->x.resize(this->x.size() + BLOCK_SIZE, 0.0f);
+        this->y.resize(this->y.size() + BLOCK_SIZE, 0.0f);
+        this->z.resize(this->z.size() + BLOCK_SIZE, 0.0f);
+        this->radius.resize(this->radius.size() + BLOCK_SIZE, PADDING_RADIUS);
+    }
+    this->x[this->count] = center[0];
+    this->y[this->count] = center[1];
+    this->z[this->count] = center[2];
+    this->radius[this->count] = radius;
+    ++this->count;
+}
+
+void SphereCuller::setKernel(CullKernel kernel) {
+    if (!isCullKernelSupported(kernel)) {
+        throw runtime_error(string("this CPU cannot run the ") + getCullKernelString(kernel) + " culling kernel!");
+    }
+    this->kernel = kernel;
+}
+
+uint32_t SphereCuller::cull(const Frustum& frustum, uint8_t* visible) const {
+    return this->cullBlocks(frustum, 0, this->getPaddedCount() / BLOCK_SIZE, visible);
+}
+
+uint32_t SphereCuller::cull(const Frustum& frustum, uint8_t* visible, JobSystem& jobs) const {
+    std::atomic<uint32_t> visibleCount{ 0 };
+    jobs.parallelFor(this->getPaddedCount() / BLOCK_SIZE, MIN_PARALLEL_BLOCKS,
+        [this, &frustum, visible, &visibleCount](uint32_t begin, uint32_t end, uint32_t) {
+            visibleCount.fetch_add(this->cullBlocks(frustum, begin, end, visible), std::memory_order_relaxed);
+        });
+    return visibleCount.load(std::memory_order_relaxed);
+}
+
+uint32_t SphereCuller::cullBlocks(const Frustum& frustum, uint32_t firstBlock, uint32_t lastBlock, uint8_t* visible) const {
+    SphereArrays spheres = { this->x.data(), this->y.data(), this->z.data(), this->radius.data() };
+    uint32_t first = firstBlock * BLOCK_SIZE;
+    uint32_t last = lastBlock * BLOCK_SIZE;
+    switch (this->kernel) {
+#ifdef SPHERE_CULLER_X86
+    case CullKernel::Sse:
+        return cullSse(frustum, spheres, first, last, visible);
+    case CullKernel::Avx2:
+        return cullAvx2(frustum, spheres, first, last, visible);
+#endif
+    default:
+        return cullScalar(frustum, spheres, first, last, visible);
+    }
+}
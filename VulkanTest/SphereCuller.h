@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Frustum.h"
+
+class JobSystem;
+
+// The instruction sets SphereCuller can test spheres with, slowest first.
+enum class CullKernel {
+    // isSphereVisible(), one sphere at a time.
+    Scalar,
+    // Four spheres per instruction.
+    Sse,
+    // Eight spheres per instruction.
+    Avx2,
+};
+
+const char* getCullKernelString(CullKernel kernel);
+
+// The fastest kernel this CPU runs, from CPUID and, for AVX2, whether the OS saves the YMM registers.
+CullKernel detectCullKernel();
+bool isCullKernelSupported(CullKernel kernel);
+
+// Bounding spheres in structure-of-arrays layout, so that a block of BLOCK_SIZE spheres loads into one register
+// per component, and a frustum test over them.
+//
+// The arrays are padded to a whole number of blocks with spheres that no frustum contains, so the kernels
+// never need a scalar tail and parallel ranges split on block boundaries. Results are one byte per sphere,
+// 1 if visible, and the whole padded count is written.
+class SphereCuller {
+
+public:
+
+    // Spheres per block: the widest kernel's register width.
+    static constexpr const uint32_t BLOCK_SIZE = 8;
+    // Blocks per parallel range; a few microseconds of work.
+    static constexpr const uint32_t MIN_PARALLEL_BLOCKS = 256;
+
+    SphereCuller() : kernel(detectCullKernel()) {}
+
+    void reserve(uint32_t count);
+    void clear();
+    void add(const float center[3], float radius);
+
+    uint32_t getCount() const { return this->count; }
+    // What a result array has to hold.
+    uint32_t getPaddedCount() const { return static_cast<uint32_t>(this->radius.size()); }
+
+    CullKernel getKernel() const { return this->kernel; }
+    // Throws runtime_error when this CPU cannot run `kernel`.
+    void setKernel(CullKernel kernel);
+
+    // Writes getPaddedCount() results and returns how many spheres are visible.
+    uint32_t cull(const Frustum& frustum, uint8_t* visible) const;
+    // The same, split over the job system's workers. Call from a worker thread, like JobSystem::parallelFor().
+    uint32_t cull(const Frustum& frustum, uint8_t* visible, JobSystem& jobs) const;
+
+private:
+
+    // Tests the blocks [firstBlock, lastBlock).
+    uint32_t cullBlocks(const Frustum& frustum, uint32_t firstBlock, uint32_t lastBlock, uint8_t* visible) const;
+
+    CullKernel kernel;
+    uint32_t count = 0;
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+};
@@ -0,0 +1,113 @@
+#include "StartupTracer.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "JsonWriter.h"
+
+using std::string;
+using std::ostream;
+using std::ofstream;
+using std::optional;
+using std::nullopt;
+using std::runtime_error;
+
+// Constructed during static initialization, so the epoch is as close to process start as portable C++ allows.
+static StartupTracer& startupTracerInstance = StartupTracer::get();
+
+StartupTracer::Scope::Scope(const char* name, const char* category)
+    : eventIndex(StartupTracer::get().beginEvent(name, category)), traceScope(name, category) {
+}
+
+StartupTracer::Scope::~Scope() {
+    StartupTracer::get().endEvent(this->eventIndex);
+}
+
+StartupTracer& StartupTracer::get() {
+    static StartupTracer tracer;
+    return tracer;
+}
+
+StartupTracer::StartupTracer() : epoch(Clock::now()) {
+    this->events.reserve(64);
+}
+
+int64_t StartupTracer::nowNs() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - this->epoch).count();
+}
+
+size_t StartupTracer::beginEvent(const char* name, const char* category) {
+    this->events.push_back({ name, category, this->nowNs(), 0, this->currentDepth, false });
+    ++this->currentDepth;
+    return this->events.size() - 1;
+}
+
+void StartupTracer::endEvent(size_t eventIndex) {
+    Event& event = this->events[eventIndex];
+    event.durationNs = this->nowNs() - event.startNs;
+    --this->currentDepth;
+}
+
+void StartupTracer::markInstant(const char* name, const char* category) {
+    this->events.push_back({ name, category, this->nowNs(), 0, this->currentDepth, true });
+}
+
+void StartupTracer::markFirstFrame() {
+    if (this->firstFrameNs.has_value()) {
+        return;
+    }
+    this->firstFrameNs = this->nowNs();
+    this->markInstant("firstFrame", "frame");
+}
+
+optional<double> StartupTracer::getTimeToFirstFrameMs() const {
+    if (!this->firstFrameNs.has_value()) {
+        return nullopt;
+    }
+    return static_cast<double>(*this->firstFrameNs) / 1.0e6;
+}
+
+void StartupTracer::printSummary(ostream& out) const {
+    out << "[Startup Profile]" << '\n';
+    for (const Event& event : this->events) {
+        out << '\t' << string(event.depth * 2, ' ') << event.name;
+        if (event.instant) {
+            out << " @ " << std::fixed << std::setprecision(3) << static_cast<double>(event.startNs) / 1.0e6 << " ms";
+        } else {
+            out << ": " << std::fixed << std::setprecision(3) << static_cast<double>(event.durationNs) / 1.0e6 << " ms";
+        }
+        out << '\n';
+    }
+    out << std::defaultfloat;
+}
+
+void StartupTracer::writeChromeTrace(const string& path) const {
+    ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        throw runtime_error("failed to open startup trace file: " + path);
+    }
+
+    // Chrome trace timestamps are in microseconds.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"VulkanTest startup\"}}";
+    for (const Event& event : this->events) {
+        file << ",\n{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"" << event.category << "\",\"pid\":1,\"tid\":1";
+        file << ",\"ts\":" << static_cast<double>(event.startNs) / 1.0e3;
+        if (event.instant) {
+            file << ",\"ph\":\"i\",\"s\":\"p\"}";
+        } else {
+            file << ",\"ph\":\"X\",\"dur\":" << static_cast<double>(event.durationNs) / 1.0e3 << "}";
+        }
+    }
+    file << "\n],\"otherData\":{";
+    if (this->firstFrameNs.has_value()) {
+        file << "\"timeToFirstFrameMs\":" << static_cast<double>(*this->firstFrameNs) / 1.0e6;
+    }
+    file << "}}\n";
+
+    if (!file) {
+        throw runtime_error("failed to write startup trace file: " + path);
+    }
+}
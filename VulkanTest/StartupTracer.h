@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "TraceRecorder.h"
+
+// Records how long each start-up stage takes, from process start to the first rendered frame.
+// Stages are recorded with the RAII Scope below and nest naturally; the result can be printed as a
+// summary or written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Start-up is single threaded, so the tracer does no locking. Stages also go to the trace recorder, so
+// they show up at the start of the full run's timeline.
+class StartupTracer {
+
+public:
+
+    class Scope {
+
+    public:
+
+        explicit Scope(const char* name, const char* category = "init");
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+
+        size_t eventIndex;
+        TraceRecorder::Scope traceScope;
+    };
+
+    static StartupTracer& get();
+
+    void markInstant(const char* name, const char* category = "init");
+
+    // Only the first call has an effect, so callers can invoke it unconditionally from the frame loop.
+    void markFirstFrame();
+
+    std::optional<double> getTimeToFirstFrameMs() const;
+
+    void printSummary(std::ostream& out) const;
+
+    void writeChromeTrace(const std::string& path) const;
+
+private:
+
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        std::string name;
+        const char* category;
+        int64_t startNs;
+        int64_t durationNs;
+        uint32_t depth;
+        bool instant;
+    };
+
+    StartupTracer();
+
+    int64_t nowNs() const;
+
+    size_t beginEvent(const char* name, const char* category);
+    void endEvent(size_t eventIndex);
+
+    const Clock::time_point epoch;
+    std::vector<Event> events;
+    uint32_t currentDepth = 0;
+    std::optional<int64_t> firstFrameNs;
+};
@@ -0,0 +1,303 @@
+#include "SubAllocators.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+using std::optional;
+using std::nullopt;
+using std::runtime_error;
+
+namespace {
+
+bool isPowerOfTwo(VkDeviceSize value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+VkDeviceSize nextPowerOfTwo(VkDeviceSize value) {
+    VkDeviceSize result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+uint32_t log2OfPowerOfTwo(VkDeviceSize value) {
+    uint32_t result = 0;
+    while (value > 1) {
+        value >>= 1;
+        ++result;
+    }
+    return result;
+}
+
+}
+
+double SubAllocatorStatistics::getFragmentation() const {
+    VkDeviceSize totalFree = this->capacity - this->used;
+    if (totalFree == 0) {
+        return 0.0;
+    }
+    return 1.0 - static_cast<double>(this->largestFreeRange) / static_cast<double>(totalFree);
+}
+
+SubAllocator::SubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity)
+    : capacity(capacity), granularity(std::max<VkDeviceSize>(bufferImageGranularity, 1)) {
+    if (!isPowerOfTwo(this->granularity)) {
+        throw runtime_error("bufferImageGranularity must be a power of two!");
+    }
+}
+
+VkDeviceSize SubAllocator::alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    if (alignment <= 1) {
+        return value;
+    }
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool SubAllocator::onSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB) const {
+    VkDeviceSize pageMask = ~(this->granularity - 1);
+    VkDeviceSize lastByteA = offsetA + sizeA - 1;
+    return (lastByteA & pageMask) == (offsetB & pageMask);
+}
+
+optional<VkDeviceSize> LinearSubAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) {
+    VkDeviceSize start = alignUp(this->top, alignment);
+    if (this->liveCount > 0 && this->lastKind != kind && this->onSamePage(this->lastOffset, this->lastSize, start)) {
+        start = alignUp(start, this->granularity);
+    }
+    if (size == 0 || start + size > this->capacity) {
+        return nullopt;
+    }
+
+    this->top = start + size;
+    this->lastOffset = start;
+    this->lastSize = size;
+    this->lastKind = kind;
+    ++this->liveCount;
+    return start;
+}
+
+void LinearSubAllocator::free(VkDeviceSize offset) {
+    if (this->liveCount == 0 || offset >= this->top) {
+        throw runtime_error("invalid linear sub-allocation!");
+    }
+    if (--this->liveCount == 0) {
+        this->reset();
+    }
+}
+
+void LinearSubAllocator::reset() {
+    this->top = 0;
+    this->lastOffset = 0;
+    this->lastSize = 0;
+    this->liveCount = 0;
+}
+
+SubAllocatorStatistics LinearSubAllocator::getStatistics() const {
+    SubAllocatorStatistics statistics;
+    statistics.capacity = this->capacity;
+    statistics.used = this->top;
+    statistics.largestFreeRange = this->capacity - this->top;
+    statistics.allocationCount = this->liveCount;
+    statistics.freeRangeCount = this->top < this->capacity ? 1 : 0;
+    return statistics;
+}
+
+BuddySubAllocator::BuddySubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity, VkDeviceSize minBlockSize)
+    : SubAllocator(capacity, bufferImageGranularity) {
+    this->minBlockSize = nextPowerOfTwo(std::max(minBlockSize, this->granularity));
+    if (!isPowerOfTwo(capacity) || capacity < this->minBlockSize) {
+        throw runtime_error("buddy allocator capacity must be a power of two no smaller than its minimum block!");
+    }
+
+    this->maxOrder = log2OfPowerOfTwo(capacity / this->minBlockSize);
+    this->freeBlocks.resize(this->maxOrder + 1);
+    this->freeBlocks[this->maxOrder].insert(0);
+}
+
+optional<VkDeviceSize> BuddySubAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind) {
+    // Blocks of order k start at multiples of their own size, so any alignment up to the block size holds.
+    VkDeviceSize blockSize = nextPowerOfTwo(std::max({ size, alignment, this->minBlockSize }));
+    if (size == 0 || blockSize > this->capacity) {
+        return nullopt;
+    }
+    uint32_t order = log2OfPowerOfTwo(blockSize / this->minBlockSize);
+
+    uint32_t sourceOrder = order;
+    while (sourceOrder <= this->maxOrder && this->freeBlocks[sourceOrder].empty()) {
+        ++sourceOrder;
+    }
+    if (sourceOrder > this->maxOrder) {
+        return nullopt;
+    }
+
+    // Lowest address first keeps live blocks packed towards the start and large buddies intact at the end.
+    VkDeviceSize offset = *this->freeBlocks[sourceOrder].begin();
+    this->freeBlocks[sourceOrder].erase(this->freeBlocks[sourceOrder].begin());
+
+    while (sourceOrder > order) {
+        --sourceOrder;
+        this->freeBlocks[sourceOrder].insert(offset + this->getBlockSize(sourceOrder));
+    }
+
+    this->allocatedBlocks.emplace(offset, BlockInfo{ order, size });
+    return offset;
+}
+
+void BuddySubAllocator::free(VkDeviceSize offset) {
+    auto allocated = this->allocatedBlocks.find(offset);
+    if (allocated == this->allocatedBlocks.end()) {
+        throw runtime_error("invalid buddy sub-allocation!");
+    }
+    uint32_t order = allocated->second.order;
+    this->allocatedBlocks.erase(allocated);
+
+    while (order < this->maxOrder) {
+        VkDeviceSize buddy = offset ^ this->getBlockSize(order);
+        if (this->freeBlocks[order].erase(buddy) == 0) {
+            break;
+        }
+        offset = std::min(offset, buddy);
+        ++order;
+    }
+    this->freeBlocks[order].insert(offset);
+}
+
+SubAllocatorStatistics BuddySubAllocator::getStatistics() const {
+    SubAllocatorStatistics statistics;
+    statistics.capacity = this->capacity;
+    statistics.allocationCount = static_cast<uint32_t>(this->allocatedBlocks.size());
+
+    for (const auto& [offset, block] : this->allocatedBlocks) {
+        VkDeviceSize blockSize = this->getBlockSize(block.order);
+        statistics.used += blockSize;
+        statistics.internalWaste += blockSize - block.requestedSize;
+    }
+
+    for (uint32_t order = 0; order <= this->maxOrder; ++order) {
+        statistics.freeRangeCount += static_cast<uint32_t>(this->freeBlocks[order].size());
+        if (!this->freeBlocks[order].empty()) {
+            statistics.largestFreeRange = this->getBlockSize(order);
+        }
+    }
+    return statistics;
+}
+
+FreeListSubAllocator::FreeListSubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity)
+    : SubAllocator(capacity, bufferImageGranularity) {
+    this->insertFree(0, capacity);
+}
+
+void FreeListSubAllocator::insertFree(VkDeviceSize offset, VkDeviceSize size) {
+    RangeMap::iterator range = this->ranges.emplace(offset, Range{ size, true, ResourceKind::Linear }).first;
+    this->freeBySize.emplace(size, range);
+}
+
+void FreeListSubAllocator::eraseFree(RangeMap::iterator range) {
+    auto candidates = this->freeBySize.equal_range(range->second.size);
+    for (auto it = candidates.first; it != candidates.second; ++it) {
+        if (it->second == range) {
+            this->freeBySize.erase(it);
+            return;
+        }
+    }
+}
+
+optional<VkDeviceSize> FreeListSubAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) {
+    if (size == 0) {
+        return nullopt;
+    }
+
+    // Best fit: walk free ranges from the smallest that could hold the request, since alignment
+    // and granularity padding can make a range that is large enough on paper unusable.
+    for (auto candidate = this->freeBySize.lower_bound(size); candidate != this->freeBySize.end(); ++candidate) {
+        RangeMap::iterator range = candidate->second;
+        VkDeviceSize rangeOffset = range->first;
+        VkDeviceSize rangeSize = range->second.size;
+
+        VkDeviceSize start = alignUp(rangeOffset, alignment);
+        if (start + size > rangeOffset + rangeSize) {
+            continue;
+        }
+        if (range != this->ranges.begin()) {
+            const auto& previous = *std::prev(range);
+            if (!previous.second.free && previous.second.kind != kind && this->onSamePage(previous.first, previous.second.size, start)) {
+                start = alignUp(start, this->granularity);
+            }
+        }
+
+        VkDeviceSize end = start + size;
+        VkDeviceSize rangeEnd = rangeOffset + rangeSize;
+        if (end > rangeEnd) {
+            continue;
+        }
+
+        RangeMap::iterator next = std::next(range);
+        if (next != this->ranges.end() && !next->second.free && next->second.kind != kind && this->onSamePage(start, size, next->first)) {
+            continue;
+        }
+
+        this->freeBySize.erase(candidate);
+        this->ranges.erase(range);
+        if (start > rangeOffset) {
+            this->insertFree(rangeOffset, start - rangeOffset);
+        }
+        this->ranges.emplace(start, Range{ size, false, kind });
+        if (end < rangeEnd) {
+            this->insertFree(end, rangeEnd - end);
+        }
+
+        ++this->allocationCount;
+        return start;
+    }
+
+    return nullopt;
+}
+
+void FreeListSubAllocator::free(VkDeviceSize offset) {
+    RangeMap::iterator range = this->ranges.find(offset);
+    if (range == this->ranges.end() || range->second.free) {
+        throw runtime_error("invalid free-list sub-allocation!");
+    }
+
+    VkDeviceSize start = range->first;
+    VkDeviceSize size = range->second.size;
+
+    RangeMap::iterator next = std::next(range);
+    if (next != this->ranges.end() && next->second.free) {
+        size += next->second.size;
+        this->eraseFree(next);
+        this->ranges.erase(next);
+    }
+
+    if (range != this->ranges.begin()) {
+        RangeMap::iterator previous = std::prev(range);
+        if (previous->second.free) {
+            start = previous->first;
+            size += previous->second.size;
+            this->eraseFree(previous);
+            this->ranges.erase(previous);
+        }
+    }
+
+    this->ranges.erase(range);
+    this->insertFree(start, size);
+    --this->allocationCount;
+}
+
+SubAllocatorStatistics FreeListSubAllocator::getStatistics() const {
+    SubAllocatorStatistics statistics;
+    statistics.capacity = this->capacity;
+    statistics.allocationCount = this->allocationCount;
+
+    for (const auto& [offset, range] : this->ranges) {
+        if (range.free) {
+            ++statistics.freeRangeCount;
+            statistics.largestFreeRange = std::max(statistics.largestFreeRange, range.size);
+        } else {
+            statistics.used += range.size;
+        }
+    }
+    return statistics;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Placement strategies for carving one VkDeviceMemory block into resources. They only do offset bookkeeping and
+// never touch the device, so they can be exercised on the CPU alone (see AllocatorBenchmark).
+
+// bufferImageGranularity only separates linear resources (buffers, linear images) from optimal-tiling images.
+enum class ResourceKind {
+    Linear,
+    Optimal,
+};
+
+struct SubAllocatorStatistics {
+    VkDeviceSize capacity = 0;
+    VkDeviceSize used = 0;
+    // Bytes handed out beyond what was requested (buddy rounding, alignment padding is not counted).
+    VkDeviceSize internalWaste = 0;
+    VkDeviceSize largestFreeRange = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRangeCount = 0;
+
+    // 0 when all free space is one range, approaching 1 as it splinters into many small ones.
+    double getFragmentation() const;
+};
+
+class SubAllocator {
+
+public:
+
+    SubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity);
+    virtual ~SubAllocator() = default;
+
+    virtual std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) = 0;
+    virtual void free(VkDeviceSize offset) = 0;
+    virtual SubAllocatorStatistics getStatistics() const = 0;
+
+    VkDeviceSize getCapacity() const { return this->capacity; }
+    bool isEmpty() const { return this->getStatistics().allocationCount == 0; }
+
+protected:
+
+    static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment);
+    // True when the last byte of A and the first byte of B fall into the same granularity page.
+    bool onSamePage(VkDeviceSize offsetA, VkDeviceSize sizeA, VkDeviceSize offsetB) const;
+
+    VkDeviceSize capacity;
+    VkDeviceSize granularity;
+};
+
+// Bump allocator for transient data that is released all at once: free() only counts down,
+// and the block rewinds when the last allocation in it is gone.
+class LinearSubAllocator : public SubAllocator {
+
+public:
+
+    using SubAllocator::SubAllocator;
+
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) override;
+    void free(VkDeviceSize offset) override;
+    SubAllocatorStatistics getStatistics() const override;
+
+    void reset();
+
+private:
+
+    VkDeviceSize top = 0;
+    VkDeviceSize lastOffset = 0;
+    VkDeviceSize lastSize = 0;
+    ResourceKind lastKind = ResourceKind::Linear;
+    uint32_t liveCount = 0;
+};
+
+// Power-of-two buddy allocator for short-lived resources of similar size: O(log n) allocate and free,
+// frees coalesce immediately, at the cost of rounding every request up to a power of two.
+class BuddySubAllocator : public SubAllocator {
+
+public:
+
+    // capacity must be a power of two. The smallest block is at least bufferImageGranularity,
+    // so neighbouring blocks never share a page and ResourceKind can be ignored.
+    BuddySubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity, VkDeviceSize minBlockSize = 256);
+
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) override;
+    void free(VkDeviceSize offset) override;
+    SubAllocatorStatistics getStatistics() const override;
+
+private:
+
+    struct BlockInfo {
+        uint32_t order;
+        VkDeviceSize requestedSize;
+    };
+
+    VkDeviceSize getBlockSize(uint32_t order) const { return this->minBlockSize << order; }
+
+    VkDeviceSize minBlockSize;
+    uint32_t maxOrder;
+    std::vector<std::set<VkDeviceSize>> freeBlocks;
+    std::unordered_map<VkDeviceSize, BlockInfo> allocatedBlocks;
+};
+
+// Best-fit free list with coalescing for long-lived resources of any size. Ranges are kept in address order
+// (for coalescing and granularity checks against neighbours) and indexed by size (for best fit).
+class FreeListSubAllocator : public SubAllocator {
+
+public:
+
+    FreeListSubAllocator(VkDeviceSize capacity, VkDeviceSize bufferImageGranularity);
+
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size, VkDeviceSize alignment, ResourceKind kind) override;
+    void free(VkDeviceSize offset) override;
+    SubAllocatorStatistics getStatistics() const override;
+
+private:
+
+    struct Range {
+        VkDeviceSize size;
+        bool free;
+        ResourceKind kind;
+    };
+
+    using RangeMap = std::map<VkDeviceSize, Range>;
+
+    void insertFree(VkDeviceSize offset, VkDeviceSize size);
+    void eraseFree(RangeMap::iterator range);
+
+    RangeMap ranges;
+    // Map iterators stay valid until erased, so the size index points straight at its range.
+    std::multimap<VkDeviceSize, RangeMap::iterator> freeBySize;
+    uint32_t allocationCount = 0;
+};
@@ -0,0 +1,243 @@
+#include "Swapchain.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::vector;
+using std::string;
+using std::optional;
+using std::nullopt;
+using std::ostream;
+using std::runtime_error;
+
+optional<PresentModePreference> parsePresentModePreference(const string& text) {
+    if (text == "mailbox") {
+        return PresentModePreference::Mailbox;
+    } else if (text == "immediate") {
+        return PresentModePreference::Immediate;
+    } else if (text == "fifo") {
+        return PresentModePreference::Fifo;
+    }
+    return nullopt;
+}
+
+const char* getPresentModeString(VkPresentModeKHR presentMode) {
+    switch (presentMode) {
+    case VK_PRESENT_MODE_IMMEDIATE_KHR: return "Immediate";
+    case VK_PRESENT_MODE_MAILBOX_KHR: return "Mailbox";
+    case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+    case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO Relaxed";
+    default: return "Unknown Present Mode";
+    }
+}
+
+SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface) {
+    SwapchainSupportDetails details;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+    details.formats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
+
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, nullptr);
+    details.presentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+
+    return details;
+}
+
+VkSurfaceFormatKHR Swapchain::chooseSurfaceFormat(const vector<VkSurfaceFormatKHR>& availableFormats) {
+    for (const auto& availableFormat : availableFormats) {
+        if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return availableFormat;
+        }
+    }
+    return availableFormats[0];
+}
+
+VkPresentModeKHR Swapchain::choosePresentMode(const vector<VkPresentModeKHR>& availablePresentModes, PresentModePreference preference) {
+    auto isAvailable = [&](VkPresentModeKHR mode) {
+        return std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end();
+    };
+
+    // Fall back towards the other low-latency mode first; FIFO is the one mode every surface supports.
+    vector<VkPresentModeKHR> candidates;
+    switch (preference) {
+    case PresentModePreference::Mailbox:
+        candidates = { VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR };
+        break;
+    case PresentModePreference::Immediate:
+        candidates = { VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR };
+        break;
+    case PresentModePreference::Fifo:
+        break;
+    }
+
+    for (VkPresentModeKHR mode : candidates) {
+        if (isAvailable(mode)) {
+            return mode;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D Swapchain::chooseExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D framebufferExtent) {
+    // A current extent of 0xFFFFFFFF means the surface size is determined by the swapchain.
+    if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
+        return capabilities.currentExtent;
+    }
+
+    VkExtent2D actualExtent = framebufferExtent;
+    actualExtent.width = std::clamp(actualExtent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+    actualExtent.height = std::clamp(actualExtent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    return actualExtent;
+}
+
+uint32_t Swapchain::chooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities, std::optional<uint32_t> desiredImageCount) {
+    // By default one more than the minimum, so the application never waits on the presentation engine for an
+    // image; an explicit count is taken as asked, within the limits.
+    uint32_t imageCount = std::max(desiredImageCount.value_or(capabilities.minImageCount + 1), capabilities.minImageCount);
+    // A maximum of 0 means there is no limit.
+    if (capabilities.maxImageCount > 0) {
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+    }
+    return imageCount;
+}
+
+void Swapchain::create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, VkExtent2D framebufferExtent, const Config& config) {
+    this->physicalDevice = physicalDevice;
+    this->device = device;
+    this->surface = surface;
+    this->config = config;
+    this->build(framebufferExtent, VK_NULL_HANDLE);
+}
+
+void Swapchain::recreate(VkExtent2D framebufferExtent, uint64_t lastFrameUsingOld) {
+    Retired old{ this->swapchain, this->imageViews, lastFrameUsingOld };
+
+    this->build(framebufferExtent, this->swapchain);
+
+    // The old swapchain is already retired by passing it as oldSwapchain; its images may still be in use
+    // by frames in flight, so destruction waits for collectRetired().
+    this->retired.push_back(old);
+}
+
+void Swapchain::collectRetired(uint64_t completedFrame) {
+    auto it = this->retired.begin();
+    while (it != this->retired.end()) {
+        if (it->lastFrame <= completedFrame) {
+            this->destroyImageViews(it->imageViews);
+            vkDestroySwapchainKHR(this->device, it->swapchain, HostAllocator::get().getCallbacks());
+            it = this->retired.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Swapchain::build(VkExtent2D framebufferExtent, VkSwapchainKHR oldSwapchain) {
+    SwapchainSupportDetails support = querySwapchainSupport(this->physicalDevice, this->surface);
+
+    VkSurfaceFormatKHR surfaceFormat = chooseSurfaceFormat(support.formats);
+    VkPresentModeKHR presentMode = choosePresentMode(support.presentModes, this->config.presentMode);
+    VkExtent2D extent = chooseExtent(support.capabilities, framebufferExtent);
+    uint32_t imageCount = chooseImageCount(support.capabilities, this->config.desiredImageCount);
+
+    // Frames are cleared with transfer commands where the surface allows it.
+    bool transferDst = (support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) != 0;
+
+    VkSwapchainCreateInfoKHR createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    createInfo.surface = this->surface;
+    createInfo.minImageCount = imageCount;
+    createInfo.imageFormat = surfaceFormat.format;
+    createInfo.imageColorSpace = surfaceFormat.colorSpace;
+    createInfo.imageExtent = extent;
+    createInfo.imageArrayLayers = 1;
+    createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (transferDst ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : 0);
+
+    uint32_t queueFamilyIndices[] = { this->config.graphicsFamily, this->config.presentFamily };
+    if (this->config.graphicsFamily != this->config.presentFamily) {
+        createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        createInfo.queueFamilyIndexCount = 2;
+        createInfo.pQueueFamilyIndices = queueFamilyIndices;
+    } else {
+        createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    createInfo.preTransform = support.capabilities.currentTransform;
+    createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    if ((support.capabilities.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR) == 0) {
+        // Pick the lowest supported mode; every surface supports at least one.
+        VkCompositeAlphaFlagsKHR supported = support.capabilities.supportedCompositeAlpha;
+        createInfo.compositeAlpha = static_cast<VkCompositeAlphaFlagBitsKHR>(supported & (~supported + 1));
+    }
+    createInfo.presentMode = presentMode;
+    createInfo.clipped = VK_TRUE;
+    createInfo.oldSwapchain = oldSwapchain;
+
+    VkSwapchainKHR newSwapchain;
+    if (vkCreateSwapchainKHR(this->device, &createInfo, HostAllocator::get().getCallbacks(), &newSwapchain) != VK_SUCCESS) {
+        throw runtime_error("failed to create swap chain!");
+    }
+
+    this->swapchain = newSwapchain;
+    this->imageFormat = surfaceFormat.format;
+    this->extent = extent;
+    this->presentMode = presentMode;
+    this->transferDst = transferDst;
+
+    uint32_t actualImageCount = 0;
+    vkGetSwapchainImagesKHR(this->device, this->swapchain, &actualImageCount, nullptr);
+    this->images.resize(actualImageCount);
+    vkGetSwapchainImagesKHR(this->device, this->swapchain, &actualImageCount, this->images.data());
+
+    this->imageViews.assign(actualImageCount, VK_NULL_HANDLE);
+    for (size_t i = 0; i < this->images.size(); ++i) {
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = this->images[i];
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = this->imageFormat;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &this->imageViews[i]) != VK_SUCCESS) {
+            throw runtime_error("failed to create swap chain image view!");
+        }
+    }
+}
+
+void Swapchain::destroyImageViews(const vector<VkImageView>& views) {
+    for (VkImageView view : views) {
+        vkDestroyImageView(this->device, view, HostAllocator::get().getCallbacks());
+    }
+}
+
+void Swapchain::destroy() {
+    this->collectRetired(std::numeric_limits<uint64_t>::max());
+
+    this->destroyImageViews(this->imageViews);
+    this->imageViews.clear();
+    this->images.clear();
+
+    if (this->swapchain != VK_NULL_HANDLE) {
+        vkDestroySwapchainKHR(this->device, this->swapchain, HostAllocator::get().getCallbacks());
+        this->swapchain = VK_NULL_HANDLE;
+    }
+}
+
+void Swapchain::print(ostream& out) const {
+    out << "[Swapchain]" << '\n';
+    out << "\tExtent: " << this->extent.width << 'x' << this->extent.height << '\n';
+    out << "\tImages: " << this->images.size() << '\n';
+    out << "\tPresent mode: " << getPresentModeString(this->presentMode) << '\n';
+}
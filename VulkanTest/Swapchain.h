@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+enum class PresentModePreference {
+    // Lowest latency without tearing: the newest frame replaces the queued one.
+    Mailbox,
+    // Lowest latency with tearing, and the only uncapped mode on many drivers.
+    Immediate,
+    // Classic vsync; always supported.
+    Fifo,
+};
+
+std::optional<PresentModePreference> parsePresentModePreference(const std::string& text);
+const char* getPresentModeString(VkPresentModeKHR presentMode);
+
+struct SwapchainSupportDetails {
+    VkSurfaceCapabilitiesKHR capabilities;
+    std::vector<VkSurfaceFormatKHR> formats;
+    std::vector<VkPresentModeKHR> presentModes;
+
+    bool isAdequate() const {
+        return !this->formats.empty() && !this->presentModes.empty();
+    }
+};
+
+SwapchainSupportDetails querySwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
+
+// The window's swapchain and its image views.
+// Recreation (on resize or when presentation reports it out of date) passes the current swapchain as
+// oldSwapchain and retires it instead of waiting for the device to go idle: the retired swapchain is only
+// destroyed once every frame that may still reference it has completed.
+class Swapchain {
+
+public:
+
+    struct Config {
+        PresentModePreference presentMode = PresentModePreference::Mailbox;
+        // Clamped to the surface's limits. Without one, one more than the surface's minimum.
+        std::optional<uint32_t> desiredImageCount;
+        uint32_t graphicsFamily = 0;
+        uint32_t presentFamily = 0;
+    };
+
+    void create(VkPhysicalDevice physicalDevice, VkDevice device, VkSurfaceKHR surface, VkExtent2D framebufferExtent, const Config& config);
+
+    // `lastFrameUsingOld` is the serial of the newest frame that may still use the current swapchain.
+    void recreate(VkExtent2D framebufferExtent, uint64_t lastFrameUsingOld);
+
+    // Destroys retired swapchains whose last frame is not newer than `completedFrame`.
+    void collectRetired(uint64_t completedFrame);
+
+    void destroy();
+
+    VkSwapchainKHR getHandle() const { return this->swapchain; }
+    VkFormat getImageFormat() const { return this->imageFormat; }
+    VkExtent2D getExtent() const { return this->extent; }
+    VkPresentModeKHR getPresentMode() const { return this->presentMode; }
+    uint32_t getImageCount() const { return static_cast<uint32_t>(this->images.size()); }
+    VkImage getImage(uint32_t index) const { return this->images[index]; }
+    VkImageView getImageView(uint32_t index) const { return this->imageViews[index]; }
+    bool supportsTransferDst() const { return this->transferDst; }
+
+    void print(std::ostream& out) const;
+
+private:
+
+    struct Retired {
+        VkSwapchainKHR swapchain;
+        std::vector<VkImageView> imageViews;
+        uint64_t lastFrame;
+    };
+
+    void build(VkExtent2D framebufferExtent, VkSwapchainKHR oldSwapchain);
+    void destroyImageViews(const std::vector<VkImageView>& views);
+
+    static VkSurfaceFormatKHR chooseSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
+    static VkPresentModeKHR choosePresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes, PresentModePreference preference);
+    static VkExtent2D chooseExtent(const VkSurfaceCapabilitiesKHR& capabilities, VkExtent2D framebufferExtent);
+    static uint32_t chooseImageCount(const VkSurfaceCapabilitiesKHR& capabilities, std::optional<uint32_t> desiredImageCount);
+
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    VkDevice device = VK_NULL_HANDLE;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    Config config;
+
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    VkFormat imageFormat = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent{};
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    bool transferDst = false;
+    std::vector<VkImage> images;
+    std::vector<VkImageView> imageViews;
+    std::vector<Retired> retired;
+};
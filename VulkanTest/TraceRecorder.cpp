@@ -0,0 +1,134 @@
+#include "TraceRecorder.h"
+
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "JsonWriter.h"
+
+using std::string;
+using std::ofstream;
+using std::runtime_error;
+using std::vector;
+
+namespace {
+
+// Chrome trace tracks of the process; CPU threads are numbered from 1 in the order they first record.
+constexpr const uint32_t GPU_TRACK_ID = 1000;
+
+thread_local void* currentThreadBuffer = nullptr;
+
+}
+
+// Like the start-up tracer, constructed during static initialization so the epoch is close to process start.
+static TraceRecorder& traceRecorderInstance = TraceRecorder::get();
+
+TraceRecorder::Scope::Scope(const char* name, const char* category)
+    : name(name), category(category), startNs(TraceRecorder::get().isEnabled() ? TraceRecorder::get().nowNs() : -1) {
+}
+
+TraceRecorder::Scope::~Scope() {
+    if (this->startNs >= 0) {
+        TraceRecorder& recorder = TraceRecorder::get();
+        recorder.addCpuRange(this->name, this->category, this->startNs, recorder.nowNs() - this->startNs);
+    }
+}
+
+TraceRecorder& TraceRecorder::get() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+TraceRecorder::TraceRecorder() : epoch(Clock::now()) {
+    this->gpuBuffer.trackId = GPU_TRACK_ID;
+    this->gpuBuffer.name = "GPU";
+}
+
+int64_t TraceRecorder::nowNs() const {
+    return this->toNs(Clock::now());
+}
+
+int64_t TraceRecorder::toNs(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - this->epoch).count();
+}
+
+TraceRecorder::ThreadBuffer& TraceRecorder::getThreadBuffer() {
+    // The thread-local pointer is the fast path; the lock is only taken the first time a thread records.
+    if (currentThreadBuffer == nullptr) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+        ThreadBuffer& buffer = *this->threadBuffers.back();
+        buffer.trackId = static_cast<uint32_t>(this->threadBuffers.size());
+        buffer.name = "thread " + std::to_string(buffer.trackId);
+        buffer.events.reserve(4096);
+        currentThreadBuffer = &buffer;
+    }
+    return *static_cast<ThreadBuffer*>(currentThreadBuffer);
+}
+
+void TraceRecorder::append(ThreadBuffer& buffer, const Event& event) {
+    if (buffer.events.size() >= MAX_EVENTS_PER_TRACK) {
+        ++buffer.droppedEvents;
+        return;
+    }
+    buffer.events.push_back(event);
+}
+
+void TraceRecorder::setThreadName(const string& name) {
+    if (!this->enabled) {
+        return;
+    }
+    this->getThreadBuffer().name = name;
+}
+
+const char* TraceRecorder::intern(const string& name) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->internedNames.insert(name).first->c_str();
+}
+
+void TraceRecorder::addCpuRange(const char* name, const char* category, int64_t startNs, int64_t durationNs) {
+    append(this->getThreadBuffer(), { name, category, startNs, durationNs });
+}
+
+void TraceRecorder::addGpuRange(const char* name, int64_t startNs, int64_t durationNs) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    append(this->gpuBuffer, { name, "gpu", startNs, durationNs });
+}
+
+void TraceRecorder::writeChromeTrace(const string& path) const {
+    ofstream file(path, std::ios::out | std::ios::trunc);
+    if (!file) {
+        throw runtime_error("failed to open trace file: " + path);
+    }
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    vector<const ThreadBuffer*> tracks;
+    for (const std::unique_ptr<ThreadBuffer>& buffer : this->threadBuffers) {
+        tracks.push_back(buffer.get());
+    }
+    tracks.push_back(&this->gpuBuffer);
+
+    uint64_t droppedEvents = 0;
+    // Chrome trace timestamps are in microseconds.
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"VulkanTest\"}}";
+    for (const ThreadBuffer* track : tracks) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->trackId
+            << ",\"args\":{\"name\":\"" << escapeJson(track->name) << "\"}}";
+        // Sorts the GPU track below the CPU threads.
+        file << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track->trackId
+            << ",\"args\":{\"sort_index\":" << track->trackId << "}}";
+        for (const Event& event : track->events) {
+            file << ",\n{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << track->trackId << ",\"ts\":" << static_cast<double>(event.startNs) / 1.0e3
+                << ",\"dur\":" << static_cast<double>(event.durationNs) / 1.0e3 << "}";
+        }
+        droppedEvents += track->droppedEvents;
+    }
+    file << "\n],\"otherData\":{\"droppedEvents\":" << droppedEvents << "}}\n";
+
+    if (!file) {
+        throw runtime_error("failed to write trace file: " + path);
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Records a timeline of the whole run, CPU scopes from every thread plus GPU ranges, and writes it as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev).
+//
+// Every thread appends to a buffer of its own that only it writes to, so recording a scope takes no lock;
+// the buffers are registered once per thread and merged by writeChromeTrace(), which must only be called
+// once no other thread is recording anymore. Recording is off until enable() is called, and a disabled
+// scope costs one branch. Times are nanoseconds on std::chrono::steady_clock since the recorder's epoch,
+// which GPU ranges are calibrated to before they are added.
+class TraceRecorder {
+
+public:
+
+    using Clock = std::chrono::steady_clock;
+
+    // Records the time between construction and destruction on the calling thread's track.
+    // The name and category must outlive the recorder, e.g. string literals or intern()ed names.
+    class Scope {
+
+    public:
+
+        explicit Scope(const char* name, const char* category = "cpu");
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+
+        const char* name;
+        const char* category;
+        int64_t startNs;
+    };
+
+    static TraceRecorder& get();
+
+    void enable() { this->enabled = true; }
+    bool isEnabled() const { return this->enabled; }
+
+    int64_t nowNs() const;
+    int64_t toNs(Clock::time_point time) const;
+
+    // Names the calling thread's track.
+    void setThreadName(const std::string& name);
+
+    // Returns a copy of the name that lives as long as the recorder, for names that are not literals.
+    const char* intern(const std::string& name);
+
+    void addCpuRange(const char* name, const char* category, int64_t startNs, int64_t durationNs);
+    // GPU ranges go to a track of their own, whichever thread reads them back.
+    void addGpuRange(const char* name, int64_t startNs, int64_t durationNs);
+
+    void writeChromeTrace(const std::string& path) const;
+
+private:
+
+    struct Event {
+        const char* name;
+        const char* category;
+        int64_t startNs;
+        int64_t durationNs;
+    };
+
+    struct ThreadBuffer {
+        uint32_t trackId = 0;
+        std::string name;
+        std::vector<Event> events;
+        uint64_t droppedEvents = 0;
+    };
+
+    // Keeps a runaway loop from eating all memory; events past it are only counted.
+    static constexpr const size_t MAX_EVENTS_PER_TRACK = 1u << 22;
+
+    TraceRecorder();
+
+    ThreadBuffer& getThreadBuffer();
+    static void append(ThreadBuffer& buffer, const Event& event);
+
+    const Clock::time_point epoch;
+    bool enabled = false;
+
+    // Guards registering buffers and interning names, never the recording itself.
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+    ThreadBuffer gpuBuffer;
+    // Node based, so the strings never move.
+    std::unordered_set<std::string> internedNames;
+};
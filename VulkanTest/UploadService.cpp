@@ -0,0 +1,486 @@
+#include "UploadService.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "HostAllocator.h"
+
+using std::ostream;
+using std::runtime_error;
+using std::vector;
+
+namespace {
+
+// For buffer copies, which have no offset rules; it keeps the data aligned for memcpy. Image copies use
+// getImageCopyAlignment() instead.
+constexpr const VkDeviceSize STAGING_ALIGNMENT = 16;
+
+// bufferOffset must be a multiple of the texel block size, which need not be a power of two (e.g. 12 bytes
+// for R32G32B32_SFLOAT), and of 4.
+VkDeviceSize getImageCopyAlignment(VkDeviceSize texelBlockSize) {
+    return std::lcm(texelBlockSize, VkDeviceSize(4));
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+void UploadService::create(VkDevice device, DeviceMemoryAllocator& allocator, VkQueue graphicsQueue, uint32_t graphicsFamily,
+    VkQueue transferQueue, uint32_t transferFamily, bool timelineSemaphores, VkDeviceSize ringSize) {
+    this->device = device;
+    this->allocator = &allocator;
+    this->graphicsFamily = graphicsFamily;
+    this->ringSize = ringSize;
+
+    // Without timeline semaphores a second queue would need a binary semaphore per batch that exactly one
+    // frame consumes; uploads then simply go first on the graphics queue instead.
+    this->separateQueue = timelineSemaphores && transferQueue != VK_NULL_HANDLE && transferQueue != graphicsQueue;
+    this->ownershipTransfer = this->separateQueue && transferFamily != graphicsFamily;
+    this->submitQueue = this->separateQueue ? transferQueue : graphicsQueue;
+    this->submitFamily = this->separateQueue ? transferFamily : graphicsFamily;
+
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    poolInfo.queueFamilyIndex = this->submitFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, HostAllocator::get().getCallbacks(), &this->commandPool) != VK_SUCCESS) {
+        throw runtime_error("failed to create upload command pool!");
+    }
+
+    if (this->separateQueue) {
+        VkSemaphoreTypeCreateInfo typeInfo{};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+
+        if (vkCreateSemaphore(device, &semaphoreInfo, HostAllocator::get().getCallbacks(), &this->timeline) != VK_SUCCESS) {
+            throw runtime_error("failed to create upload timeline semaphore!");
+        }
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = ringSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if (vkCreateBuffer(device, &bufferInfo, HostAllocator::get().getCallbacks(), &this->stagingBuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to create staging buffer!");
+    }
+
+    this->stagingAllocation = allocator.allocateForBuffer(this->stagingBuffer,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationLifetime::LongLived);
+    if (this->stagingAllocation.mappedData == nullptr) {
+        throw runtime_error("staging buffer memory is not mapped!");
+    }
+}
+
+void UploadService::waitIdle() {
+    while (!this->inFlight.empty()) {
+        this->waitForOldestBatch();
+    }
+}
+
+void UploadService::destroy() {
+    if (this->device == VK_NULL_HANDLE) {
+        return;
+    }
+
+    this->waitIdle();
+
+    for (VkFence fence : this->freeFences) {
+        vkDestroyFence(this->device, fence, HostAllocator::get().getCallbacks());
+    }
+    this->freeFences.clear();
+    this->freeCommandBuffers.clear();
+
+    vkDestroyCommandPool(this->device, this->commandPool, HostAllocator::get().getCallbacks());
+    if (this->timeline != VK_NULL_HANDLE) {
+        vkDestroySemaphore(this->device, this->timeline, HostAllocator::get().getCallbacks());
+    }
+
+    vkDestroyBuffer(this->device, this->stagingBuffer, HostAllocator::get().getCallbacks());
+    this->allocator->free(this->stagingAllocation);
+
+    this->device = VK_NULL_HANDLE;
+}
+
+bool UploadService::isBatchComplete(const Batch& batch) const {
+    if (this->separateQueue) {
+        uint64_t completedValue = 0;
+        vkGetSemaphoreCounterValue(this->device, this->timeline, &completedValue);
+        return completedValue >= batch.timelineValue;
+    }
+    return vkGetFenceStatus(this->device, batch.fence) == VK_SUCCESS;
+}
+
+void UploadService::reclaim() {
+    while (!this->inFlight.empty() && this->isBatchComplete(this->inFlight.front())) {
+        Batch& batch = this->inFlight.front();
+        this->ringTail = batch.ringEnd;
+
+        this->freeCommandBuffers.push_back(batch.commandBuffer);
+        if (batch.fence != VK_NULL_HANDLE) {
+            vkResetFences(this->device, 1, &batch.fence);
+            this->freeFences.push_back(batch.fence);
+        }
+        this->inFlight.pop_front();
+    }
+}
+
+void UploadService::waitForOldestBatch() {
+    const Batch& batch = this->inFlight.front();
+    if (this->separateQueue) {
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &this->timeline;
+        waitInfo.pValues = &batch.timelineValue;
+        vkWaitSemaphores(this->device, &waitInfo, UINT64_MAX);
+    } else {
+        vkWaitForFences(this->device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    }
+    this->reclaim();
+}
+
+uint64_t UploadService::allocateRing(VkDeviceSize size, VkDeviceSize alignment) {
+    if (size > this->ringSize) {
+        throw runtime_error("upload does not fit into the staging ring!");
+    }
+
+    auto placeAtHead = [&]() {
+        // The offset within the ring is what the copies see, and a ring size need not be a multiple of the
+        // alignment, so that is what gets aligned.
+        uint64_t start = this->ringHead - this->ringHead % this->ringSize + alignUp(this->ringHead % this->ringSize, alignment);
+        // Copies need contiguous source memory, so skip the tail of the ring instead of wrapping mid-upload.
+        if (start % this->ringSize + size > this->ringSize) {
+            start = alignUp(start + 1, this->ringSize);
+        }
+        return start;
+    };
+
+    for (;;) {
+        uint64_t start = placeAtHead();
+        if (start + size - this->ringTail <= this->ringSize) {
+            this->ringHead = start + size;
+            return start;
+        }
+
+        this->reclaim();
+        if (placeAtHead() + size - this->ringTail <= this->ringSize) {
+            continue;
+        }
+
+        // Still full: whatever is only recorded has to go out before its space can ever come back.
+        if (this->inFlight.empty()) {
+            this->flush();
+        }
+        ++this->ringStalls;
+        this->waitForOldestBatch();
+    }
+}
+
+void UploadService::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    // Large uploads go in chunks of half the ring, so one of them never has to wait for itself.
+    const VkDeviceSize chunkLimit = this->ringSize / 2;
+    const char* source = static_cast<const char*>(data);
+
+    while (size > 0) {
+        VkDeviceSize chunk = std::min(size, chunkLimit);
+        uint64_t position = this->allocateRing(chunk, STAGING_ALIGNMENT);
+        VkDeviceSize ringOffset = position % this->ringSize;
+        memcpy(static_cast<char*>(this->stagingAllocation.mappedData) + ringOffset, source, static_cast<size_t>(chunk));
+
+        PendingBufferCopy copy;
+        copy.buffer = buffer;
+        copy.region.srcOffset = ringOffset;
+        copy.region.dstOffset = offset;
+        copy.region.size = chunk;
+        this->pendingBuffers.push_back(copy);
+
+        source += chunk;
+        offset += chunk;
+        size -= chunk;
+    }
+}
+
+void UploadService::uploadImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel, VkExtent3D extent, VkDeviceSize texelBlockSize,
+    const void* data, VkDeviceSize size, VkImageLayout finalLayout) {
+    if (texelBlockSize == 0) {
+        throw runtime_error("image upload needs the texel block size!");
+    }
+    uint64_t position = this->allocateRing(size, getImageCopyAlignment(texelBlockSize));
+    VkDeviceSize ringOffset = position % this->ringSize;
+    memcpy(static_cast<char*>(this->stagingAllocation.mappedData) + ringOffset, data, static_cast<size_t>(size));
+
+    PendingImageCopy copy{};
+    copy.image = image;
+    copy.region.bufferOffset = ringOffset;
+    copy.region.bufferRowLength = 0;
+    copy.region.bufferImageHeight = 0;
+    copy.region.imageSubresource.aspectMask = aspect;
+    copy.region.imageSubresource.mipLevel = mipLevel;
+    copy.region.imageSubresource.baseArrayLayer = 0;
+    copy.region.imageSubresource.layerCount = 1;
+    copy.region.imageOffset = { 0, 0, 0 };
+    copy.region.imageExtent = extent;
+    copy.finalLayout = finalLayout;
+    copy.size = size;
+    this->pendingImages.push_back(copy);
+}
+
+void UploadService::recordReleaseBarriers(VkCommandBuffer commandBuffer) {
+    // Same queue: later commands only need the writes made visible. Separate queue: the semaphore does that,
+    // and with an ownership transfer the graphics side finishes the job in recordAcquireBarriers().
+    VkAccessFlags dstAccess = this->separateQueue ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+    VkPipelineStageFlags dstStage = this->separateQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    uint32_t srcFamily = this->ownershipTransfer ? this->submitFamily : VK_QUEUE_FAMILY_IGNORED;
+    uint32_t dstFamily = this->ownershipTransfer ? this->graphicsFamily : VK_QUEUE_FAMILY_IGNORED;
+
+    vector<VkMemoryBarrier> memoryBarriers;
+    vector<VkBufferMemoryBarrier> bufferBarriers;
+    vector<VkImageMemoryBarrier> imageBarriers;
+
+    if (this->ownershipTransfer) {
+        // pendingBuffers is sorted by buffer, so one barrier covers all regions of a buffer.
+        for (size_t i = 0; i < this->pendingBuffers.size();) {
+            VkBuffer buffer = this->pendingBuffers[i].buffer;
+            VkDeviceSize begin = this->pendingBuffers[i].region.dstOffset;
+            VkDeviceSize end = begin + this->pendingBuffers[i].region.size;
+            for (++i; i < this->pendingBuffers.size() && this->pendingBuffers[i].buffer == buffer; ++i) {
+                begin = std::min(begin, this->pendingBuffers[i].region.dstOffset);
+                end = std::max(end, this->pendingBuffers[i].region.dstOffset + this->pendingBuffers[i].region.size);
+            }
+
+            VkBufferMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = 0;
+            barrier.srcQueueFamilyIndex = srcFamily;
+            barrier.dstQueueFamilyIndex = dstFamily;
+            barrier.buffer = buffer;
+            barrier.offset = begin;
+            barrier.size = end - begin;
+            bufferBarriers.push_back(barrier);
+
+            // The acquire must match the release exactly, apart from the access masks.
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            this->bufferAcquires.push_back(barrier);
+        }
+    } else if (!this->separateQueue && !this->pendingBuffers.empty()) {
+        VkMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        memoryBarriers.push_back(barrier);
+    }
+
+    for (const PendingImageCopy& copy : this->pendingImages) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = dstAccess;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = copy.finalLayout;
+        barrier.srcQueueFamilyIndex = srcFamily;
+        barrier.dstQueueFamilyIndex = dstFamily;
+        barrier.image = copy.image;
+        barrier.subresourceRange.aspectMask = copy.region.imageSubresource.aspectMask;
+        barrier.subresourceRange.baseMipLevel = copy.region.imageSubresource.mipLevel;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        imageBarriers.push_back(barrier);
+
+        if (this->ownershipTransfer) {
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            this->imageAcquires.push_back(barrier);
+        }
+    }
+
+    if (memoryBarriers.empty() && bufferBarriers.empty() && imageBarriers.empty()) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage, 0,
+        static_cast<uint32_t>(memoryBarriers.size()), memoryBarriers.data(),
+        static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+        static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+}
+
+void UploadService::flush() {
+    if (this->pendingBuffers.empty() && this->pendingImages.empty()) {
+        return;
+    }
+
+    this->reclaim();
+
+    VkCommandBuffer commandBuffer;
+    if (!this->freeCommandBuffers.empty()) {
+        commandBuffer = this->freeCommandBuffers.back();
+        this->freeCommandBuffers.pop_back();
+    } else {
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = this->commandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(this->device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+            throw runtime_error("failed to allocate upload command buffer!");
+        }
+    }
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+        throw runtime_error("failed to begin recording upload command buffer!");
+    }
+
+    if (!this->pendingImages.empty()) {
+        vector<VkImageMemoryBarrier> toTransferDst;
+        for (const PendingImageCopy& copy : this->pendingImages) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = copy.image;
+            barrier.subresourceRange.aspectMask = copy.region.imageSubresource.aspectMask;
+            barrier.subresourceRange.baseMipLevel = copy.region.imageSubresource.mipLevel;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+            toTransferDst.push_back(barrier);
+        }
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+            0, nullptr, 0, nullptr, static_cast<uint32_t>(toTransferDst.size()), toTransferDst.data());
+    }
+
+    std::stable_sort(this->pendingBuffers.begin(), this->pendingBuffers.end(), [](const PendingBufferCopy& a, const PendingBufferCopy& b) {
+        return a.buffer < b.buffer;
+    });
+
+    vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < this->pendingBuffers.size();) {
+        VkBuffer buffer = this->pendingBuffers[i].buffer;
+        regions.clear();
+        for (; i < this->pendingBuffers.size() && this->pendingBuffers[i].buffer == buffer; ++i) {
+            regions.push_back(this->pendingBuffers[i].region);
+        }
+        vkCmdCopyBuffer(commandBuffer, this->stagingBuffer, buffer, static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    for (const PendingImageCopy& copy : this->pendingImages) {
+        vkCmdCopyBufferToImage(commandBuffer, this->stagingBuffer, copy.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy.region);
+    }
+
+    this->recordReleaseBarriers(commandBuffer);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+        throw runtime_error("failed to record upload command buffer!");
+    }
+
+    Batch batch{};
+    batch.commandBuffer = commandBuffer;
+    batch.ringEnd = this->ringHead;
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    if (this->separateQueue) {
+        batch.timelineValue = ++this->lastSubmittedValue;
+
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineInfo.signalSemaphoreValueCount = 1;
+        timelineInfo.pSignalSemaphoreValues = &batch.timelineValue;
+
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &this->timeline;
+    } else if (!this->freeFences.empty()) {
+        batch.fence = this->freeFences.back();
+        this->freeFences.pop_back();
+    } else {
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(this->device, &fenceInfo, HostAllocator::get().getCallbacks(), &batch.fence) != VK_SUCCESS) {
+            throw runtime_error("failed to create upload fence!");
+        }
+    }
+
+    if (vkQueueSubmit(this->submitQueue, 1, &submitInfo, batch.fence) != VK_SUCCESS) {
+        throw runtime_error("failed to submit upload batch!");
+    }
+
+    this->inFlight.push_back(batch);
+    if (this->separateQueue) {
+        this->acquireWaitValue = batch.timelineValue;
+    }
+
+    ++this->batchCount;
+    this->copyCount += this->pendingBuffers.size() + this->pendingImages.size();
+    for (const PendingBufferCopy& copy : this->pendingBuffers) {
+        this->bytesUploaded += copy.region.size;
+    }
+    for (const PendingImageCopy& copy : this->pendingImages) {
+        this->bytesUploaded += copy.size;
+    }
+    this->pendingBuffers.clear();
+    this->pendingImages.clear();
+}
+
+TimelineWait UploadService::recordAcquireBarriers(VkCommandBuffer commandBuffer) {
+    TimelineWait wait;
+    if (!this->separateQueue || this->acquireWaitValue == 0) {
+        return wait;
+    }
+
+    if (!this->bufferAcquires.empty() || !this->imageAcquires.empty()) {
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            0, nullptr,
+            static_cast<uint32_t>(this->bufferAcquires.size()), this->bufferAcquires.data(),
+            static_cast<uint32_t>(this->imageAcquires.size()), this->imageAcquires.data());
+        this->bufferAcquires.clear();
+        this->imageAcquires.clear();
+    }
+
+    wait.semaphore = this->timeline;
+    wait.value = this->acquireWaitValue;
+    wait.stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    this->acquireWaitValue = 0;
+    return wait;
+}
+
+void UploadService::printStatistics(ostream& out) const {
+    out << "[Uploads]" << '\n';
+    if (this->ownershipTransfer) {
+        out << '\t' << "Transfer queue family " << this->submitFamily << ", ownership transfer to family " << this->graphicsFamily << ", timeline semaphore" << '\n';
+    } else if (this->separateQueue) {
+        out << '\t' << "Separate queue in graphics family " << this->submitFamily << ", timeline semaphore" << '\n';
+    } else {
+        out << '\t' << "Graphics queue, fence per batch" << '\n';
+    }
+    out << '\t' << "Staging ring: " << this->ringSize / (1024 * 1024) << " MiB, " << this->ringStalls << " stalls waiting for space" << '\n';
+    out << '\t' << "Batches: " << this->batchCount << ", copies: " << this->copyCount << ", " << this->bytesUploaded << " bytes" << '\n';
+}
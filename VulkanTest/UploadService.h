@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+#include <vector>
+
+#include "DeviceMemoryAllocator.h"
+#include "FrameRing.h"
+
+// Streams buffer and image data to the device through one persistently mapped staging ring.
+//
+// Uploads are memcpy'd into the ring and only recorded; flush() turns everything since the last flush into one
+// command buffer with a single vkCmdCopyBuffer per destination buffer, submitted on the transfer queue when the
+// device has a separate one (and timeline semaphores), else on the graphics queue. Ring space is reclaimed
+// as batches complete, tracked by the timeline semaphore or by a fence per batch.
+class UploadService {
+
+public:
+
+    void create(VkDevice device, DeviceMemoryAllocator& allocator, VkQueue graphicsQueue, uint32_t graphicsFamily,
+        VkQueue transferQueue, uint32_t transferFamily, bool timelineSemaphores, VkDeviceSize ringSize);
+    void destroy();
+
+    void uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+    // One mip level of one layer, tightly packed. texelBlockSize is the format's bytes per texel (or per block
+    // for compressed formats), which the staging offset has to be a multiple of. The image ends up in
+    // finalLayout, owned by the graphics family.
+    void uploadImage(VkImage image, VkImageAspectFlags aspect, uint32_t mipLevel, VkExtent3D extent, VkDeviceSize texelBlockSize,
+        const void* data, VkDeviceSize size, VkImageLayout finalLayout);
+
+    // Submits all recorded uploads as one batch. Does nothing when there are none.
+    void flush();
+
+    // Records the graphics-side half of the ownership transfers for batches flushed since the last call, and
+    // returns the semaphore wait the command buffer's submission needs (empty when uploads share its queue).
+    TimelineWait recordAcquireBarriers(VkCommandBuffer commandBuffer);
+
+    // Blocks until every flushed upload has completed (for shutdown).
+    void waitIdle();
+
+    void printStatistics(std::ostream& out) const;
+
+private:
+
+    struct PendingBufferCopy {
+        VkBuffer buffer;
+        VkBufferCopy region;
+    };
+
+    struct PendingImageCopy {
+        VkImage image;
+        VkBufferImageCopy region;
+        VkImageLayout finalLayout;
+        VkDeviceSize size;
+    };
+
+    struct Batch {
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        uint64_t timelineValue;
+        // Virtual ring position up to which this batch's data extends.
+        uint64_t ringEnd;
+    };
+
+    // Ring positions only grow; the physical offset is position % ringSize.
+    uint64_t allocateRing(VkDeviceSize size, VkDeviceSize alignment);
+    void reclaim();
+    void waitForOldestBatch();
+    bool isBatchComplete(const Batch& batch) const;
+    void recordReleaseBarriers(VkCommandBuffer commandBuffer);
+
+    VkDevice device = VK_NULL_HANDLE;
+    DeviceMemoryAllocator* allocator = nullptr;
+
+    VkQueue submitQueue = VK_NULL_HANDLE;
+    uint32_t submitFamily = 0;
+    uint32_t graphicsFamily = 0;
+    // Uploads run on their own queue, ordered against rendering by the timeline semaphore.
+    bool separateQueue = false;
+    // ...and that queue is in another family, so resources change owner via release/acquire barriers.
+    bool ownershipTransfer = false;
+
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+    VkSemaphore timeline = VK_NULL_HANDLE;
+    uint64_t lastSubmittedValue = 0;
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    DeviceAllocation stagingAllocation;
+    VkDeviceSize ringSize = 0;
+    uint64_t ringHead = 0;
+    uint64_t ringTail = 0;
+
+    std::vector<PendingBufferCopy> pendingBuffers;
+    std::vector<PendingImageCopy> pendingImages;
+    std::deque<Batch> inFlight;
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+    std::vector<VkFence> freeFences;
+
+    std::vector<VkBufferMemoryBarrier> bufferAcquires;
+    std::vector<VkImageMemoryBarrier> imageAcquires;
+    uint64_t acquireWaitValue = 0;
+
+    uint64_t batchCount = 0;
+    uint64_t copyCount = 0;
+    uint64_t bytesUploaded = 0;
+    uint64_t ringStalls = 0;
+};
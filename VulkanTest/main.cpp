@@ -1,60 +1,239 @@
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+// <windows.h> is pulled in by glfw3native.h; keep its min/max macros away from std::min/std::max.
+#define NOMINMAX
+#endif
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#endif
 
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <cctype>
 #include <vector>
+#include <string>
 #include <optional>
-#include <unordered_set>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+#include "AllocatorBenchmark.h"
+#include "BindlessTable.h"
+#include "CullingBenchmark.h"
+#include "DebugMessageSink.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "DeviceMemoryAllocator.h"
+#include "DeviceFeatures.h"
+#include "FrameBenchmark.h"
+#include "FrameRing.h"
+#include "FrameScheduler.h"
+#include "GpuDrivenRenderer.h"
+#include "GpuProfiler.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "JobSystemBenchmark.h"
+#include "ParallelRecorder.h"
+#include "PipelineCache.h"
+#include "QueuePool.h"
+#include "RenderGraph.h"
+#include "SceneRenderer.h"
+#include "StartupTracer.h"
+#include "Swapchain.h"
+#include "TraceRecorder.h"
+#include "UploadService.h"
 
 using std::vector;
+using std::string;
 using std::cerr;
 using std::cout;
 using std::endl;
 using std::runtime_error;
 using std::exception;
 using std::optional;
-using std::unordered_set;
+using std::nullopt;
+using std::array;
+
+using DeviceUUID = array<uint8_t, VK_UUID_SIZE>;
+
+static optional<string> getEnvironmentVariable(const char* name) {
+#ifdef _MSC_VER
+    // getenv() is rejected by SDL checks, so use the bounds-checked variant on MSVC.
+    char* value = nullptr;
+    size_t length = 0;
+    if (_dupenv_s(&value, &length, name) != 0 || value == nullptr) {
+        return nullopt;
+    }
+    string result(value);
+    free(value);
+    return result;
+#else
+    const char* value = std::getenv(name);
+    if (value == nullptr) {
+        return nullopt;
+    }
+    return string(value);
+#endif
+}
+
+struct ApplicationOptions {
+    // Render into a device-local offscreen image instead of a window, so no display server is needed.
+    bool headless = false;
+    // Number of frames the headless loop renders before the application exits.
+    uint32_t headlessFrameCount = 1000;
+    // Where to write the Chrome trace JSON of the start-up stages, if anywhere.
+    optional<string> startupTracePath;
+    // Where to write the Chrome trace JSON of the whole run, CPU threads and GPU scopes, if anywhere.
+    optional<string> tracePath;
+    string pipelineCachePath = "pipeline_cache.bin";
+    // Use exactly this physical device instead of the highest-scoring one.
+    optional<DeviceUUID> pinnedDeviceUUID;
+    // One priority per queue to create for each role, indexed by QueueRole. Extra queues beyond the first
+    // can be leased from the queue pool by submission threads.
+    array<vector<float>, QUEUE_ROLE_COUNT> queuePriorities = { {
+        { 1.0f },
+        { 0.5f },
+        { 0.5f },
+        { 1.0f },
+    } };
+    PresentModePreference presentMode = PresentModePreference::Mailbox;
+    // Unset: one more than the surface's minimum.
+    optional<uint32_t> swapchainImageCount;
+    // How many frames the CPU may record ahead of the GPU.
+    uint32_t framesInFlight = 2;
+    // The window only renders when something changes by default, so an idle window costs no CPU.
+    // Headless runs treat on-demand as continuous, since nothing there can ask for a redraw.
+    LoopMode loopMode = LoopMode::OnDemand;
+    double targetFps = 60.0;
+    // Per message ID and second; further repeats are only counted.
+    uint32_t debugMessageRateLimit = 10;
+    // Runs a benchmark instead of the normal application.
+    optional<string> benchmark;
+    // Triangles in the scene, one draw call each; the recording benchmark defaults to a heavier scene.
+    optional<uint32_t> drawCount;
+    // Draw the scene through GPU culling and indirect draws instead of one recorded draw per triangle.
+    bool gpuDriven = false;
+    // With gpuDriven: two-phase occlusion culling against a depth pyramid on top of frustum culling.
+    bool occlusionCulling = false;
+    // Job system workers recording the scene's command buffers; 0 uses all of them, one per core.
+    uint32_t recordThreads = 0;
+    // The frame benchmark renders this many frames before it starts measuring --frames more.
+    uint32_t benchmarkWarmupFrames = 100;
+    string benchmarkOutputPath = "frame_benchmark.json";
+    // Results of an earlier frame benchmark run to compare against, and how much slower counts as a regression.
+    optional<string> benchmarkBaselinePath;
+    double regressionThreshold = 0.10;
+    // How the driver's host memory is allocated; fixed before the first Vulkan call.
+    HostAllocatorMode hostAllocatorMode = HostAllocatorMode::Tracking;
+};
+
+static string formatDeviceUUID(const DeviceUUID& uuid) {
+    static const char* const digits = "0123456789abcdef";
+    string text;
+    for (size_t i = 0; i < uuid.size(); ++i) {
+        // Same grouping as the canonical 8-4-4-4-12 UUID spelling.
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            text += '-';
+        }
+        text += digits[uuid[i] >> 4];
+        text += digits[uuid[i] & 0xF];
+    }
+    return text;
+}
+
+static DeviceUUID parseDeviceUUID(const string& text) {
+    string hex;
+    for (char c : text) {
+        if (c != '-') {
+            hex += c;
+        }
+    }
+
+    // Checked by hand: stoul() would also take whitespace and a sign inside a byte.
+    DeviceUUID uuid{};
+    if (hex.size() != uuid.size() * 2 || !std::all_of(hex.begin(), hex.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; })) {
+        throw runtime_error("invalid device UUID: " + text);
+    }
+
+    auto nibble = [](char c) {
+        return static_cast<uint8_t>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(static_cast<unsigned char>(c)) - 'a' + 10);
+    };
+    for (size_t i = 0; i < uuid.size(); ++i) {
+        uuid[i] = static_cast<uint8_t>(nibble(hex[i * 2]) << 4 | nibble(hex[i * 2 + 1]));
+    }
+    return uuid;
+}
 
 class HelloTriangleApplication {
 
 public:
 
+    explicit HelloTriangleApplication(const ApplicationOptions& options) : options(options) {}
+
     void run() {
-        this->initWindow();
+        // The instance reports through the sink from vkCreateInstance on, and its messenger is never destroyed
+        // (see cleanup), so the sink starts first and stops last.
+        if (enableValidationLayers) {
+            this->debugMessages.setRateLimit(this->options.debugMessageRateLimit);
+            this->debugMessages.start();
+        }
+        this->jobs.start(0);
+        if (!this->options.headless) {
+            this->initWindow();
+        }
         this->initVulkan();
         this->mainLoop();
+        this->frameRing.printTimings(cout);
+        this->gpuProfiler.printStatistics(cout);
+        this->reportStartupProfile();
         this->cleanup();
+        this->jobs.stop();
+        this->debugMessages.stop();
+        this->debugMessages.printSummary(cout);
+        // After cleanup, so live bytes are what the driver still holds: the never destroyed messenger, or leaks.
+        HostAllocator::get().printStatistics(cout);
+        this->writeTrace();
     }
 
 private:
 
+    // A replaced render graph and the framebuffers built with it, kept until the frames using them completed.
+    struct RetiredRenderGraph {
+        uint64_t serial;
+        std::unique_ptr<RenderGraph> graph;
+        vector<VkFramebuffer> framebuffers;
+    };
+
     struct QueueFamilyIndices {
         optional<uint32_t> graphicsFamily;
         optional<uint32_t> presentFamily;
+        // Fall back to the graphics family when the device has no separate compute or transfer family,
+        // so these are always set whenever graphicsFamily is.
+        optional<uint32_t> computeFamily;
+        optional<uint32_t> transferFamily;
 
-        bool isComplete() const {
-            return this->graphicsFamily.has_value() && this->presentFamily.has_value();
+        bool hasAsyncCompute() const {
+            return this->computeFamily != this->graphicsFamily;
         }
-    };
 
-    static const char * getSeverityString(VkDebugUtilsMessageSeverityFlagBitsEXT severity) {
-        if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
-            return "Error";
-        } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-            return "Warning";
-        } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT) {
-            return "Info";
-        } else if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
-            return "Verbose";
-        } else {
-            return "Unknown Severity String";
+        bool hasDedicatedTransfer() const {
+            return this->transferFamily != this->graphicsFamily && this->transferFamily != this->computeFamily;
         }
-    }
+
+        // A headless device never presents, so the present family is only required when there is a surface.
+        bool isComplete(bool requiresPresent) const {
+            return this->graphicsFamily.has_value() && (this->presentFamily.has_value() || !requiresPresent);
+        }
+    };
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -62,7 +241,8 @@ private:
         const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
         void* pUserData) {
 
-        cerr << "[Validation Layer] " << "[Severity] " << getSeverityString(messageSeverity) << " [Message] " << pCallbackData->pMessage << endl;
+        // Formatting and writing happen on the sink's logger thread, so the driver thread returns right away.
+        static_cast<DebugMessageSink*>(pUserData)->post(messageSeverity, pCallbackData);
 
         return VK_FALSE;
     }
@@ -93,7 +273,7 @@ private:
         }
     }
 
-    static VkDebugUtilsMessengerCreateInfoEXT populateDebugMessengerCreateInfo() {
+    static VkDebugUtilsMessengerCreateInfoEXT populateDebugMessengerCreateInfo(DebugMessageSink* sink) {
         VkDebugUtilsMessengerCreateInfoEXT createInfo;
         createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
         createInfo.pNext = nullptr;
@@ -101,11 +281,13 @@ private:
         createInfo.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
         createInfo.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
         createInfo.pfnUserCallback = debugCallback;
-        createInfo.pUserData = nullptr;
+        createInfo.pUserData = sink;
         return createInfo;
     }
 
     static vector<VkLayerProperties> getAllAvailableLayers() {
+        StartupTracer::Scope scope("vkEnumerateInstanceLayerProperties", "loader");
+
         uint32_t layerCount;
         vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
 
@@ -115,6 +297,8 @@ private:
     }
 
     static vector<VkExtensionProperties> getAllAvailableExtensions() {
+        StartupTracer::Scope scope("vkEnumerateInstanceExtensionProperties", "loader");
+
         uint32_t extensionCount = 0;
         vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
 
@@ -131,12 +315,17 @@ private:
         }
     }
 
-    static vector<const char*> getRequiredExtensions() {
-        uint32_t glfwExtensionCount = 0;
-        const char** glfwExtensions;
-        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    static vector<const char*> getRequiredExtensions(bool headless) {
+        vector<const char*> extensions;
+
+        // GLFW is never initialized in headless mode, and an offscreen image needs no surface extensions.
+        if (!headless) {
+            uint32_t glfwExtensionCount = 0;
+            const char** glfwExtensions;
+            glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-        vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+            extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+        }
 
         if (enableValidationLayers) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -145,15 +334,15 @@ private:
         return extensions;
     }
 
-    static void showRequiredExtensions() {
-        vector<const char*> extensions = getRequiredExtensions();
+    static void showRequiredExtensions(bool headless) {
+        vector<const char*> extensions = getRequiredExtensions(headless);
         cout << "[All Required Extensions]" << '\n';
         for (const char* p : extensions) {
             cout << '\t' << p << '\n';
         }
     }
 
-    static VkApplicationInfo createApplicationInfo() {
+    static VkApplicationInfo createApplicationInfo(uint32_t apiVersion) {
         VkApplicationInfo appInfo;
         appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
         appInfo.pNext = nullptr;
@@ -161,7 +350,7 @@ private:
         appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         appInfo.pEngineName = "No Engine";
         appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-        appInfo.apiVersion = VK_API_VERSION_1_0;
+        appInfo.apiVersion = apiVersion;
         return appInfo;
     }
 
@@ -223,7 +412,8 @@ private:
             }
         }
         // Please note that the presentation queue and the graphics queue can actually be the same queue.
-        for (size_t i = 0; i < queueFamilies.size(); ++i) {
+        // Without a surface (headless mode) there is nothing to present to, so the present family stays empty.
+        for (size_t i = 0; surface != VK_NULL_HANDLE && i < queueFamilies.size(); ++i) {
             VkBool32 presentSupport = false;
             vkGetPhysicalDeviceSurfaceSupportKHR(device, static_cast<uint32_t>(i), surface, &presentSupport);
             if (presentSupport) {
@@ -232,20 +422,168 @@ private:
             }
         }
 
+        if (!indices.graphicsFamily.has_value()) {
+            return indices;
+        }
+
+        // Async compute: a compute family without the graphics bit runs alongside the graphics queue.
+        indices.computeFamily = findQueueFamilyExcluding(queueFamilies, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+        if (!indices.computeFamily.has_value()) {
+            indices.computeFamily = indices.graphicsFamily;
+        }
+
+        // Transfer: prefer a pure copy engine, then any non-graphics family that can copy.
+        // Graphics and compute families always support transfer, even when they do not advertise the bit.
+        indices.transferFamily = findQueueFamilyExcluding(queueFamilies, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = findQueueFamilyExcluding(queueFamilies, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT);
+        }
+        if (!indices.transferFamily.has_value()) {
+            indices.transferFamily = indices.graphicsFamily;
+        }
+
         return indices;
     }
 
-    static bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
+    static optional<uint32_t> findQueueFamilyExcluding(const vector<VkQueueFamilyProperties>& queueFamilies, VkQueueFlags required, VkQueueFlags excluded) {
+        for (size_t i = 0; i < queueFamilies.size(); ++i) {
+            VkQueueFlags flags = queueFamilies[i].queueFlags;
+            if ((flags & required) == required && (flags & excluded) == 0 && queueFamilies[i].queueCount > 0) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        return nullopt;
+    }
+
+    static vector<VkExtensionProperties> getDeviceExtensions(VkPhysicalDevice device) {
+        uint32_t extensionCount = 0;
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+        vector<VkExtensionProperties> extensions(extensionCount);
+        vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+        return extensions;
+    }
+
+    static bool hasExtension(const vector<VkExtensionProperties>& extensions, const char* name) {
+        for (const auto& extension : extensions) {
+            if (strcmp(extension.extensionName, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static vector<const char*> getRequiredDeviceExtensions(bool headless) {
+        if (headless) {
+            return {};
+        }
+        return { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    }
+
+    static optional<DeviceUUID> getDeviceUUID(VkPhysicalDevice device, uint32_t instanceApiVersion) {
+        // vkGetPhysicalDeviceProperties2 is core in 1.1; on a 1.0 instance or device there is no UUID to query.
+        if (instanceApiVersion < VK_API_VERSION_1_1 || getDeviceProperties(device).apiVersion < VK_API_VERSION_1_1) {
+            return nullopt;
+        }
+
+        VkPhysicalDeviceIDProperties idProperties{};
+        idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &idProperties;
+        vkGetPhysicalDeviceProperties2(device, &properties);
+
+        DeviceUUID uuid;
+        std::copy(std::begin(idProperties.deviceUUID), std::end(idProperties.deviceUUID), uuid.begin());
+        return uuid;
+    }
+
+    static const char* getDeviceTypeString(VkPhysicalDeviceType type) {
+        switch (type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "Discrete GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "Integrated GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "Virtual GPU";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: return "CPU";
+        default: return "Other";
+        }
+    }
+
+    // Returns 0 for devices that cannot run the application at all; otherwise higher is better.
+    // Device type dominates, so a discrete GPU always wins over an integrated one, which always wins over a
+    // CPU implementation such as lavapipe. Within a type, memory, limits, queues and extensions break the tie.
+    static uint64_t rateDeviceSuitability(VkPhysicalDevice device, VkSurfaceKHR surface) {
         VkPhysicalDeviceProperties deviceProperties = getDeviceProperties(device);
-        VkPhysicalDeviceFeatures deviceFeatures = getDeviceFeatures(device);
         QueueFamilyIndices indices = findQueueFamilies(device, surface);
 
-        return deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-                deviceFeatures.geometryShader &&
-                indices.isComplete();
+        if (!indices.isComplete(surface != VK_NULL_HANDLE)) {
+            return 0;
+        }
+
+        vector<VkExtensionProperties> extensions = getDeviceExtensions(device);
+        for (const char* required : getRequiredDeviceExtensions(surface == VK_NULL_HANDLE)) {
+            if (!hasExtension(extensions, required)) {
+                return 0;
+            }
+        }
+
+        if (surface != VK_NULL_HANDLE && !querySwapchainSupport(device, surface).isAdequate()) {
+            return 0;
+        }
+
+        // The scene indexes the bindless table's storage buffers with a push constant.
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(device, &features);
+        if (!features.shaderStorageBufferArrayDynamicIndexing) {
+            return 0;
+        }
+
+        uint64_t score = 0;
+
+        switch (deviceProperties.deviceType) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 4000000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 3000000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 2000000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 1000000; break;
+        default: break;
+        }
+
+        // One point per MiB of the largest device-local heap, capped well below the device type steps.
+        VkPhysicalDeviceMemoryProperties memoryProperties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+        VkDeviceSize largestLocalHeap = 0;
+        for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; ++i) {
+            if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                largestLocalHeap = std::max(largestLocalHeap, memoryProperties.memoryHeaps[i].size);
+            }
+        }
+        score += std::min<uint64_t>(largestLocalHeap / (1024 * 1024), 256 * 1024);
+
+        const VkPhysicalDeviceLimits& limits = deviceProperties.limits;
+        score += limits.maxImageDimension2D / 64;
+        score += limits.maxComputeWorkGroupInvocations / 16;
+        score += std::min<uint64_t>(limits.maxDrawIndirectCount, 1u << 20) / 4096;
+
+        vector<VkQueueFamilyProperties> queueFamilies = getDeviceQueueFamilyProperties(device);
+        score += indices.hasAsyncCompute() ? 2000 : 0;
+        score += indices.hasDedicatedTransfer() ? 2000 : 0;
+        score += queueFamilies[indices.graphicsFamily.value()].timestampValidBits > 0 ? 1000 : 0;
+
+        const char* const usefulExtensions[] = {
+            VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME,
+            VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+            VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME,
+        };
+        for (const char* name : usefulExtensions) {
+            score += hasExtension(extensions, name) ? 500 : 0;
+        }
+
+        return score;
     }
 
     static vector<VkPhysicalDevice> getAllAvailableDevices(VkInstance instance) {
+        StartupTracer::Scope scope("vkEnumeratePhysicalDevices", "loader");
+
         uint32_t deviceCount = 0;
         vkEnumeratePhysicalDevices(instance, &deviceCount, nullptr);
 
@@ -259,6 +597,7 @@ private:
     }
 
     void createSurface() {
+        StartupTracer::Scope scope("createSurface");
 
         // Below is what exactly "glfwCreateWindowSurface()" does
         
@@ -276,28 +615,799 @@ private:
         */
         
 
-        if (glfwCreateWindowSurface(this->instance, this->window, nullptr, &this->surface) != VK_SUCCESS) {
+        if (glfwCreateWindowSurface(this->instance, this->window, HostAllocator::get().getCallbacks(), &this->surface) != VK_SUCCESS) {
             throw std::runtime_error("failed to create window surface!");
         }
     }
 
+    void createOffscreenTarget() {
+        StartupTracer::Scope scope("createOffscreenTarget");
+
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = OFFSCREEN_FORMAT;
+        imageInfo.extent = { WIDTH, HEIGHT, 1 };
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (vkCreateImage(this->device, &imageInfo, HostAllocator::get().getCallbacks(), &this->offscreenImage) != VK_SUCCESS) {
+            throw runtime_error("failed to create offscreen image!");
+        }
+
+        this->offscreenImageAllocation = this->memoryAllocator.allocateForImage(this->offscreenImage, VK_IMAGE_TILING_OPTIMAL,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationLifetime::LongLived);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = this->offscreenImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = OFFSCREEN_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(this->device, &viewInfo, HostAllocator::get().getCallbacks(), &this->offscreenImageView) != VK_SUCCESS) {
+            throw runtime_error("failed to create offscreen image view!");
+        }
+    }
+
+    void createPipelineCache() {
+        StartupTracer::Scope scope("createPipelineCache");
+
+        this->pipelineCache.create(getDeviceProperties(this->physicalDevice), this->device, this->options.pipelineCachePath);
+    }
+
+    void createMemoryAllocator() {
+        StartupTracer::Scope scope("createMemoryAllocator");
+
+        this->memoryAllocator.create(this->physicalDevice, this->device, this->capabilities.apiVersion);
+    }
+
+    void createUploadService() {
+        StartupTracer::Scope scope("createUploadService");
+
+        this->uploads.create(this->device, this->memoryAllocator,
+            this->graphicsQueue, this->queuePool.getFamilyIndex(QueueRole::Graphics),
+            this->transferQueue, this->queuePool.getFamilyIndex(QueueRole::Transfer),
+            this->capabilities.timelineSemaphores, STAGING_RING_SIZE);
+    }
+
+    void createFrameRing() {
+        StartupTracer::Scope scope("createFrameRing");
+
+        this->frameRing.create(this->device, this->queuePool.getFamilyIndex(QueueRole::Graphics), this->options.framesInFlight);
+    }
+
+    void createGpuProfiler() {
+        StartupTracer::Scope scope("createGpuProfiler");
+
+        uint32_t graphicsFamily = this->queuePool.getFamilyIndex(QueueRole::Graphics);
+        uint32_t timestampValidBits = getDeviceQueueFamilyProperties(this->physicalDevice)[graphicsFamily].timestampValidBits;
+        float timestampPeriod = getDeviceProperties(this->physicalDevice).limits.timestampPeriod;
+
+        this->gpuProfiler.create(this->device, this->options.framesInFlight, timestampValidBits, timestampPeriod);
+        if (this->options.tracePath.has_value() || this->options.benchmark == string("frames")) {
+            this->gpuProfiler.calibrateClock(this->instance, this->physicalDevice, this->graphicsQueue, graphicsFamily,
+                this->capabilities.calibratedTimestamps);
+        }
+    }
+
+    void createDescriptorAllocators() {
+        StartupTracer::Scope scope("createDescriptorAllocators");
+
+        this->descriptorLayouts.create(this->device);
+        this->descriptors.create(this->device, this->options.framesInFlight);
+    }
+
+    void createBindlessTable() {
+        StartupTracer::Scope scope("createBindlessTable");
+
+        this->bindless.create(this->device, this->memoryAllocator, this->uploads, this->descriptorLayouts, this->capabilities,
+            getDeviceProperties(this->physicalDevice).limits, this->options.framesInFlight);
+    }
+
+    void createScene() {
+        StartupTracer::Scope scope("createScene");
+
+        VkFormat format = this->options.headless ? OFFSCREEN_FORMAT : this->swapchain.getImageFormat();
+        this->scene.create(this->device, format, this->pipelineCache.getHandle(), SHADER_DIRECTORY,
+            this->memoryAllocator, this->uploads, this->bindless);
+
+        uint32_t defaultDrawCount = 1;
+        if (this->options.benchmark == string("recording")) {
+            defaultDrawCount = RECORDING_BENCHMARK_DRAW_COUNT;
+        } else if (this->options.benchmark == string("gpu-driven")) {
+            defaultDrawCount = GPU_DRIVEN_BENCHMARK_DRAW_COUNT;
+        }
+        this->drawCount = this->options.drawCount.value_or(defaultDrawCount);
+    }
+
+    void createGpuDrivenRenderer() {
+        StartupTracer::Scope scope("createGpuDrivenRenderer");
+
+        if (!this->options.gpuDriven && this->options.benchmark != string("gpu-driven")) {
+            return;
+        }
+        if (!GpuDrivenRenderer::isSupported(this->capabilities)) {
+            throw runtime_error("GPU-driven rendering needs drawIndirectFirstInstance!");
+        }
+        VkFormat format = this->options.headless ? OFFSCREEN_FORMAT : this->swapchain.getImageFormat();
+        this->gpuDriven.create(this->device, this->memoryAllocator, this->uploads, this->bindless, this->descriptorLayouts,
+            this->descriptors, this->capabilities, getDeviceProperties(this->physicalDevice).limits, this->scene, format,
+            this->pipelineCache.getHandle(), SHADER_DIRECTORY, this->drawCount, this->options.framesInFlight);
+        this->gpuDrivenCreated = true;
+        if (this->options.occlusionCulling && !this->gpuDriven.isOcclusionSupported()) {
+            throw runtime_error("occlusion culling needs shaderStorageImageArrayDynamicIndexing!");
+        }
+        this->useGpuDriven = this->options.gpuDriven;
+        this->useOcclusion = this->options.occlusionCulling;
+    }
+
+    void createParallelRecorder() {
+        StartupTracer::Scope scope("createParallelRecorder");
+
+        this->recorder.create(this->device, this->queuePool.getFamilyIndex(QueueRole::Graphics), this->options.framesInFlight, this->jobs);
+        if (this->options.recordThreads > 0) {
+            this->recorder.setThreadCount(this->options.recordThreads);
+        }
+    }
+
+    VkClearValue getClearColor() const {
+        float t = static_cast<float>(this->frameRing.getCurrentSerial() % 256) / 255.0f;
+        VkClearValue clearValue{};
+        clearValue.color = { { t, 0.0f, 1.0f - t, 1.0f } };
+        return clearValue;
+    }
+
+    void recordScene(VkCommandBuffer commandBuffer, VkExtent2D extent) {
+        VkClearValue clearValue = this->getClearColor();
+
+        VkRenderPassBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        beginInfo.renderPass = this->scene.getRenderPass();
+        beginInfo.framebuffer = this->currentFramebuffer;
+        beginInfo.renderArea.offset = { 0, 0 };
+        beginInfo.renderArea.extent = extent;
+        beginInfo.clearValueCount = 1;
+        beginInfo.pClearValues = &clearValue;
+
+        this->recorder.recordRenderPass(commandBuffer, beginInfo, this->frameRing.getCurrentFrameIndex(), this->drawCount,
+            [this, extent](VkCommandBuffer target, uint32_t firstDraw, uint32_t count) {
+                this->scene.recordDraws(target, extent, firstDraw, count, this->drawCount);
+            });
+    }
+
+    // A handful of commands however many instances there are; not worth spreading over threads.
+    void recordGpuDrivenDraws(VkCommandBuffer commandBuffer, VkExtent2D extent, CullPass pass) {
+        VkClearValue clearValues[2] = { this->getClearColor(), {} };
+        clearValues[1].depthStencil = { 1.0f, 0 };
+
+        VkRenderPassBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        beginInfo.renderPass = this->gpuDriven.getRenderPass(pass);
+        beginInfo.framebuffer = this->currentFramebuffer;
+        beginInfo.renderArea.offset = { 0, 0 };
+        beginInfo.renderArea.extent = extent;
+        beginInfo.clearValueCount = 2;
+        beginInfo.pClearValues = clearValues;
+
+        vkCmdBeginRenderPass(commandBuffer, &beginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        this->gpuDriven.recordDraws(commandBuffer, extent, pass);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    // Frustum culling: reset the counters, cull, draw, read the counters back. Occlusion culling replaces the cull
+    // and draw with an early cull and draw, the depth pyramid, and a late cull and draw. Returns the depth buffer.
+    RenderGraphResource addGpuDrivenPasses(RenderGraph& graph, RenderGraphResource target, VkExtent2D extent) {
+        // Per frame in flight, like the imports below; bound each frame by setGpuDrivenBuffers().
+        RenderGraphResource drawCommands = graph.importBuffer("draw commands", this->gpuDriven.getDrawCommandsSize());
+        RenderGraphResource counters = graph.importBuffer("cull counters", this->gpuDriven.getCountersSize());
+        RenderGraphResource depth = graph.createImage("depth", GpuDrivenRenderer::DEPTH_FORMAT, extent, VK_IMAGE_ASPECT_DEPTH_BIT);
+        this->drawCommandsResource = drawCommands;
+        this->cullCountersResource = counters;
+
+        auto addDrawPass = [this, &graph, target, extent, drawCommands, counters, depth](const char* name, CullPass pass) {
+            graph.addPass(name,
+                [target, drawCommands, counters, depth](RenderGraph::PassBuilder& builder) {
+                    builder.read(drawCommands, ResourceUsage::IndirectArgument);
+                    builder.read(counters, ResourceUsage::IndirectArgument);
+                    builder.write(target, ResourceUsage::ColorAttachment);
+                    builder.write(depth, ResourceUsage::DepthAttachment);
+                },
+                [this, extent, pass](VkCommandBuffer commandBuffer) { this->recordGpuDrivenDraws(commandBuffer, extent, pass); });
+        };
+
+        graph.addPass(GpuDrivenRenderer::RESET_PASS,
+            [counters](RenderGraph::PassBuilder& builder) { builder.write(counters, ResourceUsage::TransferDst); },
+            [this](VkCommandBuffer commandBuffer) { this->gpuDriven.recordResetCounters(commandBuffer); });
+
+        if (!this->useOcclusion) {
+            graph.addPass(GpuDrivenRenderer::CULL_PASS,
+                [drawCommands, counters](RenderGraph::PassBuilder& builder) {
+                    builder.write(drawCommands, ResourceUsage::ComputeStorageWrite);
+                    builder.write(counters, ResourceUsage::ComputeStorageWrite);
+                },
+                [this](VkCommandBuffer commandBuffer) { this->gpuDriven.recordCull(commandBuffer, CullPass::Frustum); });
+            addDrawPass(GpuDrivenRenderer::DRAW_PASS, CullPass::Frustum);
+        } else {
+            // Frames still in flight keep the previous pyramid until they complete.
+            this->gpuDriven.resizeDepthPyramid(extent, this->frameRing.getCurrentSerial());
+            const DepthPyramid& pyramid = this->gpuDriven.getDepthPyramid();
+            RenderGraphResource visibility = graph.importBuffer("visibility", this->gpuDriven.getVisibilitySize());
+            RenderGraphResource pyramidImage = graph.importImage("depth pyramid", DepthPyramid::FORMAT, { pyramid.getSize(), pyramid.getSize() },
+                VK_IMAGE_ASPECT_COLOR_BIT, ResourceUsage::ComputeSampled);
+            RenderGraphResource pyramidCounter = graph.importBuffer("depth pyramid counter", pyramid.getCounterSize());
+            this->visibilityResource = visibility;
+            this->depthPyramidResource = pyramidImage;
+            this->depthPyramidCounterResource = pyramidCounter;
+
+            graph.addPass(GpuDrivenRenderer::EARLY_CULL_PASS,
+                [visibility, drawCommands, counters](RenderGraph::PassBuilder& builder) {
+                    builder.read(visibility, ResourceUsage::ComputeStorageRead);
+                    builder.write(drawCommands, ResourceUsage::ComputeStorageWrite);
+                    builder.write(counters, ResourceUsage::ComputeStorageWrite);
+                },
+                [this](VkCommandBuffer commandBuffer) { this->gpuDriven.recordCull(commandBuffer, CullPass::Early); });
+            addDrawPass(GpuDrivenRenderer::EARLY_DRAW_PASS, CullPass::Early);
+            RenderGraph* graphPointer = &graph;
+            graph.addPass(GpuDrivenRenderer::DEPTH_PYRAMID_PASS,
+                [depth, pyramidImage, pyramidCounter](RenderGraph::PassBuilder& builder) {
+                    builder.read(depth, ResourceUsage::ComputeSampled);
+                    builder.write(pyramidImage, ResourceUsage::ComputeStorageWrite);
+                    builder.write(pyramidCounter, ResourceUsage::ComputeStorageWrite);
+                },
+                [this, graphPointer, depth](VkCommandBuffer commandBuffer) {
+                    this->gpuDriven.recordDepthPyramid(commandBuffer, graphPointer->getImageView(depth));
+                });
+            graph.addPass(GpuDrivenRenderer::LATE_CULL_PASS,
+                [pyramidImage, visibility, drawCommands, counters](RenderGraph::PassBuilder& builder) {
+                    builder.read(pyramidImage, ResourceUsage::ComputeSampled);
+                    builder.write(visibility, ResourceUsage::ComputeStorageWrite);
+                    builder.write(drawCommands, ResourceUsage::ComputeStorageWrite);
+                    builder.write(counters, ResourceUsage::ComputeStorageWrite);
+                },
+                [this](VkCommandBuffer commandBuffer) { this->gpuDriven.recordCull(commandBuffer, CullPass::Late); });
+            addDrawPass(GpuDrivenRenderer::LATE_DRAW_PASS, CullPass::Late);
+        }
+
+        graph.addPass(GpuDrivenRenderer::READBACK_PASS,
+            [counters](RenderGraph::PassBuilder& builder) {
+                builder.read(counters, ResourceUsage::TransferSrc);
+                builder.setSideEffects();
+            },
+            [this](VkCommandBuffer commandBuffer) { this->gpuDriven.recordReadback(commandBuffer); });
+        return depth;
+    }
+
+    // Declares the frame's passes against the current target and creates a framebuffer for each image the
+    // target can be bound to.
+    std::unique_ptr<RenderGraph> buildRenderGraph() {
+        auto graph = std::make_unique<RenderGraph>();
+        graph->create(this->device, this->memoryAllocator, this->capabilities.synchronization2);
+
+        bool headless = this->options.headless;
+        VkFormat format = headless ? OFFSCREEN_FORMAT : this->swapchain.getImageFormat();
+        VkExtent2D extent = headless ? VkExtent2D{ WIDTH, HEIGHT } : this->swapchain.getExtent();
+        // The offscreen image is left ready to be copied out, which is what a readback would do next.
+        RenderGraphResource target = graph->importImage(headless ? "offscreen" : "swapchain", format, extent, VK_IMAGE_ASPECT_COLOR_BIT,
+            headless ? ResourceUsage::TransferSrc : ResourceUsage::Present);
+        this->frameTarget = target;
+
+        RenderGraphResource depth;
+        if (!this->useGpuDriven) {
+            graph->addPass("scene",
+                [target](RenderGraph::PassBuilder& builder) { builder.write(target, ResourceUsage::ColorAttachment); },
+                [this, extent](VkCommandBuffer commandBuffer) { this->recordScene(commandBuffer, extent); });
+        } else {
+            depth = this->addGpuDrivenPasses(*graph, target, extent);
+        }
+
+        graph->compile();
+
+        auto createFramebuffer = [this, &graph, depth, extent](VkImageView view) {
+            if (depth.isValid()) {
+                return this->gpuDriven.createFramebuffer(view, graph->getImageView(depth), extent);
+            }
+            return this->scene.createFramebuffer(view, extent);
+        };
+        this->framebuffers.clear();
+        if (headless) {
+            this->framebuffers.push_back(createFramebuffer(this->offscreenImageView));
+        } else {
+            for (uint32_t i = 0; i < this->swapchain.getImageCount(); ++i) {
+                this->framebuffers.push_back(createFramebuffer(this->swapchain.getImageView(i)));
+            }
+        }
+        return graph;
+    }
+
+    void createRenderGraph() {
+        StartupTracer::Scope scope("createRenderGraph");
+
+        this->renderGraph = this->buildRenderGraph();
+    }
+
+    // Builds a new graph for what changed, e.g. the extent or the passes. Frames up to the current one may still
+    // use the old graph and its framebuffers, which point at its image views, so both retire together.
+    void rebuildRenderGraph() {
+        this->retiredRenderGraphs.push_back({ this->frameRing.getCurrentSerial(), std::move(this->renderGraph), std::move(this->framebuffers) });
+        this->renderGraph = this->buildRenderGraph();
+    }
+
+    void destroyFramebuffers(const vector<VkFramebuffer>& framebuffers) {
+        for (VkFramebuffer framebuffer : framebuffers) {
+            vkDestroyFramebuffer(this->device, framebuffer, HostAllocator::get().getCallbacks());
+        }
+    }
+
+    // Frames up to the current one may still record with the old graph's images and framebuffers; they are
+    // destroyed once those frames completed.
+    void collectRetiredRenderGraphs() {
+        uint64_t completedSerial = this->frameRing.getCompletedSerial();
+        auto retired = std::remove_if(this->retiredRenderGraphs.begin(), this->retiredRenderGraphs.end(),
+            [this, completedSerial](RetiredRenderGraph& entry) {
+                if (entry.serial > completedSerial) {
+                    return false;
+                }
+                entry.graph->destroy();
+                this->destroyFramebuffers(entry.framebuffers);
+                return true;
+            });
+        this->retiredRenderGraphs.erase(retired, this->retiredRenderGraphs.end());
+    }
+
+    void drawOffscreenFrame() {
+        TraceRecorder::Scope frameTraceScope("drawOffscreenFrame");
+        HostAllocator::get().onFrame();
+        FrameRing::Frame& frame = this->waitForFrame();
+        this->bindless.beginFrame(this->frameRing.getCurrentFrameIndex(), this->frameRing.getCompletedSerial());
+        this->descriptors.beginFrame(this->frameRing.getCurrentFrameIndex());
+        if (this->gpuDrivenCreated) {
+            this->gpuDriven.beginFrame(this->frameRing.getCurrentFrameIndex(), this->frameRing.getCurrentSerial(),
+                this->frameRing.getCompletedSerial());
+        }
+        this->collectRetiredRenderGraphs();
+        this->uploads.flush();
+
+        TimelineWait uploadWait;
+        {
+            TraceRecorder::Scope traceScope("record");
+            this->frameRing.beginCommandBuffer(frame);
+            this->gpuProfiler.beginFrame(this->frameRing.getCurrentFrameIndex(), frame.commandBuffer);
+            this->recordCompletedFrame(frame);
+            {
+                GpuProfiler::Scope frameScope(this->gpuProfiler, frame.commandBuffer, "frame");
+                uploadWait = this->uploads.recordAcquireBarriers(frame.commandBuffer);
+                this->renderGraph->setImportedImage(this->frameTarget, this->offscreenImage, this->offscreenImageView);
+                this->setGpuDrivenBuffers();
+                this->currentFramebuffer = this->framebuffers[0];
+                this->renderGraph->execute(frame.commandBuffer, &this->gpuProfiler);
+            }
+            this->frameRing.endCommandBuffer(frame);
+        }
+
+        // Nothing is presented, so there is no semaphore to wait on or signal; the fence paces the ring.
+        TraceRecorder::Scope submitTraceScope("submit");
+        this->frameRing.submit(frame, this->graphicsQueue, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, uploadWait);
+    }
+
+    // Hands what the profiler just read back to the frame benchmark, if one is measuring. The slot has not been
+    // submitted again yet, so it still holds the submission time of the frame the results belong to.
+    void recordCompletedFrame(const FrameRing::Frame& frame) {
+        optional<GpuProfiler::CompletedFrame> completed = this->gpuProfiler.takeCompletedFrame();
+        if (this->frameBenchmark == nullptr || !completed.has_value()) {
+            return;
+        }
+        this->frameBenchmark->add(FrameBenchmark::Metric::GpuFrame, completed->gpuMs);
+        if (completed->endNs.has_value()) {
+            int64_t latencyNs = *completed->endNs - TraceRecorder::get().toNs(frame.submitTime);
+            this->frameBenchmark->add(FrameBenchmark::Metric::SubmitLatency, static_cast<double>(latencyNs) / 1.0e6);
+        }
+    }
+
+    void setGpuDrivenBuffers() {
+        if (!this->useGpuDriven) {
+            return;
+        }
+        uint32_t frameIndex = this->frameRing.getCurrentFrameIndex();
+        this->renderGraph->setImportedBuffer(this->drawCommandsResource, this->gpuDriven.getDrawCommands(frameIndex));
+        this->renderGraph->setImportedBuffer(this->cullCountersResource, this->gpuDriven.getCounters(frameIndex));
+        if (this->useOcclusion) {
+            const DepthPyramid& pyramid = this->gpuDriven.getDepthPyramid();
+            this->renderGraph->setImportedBuffer(this->visibilityResource, this->gpuDriven.getVisibility());
+            this->renderGraph->setImportedImage(this->depthPyramidResource, pyramid.getImage(), pyramid.getView());
+            this->renderGraph->setImportedBuffer(this->depthPyramidCounterResource, pyramid.getCounter());
+        }
+    }
+
+    FrameRing::Frame& waitForFrame() {
+        TraceRecorder::Scope traceScope("waitForFrame");
+        return this->frameRing.beginFrame();
+    }
+
+    void drawFrame() {
+        TraceRecorder::Scope frameTraceScope("drawFrame");
+        HostAllocator::get().onFrame();
+        FrameRing::Frame& frame = this->waitForFrame();
+        this->bindless.beginFrame(this->frameRing.getCurrentFrameIndex(), this->frameRing.getCompletedSerial());
+        this->descriptors.beginFrame(this->frameRing.getCurrentFrameIndex());
+        if (this->gpuDrivenCreated) {
+            this->gpuDriven.beginFrame(this->frameRing.getCurrentFrameIndex(), this->frameRing.getCurrentSerial(),
+                this->frameRing.getCompletedSerial());
+        }
+        this->swapchain.collectRetired(this->frameRing.getCompletedSerial());
+        this->collectRetiredRenderGraphs();
+
+        uint32_t imageIndex;
+        VkResult result;
+        {
+            TraceRecorder::Scope traceScope("vkAcquireNextImageKHR");
+            result = vkAcquireNextImageKHR(this->device, this->swapchain.getHandle(), UINT64_MAX, frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            this->recreateSwapchain();
+            return;
+        } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            throw runtime_error("failed to acquire swap chain image!");
+        }
+
+        // Uploads recorded since the last frame go out now, so the copies overlap with recording this frame.
+        this->uploads.flush();
+
+        TimelineWait uploadWait;
+        {
+            TraceRecorder::Scope traceScope("record");
+            this->frameRing.beginCommandBuffer(frame);
+            this->gpuProfiler.beginFrame(this->frameRing.getCurrentFrameIndex(), frame.commandBuffer);
+            {
+                GpuProfiler::Scope frameScope(this->gpuProfiler, frame.commandBuffer, "frame");
+                uploadWait = this->uploads.recordAcquireBarriers(frame.commandBuffer);
+                this->renderGraph->setImportedImage(this->frameTarget, this->swapchain.getImage(imageIndex), this->swapchain.getImageView(imageIndex));
+                this->setGpuDrivenBuffers();
+                this->currentFramebuffer = this->framebuffers[imageIndex];
+                this->renderGraph->execute(frame.commandBuffer, &this->gpuProfiler);
+            }
+            this->frameRing.endCommandBuffer(frame);
+        }
+
+        TraceRecorder::Scope submitTraceScope("submit");
+        this->frameRing.submit(frame, this->graphicsQueue, frame.imageAvailable, this->renderGraph->getFirstUseStage(this->frameTarget),
+            frame.renderFinished, uploadWait);
+
+        VkSwapchainKHR swapchainHandle = this->swapchain.getHandle();
+        VkPresentInfoKHR presentInfo{};
+        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &frame.renderFinished;
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapchainHandle;
+        presentInfo.pImageIndices = &imageIndex;
+
+        {
+            TraceRecorder::Scope traceScope("vkQueuePresentKHR");
+            result = vkQueuePresentKHR(this->presentQueue, &presentInfo);
+        }
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || this->framebufferResized) {
+            this->recreateSwapchain();
+        } else if (result != VK_SUCCESS) {
+            throw runtime_error("failed to present swap chain image!");
+        }
+
+        StartupTracer::get().markFirstFrame();
+    }
+
+    // Renders the scene with 1..N recording threads and reports how the CPU time to record it scales.
+    void runRecordingBenchmark() {
+        uint32_t measuredFrames = std::max(1u, this->options.headlessFrameCount);
+        vector<double> averageMs;
+
+        for (uint32_t threads = 1; threads <= this->jobs.getWorkerCount(); ++threads) {
+            this->recorder.setThreadCount(threads);
+            for (uint32_t frame = 0; frame < RECORDING_BENCHMARK_WARMUP_FRAMES; ++frame) {
+                this->drawOffscreenFrame();
+            }
+            this->recorder.resetStatistics();
+            for (uint32_t frame = 0; frame < measuredFrames; ++frame) {
+                this->drawOffscreenFrame();
+            }
+            averageMs.push_back(this->recorder.getRecordTime().average());
+        }
+        vkDeviceWaitIdle(this->device);
+
+        cout << "[Recording Benchmark]" << '\n';
+        cout << "\tDraws: " << this->drawCount << ", " << measuredFrames << " frames per thread count" << '\n';
+        for (size_t i = 0; i < averageMs.size(); ++i) {
+            cout << "\t" << (i + 1) << " threads: " << averageMs[i] << " ms per frame, speedup " << averageMs[0] / averageMs[i] << "x" << '\n';
+        }
+    }
+
+    // Waits for the GPU and hands the results of the frames still in flight, oldest first, to the frame benchmark.
+    void collectFramesInFlight() {
+        vkDeviceWaitIdle(this->device);
+
+        uint32_t framesInFlight = this->frameRing.getFramesInFlight();
+        for (uint32_t i = 1; i <= framesInFlight; ++i) {
+            uint32_t frameIndex = (this->frameRing.getCurrentFrameIndex() + i) % framesInFlight;
+            this->gpuProfiler.collectFrame(frameIndex);
+            this->recordCompletedFrame(this->frameRing.getFrame(frameIndex));
+        }
+    }
+
+    // Renders a fixed number of frames as fast as possible and writes percentiles of the CPU frame time, the
+    // GPU frame time and the submit-to-complete latency, optionally checking them against a baseline.
+    void runFrameBenchmark() {
+        uint32_t measuredFrames = std::max(1u, this->options.headlessFrameCount);
+        FrameBenchmark benchmark;
+        benchmark.setDescription(getDeviceProperties(this->physicalDevice).deviceName, this->drawCount,
+            this->options.benchmarkWarmupFrames, measuredFrames);
+        benchmark.reserve(measuredFrames);
+
+        for (uint32_t frame = 0; frame < this->options.benchmarkWarmupFrames; ++frame) {
+            this->drawOffscreenFrame();
+        }
+
+        // The first framesInFlight results read back belong to warm-up frames, which is as good as any and keeps
+        // the GPU sample count equal to the measured frame count once the last frames are collected below.
+        this->frameBenchmark = &benchmark;
+        FrameRing::Clock::time_point frameStart = FrameRing::Clock::now();
+        for (uint32_t frame = 0; frame < measuredFrames; ++frame) {
+            this->drawOffscreenFrame();
+            FrameRing::Clock::time_point frameEnd = FrameRing::Clock::now();
+            benchmark.add(FrameBenchmark::Metric::CpuFrame, std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+            frameStart = frameEnd;
+        }
+        this->collectFramesInFlight();
+        this->frameBenchmark = nullptr;
+
+        benchmark.print(cout);
+        benchmark.writeJson(this->options.benchmarkOutputPath);
+        cout << "\tResults written to " << this->options.benchmarkOutputPath << '\n';
+
+        if (!this->options.benchmarkBaselinePath.has_value()) {
+            return;
+        }
+        vector<FrameBenchmark::Regression> regressions =
+            benchmark.compareWithBaseline(*this->options.benchmarkBaselinePath, this->options.regressionThreshold);
+        cout << "\tBaseline " << *this->options.benchmarkBaselinePath << ": ";
+        if (regressions.empty()) {
+            cout << "no regressions beyond " << this->options.regressionThreshold * 100.0 << "%" << '\n';
+            return;
+        }
+        cout << regressions.size() << " failed comparisons (regressions beyond " << this->options.regressionThreshold * 100.0
+            << "% or statistics missing from the baseline)" << '\n';
+        for (const FrameBenchmark::Regression& regression : regressions) {
+            cout << "\t\t" << regression.metric << " " << regression.statistic << ": ";
+            if (regression.missingFromBaseline) {
+                cout << "missing from the baseline, now " << regression.currentMs << " ms" << '\n';
+            } else {
+                cout << regression.baselineMs << " ms -> " << regression.currentMs << " ms" << '\n';
+            }
+        }
+        throw runtime_error("frame benchmark regressed against the baseline!");
+    }
+
+    // Renders the same instances with one CPU-recorded draw each, then through GPU frustum culling and indirect
+    // draws, then with occlusion culling on top where supported, and compares the CPU and GPU frame times.
+    void runGpuDrivenBenchmark() {
+        struct Path {
+            const char* name;
+            bool gpuDriven;
+            bool occlusion;
+            FrameBenchmark::Summary cpu;
+            FrameBenchmark::Summary gpu;
+            double drawn;
+        };
+        vector<Path> paths = {
+            { "CPU draws", false, false, {}, {}, 0.0 },
+            { "GPU-driven, frustum culling", true, false, {}, {}, 0.0 },
+        };
+        if (this->gpuDriven.isOcclusionSupported()) {
+            paths.push_back({ "GPU-driven, occlusion culling", true, true, {}, {}, 0.0 });
+        }
+        uint32_t measuredFrames = std::max(1u, this->options.headlessFrameCount);
+
+        for (Path& path : paths) {
+            this->useGpuDriven = path.gpuDriven;
+            this->useOcclusion = path.occlusion;
+            this->rebuildRenderGraph();
+
+            FrameBenchmark benchmark;
+            benchmark.reserve(measuredFrames);
+            for (uint32_t frame = 0; frame < this->options.benchmarkWarmupFrames; ++frame) {
+                this->drawOffscreenFrame();
+            }
+            this->gpuDriven.resetStatistics();
+
+            this->frameBenchmark = &benchmark;
+            FrameRing::Clock::time_point frameStart = FrameRing::Clock::now();
+            for (uint32_t frame = 0; frame < measuredFrames; ++frame) {
+                this->drawOffscreenFrame();
+                FrameRing::Clock::time_point frameEnd = FrameRing::Clock::now();
+                benchmark.add(FrameBenchmark::Metric::CpuFrame, std::chrono::duration<double, std::milli>(frameEnd - frameStart).count());
+                frameStart = frameEnd;
+            }
+            this->collectFramesInFlight();
+            this->frameBenchmark = nullptr;
+
+            path.cpu = benchmark.summarize(FrameBenchmark::Metric::CpuFrame);
+            path.gpu = benchmark.summarize(FrameBenchmark::Metric::GpuFrame);
+            path.drawn = this->gpuDriven.getAverageDrawn();
+        }
+
+        cout << "[GPU-Driven Benchmark]" << '\n';
+        cout << "\tInstances: " << this->gpuDriven.getInstanceCount() << " (" << this->drawCount << " for CPU draws), " << measuredFrames
+            << " measured frames per path, " << getIndirectDrawModeString(this->gpuDriven.getMode()) << '\n';
+        for (const Path& path : paths) {
+            cout << '\t' << path.name << ": CPU p50 " << path.cpu.p50 << " ms, p99 " << path.cpu.p99 << " ms";
+            if (path.gpu.samples > 0) {
+                cout << "; GPU p50 " << path.gpu.p50 << " ms, p99 " << path.gpu.p99 << " ms";
+            }
+            if (path.gpuDriven) {
+                cout << "; " << path.drawn << " drawn on average";
+            }
+            cout << '\n';
+        }
+    }
+
+    // Allocates a frame's worth of transient descriptor sets per frame, once from the frame-linear allocator and
+    // once from a pool that frees every set individually, and compares the CPU time per frame. Nothing is
+    // submitted, so sets may be recycled without waiting for fences.
+    void runDescriptorBenchmark() {
+        VkDescriptorSetLayoutBinding bindings[2]{};
+        bindings[0].binding = 0;
+        bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[0].descriptorCount = 1;
+        bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        bindings[1].binding = 1;
+        bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        bindings[1].descriptorCount = 1;
+        bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        VkDescriptorSetLayout layout = this->descriptorLayouts.getLayout(bindings, 2);
+        const VkDescriptorSetLayoutBinding reordered[2] = { bindings[1], bindings[0] };
+        if (this->descriptorLayouts.getLayout(reordered, 2) != layout) {
+            throw runtime_error("descriptor layout cache created a second layout for identical bindings!");
+        }
+
+        uint32_t measuredFrames = std::max(1u, this->options.headlessFrameCount);
+        uint32_t framesInFlight = this->options.framesInFlight;
+
+        DescriptorAllocator linear;
+        linear.create(this->device, framesInFlight);
+        FrameRing::Clock::time_point linearStart = FrameRing::Clock::now();
+        for (uint32_t frame = 0; frame < measuredFrames; ++frame) {
+            linear.beginFrame(frame % framesInFlight);
+            for (uint32_t i = 0; i < DESCRIPTOR_BENCHMARK_SETS; ++i) {
+                linear.allocate(layout);
+            }
+        }
+        FrameRing::Clock::time_point linearEnd = FrameRing::Clock::now();
+        linear.destroy();
+
+        uint32_t maxSets = DESCRIPTOR_BENCHMARK_SETS * framesInFlight;
+        VkDescriptorPoolSize poolSizes[2] = { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, maxSets }, { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, maxSets } };
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+        poolInfo.maxSets = maxSets;
+        poolInfo.poolSizeCount = 2;
+        poolInfo.pPoolSizes = poolSizes;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(this->device, &poolInfo, HostAllocator::get().getCallbacks(), &pool) != VK_SUCCESS) {
+            throw runtime_error("failed to create descriptor pool!");
+        }
+
+        VkDescriptorSetAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = pool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &layout;
+
+        vector<vector<VkDescriptorSet>> frameSets(framesInFlight);
+        FrameRing::Clock::time_point individualStart = FrameRing::Clock::now();
+        for (uint32_t frame = 0; frame < measuredFrames; ++frame) {
+            vector<VkDescriptorSet>& sets = frameSets[frame % framesInFlight];
+            for (VkDescriptorSet set : sets) {
+                vkFreeDescriptorSets(this->device, pool, 1, &set);
+            }
+            sets.clear();
+            for (uint32_t i = 0; i < DESCRIPTOR_BENCHMARK_SETS; ++i) {
+                VkDescriptorSet set;
+                if (vkAllocateDescriptorSets(this->device, &allocInfo, &set) != VK_SUCCESS) {
+                    throw runtime_error("failed to allocate descriptor set!");
+                }
+                sets.push_back(set);
+            }
+        }
+        FrameRing::Clock::time_point individualEnd = FrameRing::Clock::now();
+        vkDestroyDescriptorPool(this->device, pool, HostAllocator::get().getCallbacks());
+
+        double linearMs = std::chrono::duration<double, std::milli>(linearEnd - linearStart).count() / measuredFrames;
+        double individualMs = std::chrono::duration<double, std::milli>(individualEnd - individualStart).count() / measuredFrames;
+        cout << "[Descriptor Benchmark]" << '\n';
+        cout << "\tSets: " << DESCRIPTOR_BENCHMARK_SETS << " per frame, " << measuredFrames << " frames, " << framesInFlight << " frames in flight" << '\n';
+        cout << "\tFrame-linear with pool resets: " << linearMs << " ms per frame" << '\n';
+        cout << "\tIndividually freed: " << individualMs << " ms per frame, " << individualMs / linearMs << "x slower" << '\n';
+    }
+
+    void headlessLoop() {
+        if (this->options.benchmark == string("gpu-driven")) {
+            this->runGpuDrivenBenchmark();
+            return;
+        }
+        if (this->options.benchmark == string("descriptors")) {
+            this->runDescriptorBenchmark();
+            return;
+        }
+        if (this->options.benchmark == string("recording")) {
+            this->runRecordingBenchmark();
+            return;
+        }
+        if (this->options.benchmark == string("frames")) {
+            this->runFrameBenchmark();
+            return;
+        }
+
+        this->frameScheduler.configure(this->options.loopMode == LoopMode::FpsLimit ? LoopMode::FpsLimit : LoopMode::Continuous, this->options.targetFps);
+        this->frameScheduler.start();
+
+        for (uint32_t frame = 0; frame < this->options.headlessFrameCount; ++frame) {
+            this->drawOffscreenFrame();
+            this->frameScheduler.onFrameRendered();
+            StartupTracer::get().markFirstFrame();
+            TraceRecorder::Scope traceScope("paceFrame");
+            this->frameScheduler.paceFrame();
+        }
+        vkDeviceWaitIdle(this->device);
+
+        this->frameScheduler.printReport(cout);
+    }
+
     void createLogicalDevice() {
+        StartupTracer::Scope scope("createLogicalDevice");
+
         QueueFamilyIndices indices = findQueueFamilies(this->physicalDevice, this->surface);
 
-        vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-        unordered_set<uint32_t> uniqueQueueFamilies = { indices.graphicsFamily.value(), indices.presentFamily.value() };
+        cout << "[Queue Families]" << '\n';
+        cout << "\tGraphics: " << indices.graphicsFamily.value() << '\n';
+        cout << "\tCompute: " << indices.computeFamily.value() << (indices.hasAsyncCompute() ? " (async)" : "") << '\n';
+        cout << "\tTransfer: " << indices.transferFamily.value() << (indices.hasDedicatedTransfer() ? " (dedicated)" : "") << '\n';
+        if (indices.presentFamily.has_value()) {
+            cout << "\tPresent: " << indices.presentFamily.value() << '\n';
+        }
+
+        const auto& priorities = this->options.queuePriorities;
+        vector<QueueRequest> queueRequests = {
+            { QueueRole::Graphics, indices.graphicsFamily.value(), priorities[static_cast<size_t>(QueueRole::Graphics)] },
+            { QueueRole::Compute, indices.computeFamily.value(), priorities[static_cast<size_t>(QueueRole::Compute)] },
+            { QueueRole::Transfer, indices.transferFamily.value(), priorities[static_cast<size_t>(QueueRole::Transfer)] },
+        };
+        // Presenting from the graphics queue needs no extra queue, so only a separate present family gets its own.
+        bool separatePresentFamily = indices.presentFamily.has_value() && indices.presentFamily != indices.graphicsFamily;
+        if (separatePresentFamily) {
+            queueRequests.push_back({ QueueRole::Present, indices.presentFamily.value(), priorities[static_cast<size_t>(QueueRole::Present)] });
+        }
 
-        float queuePriority = 1.0f;
-        for (uint32_t queueFamily : uniqueQueueFamilies) {
-            VkDeviceQueueCreateInfo queueCreateInfo{};
-            queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-            queueCreateInfo.queueFamilyIndex = queueFamily;
-            queueCreateInfo.queueCount = 1;
-            queueCreateInfo.pQueuePriorities = &queuePriority;
-            queueCreateInfos.push_back(queueCreateInfo);
+        this->queuePool.plan(getDeviceQueueFamilyProperties(this->physicalDevice), queueRequests);
+        if (indices.presentFamily.has_value() && !separatePresentFamily) {
+            this->queuePool.shareQueue(QueueRole::Present, QueueRole::Graphics);
         }
 
-        VkPhysicalDeviceFeatures deviceFeatures{};
+        vector<VkDeviceQueueCreateInfo> queueCreateInfos = this->queuePool.getCreateInfos();
+
+        vector<const char*> deviceExtensions = getRequiredDeviceExtensions(this->options.headless);
+        DeviceFeatureChain enabledFeatures;
+        this->capabilities = negotiateDeviceFeatures(this->physicalDevice, this->instanceApiVersion, enabledFeatures, deviceExtensions);
+        printDeviceCapabilities(cout, this->capabilities);
 
         VkDeviceCreateInfo createInfo;
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -307,9 +1417,9 @@ private:
         createInfo.pQueueCreateInfos = queueCreateInfos.data();
         createInfo.enabledLayerCount = 0;
         createInfo.ppEnabledLayerNames = nullptr;
-        createInfo.enabledExtensionCount = 0;
-        createInfo.ppEnabledExtensionNames = nullptr;
-        createInfo.pEnabledFeatures = &deviceFeatures;
+        createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
+        createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+        enabledFeatures.attach(createInfo);
 
         // The following code is for backward compatability.
         // In latest Vulkan implementation, the 2 parameters 'enabledLayerCount' and 'ppEnabledLayerNames' will be ignored.
@@ -318,39 +1428,77 @@ private:
             createInfo.ppEnabledLayerNames = this->validationLayers.data();
         }
 
-        if (vkCreateDevice(this->physicalDevice, &createInfo, nullptr, &this->device) != VK_SUCCESS) {
-            throw std::runtime_error("failed to create logical device!");
+        {
+            StartupTracer::Scope createDeviceScope("vkCreateDevice", "loader");
+            if (vkCreateDevice(this->physicalDevice, &createInfo, HostAllocator::get().getCallbacks(), &this->device) != VK_SUCCESS) {
+                throw std::runtime_error("failed to create logical device!");
+            }
         }
 
-        vkGetDeviceQueue(this->device, indices.graphicsFamily.value(), 0, &this->graphicsQueue);
-        vkGetDeviceQueue(this->device, indices.presentFamily.value(), 0, &this->presentQueue);
+        this->queuePool.retrieveQueues(this->device);
+        this->queuePool.print(cout);
+
+        this->graphicsQueue = this->queuePool.getQueue(QueueRole::Graphics);
+        this->computeQueue = this->queuePool.getQueue(QueueRole::Compute);
+        this->transferQueue = this->queuePool.getQueue(QueueRole::Transfer);
+        if (this->queuePool.hasRole(QueueRole::Present)) {
+            this->presentQueue = this->queuePool.getQueue(QueueRole::Present);
+        }
     }
 
     void pickPhysicalDevice() {
+        StartupTracer::Scope scope("pickPhysicalDevice");
+
         vector<VkPhysicalDevice> devices = getAllAvailableDevices(this->instance);
+        uint64_t bestScore = 0;
+
+        cout << "[All Physical Devices]" << '\n';
         for (const auto& device : devices) {
-            if (isDeviceSuitable(device, this->surface)) {
+            VkPhysicalDeviceProperties deviceProperties = getDeviceProperties(device);
+            optional<DeviceUUID> uuid = getDeviceUUID(device, this->instanceApiVersion);
+            uint64_t score = rateDeviceSuitability(device, this->surface);
+
+            cout << '\t' << deviceProperties.deviceName << " (" << getDeviceTypeString(deviceProperties.deviceType) << ")";
+            cout << " score " << score;
+            if (uuid.has_value()) {
+                cout << " uuid " << formatDeviceUUID(*uuid);
+            }
+            cout << '\n';
+
+            if (this->options.pinnedDeviceUUID.has_value()) {
+                if (uuid == this->options.pinnedDeviceUUID) {
+                    if (score == 0) {
+                        throw runtime_error("the pinned device " + formatDeviceUUID(*uuid) + " is not suitable!");
+                    }
+                    this->physicalDevice = device;
+                }
+            } else if (score > bestScore) {
+                bestScore = score;
                 this->physicalDevice = device;
-                break;
             }
         }
 
         if (this->physicalDevice == VK_NULL_HANDLE) {
+            if (this->options.pinnedDeviceUUID.has_value()) {
+                throw runtime_error("failed to find the pinned device " + formatDeviceUUID(*this->options.pinnedDeviceUUID) + "!");
+            }
             throw std::runtime_error("failed to find a suitable GPU!");
         }
 
-        getDeviceProperties(this->physicalDevice);
-        getDeviceFeatures(this->physicalDevice);
+        cout << "[Selected Physical Device]" << '\n';
+        cout << '\t' << getDeviceProperties(this->physicalDevice).deviceName << '\n';
     }
 
     void setupDebugMessenger() {
+        StartupTracer::Scope scope("setupDebugMessenger");
+
         if (!enableValidationLayers) {
             return;
         }
 
-        VkDebugUtilsMessengerCreateInfoEXT createInfo = populateDebugMessengerCreateInfo();
+        VkDebugUtilsMessengerCreateInfoEXT createInfo = populateDebugMessengerCreateInfo(&this->debugMessages);
 
-        if (CreateDebugUtilsMessengerEXT(this->instance, &createInfo, nullptr, &this->debugMessenger) != VK_SUCCESS) {
+        if (CreateDebugUtilsMessengerEXT(this->instance, &createInfo, HostAllocator::get().getCallbacks(), &this->debugMessenger) != VK_SUCCESS) {
             throw runtime_error("failed to set up debug messenger!");
         }
     }
@@ -377,47 +1525,191 @@ private:
     }
 
     void createInstance() {
+        StartupTracer::Scope scope("createInstance");
+
         if (enableValidationLayers && !checkValidationLayerSupport()) {
             throw runtime_error("validation layers requested, but not available!");
         }
 
-        VkApplicationInfo appInfo = createApplicationInfo();
+        // Ask for the newest version both the loader and this code know; devices may still be older.
+        this->instanceApiVersion = std::min(getApiVersionWithoutPatch(getInstanceApiVersion()), VK_API_VERSION_1_3);
+        VkApplicationInfo appInfo = createApplicationInfo(this->instanceApiVersion);
         
-        vector<const char *> extensions = getRequiredExtensions();
+        vector<const char *> extensions = getRequiredExtensions(this->options.headless);
 
-        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = populateDebugMessengerCreateInfo();
+        VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo = populateDebugMessengerCreateInfo(&this->debugMessages);
 
         VkInstanceCreateInfo createInfo = createInstanceCreationInfo(&appInfo, extensions, &debugCreateInfo, this->validationLayers);
 
-        if (vkCreateInstance(&createInfo, nullptr, &this->instance) != VK_SUCCESS) {
-            throw runtime_error("failed to create instance!");
+        {
+            StartupTracer::Scope createInstanceScope("vkCreateInstance", "loader");
+            if (vkCreateInstance(&createInfo, HostAllocator::get().getCallbacks(), &this->instance) != VK_SUCCESS) {
+                throw runtime_error("failed to create instance!");
+            }
         }
 
         showAllAvailableExtensions();
-        showRequiredExtensions();
+        showRequiredExtensions(this->options.headless);
     }
 
     void initWindow() {
-        glfwInit();
+        StartupTracer::Scope scope("initWindow");
+
+        {
+            StartupTracer::Scope glfwInitScope("glfwInit");
+            glfwInit();
+        }
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
+        StartupTracer::Scope createWindowScope("glfwCreateWindow");
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+
+        // Anything that can change what is on screen wakes an on-demand loop up for one frame.
+        glfwSetWindowRefreshCallback(window, [](GLFWwindow* w) { getApplication(w)->frameScheduler.requestRedraw(); });
+        glfwSetWindowFocusCallback(window, [](GLFWwindow* w, int) { getApplication(w)->frameScheduler.requestRedraw(); });
+        glfwSetKeyCallback(window, [](GLFWwindow* w, int, int, int, int) { getApplication(w)->frameScheduler.requestRedraw(); });
+        glfwSetMouseButtonCallback(window, [](GLFWwindow* w, int, int, int) { getApplication(w)->frameScheduler.requestRedraw(); });
+        glfwSetCursorPosCallback(window, [](GLFWwindow* w, double, double) { getApplication(w)->frameScheduler.requestRedraw(); });
+        glfwSetScrollCallback(window, [](GLFWwindow* w, double, double) { getApplication(w)->frameScheduler.requestRedraw(); });
+    }
+
+    static HelloTriangleApplication* getApplication(GLFWwindow* window) {
+        return reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+    }
+
+    static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = getApplication(window);
+        app->framebufferResized = true;
+        app->frameScheduler.requestRedraw();
+    }
+
+    VkExtent2D getFramebufferExtent() const {
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(this->window, &width, &height);
+        return { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+    }
+
+    void createSwapchain() {
+        StartupTracer::Scope scope("createSwapchain");
+
+        Swapchain::Config config;
+        config.presentMode = this->options.presentMode;
+        config.desiredImageCount = this->options.swapchainImageCount;
+        config.graphicsFamily = this->queuePool.getFamilyIndex(QueueRole::Graphics);
+        config.presentFamily = this->queuePool.getFamilyIndex(QueueRole::Present);
+
+        this->swapchain.create(this->physicalDevice, this->device, this->surface, this->getFramebufferExtent(), config);
+        this->swapchain.print(cout);
+    }
+
+    void recreateSwapchain() {
+        VkExtent2D extent = this->getFramebufferExtent();
+        // A minimized window has no area to present to; keep the flag set and try again once it is restored.
+        if (extent.width == 0 || extent.height == 0) {
+            return;
+        }
+
+        // Frames up to the current one may still reference the old swapchain; the frame ring reports when they
+        // have completed and drawFrame() collects it then, so nothing here waits for the GPU.
+        this->swapchain.recreate(extent, this->frameRing.getCurrentSerial());
+        this->framebufferResized = false;
+
+        // Transient images follow the new extent, so the graph is rebuilt; the old one retires like the swapchain.
+        this->rebuildRenderGraph();
     }
 
     void initVulkan() {
+        StartupTracer::Scope scope("initVulkan");
+
         this->createInstance();
         this->setupDebugMessenger();
-        this->createSurface();
+        if (!this->options.headless) {
+            this->createSurface();
+        }
         this->pickPhysicalDevice();
         this->createLogicalDevice();
+        this->createPipelineCache();
+        this->createMemoryAllocator();
+        this->createUploadService();
+        if (this->options.headless) {
+            this->createOffscreenTarget();
+        } else {
+            this->createSwapchain();
+        }
+        this->createFrameRing();
+        this->createGpuProfiler();
+        this->createDescriptorAllocators();
+        this->createBindlessTable();
+        this->createScene();
+        this->createGpuDrivenRenderer();
+        this->createParallelRecorder();
+        this->createRenderGraph();
     }
 
     void mainLoop() {
+        if (this->options.headless) {
+            this->headlessLoop();
+            return;
+        }
+
+        this->frameScheduler.configure(this->options.loopMode, this->options.targetFps);
+        this->frameScheduler.start();
+
         while (!glfwWindowShouldClose(window)) {
-            glfwPollEvents();
+            if (this->frameScheduler.getMode() == LoopMode::OnDemand) {
+                // Sleep in the OS event queue; the timeout is a safety net against a missed wake-up.
+                {
+                    TraceRecorder::Scope traceScope("glfwWaitEventsTimeout");
+                    glfwWaitEventsTimeout(ON_DEMAND_WAKE_INTERVAL_SECONDS);
+                }
+                if (!this->frameScheduler.consumeRedraw()) {
+                    this->frameScheduler.onIdleWake();
+                    continue;
+                }
+            } else {
+                glfwPollEvents();
+            }
+
+            if (this->framebufferResized) {
+                this->recreateSwapchain();
+            }
+            this->drawFrame();
+            this->frameScheduler.onFrameRendered();
+            TraceRecorder::Scope traceScope("paceFrame");
+            this->frameScheduler.paceFrame();
         }
+
+        this->frameScheduler.printReport(cout);
+    }
+
+    void reportStartupProfile() {
+        const StartupTracer& tracer = StartupTracer::get();
+        tracer.printSummary(cout);
+
+        optional<double> timeToFirstFrameMs = tracer.getTimeToFirstFrameMs();
+        if (timeToFirstFrameMs.has_value()) {
+            cout << "\tTime to first frame: " << *timeToFirstFrameMs << " ms" << '\n';
+        }
+
+        if (this->options.startupTracePath.has_value()) {
+            tracer.writeChromeTrace(*this->options.startupTracePath);
+            cout << "\tStartup trace written to " << *this->options.startupTracePath << '\n';
+        }
+    }
+
+    // After every other thread stopped, so no buffer is still being written to.
+    void writeTrace() {
+        if (!this->options.tracePath.has_value()) {
+            return;
+        }
+        TraceRecorder::get().writeChromeTrace(*this->options.tracePath);
+        cout << "[Trace]" << '\n';
+        cout << "\tWritten to " << *this->options.tracePath << '\n';
     }
 
     void cleanup() {
@@ -427,12 +1719,62 @@ private:
         //     DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
         // }
 
-        vkDestroyDevice(this->device, nullptr);
-        vkDestroySurfaceKHR(this->instance, this->surface, nullptr);
-        vkDestroyInstance(this->instance, nullptr);
+        vkDeviceWaitIdle(this->device);
+
+        this->pipelineCache.save();
+        this->pipelineCache.print(cout);
+        this->pipelineCache.destroy();
 
-        glfwDestroyWindow(this->window);
-        glfwTerminate();
+        this->frameRing.destroy();
+        this->gpuProfiler.destroy();
+
+        this->renderGraph->printStatistics(cout);
+        this->renderGraph->destroy();
+        this->destroyFramebuffers(this->framebuffers);
+        for (RetiredRenderGraph& retired : this->retiredRenderGraphs) {
+            retired.graph->destroy();
+            this->destroyFramebuffers(retired.framebuffers);
+        }
+        this->retiredRenderGraphs.clear();
+
+        this->recorder.printStatistics(cout);
+        this->recorder.destroy();
+        if (this->gpuDrivenCreated) {
+            this->gpuDriven.printStatistics(cout, this->gpuProfiler);
+            this->gpuDriven.destroy();
+        }
+        this->scene.destroy();
+        this->bindless.printStatistics(cout);
+        this->bindless.destroy();
+        this->descriptors.printStatistics(cout);
+        this->descriptors.destroy();
+        this->descriptorLayouts.printStatistics(cout);
+        this->descriptorLayouts.destroy();
+
+        if (this->options.headless) {
+            vkDestroyImageView(this->device, this->offscreenImageView, HostAllocator::get().getCallbacks());
+            vkDestroyImage(this->device, this->offscreenImage, HostAllocator::get().getCallbacks());
+            this->memoryAllocator.free(this->offscreenImageAllocation);
+        } else {
+            this->swapchain.destroy();
+        }
+
+        this->uploads.printStatistics(cout);
+        this->uploads.destroy();
+
+        this->memoryAllocator.printStatistics(cout);
+        this->memoryAllocator.destroy();
+
+        vkDestroyDevice(this->device, HostAllocator::get().getCallbacks());
+        if (this->surface != VK_NULL_HANDLE) {
+            vkDestroySurfaceKHR(this->instance, this->surface, HostAllocator::get().getCallbacks());
+        }
+        vkDestroyInstance(this->instance, HostAllocator::get().getCallbacks());
+
+        if (!this->options.headless) {
+            glfwDestroyWindow(this->window);
+            glfwTerminate();
+        }
     }
 
 #ifdef NDEBUG
@@ -443,25 +1785,288 @@ private:
 
     static constexpr const uint32_t WIDTH = 800;
     static constexpr const uint32_t HEIGHT = 600;
+    static constexpr const VkFormat OFFSCREEN_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
+    static constexpr const double ON_DEMAND_WAKE_INTERVAL_SECONDS = 0.5;
+    static constexpr const VkDeviceSize STAGING_RING_SIZE = 16 * 1024 * 1024;
+    static constexpr const char* const SHADER_DIRECTORY = "shaders/";
+    static constexpr const uint32_t RECORDING_BENCHMARK_DRAW_COUNT = 20000;
+    static constexpr const uint32_t RECORDING_BENCHMARK_WARMUP_FRAMES = 30;
+    static constexpr const uint32_t DESCRIPTOR_BENCHMARK_SETS = 4096;
+    static constexpr const uint32_t GPU_DRIVEN_BENCHMARK_DRAW_COUNT = 100000;
 
     const vector<const char*> validationLayers{
         "VK_LAYER_KHRONOS_validation"
     };
 
-    GLFWwindow* window;
+    const ApplicationOptions options;
+
+    GLFWwindow* window = nullptr;
     VkInstance instance;
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
     VkDebugUtilsMessengerEXT debugMessenger;
-    VkSurfaceKHR surface;
+    DebugMessageSink debugMessages;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice device;
+    DeviceCapabilities capabilities;
     VkQueue graphicsQueue;
-    VkQueue presentQueue;
+    VkQueue presentQueue = VK_NULL_HANDLE;
+    Swapchain swapchain;
+    bool framebufferResized = false;
+    // The same handle as graphicsQueue when the device has no separate family for the role.
+    VkQueue computeQueue;
+    VkQueue transferQueue;
+    // Every queue of the device; the handles above are the primary queue of each role.
+    QueuePool queuePool;
+
+    // Headless mode only: the image frames are rendered into.
+    VkImage offscreenImage = VK_NULL_HANDLE;
+    DeviceAllocation offscreenImageAllocation;
+    VkImageView offscreenImageView = VK_NULL_HANDLE;
+
+    FrameRing frameRing;
+    GpuProfiler gpuProfiler;
+    std::unique_ptr<RenderGraph> renderGraph;
+    RenderGraphResource frameTarget;
+    vector<RetiredRenderGraph> retiredRenderGraphs;
+    DescriptorLayoutCache descriptorLayouts;
+    DescriptorAllocator descriptors;
+    BindlessTable bindless;
+    SceneRenderer scene;
+    uint32_t drawCount = 1;
+    GpuDrivenRenderer gpuDriven;
+    bool gpuDrivenCreated = false;
+    // Whether the render graph draws through gpuDriven, and culls occlusion; the GPU-driven benchmark switches them.
+    bool useGpuDriven = false;
+    bool useOcclusion = false;
+    RenderGraphResource drawCommandsResource;
+    RenderGraphResource cullCountersResource;
+    RenderGraphResource visibilityResource;
+    RenderGraphResource depthPyramidResource;
+    RenderGraphResource depthPyramidCounterResource;
+    // Set while the frame benchmark measures; completed frames are reported to it.
+    FrameBenchmark* frameBenchmark = nullptr;
+    // One per image the frame target can be, indexed like the swapchain images.
+    vector<VkFramebuffer> framebuffers;
+    VkFramebuffer currentFramebuffer = VK_NULL_HANDLE;
+    ParallelRecorder recorder;
+    PipelineCache pipelineCache;
+    // Shared by everything that runs in parallel; the main thread is worker 0.
+    JobSystem jobs;
+    DeviceMemoryAllocator memoryAllocator;
+    UploadService uploads;
+    FrameScheduler frameScheduler;
 };
 
-int main() {
-    HelloTriangleApplication app;
+static uint32_t parseUnsigned(const string& text, const char* optionName) {
+    // stoull() accepts a sign and wraps negative values around, and anything past 32 bits would be truncated.
+    if (text.find('-') == string::npos) {
+        try {
+            size_t consumed = 0;
+            unsigned long long value = std::stoull(text, &consumed);
+            if (consumed == text.size() && value <= UINT32_MAX) {
+                return static_cast<uint32_t>(value);
+            }
+        }
+        catch (const exception&) {
+        }
+    }
+    throw runtime_error(string("invalid value for ") + optionName + ": " + text);
+}
 
+// Frame rates such as 59.94 are fractional; only finite positive values make sense.
+static double parseDouble(const string& text, const char* optionName) {
     try {
+        size_t consumed = 0;
+        double value = std::stod(text, &consumed);
+        if (consumed == text.size() && std::isfinite(value) && value > 0.0) {
+            return value;
+        }
+    }
+    catch (const exception&) {
+    }
+    throw runtime_error(string("invalid value for ") + optionName + ": " + text);
+}
+
+// Parses "<role>=<priority>[,<priority>...]", e.g. "compute=1.0,0.25".
+static void parseQueuePriorities(const string& text, ApplicationOptions& options) {
+    size_t separator = text.find('=');
+    if (separator == string::npos) {
+        throw runtime_error("invalid value for --queues: " + text);
+    }
+
+    string roleName = text.substr(0, separator);
+    QueueRole role;
+    if (roleName == "graphics") {
+        role = QueueRole::Graphics;
+    } else if (roleName == "compute") {
+        role = QueueRole::Compute;
+    } else if (roleName == "transfer") {
+        role = QueueRole::Transfer;
+    } else if (roleName == "present") {
+        role = QueueRole::Present;
+    } else {
+        throw runtime_error("unknown queue role for --queues: " + roleName);
+    }
+
+    vector<float> priorities;
+    size_t start = separator + 1;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        // Like parseDouble(): the whole token, and finite, since NaN would pass any range check later.
+        string token = text.substr(start, end - start);
+        size_t consumed = 0;
+        float priority = 0.0f;
+        try {
+            priority = std::stof(token, &consumed);
+        }
+        catch (const std::logic_error&) {
+        }
+        if (consumed == 0 || consumed != token.size() || !std::isfinite(priority)) {
+            throw runtime_error("invalid value for --queues: " + text);
+        }
+        priorities.push_back(priority);
+        start = end + 1;
+    }
+
+    options.queuePriorities[static_cast<size_t>(role)] = priorities;
+}
+
+static ApplicationOptions parseCommandLine(int argc, char* argv[]) {
+    ApplicationOptions options;
+
+    // The environment variable lets render farms switch to headless without touching the command line.
+    optional<string> headlessEnv = getEnvironmentVariable("VULKAN_TEST_HEADLESS");
+    if (headlessEnv.has_value() && !headlessEnv->empty() && *headlessEnv != "0") {
+        options.headless = true;
+    }
+    options.startupTracePath = getEnvironmentVariable("VULKAN_TEST_STARTUP_TRACE");
+    options.tracePath = getEnvironmentVariable("VULKAN_TEST_TRACE");
+    optional<string> pipelineCacheEnv = getEnvironmentVariable("VULKAN_TEST_PIPELINE_CACHE");
+    if (pipelineCacheEnv.has_value() && !pipelineCacheEnv->empty()) {
+        options.pipelineCachePath = *pipelineCacheEnv;
+    }
+    optional<string> deviceEnv = getEnvironmentVariable("VULKAN_TEST_DEVICE_UUID");
+    if (deviceEnv.has_value() && !deviceEnv->empty()) {
+        options.pinnedDeviceUUID = parseDeviceUUID(*deviceEnv);
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--headless") {
+            options.headless = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            options.headlessFrameCount = parseUnsigned(argv[++i], "--frames");
+        } else if (arg == "--startup-trace" && i + 1 < argc) {
+            options.startupTracePath = string(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            options.tracePath = string(argv[++i]);
+        } else if (arg == "--pipeline-cache" && i + 1 < argc) {
+            options.pipelineCachePath = argv[++i];
+        } else if (arg == "--device-uuid" && i + 1 < argc) {
+            options.pinnedDeviceUUID = parseDeviceUUID(argv[++i]);
+        } else if (arg == "--queues" && i + 1 < argc) {
+            parseQueuePriorities(argv[++i], options);
+        } else if (arg == "--present-mode" && i + 1 < argc) {
+            optional<PresentModePreference> presentMode = parsePresentModePreference(argv[++i]);
+            if (!presentMode.has_value()) {
+                throw runtime_error(string("invalid value for --present-mode: ") + argv[i]);
+            }
+            options.presentMode = *presentMode;
+        } else if (arg == "--swapchain-images" && i + 1 < argc) {
+            options.swapchainImageCount = parseUnsigned(argv[++i], "--swapchain-images");
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            options.framesInFlight = parseUnsigned(argv[++i], "--frames-in-flight");
+        } else if (arg == "--loop" && i + 1 < argc) {
+            optional<LoopMode> loopMode = parseLoopMode(argv[++i]);
+            if (!loopMode.has_value()) {
+                throw runtime_error(string("invalid value for --loop: ") + argv[i]);
+            }
+            options.loopMode = *loopMode;
+        } else if (arg == "--target-fps" && i + 1 < argc) {
+            options.targetFps = parseDouble(argv[++i], "--target-fps");
+        } else if (arg == "--bench" && i + 1 < argc) {
+            options.benchmark = string(argv[++i]);
+        } else if (arg == "--debug-rate-limit" && i + 1 < argc) {
+            options.debugMessageRateLimit = parseUnsigned(argv[++i], "--debug-rate-limit");
+        } else if (arg == "--draws" && i + 1 < argc) {
+            options.drawCount = parseUnsigned(argv[++i], "--draws");
+        } else if (arg == "--gpu-driven") {
+            options.gpuDriven = true;
+        } else if (arg == "--occlusion") {
+            options.gpuDriven = true;
+            options.occlusionCulling = true;
+        } else if (arg == "--record-threads" && i + 1 < argc) {
+            options.recordThreads = parseUnsigned(argv[++i], "--record-threads");
+        } else if (arg == "--host-allocator" && i + 1 < argc) {
+            optional<HostAllocatorMode> hostAllocatorMode = parseHostAllocatorMode(argv[++i]);
+            if (!hostAllocatorMode.has_value()) {
+                throw runtime_error(string("invalid value for --host-allocator: ") + argv[i]);
+            }
+            options.hostAllocatorMode = *hostAllocatorMode;
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            options.benchmarkWarmupFrames = parseUnsigned(argv[++i], "--warmup");
+        } else if (arg == "--bench-output" && i + 1 < argc) {
+            options.benchmarkOutputPath = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            options.benchmarkBaselinePath = string(argv[++i]);
+        } else if (arg == "--regression-threshold" && i + 1 < argc) {
+            // In percent, like the report prints it.
+            options.regressionThreshold = parseUnsigned(argv[++i], "--regression-threshold") / 100.0;
+        } else {
+            throw runtime_error("unknown command line option: " + arg);
+        }
+    }
+
+    return options;
+}
+
+// Benchmarks that need no Vulkan device run before the application is even constructed.
+static bool runCpuBenchmark(const string& name) {
+    if (name == "allocator") {
+        runAllocatorBenchmark(cout);
+        return true;
+    }
+    if (name == "jobs") {
+        runJobSystemBenchmark(cout);
+        return true;
+    }
+    if (name == "culling") {
+        runCullingBenchmark(cout);
+        return true;
+    }
+    return false;
+}
+
+// Benchmarks that need the device run inside the application, always headless so no window or vsync gets in the way.
+static bool isRenderingBenchmark(const string& name) {
+    return name == "recording" || name == "frames" || name == "descriptors" || name == "gpu-driven";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        ApplicationOptions options = parseCommandLine(argc, argv);
+        if (options.benchmark.has_value()) {
+            if (isRenderingBenchmark(*options.benchmark)) {
+                options.headless = true;
+            } else {
+                if (!runCpuBenchmark(*options.benchmark)) {
+                    throw runtime_error("unknown benchmark: " + *options.benchmark);
+                }
+                return EXIT_SUCCESS;
+            }
+        }
+
+        HostAllocator::get().configure(options.hostAllocatorMode);
+        if (options.tracePath.has_value()) {
+            TraceRecorder::get().enable();
+            TraceRecorder::get().setThreadName("main");
+        }
+
+        HelloTriangleApplication app(options);
         app.run();
     }
     catch (const exception& e) {
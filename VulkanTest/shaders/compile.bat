@@ -0,0 +1,7 @@
+@echo off
+rem Compiles every GLSL shader in this directory to SPIR-V next to its source (triangle.vert -> triangle.vert.spv).
+setlocal
+set GLSLC="%VULKAN_SDK%\Bin\glslc.exe"
+for %%f in ("%~dp0*.vert" "%~dp0*.frag" "%~dp0*.comp") do (
+    %GLSLC% "%%~ff" -o "%%~ff.spv" || exit /b 1
+)
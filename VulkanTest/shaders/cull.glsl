@@ -0,0 +1,79 @@
+// Shared by the cull passes of GpuDrivenRenderer: one invocation per instance, writing the draw commands the
+// scene passes execute indirectly. Included, not compiled on its own.
+layout(local_size_x = 64) in;
+
+// True with vkCmdDrawIndexedIndirectCount: drawn instances are packed at the front. Otherwise every instance
+// keeps its own command, with instanceCount 0 when not drawn.
+layout(constant_id = 0) const bool COMPACT = true;
+
+struct Instance {
+    vec4 sphere;
+    float scale;
+    uint material;
+    vec2 padding;
+};
+
+struct DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(push_constant) uniform CullConstants {
+    uint instanceCount;
+    // Which half of the commands and which draw count this pass fills: 0 early (or frustum only), 1 late.
+    uint phase;
+    ivec2 depthSize;
+    int pyramidLevels;
+} cull;
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    Instance instances[];
+};
+
+layout(std430, set = 0, binding = 1) writeonly buffer DrawCommands {
+    DrawCommand commands[];
+};
+
+// Zeroed before the first cull pass of the frame.
+layout(std430, set = 0, binding = 2) buffer CullCounters {
+    uint drawCounts[2];
+    // Late pass only.
+    uint inFrustum;
+    uint occluded;
+} counters;
+
+// Per instance: 1 if the late pass found it visible last frame.
+layout(std430, set = 0, binding = 3) buffer Visibility {
+    uint visibility[];
+};
+
+layout(std140, set = 0, binding = 4) uniform CullCamera {
+    mat4 viewProjection;
+    // Normalized, pointing inside: left, right, bottom, top, near, far.
+    vec4 planes[6];
+} camera;
+
+bool isInFrustum(vec4 sphere) {
+    bool visible = true;
+    for (int i = 0; i < 6; ++i) {
+        visible = visible && dot(camera.planes[i].xyz, sphere.xyz) + camera.planes[i].w >= -sphere.w;
+    }
+    return visible;
+}
+
+void emitDraw(uint index, bool draw) {
+    uint base = cull.phase * cull.instanceCount;
+    if (!draw) {
+        if (!COMPACT) {
+            commands[base + index] = DrawCommand(3, 0, 0, 0, index);
+        }
+        return;
+    }
+
+    uint slot = atomicAdd(counters.drawCounts[cull.phase], 1);
+    // firstInstance carries the instance index to the vertex shader as gl_InstanceIndex.
+    commands[base + (COMPACT ? slot : index)] = DrawCommand(3, 1, 0, 0, index);
+}
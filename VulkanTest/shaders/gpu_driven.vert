@@ -0,0 +1,49 @@
+#version 450
+
+// Storage buffer slots of the bindless table (BindlessTable::getCapacity).
+layout(constant_id = 0) const uint STORAGE_BUFFER_COUNT = 1;
+
+struct Instance {
+    vec4 sphere;
+    float scale;
+    uint material;
+    vec2 padding;
+};
+
+// The draw commands' firstInstance is the instance index, so gl_InstanceIndex picks the instance.
+layout(push_constant) uniform DrawConstants {
+    mat4 viewProjection;
+    uint instanceBuffer;
+    uint materialBuffer;
+} draw;
+
+// Binding 2 of the bindless table holds every storage buffer; both blocks alias it.
+layout(std430, set = 0, binding = 2) readonly buffer Instances {
+    Instance instances[];
+} instanceBuffers[STORAGE_BUFFER_COUNT];
+
+layout(std430, set = 0, binding = 2) readonly buffer Materials {
+    float tints[];
+} materials[STORAGE_BUFFER_COUNT];
+
+layout(location = 0) out vec3 fragColor;
+
+const vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+const vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    Instance instance = instanceBuffers[draw.instanceBuffer].instances[gl_InstanceIndex];
+    float tint = materials[draw.materialBuffer].tints[instance.material];
+    vec2 position = positions[gl_VertexIndex] * instance.scale + instance.sphere.xy;
+    gl_Position = draw.viewProjection * vec4(position, instance.sphere.z, 1.0);
+    fragColor = mix(colors[gl_VertexIndex], vec3(1.0), tint);
+}
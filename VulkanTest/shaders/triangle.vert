@@ -0,0 +1,37 @@
+#version 450
+
+// Storage buffer slots of the bindless table (BindlessTable::getCapacity).
+layout(constant_id = 0) const uint STORAGE_BUFFER_COUNT = 1;
+
+// One triangle per draw, placed on a grid by the push constants; there are no vertex buffers yet.
+layout(push_constant) uniform DrawConstants {
+    vec2 offset;
+    float scale;
+    uint materialBuffer;
+    uint material;
+} draw;
+
+// Binding 2 of the bindless table holds every storage buffer; the material buffer is one of them.
+layout(std430, set = 0, binding = 2) readonly buffer Materials {
+    float tints[];
+} materials[STORAGE_BUFFER_COUNT];
+
+layout(location = 0) out vec3 fragColor;
+
+const vec2 positions[3] = vec2[](
+    vec2(0.0, -0.5),
+    vec2(0.5, 0.5),
+    vec2(-0.5, 0.5)
+);
+
+const vec3 colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    float tint = materials[draw.materialBuffer].tints[draw.material];
+    gl_Position = vec4(positions[gl_VertexIndex] * draw.scale + draw.offset, 0.0, 1.0);
+    fragColor = mix(colors[gl_VertexIndex], vec3(1.0), tint);
+}